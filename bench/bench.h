@@ -0,0 +1,126 @@
+#ifndef PYCOREAUDIO_BENCH_H
+#define PYCOREAUDIO_BENCH_H
+
+/*
+ * Helpers shared by the benchmarks.
+ */
+#include "hal_sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct Result {
+    double nsPerCall;
+    double callsPerSec;
+    double halCallsPerCall;
+};
+
+/**
+ * Run [fn] repeatedly for about [seconds] seconds.
+ * HAL calls are counted if [sim] is not NULL.
+ */
+template <typename Fn>
+Result measure(hal::SimBackend* sim, double seconds, Fn fn){
+    typedef std::chrono::steady_clock clock;
+    for(int i = 0; i < 16; i++) fn();  //warm-up
+
+    if(sim) sim->resetCallCount();
+    UInt64 iterations = 0, batch = 1;
+    clock::time_point start = clock::now();
+    double elapsed = 0;
+    while(elapsed < seconds){
+        for(UInt64 i = 0; i < batch; i++) fn();
+        iterations += batch;
+        if(batch < (1 << 16)) batch *= 2;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    Result result;
+    result.nsPerCall = elapsed * 1e9 / iterations;
+    result.callsPerSec = iterations / elapsed;
+    result.halCallsPerCall = sim ? (double)sim->callCount() / iterations : 0;
+    return result;
+}
+
+/**
+ * Get the [p]-th percentile (0-100) of [samples].
+ */
+template <typename T>
+T percentile(std::vector<T> samples, double p){
+    if(samples.empty()) return T();
+    size_t index = (size_t)(p / 100.0 * (samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+template <typename T>
+void parseOption(const char* text, T &value){ value = (T)strtoll(text, NULL, 10); }
+inline void parseOption(const char* text, double &value){ value = atof(text); }
+inline void parseOption(const char* text, std::string &value){ value = text; }
+
+/**
+ * The "--name value" command line options of a benchmark.
+ * Values keep their defaults unless given; integers are parsed in base 10.
+ */
+class Options {
+public:
+    /**
+     * Add an option.
+     * @param name - the option, e.g. "--seconds"
+     * @param metavar - what its value is, e.g. "S", for the usage message
+     * @param value - where the value goes, also holding the default
+     */
+    template <typename T>
+    Options& add(const char* name, const char* metavar, T &value){
+        T* target = &value;
+        Option option = { name, metavar, [target](const char* text){ parseOption(text, *target); } };
+        options.push_back(option);
+        return *this;
+    }
+
+    /**
+     * Parse [argv], printing the usage message on an unknown option or a
+     * missing value.
+     * @result - false if the benchmark should exit with status 2
+     */
+    bool parse(int argc, char** argv) const {
+        for(int i = 1; i < argc; i += 2){
+            const Option* option = find(argv[i]);
+            if(!option || i + 1 == argc){
+                usage(argv[0]);
+                return false;
+            }
+            option->set(argv[i + 1]);
+        }
+        return true;
+    }
+
+private:
+    struct Option {
+        const char* name;
+        const char* metavar;
+        std::function<void(const char*)> set;
+    };
+
+    const Option* find(const char* name) const {
+        for(const Option &option : options){
+            if(strcmp(option.name, name) == 0) return &option;
+        }
+        return NULL;
+    }
+
+    void usage(const char* program) const {
+        fprintf(stderr, "usage: %s", program);
+        for(const Option &option : options) fprintf(stderr, " [%s %s]", option.name, option.metavar);
+        fprintf(stderr, "\n");
+    }
+
+    std::vector<Option> options;
+};
+
+#endif //PYCOREAUDIO_BENCH_H
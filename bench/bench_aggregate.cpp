@@ -0,0 +1,112 @@
+/*
+ * Benchmark of the aggregate device fan-out (fanout.h).
+ *
+ * A simulated multi-output device without controls of its own is built
+ * over 1 to 8 sub-devices, with a per-call HAL latency. For each size
+ * this reports the wall time of setVolumeForDevice() and
+ * getVolumeForDevice() on the aggregate device, which fan out to every
+ * sub-device at once, next to the time of the same call on a single
+ * sub-device and of setting the sub-devices one after the other; the
+ * fan-out should take about as long as one sub-device. The volumes and
+ * mute states must land on every sub-device, and the sub-device list
+ * must follow changes made in the simulated HAL, removed devices
+ * included.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_aggregate [--latency-ns N] [--seconds S]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "hal_sim.h"
+#include <stdio.h>
+#include <string>
+
+/**
+ * Whether every device of [deviceIDs] is at [volume] and [mute].
+ */
+static bool allAt(const std::vector<AudioDeviceID> &deviceIDs, int volume, int mute){
+    for(AudioDeviceID deviceID : deviceIDs){
+        if(getVolumeForDevice(deviceID) != volume || getMuteForDevice(deviceID) != mute) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv){
+    UInt64 latency = 200000;
+    double seconds = 0.2;
+    Options options;
+    options.add("--latency-ns", "N", latency)
+           .add("--seconds", "S", seconds);
+    if(!options.parse(argc, argv)) return 2;
+    bool failed = false;
+
+    printf("simulated HAL latency: %llu ns/call\n\n", (unsigned long long)latency);
+    printf("%11s %14s %14s %14s %14s %8s\n", "sub-devices", "set one us", "set each us", "set fan-out us",
+           "get fan-out us", "speedup");
+    const UInt32 counts[] = { 1, 2, 4, 8 };
+    for(UInt32 count : counts){
+        hal::SimBackend sim;
+        std::vector<AudioDeviceID> subDevices;
+        for(UInt32 i = 0; i < count; i++){
+            hal::SimDeviceSpec spec;
+            spec.name = "Speaker " + std::to_string(i + 1);
+            spec.uid = "speaker-" + std::to_string(i + 1);
+            subDevices.push_back(sim.addDevice(spec));
+        }
+        hal::SimDeviceSpec spec;
+        spec.name = "Multi-Output Device";
+        spec.uid = "multi-output";
+        spec.hasVolume = false;
+        spec.hasMute = false;
+        spec.subDevices = subDevices;
+        AudioDeviceID aggregate = sim.addDevice(spec);
+        sim.setDefaultOutputDevice(aggregate);
+        hal::setBackend(&sim);
+        if(!init()){
+            fprintf(stderr, "could not initialize\n");
+            return 1;
+        }
+
+        //Through the default output device, as setVolume()/setMute() would
+        bool spread = setVolume(30) && setMute(true) && allAt(subDevices, 30, 1)
+                   && getVolume() == 30 && getMute() == 1;
+        spread = spread && setMuteForDevice(aggregate, false) && allAt(subDevices, 30, 0);
+        if(!spread){
+            fprintf(stderr, "%u sub-devices: volume/mute did not reach every sub-device\n", count);
+            failed = true;
+        }
+
+        sim.setLatency(latency);
+        int volume = 0;
+        Result one = measure(NULL, seconds, [&]{ setVolumeForDevice(subDevices[0], volume++ % 100); });
+        Result each = measure(NULL, seconds, [&]{
+            int level = volume++ % 100;
+            for(AudioDeviceID subDevice : subDevices) setVolumeForDevice(subDevice, level);
+        });
+        Result fanned = measure(NULL, seconds, [&]{ setVolumeForDevice(aggregate, volume++ % 100); });
+        Result read = measure(NULL, seconds, [&]{ getVolumeForDevice(aggregate); });
+        printf("%11u %14.1f %14.1f %14.1f %14.1f %7.1fx\n", count, one.nsPerCall / 1000, each.nsPerCall / 1000,
+               fanned.nsPerCall / 1000, read.nsPerCall / 1000, each.nsPerCall / fanned.nsPerCall);
+        sim.setLatency(0);
+
+        //The sub-device list is followed through its listener
+        if(count >= 3){
+            std::vector<AudioDeviceID> first(subDevices.begin(), subDevices.end() - 1);
+            sim.setSubDevices(aggregate, first);
+            sim.flushNotifications();
+            bool followed = setVolumeForDevice(aggregate, 70) && allAt(first, 70, 0)
+                         && getVolumeForDevice(subDevices.back()) != 70;
+            sim.removeDevice(first.back());
+            first.pop_back();
+            sim.flushNotifications();
+            followed = followed && setVolumeForDevice(aggregate, 80) && allAt(first, 80, 0);
+            if(!followed){
+                fprintf(stderr, "%u sub-devices: changes of the sub-device list were not followed\n", count);
+                failed = true;
+            }
+        }
+        deinit();
+        hal::setBackend(NULL);
+    }
+    return failed ? 1 : 0;
+}
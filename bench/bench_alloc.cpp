@@ -0,0 +1,102 @@
+/*
+ * Heap allocations of the volume/mute paths.
+ *
+ * Replaces the global operator new/delete with counting versions and
+ * reports allocations and ns per call of every get/set call built on the
+ * property layer (property.h), with 2 and 64 channels per device. Exits
+ * with status 1 if any of them allocates.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_alloc [--seconds S]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "hal_sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<UInt64> allocations(0);
+
+void* operator new(size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if(p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size){
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+static int failures = 0;
+
+template <typename Fn>
+static void run(UInt32 channels, const char* operation, double seconds, Fn fn){
+    const UInt64 calls = 10000;
+    for(int i = 0; i < 16; i++) fn();   //warm-up
+    UInt64 before = allocations.load();
+    for(UInt64 i = 0; i < calls; i++) fn();
+    double perCall = (double)(allocations.load() - before) / calls;
+
+    Result result = measure(NULL, seconds, fn);
+    printf("%8u  %-20s %12.1f %12.3f\n", channels, operation, result.nsPerCall, perCall);
+    if(perCall > 0) failures++;
+}
+
+int main(int argc, char** argv){
+    double seconds = 0.2;
+    Options options;
+    options.add("--seconds", "S", seconds);
+    if(!options.parse(argc, argv)) return 2;
+
+    printf("%8s  %-20s %12s %12s\n", "channels", "operation", "ns/call", "allocs/call");
+    const UInt32 channelCounts[] = { 2, 64 };
+    for(UInt32 channels : channelCounts){
+        hal::SimBackend sim;
+        sim.populate(1, channels);
+        hal::setBackend(&sim);
+        if(!init()){
+            fprintf(stderr, "init() failed\n");
+            return 1;
+        }
+        AudioDeviceID deviceID = outputState()->deviceID;
+
+        int volume = 0;
+        bool mute = false;
+        run(channels, "getVolume", seconds, []{ getVolume(); });
+        run(channels, "setVolume", seconds, [&]{ setVolume(volume); volume = (volume + 1) % 101; });
+        run(channels, "getMute", seconds, []{ getMute(); });
+        run(channels, "setMute", seconds, [&]{ setMute(mute); mute = !mute; });
+        run(channels, "getVolumeForDevice", seconds, [&]{ getVolumeForDevice(deviceID); });
+        run(channels, "setVolumeForDevice", seconds, [&]{ setVolumeForDevice(deviceID, volume); volume = (volume + 1) % 101; });
+        run(channels, "getMuteForDevice", seconds, [&]{ getMuteForDevice(deviceID); });
+        run(channels, "setMuteForDevice", seconds, [&]{ setMuteForDevice(deviceID, mute); mute = !mute; });
+
+        deinit();
+        hal::setBackend(NULL);
+    }
+
+    if(failures > 0){
+        fprintf(stderr, "%d operations allocate\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+"""
+asyncio benchmark, against the simulated HAL.
+
+Keeps --in-flight awaitable calls (*Async) running on the native worker
+pool while the simulated HAL takes --latency-us per call, plus up to
+--jitter-us of random extra. A ticker coroutine measures how late the
+event loop wakes it up, which shows whether anything blocks the loop.
+The same load is then run through loop.run_in_executor() with the
+synchronous calls for comparison. Wrong results make the script exit
+with status 1.
+
+Build the module first (`python3 setup.py build` on a non-macOS host),
+then run `python3 bench/bench_async.py [--latency-us N] [--in-flight N]`.
+"""
+import argparse
+import asyncio
+import concurrent.futures
+import glob
+import os
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = glob.glob(os.path.join(ROOT, "build", "lib*"))
+import CoreAudio
+
+if not hasattr(CoreAudio, "_simPopulate"):
+    sys.exit("CoreAudio was not built against the simulated HAL")
+
+TICK = 0.001
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * fraction))]
+
+
+async def ticker(stop, lags):
+    while not stop.is_set():
+        expected = time.perf_counter() + TICK
+        await asyncio.sleep(TICK)
+        lags.append(time.perf_counter() - expected)
+
+
+async def load(call, ids, seconds, in_flight, failures):
+    latencies = []
+    deadline = time.perf_counter() + seconds
+
+    async def client(index):
+        device = ids[index % len(ids)]
+        count = 0
+        while time.perf_counter() < deadline:
+            volume = 10 + (count % 80)
+            start = time.perf_counter()
+            if count % 2:
+                if not await call("setVolumeForDevice", device, volume):
+                    failures.append("setVolumeForDevice(%d, %d) failed" % (device, volume))
+            elif not 0 <= await call("getVolumeForDevice", device) <= 100:
+                failures.append("getVolumeForDevice(%d) out of range" % device)
+            latencies.append(time.perf_counter() - start)
+            count += 1
+
+    stop = asyncio.Event()
+    lags = []
+    tick = asyncio.ensure_future(ticker(stop, lags))
+    start = time.perf_counter()
+    await asyncio.gather(*[client(i) for i in range(in_flight)])
+    elapsed = time.perf_counter() - start
+    stop.set()
+    await tick
+    return len(latencies) / elapsed, latencies, lags
+
+
+def native(name, *args):
+    return getattr(CoreAudio, name + "Async")(*args)
+
+
+def executor(pool):
+    loop = asyncio.get_running_loop()
+
+    def call(name, *args):
+        return loop.run_in_executor(pool, getattr(CoreAudio, name), *args)
+    return call
+
+
+def report(label, throughput, latencies, lags):
+    print("%-16s %10.0f %9.1f %9.1f %9.1f %11.2f" % (
+        label, throughput,
+        percentile(latencies, 0.5) * 1e6, percentile(latencies, 0.99) * 1e6,
+        percentile(latencies, 0.999) * 1e6, max(lags) * 1e3))
+
+
+async def main(options):
+    ids = [device[7] for device in await CoreAudio.getDevicesAsync()]
+    failures = []
+    print("HAL latency %.1f us + up to %.1f us jitter, %d devices, %d in flight, %d threads" % (
+        options.latency_us, options.jitter_us, len(ids), options.in_flight, options.threads))
+    print("%-16s %10s %9s %9s %9s %11s" % ("", "calls/s", "p50 us", "p99 us", "p99.9 us", "max lag ms"))
+
+    report("native", *await load(native, ids, options.seconds, options.in_flight, failures))
+    with concurrent.futures.ThreadPoolExecutor(options.threads) as pool:
+        report("run_in_executor", *await load(executor(pool), ids, options.seconds, options.in_flight, failures))
+
+    if CoreAudio.asyncInFlight():
+        failures.append("%d calls still in flight" % CoreAudio.asyncInFlight())
+    return failures
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--latency-us", type=float, default=50.0)
+    parser.add_argument("--jitter-us", type=float, default=50.0)
+    parser.add_argument("--seconds", type=float, default=1.0)
+    parser.add_argument("--devices", type=int, default=8)
+    parser.add_argument("--in-flight", type=int, default=256)
+    parser.add_argument("--threads", type=int, default=4)
+    options = parser.parse_args()
+
+    CoreAudio._simPopulate(options.devices)
+    CoreAudio._simSetLatency(int(options.latency_us * 1000), int(options.jitter_us * 1000))
+    if not CoreAudio.init():
+        sys.exit("init() failed")
+    CoreAudio.setAsyncLimits(options.threads, 256)
+    failed = asyncio.run(main(options))
+
+    CoreAudio.deinit()
+    CoreAudio._simSetLatency(0)
+    if failed:
+        print("%d failures, first: %s" % (len(failed), failed[0]))
+        sys.exit(1)
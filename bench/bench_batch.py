@@ -0,0 +1,76 @@
+"""
+Batch calls vs. per-device calls, against the simulated HAL.
+
+Compares setting/getting the volume of N devices through a Python loop
+over setVolumeForDevice/getVolumeForDevice with a single setVolumes/
+getVolumes call taking a list of tuples or a packed array('I'), and
+reports the HAL calls every device takes. Both make the same HAL calls,
+which a batch cannot save: it only saves the per-call overhead around
+them.
+
+Build the module first (`python3 setup.py build` on a non-macOS host),
+then run `python3 bench/bench_batch.py`.
+"""
+import array
+import glob
+import os
+import sys
+import timeit
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = glob.glob(os.path.join(ROOT, "build", "lib*"))
+import CoreAudio
+
+if not hasattr(CoreAudio, "_simPopulate"):
+    sys.exit("CoreAudio was not built against the simulated HAL")
+
+
+def per_device(fn, repeat=5):
+    """Best ns per device of fn(), which handles all devices once."""
+    number, _ = timeit.Timer(fn).autorange()
+    return min(timeit.repeat(fn, number=number, repeat=repeat)) / number
+
+
+def hal_calls(fn):
+    """HAL calls fn() makes."""
+    CoreAudio.resetStats()
+    fn()
+    return sum(entry["calls"] for selectors in CoreAudio.stats()["hal"].values() for entry in selectors.values())
+
+
+def main():
+    print("%7s  %-28s %12s %9s %10s" % ("devices", "operation", "ns/device", "speedup", "hal/device"))
+    for count in (1, 12, 64):
+        CoreAudio._simPopulate(count)
+        CoreAudio.init()
+        ids = [device[7] for device in CoreAudio.getDevices()]
+        pairs = [(device, 40) for device in ids]
+        packed = array.array("I", [value for pair in pairs for value in pair])
+        packed_ids = array.array("I", ids)
+
+        def set_loop():
+            for device, volume in pairs:
+                CoreAudio.setVolumeForDevice(device, volume)
+
+        def get_loop():
+            for device in ids:
+                CoreAudio.getVolumeForDevice(device)
+
+        rows = [
+            ("setVolumeForDevice loop", set_loop, None),
+            ("setVolumes(list)", lambda: CoreAudio.setVolumes(pairs), "setVolumeForDevice loop"),
+            ("setVolumes(array)", lambda: CoreAudio.setVolumes(packed), "setVolumeForDevice loop"),
+            ("getVolumeForDevice loop", get_loop, None),
+            ("getVolumes(list)", lambda: CoreAudio.getVolumes(ids), "getVolumeForDevice loop"),
+            ("getVolumes(array)", lambda: CoreAudio.getVolumes(packed_ids), "getVolumeForDevice loop"),
+        ]
+        results = {}
+        for name, fn, baseline in rows:
+            results[name] = per_device(fn) / count * 1e9
+            speedup = "%8.1fx" % (results[baseline] / results[name]) if baseline else ""
+            print("%7d  %-28s %12.1f %9s %10.1f" % (count, name, results[name], speedup, hal_calls(fn) / count))
+        CoreAudio.deinit()
+
+
+if __name__ == "__main__":
+    main()
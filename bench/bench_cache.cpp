@@ -0,0 +1,283 @@
+/*
+ * Benchmark of the persistent device cache (devcache.h).
+ *
+ * Starts the library over and over against a slow simulated HAL with a
+ * few multi-channel devices and an aggregate device of two of them, and
+ * reports the time and HAL calls from
+ * init() to the first setVolume() and to the first registry snapshot,
+ * then how long the background validation takes:
+ *
+ *   cold        no cache file, everything is queried and the file is written
+ *   warm        served from the file, which must be left alone
+ *   changed     a device renamed, one with other channels, one gone, and the
+ *               default device and a sub-device of the aggregate device
+ *               re-plugged under new IDs; before validation, setting the
+ *               volume of the aggregate device must reach the sub-devices
+ *               it has now; after validation the registry and the channel maps must
+ *               match the HAL again and the file must be rewritten
+ *   corrupt     a damaged file must be ignored like a missing one
+ *
+ * The first registry snapshot may only hold IDs the HAL reports, even
+ * before the validation. After every validation, the registry snapshot
+ * must equal what the HAL reports and the channel map of every output
+ * device what it builds.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_cache [--devices N] [--channels N] [--latency-ns N] [--path PATH]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "channels.h"
+#include "devcache.h"
+#include "hal_sim.h"
+#include "registry.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Simulated HAL that also counts the calls of each thread, to tell the
+ * calls a start waits for from those of the background validation.
+ */
+class CountingSim : public hal::SimBackend {
+public:
+    static thread_local UInt64 calls;
+
+    Boolean hasProperty(AudioObjectID objectID, const AudioObjectPropertyAddress* address) override {
+        calls++;
+        return SimBackend::hasProperty(objectID, address);
+    }
+    OSStatus getPropertyDataSize(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                 UInt32 qualifierDataSize, const void* qualifierData, UInt32* outDataSize) override {
+        calls++;
+        return SimBackend::getPropertyDataSize(objectID, address, qualifierDataSize, qualifierData, outDataSize);
+    }
+    OSStatus getPropertyData(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                             UInt32 qualifierDataSize, const void* qualifierData,
+                             UInt32* ioDataSize, void* outData) override {
+        calls++;
+        return SimBackend::getPropertyData(objectID, address, qualifierDataSize, qualifierData, ioDataSize, outData);
+    }
+    OSStatus setPropertyData(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                             UInt32 qualifierDataSize, const void* qualifierData,
+                             UInt32 dataSize, const void* data) override {
+        calls++;
+        return SimBackend::setPropertyData(objectID, address, qualifierDataSize, qualifierData, dataSize, data);
+    }
+    OSStatus addPropertyListener(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                 AudioObjectPropertyListenerProc listener, void* clientData) override {
+        calls++;
+        return SimBackend::addPropertyListener(objectID, address, listener, clientData);
+    }
+};
+
+thread_local UInt64 CountingSim::calls = 0;
+
+struct Step {
+    double us;
+    UInt64 calls;               //made by the starting thread
+};
+
+struct Startup {
+    Step init;
+    Step firstVolume;           //the first setVolume() after init()
+    Step firstList;             //then the first registry snapshot
+    double validatedMs;         //from init() until the validation is done
+    bool volumeSet;
+    bool currentIDs;            //the first snapshot only held devices present now
+    bool aggregateSet;          //the aggregate volume reached its current sub-devices
+};
+
+/**
+ * Run [fn] and take its time and HAL calls.
+ */
+template <typename Fn>
+static Step step(Fn fn){
+    UInt64 calls = CountingSim::calls;
+    Clock::time_point begin = Clock::now();
+    fn();
+    Step result;
+    result.us = std::chrono::duration<double, std::micro>(Clock::now() - begin).count();
+    result.calls = CountingSim::calls - calls;
+    return result;
+}
+
+/**
+ * init(), setVolume(), a registry snapshot and the wait for the validation.
+ */
+static Startup start(int volume, AudioDeviceID aggregate, const std::vector<AudioDeviceID> &subDevices){
+    Startup result;
+    bool ok = true;
+    Clock::time_point begin = Clock::now();
+    result.init = step([&]{ ok = init(); });
+    result.firstVolume = step([&]{ ok = ok && setVolume(volume); });
+    //Served from the seeded map, unless the validation was quicker
+    result.aggregateSet = setVolumeForDevice(aggregate, volume);
+    for(AudioDeviceID subDevice : subDevices){
+        result.aggregateSet = result.aggregateSet && getVolumeForDevice(subDevice) == volume;
+    }
+    DeviceSnapshot devices;
+    result.firstList = step([&]{ devices = deviceRegistry.snapshot(); });
+    std::vector<AudioDeviceID> present;
+    result.currentIDs = devices && getDeviceIDs(present);
+    for(size_t i = 0; result.currentIDs && i < devices->size(); i++){
+        result.currentIDs = std::find(present.begin(), present.end(), (*devices)[i].id) != present.end();
+    }
+    ok = ok && devices && deviceCache.wait(10000);
+    result.validatedMs = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    result.volumeSet = ok && getVolume() == volume;
+    return result;
+}
+
+static bool same(const ChannelMap &a, const ChannelMap &b){
+    return a.volume == b.volume && a.mute == b.mute && a.outputChannels == b.outputChannels
+        && a.stereo[0] == b.stereo[0] && a.stereo[1] == b.stereo[1] && a.subDevices == b.subDevices;
+}
+
+/**
+ * Whether the registry and the channel maps match what the HAL reports.
+ */
+static bool consistent(){
+    std::vector<DeviceInfo> actual;
+    DeviceSnapshot cached = deviceRegistry.snapshot();
+    if(!getDevices(actual) || !cached || cached->size() != actual.size()) return false;
+    for(size_t i = 0; i < actual.size(); i++){
+        const DeviceInfo &a = actual[i], &b = (*cached)[i];
+        if(a.id != b.id || a.name != b.name || a.manufacturer != b.manufacturer || a.uid != b.uid
+           || a.inStreams != b.inStreams || a.outStreams != b.outStreams) return false;
+        ChannelMap built;
+        if(a.outStreams > 0 && (!ChannelMapCache::build(a.id, built) || !same(built, *channelMaps.lookup(a.id)))){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Identity of the cache file, which a rewrite changes as it renames a new file over it.
+ */
+static ino_t inode(const std::string &path){
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? info.st_ino : 0;
+}
+
+int main(int argc, char** argv){
+    int deviceCount = 8;
+    UInt32 channels = 32;
+    UInt64 latency = 20000;
+    std::string path = "bench_cache.bin";
+    Options options;
+    options.add("--devices", "N", deviceCount)
+           .add("--channels", "N", channels)
+           .add("--latency-ns", "N", latency)
+           .add("--path", "PATH", path);
+    if(!options.parse(argc, argv)) return 2;
+    if(deviceCount < 5){
+        fprintf(stderr, "--devices must be at least 5\n");
+        return 2;
+    }
+    bool failed = false;
+
+    CountingSim sim;
+    std::vector<hal::SimDeviceSpec> specs;
+    std::vector<AudioDeviceID> devices;
+    for(int i = 0; i < deviceCount; i++){
+        hal::SimDeviceSpec spec;
+        spec.name = "Interface " + std::to_string(i + 1);
+        spec.manufacturer = "Simulated";
+        spec.uid = "interface-" + std::to_string(i + 1);
+        spec.inStreams = i % 2;
+        spec.outChannels = i % 2 ? 2 : channels;
+        specs.push_back(spec);
+        devices.push_back(sim.addDevice(spec));
+    }
+    //Without controls of its own, its volume is set on the sub-devices
+    hal::SimDeviceSpec aggregateSpec;
+    aggregateSpec.name = "Aggregate";
+    aggregateSpec.manufacturer = "Simulated";
+    aggregateSpec.uid = "aggregate";
+    aggregateSpec.hasMasterElement = false;
+    aggregateSpec.hasVolume = false;
+    aggregateSpec.hasMute = false;
+    aggregateSpec.subDevices = { devices[1], devices[4] };
+    AudioDeviceID aggregate = sim.addDevice(aggregateSpec);
+    sim.setDefaultOutputDevice(devices[0]);
+    sim.setLatency(latency);
+    hal::setBackend(&sim);
+    unlink(path.c_str());
+    deviceCache.setPath(path);
+
+    printf("%d devices, %u channels, %llu ns per HAL call\n\n", deviceCount, channels, (unsigned long long)latency);
+    printf("%-10s %10s %6s %12s %6s %12s %6s %10s %7s %8s\n", "start", "init us", "calls", "1st set us", "calls",
+           "1st list us", "calls", "valid. ms", "state", "file");
+
+    const char* scenarios[] = { "cold", "warm", "changed", "warm", "corrupt" };
+    Step cold = { 0, 0 };
+    for(int run = 0; run < 5; run++){
+        std::string scenario = scenarios[run];
+        ino_t before = inode(path);
+        if(scenario == "changed"){
+            sim.setDeviceName(devices[1], "Renamed Interface");
+            sim.setChannelCount(devices[2], channels / 2);
+            sim.removeDevice(devices[3]);
+            //Re-plugged, the default device keeps its UID but not its ID
+            sim.removeDevice(devices[0]);
+            devices[0] = sim.addDevice(specs[0]);
+            sim.setDefaultOutputDevice(devices[0]);
+            //The aggregate device gets its sub-device back under the new ID
+            sim.removeDevice(devices[4]);
+            devices[4] = sim.addDevice(specs[4]);
+            sim.setSubDevices(aggregate, { devices[1], devices[4] });
+            sim.flushNotifications();
+        }
+        else if(scenario == "corrupt"){
+            FILE* file = fopen(path.c_str(), "r+b");
+            if(file){
+                fseek(file, 40, SEEK_SET);
+                fputs("\xff\xff\xff\xff\xff\xff\xff\xff", file);
+                fclose(file);
+            }
+        }
+
+        Startup result = start(10 + run, aggregate, { devices[1], devices[4] });
+        bool matches = consistent();
+        ino_t after = inode(path);
+        bool rewritten = after != 0 && after != before;
+        CachedDevice entry;
+        bool readable = deviceCache.find(specs[0].uid, entry) && entry.info.id == devices[0] && entry.hasMap
+                     && entry.map.outputChannels == channels;
+        //Only the warm runs may leave the file as it was
+        bool fileOk = readable && (scenario == "warm" ? !rewritten : rewritten);
+        printf("%-10s %10.1f %6llu %12.1f %6llu %12.1f %6llu %10.2f %7s %8s\n", scenario.c_str(),
+               result.init.us, (unsigned long long)result.init.calls,
+               result.firstVolume.us, (unsigned long long)result.firstVolume.calls,
+               result.firstList.us, (unsigned long long)result.firstList.calls, result.validatedMs,
+               result.volumeSet && matches && result.currentIDs && result.aggregateSet ? "ok" : "STALE", fileOk ? (rewritten ? "written" : "kept") : "BROKEN");
+        if(!result.volumeSet || !matches || !result.currentIDs || !result.aggregateSet || !fileOk) failed = true;
+
+        //A damaged file costs a cold start, an intact one must save most of it
+        if(scenario == "cold") cold = result.init;
+        else if(scenario == "corrupt"){
+            if(result.init.calls < cold.calls){
+                fprintf(stderr, "the corrupt file was used\n");
+                failed = true;
+            }
+        }
+        else if(result.init.calls * 4 > cold.calls || result.firstList.calls > 0){
+            fprintf(stderr, "the %s start queried the HAL like a cold one\n", scenario.c_str());
+            failed = true;
+        }
+        deinit();
+    }
+
+    deviceCache.setPath("");
+    unlink(path.c_str());
+    hal::setBackend(NULL);
+    return failed ? 1 : 0;
+}
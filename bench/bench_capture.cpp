@@ -0,0 +1,214 @@
+/*
+ * Benchmark of the capture path (capture.h).
+ *
+ * A synthetic producer thread stands in for the IOProc and feeds a
+ * Capture numbered frames, while the reader borrows and releases regions
+ * the way readCapture() does. Reports the cost of an IO cycle on the
+ * producer side and of a read, the throughput of the ring across
+ * threads, and the overruns of rings of several capacities behind a
+ * realtime producer and a reader that stalls now and then. Every frame
+ * read is checked: the channels must be interleaved right and every gap
+ * in the numbering must be accounted for as dropped frames.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_capture [--frames N] [--seconds S] [--stall-ms MS]`.
+ */
+#include "bench.h"
+#include "capture.h"
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+
+static const UInt32 STREAMS = 2;            //stereo input streams of the synthetic device
+static const UInt32 CHANNELS = STREAMS * 2;
+static const UInt32 STAMP_MASK = 0xFFFFF;   //stamp * 16 + channel stays exact in a float
+
+/**
+ * Input of one IO cycle: every sample holds the number of its frame and
+ * its channel in the device, so the reader can check both.
+ */
+struct SyntheticInput {
+    std::vector<Float32> samples[STREAMS];
+    std::vector<char> storage;
+    AudioBufferList* list;
+    UInt32 frames;
+    UInt64 next;                            //number of the next frame
+
+    explicit SyntheticInput(UInt32 frames) : storage(sizeof(AudioBufferList) + STREAMS * sizeof(AudioBuffer)),
+                                             frames(frames), next(0) {
+        list = (AudioBufferList*)storage.data();
+        list->mNumberBuffers = STREAMS;
+        for(UInt32 i = 0; i < STREAMS; i++){
+            samples[i].resize((size_t)frames * 2);
+            list->mBuffers[i].mNumberChannels = 2;
+            list->mBuffers[i].mDataByteSize = (UInt32)(samples[i].size() * sizeof(Float32));
+            list->mBuffers[i].mData = samples[i].data();
+        }
+    }
+
+    void fill(){
+        for(UInt32 frame = 0; frame < frames; frame++){
+            Float32 stamp = (Float32)((next + frame) & STAMP_MASK) * 16;
+            for(UInt32 i = 0; i < STREAMS; i++){
+                samples[i][frame * 2] = stamp + i * 2;
+                samples[i][frame * 2 + 1] = stamp + i * 2 + 1;
+            }
+        }
+        next += frames;
+    }
+};
+
+/**
+ * Checks the frames a reader gets against the numbering.
+ */
+struct Checker {
+    UInt64 expected;                        //number of the next frame, masked
+    UInt64 frames;
+    UInt64 gaps;                            //frames missing in between
+    bool corrupt;
+
+    Checker() : expected(0), frames(0), gaps(0), corrupt(false) {}
+
+    void check(const Float32* samples, size_t count){
+        for(size_t frame = 0; frame < count; frame++){
+            const Float32* values = samples + frame * CHANNELS;
+            UInt64 stamp = (UInt64)values[0] / 16;
+            for(UInt32 channel = 0; channel < CHANNELS; channel++){
+                if(values[channel] != (Float32)(stamp * 16 + channel)) corrupt = true;
+            }
+            gaps += (stamp - expected) & STAMP_MASK;
+            expected = (stamp + 1) & STAMP_MASK;
+        }
+        frames += count;
+    }
+
+    //Frames dropped at the very end leave no gap behind them
+    void finish(UInt64 produced){
+        gaps += (produced - expected) & STAMP_MASK;
+    }
+};
+
+static size_t drain(Capture &capture, Checker &checker){
+    size_t total = 0, frames;
+    for(;;){
+        const Float32* samples = capture.acquire(0, &frames);
+        if(frames == 0) return total;
+        checker.check(samples, frames);
+        capture.release();
+        total += frames;
+    }
+}
+
+int main(int argc, char** argv){
+    UInt32 frames = 512;
+    double seconds = 1.0;
+    int stallMs = 30;
+    Options options;
+    options.add("--frames", "N", frames)
+           .add("--seconds", "S", seconds)
+           .add("--stall-ms", "MS", stallMs);
+    if(!options.parse(argc, argv)) return 2;
+    bool failed = false;
+    size_t cycleBytes = (size_t)frames * CHANNELS * sizeof(Float32);
+    printf("%u frames per IO cycle, %u channels in %u streams\n\n", frames, CHANNELS, STREAMS);
+
+    //One thread: an IO cycle, then a read of it
+    {
+        Capture capture(CHANNELS, 4 * frames);
+        SyntheticInput input(frames);
+        input.fill();
+        Result write = measure(NULL, seconds / 4, [&]{
+            capture.process(input.list, NULL, frames, 0);
+            size_t taken;
+            capture.acquire(0, &taken);
+            capture.release();
+        });
+        Result read = measure(NULL, seconds / 4, [&]{
+            size_t taken;
+            capture.acquire(0, &taken);
+            capture.release();
+        });
+        printf("IO cycle + read, one thread: %10.1f ns/cycle %8.2f GB/s\n", write.nsPerCall, cycleBytes / write.nsPerCall);
+        printf("empty read:                  %10.1f ns\n\n", read.nsPerCall);
+    }
+
+    //Across threads, the producer waiting for room: what the ring can move
+    {
+        Capture capture(CHANNELS, 16 * frames);
+        SyntheticInput input(frames);
+        std::atomic<bool> stopping(false);
+        std::thread producer([&]{
+            while(!stopping.load(std::memory_order_relaxed)){
+                while(capture.stats().capacity - capture.stats().queued < frames){
+                    if(stopping.load(std::memory_order_relaxed)) return;
+                    std::this_thread::yield();
+                }
+                input.fill();
+                capture.process(input.list, NULL, frames, 0);
+            }
+        });
+        Checker checker;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double elapsed = 0;
+        while(elapsed < seconds){
+            if(drain(capture, checker) == 0) std::this_thread::yield();
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        stopping.store(true);
+        producer.join();
+        drain(capture, checker);
+        checker.finish(input.next);
+        CaptureStats stats = capture.stats();
+        printf("across threads, lossless:    %10.1f Mframes/s %6.2f GB/s, %llu dropped\n\n",
+               checker.frames / elapsed / 1e6, checker.frames * CHANNELS * sizeof(Float32) / elapsed / 1e9,
+               (unsigned long long)stats.dropped);
+        if(checker.corrupt || checker.gaps != stats.dropped || stats.dropped != 0){
+            fprintf(stderr, "lossless transfer lost or corrupted frames\n");
+            failed = true;
+        }
+    }
+
+    //Realtime producer at 48 kHz, reader stalling for [stallMs] every 100 ms
+    printf("%10s %10s %10s %10s %10s\n", "capacity", "frames", "read", "overruns", "dropped");
+    const size_t capacities[] = { 1024, 4096, 16384, 65536 };
+    for(size_t capacity : capacities){
+        Capture capture(CHANNELS, capacity);
+        SyntheticInput input(frames);
+        std::atomic<bool> stopping(false);
+        std::thread producer([&]{
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+            std::chrono::nanoseconds period((UInt64)frames * 1000000000ull / 48000);
+            while(!stopping.load(std::memory_order_relaxed)){
+                input.fill();
+                capture.process(input.list, NULL, frames, 0);
+                deadline += period;
+                std::this_thread::sleep_until(deadline);
+            }
+        });
+        Checker checker;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point stall = start;
+        while(std::chrono::steady_clock::now() - start < std::chrono::duration<double>(seconds)){
+            drain(capture, checker);
+            if(std::chrono::steady_clock::now() - stall > std::chrono::milliseconds(100)){
+                std::this_thread::sleep_for(std::chrono::milliseconds(stallMs));
+                stall = std::chrono::steady_clock::now();
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        stopping.store(true);
+        producer.join();
+        drain(capture, checker);
+        checker.finish(input.next);
+        CaptureStats stats = capture.stats();
+        printf("%10llu %10llu %10llu %10llu %10llu\n", (unsigned long long)stats.capacity,
+               (unsigned long long)input.next, (unsigned long long)checker.frames,
+               (unsigned long long)stats.overruns, (unsigned long long)stats.dropped);
+        if(checker.corrupt || checker.gaps != stats.dropped || checker.frames + stats.dropped != input.next){
+            fprintf(stderr, "capacity %zu: frames corrupted or lost without being counted\n", capacity);
+            failed = true;
+        }
+    }
+    return failed ? 1 : 0;
+}
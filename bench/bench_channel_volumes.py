@@ -0,0 +1,137 @@
+"""
+Per-channel volume calls, against the simulated HAL.
+
+Checks that getChannelVolumes/setChannelVolumes move the volume of every
+channel unchanged:
+
+    scalars     random Float32 scalars set on every channel of every device
+                read back bit for bit, through one call for all devices and
+                through one call per device
+    decibels    random dB values read back within 0.001 dB, and the dB and
+                scalar views of a channel agree
+    balance     a left/right imbalance survives, while getVolume() averages it
+    objects     a call allocates the result array and its storage, whatever
+                the channel count, where a list of floats takes one per channel
+
+then reports ns per channel of both calls, in scalars and in dB, for a
+new array('f') and for a reused out= buffer, with all devices in one call.
+
+Build the module first (`python3 setup.py build` on a non-macOS host),
+then run `python3 bench/bench_channel_volumes.py`.
+"""
+import array
+import glob
+import math
+import os
+import random
+import sys
+import timeit
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = glob.glob(os.path.join(ROOT, "build", "lib*"))
+import CoreAudio
+
+if not hasattr(CoreAudio, "_simPopulate"):
+    sys.exit("CoreAudio was not built against the simulated HAL")
+
+#The simulated HAL's curve, see SimDeviceSpec
+MIN_DECIBELS = -96.0
+
+
+def per_call(fn, repeat=5):
+    """Best seconds per call of fn()."""
+    number, _ = timeit.Timer(fn).autorange()
+    return min(timeit.repeat(fn, number=number, repeat=repeat)) / number
+
+
+def check_scalars(ids, total, rng):
+    values = array.array("f", [rng.random() for _ in range(total)])
+    ok = CoreAudio.setChannelVolumes(ids, values) == b"\x01" * len(ids)
+    ok = ok and CoreAudio.getChannelVolumes(ids).tobytes() == values.tobytes()
+    #The same through one call per device
+    values = array.array("f", [rng.random() for _ in range(total)])
+    offset = 0
+    for device in ids:
+        count = len(CoreAudio.getVolumeChannels(device))
+        part = values[offset:offset + count]
+        ok = ok and CoreAudio.setChannelVolumes(device, part)
+        ok = ok and CoreAudio.getChannelVolumes(device).tobytes() == part.tobytes()
+        offset += count
+    return ok and offset == total
+
+
+def check_decibels(ids, total, rng):
+    values = array.array("f", [rng.uniform(-90.0, 0.0) for _ in range(total)])
+    ok = CoreAudio.setChannelVolumes(ids, values, True) == b"\x01" * len(ids)
+    decibels = CoreAudio.getChannelVolumes(ids, True)
+    scalars = CoreAudio.getChannelVolumes(ids)
+    ok = ok and max(abs(a - b) for a, b in zip(values, decibels)) < 1e-3
+    return ok and all(abs(max(MIN_DECIBELS, 20 * math.log10(s)) - d) < 1e-3 if s > 0 else d == MIN_DECIBELS
+                      for s, d in zip(scalars, decibels))
+
+
+def check_balance(device):
+    channels = CoreAudio.getVolumeChannels(device)
+    values = array.array("f", [0.5] * len(channels))
+    values[channels.index(1)], values[channels.index(2)] = 1.0, 0.25
+    ok = CoreAudio.setChannelVolumes(device, values)
+    ok = ok and CoreAudio.getChannelVolumes(device) == values
+    #getVolumeForDevice() only sees the average
+    return ok and CoreAudio.getVolumeForDevice(device) == round(100 * sum(values) / len(values))
+
+
+def objects_per_call(fn, calls=200):
+    """Allocated blocks that stay alive per call of fn(), keeping its results."""
+    results = [None] * calls
+    fn()
+    before = sys.getallocatedblocks()
+    for i in range(calls):
+        results[i] = fn()
+    return (sys.getallocatedblocks() - before) / calls
+
+
+def main():
+    failures = []
+    rng = random.Random(25)
+    print("%7s %8s  %-30s %12s %12s" % ("devices", "channels", "operation", "ns/call", "ns/channel"))
+    for devices, channels in ((1, 2), (16, 8), (16, 64)):
+        CoreAudio._simPopulate(devices, channels)
+        CoreAudio.init()
+        ids = array.array("I", CoreAudio.listDeviceIDs())
+        total = sum(len(CoreAudio.getVolumeChannels(device)) for device in ids)
+
+        objects = objects_per_call(lambda: CoreAudio.getChannelVolumes(ids))
+        checks = [
+            ("scalars", check_scalars(ids, total, rng)),
+            ("decibels", check_decibels(ids, total, rng)),
+            ("balance", check_balance(ids[0])),
+            ("objects", objects < 3),
+        ]
+        for name, ok in checks:
+            if not ok:
+                failures.append("%s with %d x %d" % (name, devices, channels))
+
+        values = CoreAudio.getChannelVolumes(ids)
+        decibels = CoreAudio.getChannelVolumes(ids, True)
+        out = array.array("f", values)
+        rows = [
+            ("getChannelVolumes", lambda: CoreAudio.getChannelVolumes(ids)),
+            ("getChannelVolumes(out=)", lambda: CoreAudio.getChannelVolumes(ids, False, out)),
+            ("getChannelVolumes(dB)", lambda: CoreAudio.getChannelVolumes(ids, True)),
+            ("setChannelVolumes", lambda: CoreAudio.setChannelVolumes(ids, values)),
+            ("setChannelVolumes(dB)", lambda: CoreAudio.setChannelVolumes(ids, decibels, True)),
+        ]
+        for name, fn in rows:
+            seconds = per_call(fn)
+            print("%7d %8d  %-30s %12.0f %12.1f" % (devices, total, name, seconds * 1e9, seconds * 1e9 / total))
+        print("%7d %8d  %-30s %12.1f %12.1f" % (devices, total, "blocks kept: array, list", objects,
+                                               objects_per_call(lambda: CoreAudio.getChannelVolumes(ids).tolist())))
+        CoreAudio.deinit()
+
+    print("\nchecks: %s" % ("ok" if not failures else "FAILED " + ", ".join(failures)))
+    if failures:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
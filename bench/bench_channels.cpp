@@ -0,0 +1,61 @@
+/*
+ * Benchmark of the channel map cache (channels.h).
+ *
+ * For devices with 2 to 64 output channels, reports the cost of
+ * building a channel map, of a cached lookup, of probing the channels
+ * with getValidChannels() as the module used to, and of the per-device
+ * volume calls that write or read every mapped element.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_channels [--latency-ns N] [--seconds S]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "channels.h"
+#include "hal_sim.h"
+#include <stdio.h>
+
+static void report(UInt32 channels, const char* operation, const Result &result){
+    printf("%8u  %-20s %12.1f %14.0f %10.1f\n",
+           channels, operation, result.nsPerCall, result.callsPerSec, result.halCallsPerCall);
+}
+
+int main(int argc, char** argv){
+    UInt64 latency = 0;
+    double seconds = 0.2;
+    Options options;
+    options.add("--latency-ns", "N", latency)
+           .add("--seconds", "S", seconds);
+    if(!options.parse(argc, argv)) return 2;
+
+    printf("simulated HAL latency: %llu ns/call\n\n", (unsigned long long)latency);
+    printf("%8s  %-20s %12s %14s %10s\n", "channels", "operation", "ns/call", "calls/sec", "HAL/call");
+
+    const UInt32 channelCounts[] = { 2, 8, 16, 32, 64 };
+    for(UInt32 channels : channelCounts){
+        hal::SimBackend sim;
+        sim.populate(1, channels);
+        sim.setLatency(latency);
+        hal::setBackend(&sim);
+        if(!init()){
+            fprintf(stderr, "init() failed\n");
+            return 1;
+        }
+        AudioDeviceID deviceID = outputState()->deviceID;
+        if(channelMaps.lookup(deviceID)->volume.size() != channels + 1){
+            fprintf(stderr, "channel map of a %u channel device is wrong\n", channels);
+            return 1;
+        }
+
+        int volume = 0;
+        report(channels, "probe channels", measure(&sim, seconds, [&]{ getValidChannels(&deviceID); }));
+        report(channels, "build map", measure(&sim, seconds, [&]{ ChannelMap map; ChannelMapCache::build(deviceID, map); }));
+        report(channels, "cached lookup", measure(&sim, seconds, [&]{ channelMaps.lookup(deviceID); }));
+        report(channels, "setVolumeForDevice", measure(&sim, seconds, [&]{ setVolumeForDevice(deviceID, volume); volume = (volume + 1) % 101; }));
+        report(channels, "getVolumeForDevice", measure(&sim, seconds, [&]{ getVolumeForDevice(deviceID); }));
+
+        deinit();
+        hal::setBackend(NULL);
+    }
+    return 0;
+}
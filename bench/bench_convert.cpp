@@ -0,0 +1,173 @@
+/*
+ * Benchmark of the sample conversion kernels (convert.h).
+ *
+ * For every conversion between the integer formats and Float32, and for
+ * interleaving and deinterleaving 2 to 8 channels, reports the GB/s
+ * (bytes read plus bytes written) of the scalar kernel and of every
+ * vector kernel the CPU supports. Before timing, every vector kernel
+ * must give exactly the bytes of the scalar one, for every length up to
+ * a few vectors (so all the tails run) and for inputs full of edge cases:
+ * full scale, beyond it, rounding ties, NaN and infinities.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_convert [--samples N] [--seconds S]`.
+ */
+#include "bench.h"
+#include "convert.h"
+#include "simd.h"
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const simd::Level LEVELS[] = { simd::LEVEL_SCALAR, simd::LEVEL_SSE2, simd::LEVEL_AVX2, simd::LEVEL_NEON };
+static const char* FORMAT_NAMES[] = { "int16", "int24", "int32", "float32" };
+
+/**
+ * Float samples of a signal slightly beyond full scale, mixed with the
+ * values conversions get wrong most easily if [edgeCases]. Timing uses
+ * the plain signal, denormals and NaN are slow on some CPUs.
+ */
+static std::vector<Float32> floatInput(size_t samples, std::mt19937 &random, bool edgeCases = true){
+    static const Float32 edges[] = {
+        0.0f, -0.0f, 1.0f, -1.0f, 1.5f, -1.5f, 0.99999994f, -0.99999994f,
+        0.5f / 32768, 1.5f / 32768, 2.5f / 32768, -2.5f / 32768, 0.5f / 8388608, 1.5f / 8388608,
+        NAN, INFINITY, -INFINITY, 1e-40f, 32767.5f / 32768, -32768.5f / 32768
+    };
+    std::uniform_real_distribution<Float32> signal(-1.2f, 1.2f);
+    std::vector<Float32> input(samples);
+    for(size_t i = 0; i < samples; i++) input[i] = edgeCases && random() % 4 == 0 ? edges[random() % 20] : signal(random);
+    return input;
+}
+
+static std::vector<UInt8> integerInput(size_t bytes, std::mt19937 &random){
+    std::vector<UInt8> input(bytes);
+    for(UInt8 &byte : input) byte = (UInt8)random();
+    return input;
+}
+
+/**
+ * Check the kernels of [level] against the scalar ones for every length
+ * up to [maxSamples].
+ *
+ * @result - number of mismatches
+ */
+static int verify(simd::Level level, size_t maxSamples, std::mt19937 &random){
+    int mismatches = 0;
+    for(size_t samples = 0; samples <= maxSamples; samples++){
+        std::vector<Float32> floats = floatInput(samples, random);
+        for(int format = FORMAT_INT16; format <= FORMAT_INT32; format++){
+            size_t size = sampleSize((SampleFormat)format);
+            //One spare sample after each output, which no kernel may touch
+            std::vector<UInt8> expected((samples + 1) * size, 0xA5), actual((samples + 1) * size, 0xA5);
+            fromFloat32(simd::LEVEL_SCALAR, (SampleFormat)format, floats.data(), expected.data(), samples);
+            fromFloat32(level, (SampleFormat)format, floats.data(), actual.data(), samples);
+            if(expected != actual){
+                fprintf(stderr, "%s float32 -> %s differs at %zu samples\n", simd::name(level), FORMAT_NAMES[format], samples);
+                mismatches++;
+            }
+
+            std::vector<UInt8> integers = integerInput(samples * size, random);
+            std::vector<Float32> expectedFloats(samples + 1, -7.0f), actualFloats(samples + 1, -7.0f);
+            toFloat32(simd::LEVEL_SCALAR, (SampleFormat)format, integers.data(), expectedFloats.data(), samples);
+            toFloat32(level, (SampleFormat)format, integers.data(), actualFloats.data(), samples);
+            if(memcmp(expectedFloats.data(), actualFloats.data(), expectedFloats.size() * sizeof(Float32)) != 0){
+                fprintf(stderr, "%s %s -> float32 differs at %zu samples\n", simd::name(level), FORMAT_NAMES[format], samples);
+                mismatches++;
+            }
+        }
+
+        for(UInt32 channels = 1; channels <= 8; channels++){
+            std::vector<Float32> frames = floatInput(samples * channels, random);
+            std::vector<Float32> expected(frames.size() + 1, -7.0f), actual(frames.size() + 1, -7.0f);
+            Float32* expectedPlanes[8];
+            Float32* actualPlanes[8];
+            for(UInt32 channel = 0; channel < channels; channel++){
+                expectedPlanes[channel] = expected.data() + channel * samples;
+                actualPlanes[channel] = actual.data() + channel * samples;
+            }
+            deinterleave(simd::LEVEL_SCALAR, frames.data(), channels, samples, expectedPlanes);
+            deinterleave(level, frames.data(), channels, samples, actualPlanes);
+            if(memcmp(expected.data(), actual.data(), expected.size() * sizeof(Float32)) != 0){
+                fprintf(stderr, "%s deinterleave of %u channels differs at %zu frames\n", simd::name(level), channels, samples);
+                mismatches++;
+            }
+            std::vector<Float32> interleaved(frames.size() + 1, -7.0f);
+            interleave(level, actualPlanes, channels, samples, interleaved.data());
+            if(memcmp(interleaved.data(), frames.data(), frames.size() * sizeof(Float32)) != 0 || interleaved.back() != -7.0f){
+                fprintf(stderr, "%s interleave of %u channels does not restore the frames at %zu frames\n",
+                        simd::name(level), channels, samples);
+                mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+static void report(const char* operation, simd::Level level, size_t bytes, const Result &result){
+    printf("%-22s %-8s %10.1f %10.2f\n", operation, simd::name(level), result.nsPerCall / 1000, bytes / result.nsPerCall);
+}
+
+int main(int argc, char** argv){
+    size_t samples = 1 << 16;
+    double seconds = 0.1;
+    Options options;
+    options.add("--samples", "N", samples)
+           .add("--seconds", "S", seconds);
+    if(!options.parse(argc, argv)) return 2;
+
+    std::mt19937 random(1);
+    int mismatches = 0;
+    for(simd::Level level : LEVELS){
+        if(level != simd::LEVEL_SCALAR && simd::supported(level)) mismatches += verify(level, 80, random);
+    }
+    printf("%zu samples per call, kernels in use: %s, %s\n\n", samples, simd::name(simd::level()),
+           mismatches == 0 ? "all kernels match the scalar ones" : "MISMATCHES");
+    printf("%-22s %-8s %10s %10s\n", "operation", "kernel", "us/call", "GB/s");
+
+    std::vector<Float32> floats = floatInput(samples, random, false);
+    std::vector<Float32> floatOutput(samples);
+    std::vector<UInt8> integers = integerInput(samples * 4, random), integerOutput(samples * 4);
+    char operation[64];
+    for(int format = FORMAT_INT16; format <= FORMAT_INT32; format++){
+        size_t bytes = samples * (sampleSize((SampleFormat)format) + sizeof(Float32));
+        for(simd::Level level : LEVELS){
+            if(!simd::supported(level)) continue;
+            snprintf(operation, sizeof(operation), "%s -> float32", FORMAT_NAMES[format]);
+            report(operation, level, bytes, measure(NULL, seconds, [&]{
+                toFloat32(level, (SampleFormat)format, integers.data(), floatOutput.data(), samples);
+            }));
+        }
+        for(simd::Level level : LEVELS){
+            if(!simd::supported(level)) continue;
+            snprintf(operation, sizeof(operation), "float32 -> %s", FORMAT_NAMES[format]);
+            report(operation, level, bytes, measure(NULL, seconds, [&]{
+                fromFloat32(level, (SampleFormat)format, floats.data(), integerOutput.data(), samples);
+            }));
+        }
+    }
+
+    const UInt32 channelCounts[] = { 2, 4, 6, 8 };
+    for(UInt32 channels : channelCounts){
+        size_t frames = samples / channels;
+        size_t bytes = 2 * frames * channels * sizeof(Float32);
+        Float32* planes[8];
+        for(UInt32 channel = 0; channel < channels; channel++) planes[channel] = floatOutput.data() + channel * frames;
+        for(simd::Level level : LEVELS){
+            if(!simd::supported(level)) continue;
+            snprintf(operation, sizeof(operation), "deinterleave %u ch", channels);
+            report(operation, level, bytes, measure(NULL, seconds, [&]{
+                deinterleave(level, floats.data(), channels, frames, planes);
+            }));
+        }
+        for(simd::Level level : LEVELS){
+            if(!simd::supported(level)) continue;
+            snprintf(operation, sizeof(operation), "interleave %u ch", channels);
+            report(operation, level, bytes, measure(NULL, seconds, [&]{
+                interleave(level, planes, channels, frames, floats.data());
+            }));
+        }
+    }
+    return mismatches == 0 ? 0 : 1;
+}
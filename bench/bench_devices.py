@@ -0,0 +1,117 @@
+"""
+Device enumeration benchmark, against the simulated HAL.
+
+Sets up --devices devices of which only two have output streams, then
+compares the ways of listing them: getDevices() with a cold and a warm
+device registry, listDeviceIDs(), and listDevices() with no attribute
+access, with filtering down to the speakers and reading their names,
+and with every attribute read. Reports the time and the number of HAL
+calls of each.
+
+Build the module first (`python3 setup.py build` on a non-macOS host),
+then run `python3 bench/bench_devices.py [--devices N] [--latency-us N]`.
+"""
+import argparse
+import glob
+import os
+import statistics
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = glob.glob(os.path.join(ROOT, "build", "lib*"))
+import CoreAudio
+
+if not hasattr(CoreAudio, "_simPopulate"):
+    sys.exit("CoreAudio was not built against the simulated HAL")
+
+ATTRIBUTES = ("name", "manufacturer", "uid", "inStreams", "outStreams", "isMic", "isSpeaker", "channels")
+
+
+def cold_get_devices():
+    #deinit() drops the registry's cache
+    CoreAudio.deinit()
+    CoreAudio.init()
+    return lambda: CoreAudio.getDevices()
+
+
+def warm_get_devices():
+    CoreAudio.getDevices()
+    return lambda: CoreAudio.getDevices()
+
+
+def ids_only():
+    return lambda: CoreAudio.listDeviceIDs()
+
+
+def lazy_objects():
+    return lambda: CoreAudio.listDevices()
+
+
+def speaker_names():
+    return lambda: [device.name for device in CoreAudio.listDevices() if device.isSpeaker]
+
+
+def every_attribute():
+    def run():
+        for device in CoreAudio.listDevices():
+            for attribute in ATTRIBUTES:
+                getattr(device, attribute)
+    return run
+
+
+CASES = (
+    ("getDevices() cold", cold_get_devices),
+    ("getDevices() warm", warm_get_devices),
+    ("listDeviceIDs()", ids_only),
+    ("listDevices()", lazy_objects),
+    ("  + speaker names", speaker_names),
+    ("  + every attribute", every_attribute),
+)
+
+
+def measure(setup, rounds):
+    times = []
+    calls = []
+    for _ in range(rounds):
+        run = setup()
+        before = CoreAudio._simCallCount()
+        start = time.perf_counter()
+        run()
+        times.append(time.perf_counter() - start)
+        calls.append(CoreAudio._simCallCount() - before)
+    return statistics.median(times), statistics.median(calls)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--devices", type=int, default=40)
+    parser.add_argument("--latency-us", type=float, default=20.0)
+    parser.add_argument("--rounds", type=int, default=20)
+    options = parser.parse_args()
+
+    CoreAudio._simPopulate(options.devices)
+    if not CoreAudio.init():
+        sys.exit("init() failed")
+    #Keep the default output device a speaker
+    ids = CoreAudio.listDeviceIDs()
+    for deviceID in ids[2:]:
+        CoreAudio._simSetStreamCounts(deviceID, 1, 0)
+    CoreAudio._simSetLatency(int(options.latency_us * 1000))
+
+    speakers = [device for device in CoreAudio.listDevices() if device.isSpeaker]
+    if len(speakers) != 2:
+        sys.exit("expected 2 speakers, got %d" % len(speakers))
+
+    print("%d devices, 2 speakers, HAL latency %.1f us" % (len(ids), options.latency_us))
+    print("%-22s %12s %10s" % ("", "us/call", "HAL calls"))
+    for label, setup in CASES:
+        elapsed, calls = measure(setup, options.rounds)
+        print("%-22s %12.1f %10d" % (label, elapsed * 1e6, calls))
+
+    CoreAudio.deinit()
+    CoreAudio._simSetLatency(0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,96 @@
+/*
+ * Benchmark of the change notification path.
+ *
+ * Reports the cost of the event ring on its own and across threads, the
+ * latency from a setVolume() to the event being read by a blocked
+ * consumer, and the CPU time a consumer burns while waiting idle.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_events [--events N]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "events.h"
+#include "ring.h"
+#include <stdio.h>
+#include <sys/resource.h>
+#include <thread>
+
+static double cpuSeconds(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char** argv){
+    int samples = 2000;
+    Options options;
+    options.add("--events", "N", samples);
+    if(!options.parse(argc, argv)) return 2;
+
+    //Ring on its own, push and pop on the same thread
+    SpscRing<Event> ring(4096);
+    Event event = { EVENT_VOLUME, 2, 1, 0 };
+    Event out[64];
+    Result single = measure(NULL, 0.2, [&]{ ring.push(event); ring.pop(out, 64); });
+    printf("ring push+pop, one thread:   %8.1f ns/event\n", single.nsPerCall);
+
+    //Ring across threads
+    const size_t total = 10000000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::thread producer([&]{
+        for(size_t i = 0; i < total; i++){
+            while(!ring.push(event)) std::this_thread::yield();
+        }
+    });
+    size_t received = 0;
+    while(received < total){
+        size_t taken = ring.pop(out, 64);
+        if(taken == 0) std::this_thread::yield();
+        received += taken;
+    }
+    producer.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("ring across two threads:     %8.1f ns/event (%.1f M events/s)\n\n",
+           elapsed * 1e9 / total, total / elapsed / 1e6);
+
+    //HAL listener -> ring -> blocked reader
+    hal::SimBackend sim;
+    sim.populate(1);
+    hal::setBackend(&sim);
+    init();
+    eventWatcher.watch(outputState()->deviceID, EVENT_VOLUME);
+
+    std::vector<double> stamped, delivered;
+    for(int i = 0; i < samples; i++){
+        UInt64 before = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        setVolume(i % 2 ? 30 : 70);
+        size_t count = eventWatcher.read(out, 64, 1000);
+        UInt64 after = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        if(count == 0){
+            fprintf(stderr, "no event after setVolume()\n");
+            return 1;
+        }
+        stamped.push_back((out[0].timestamp - before) / 1000.0);
+        delivered.push_back((after - before) / 1000.0);
+        sim.flushNotifications();
+        eventWatcher.drain(out, 64);    //remaining per-channel events
+    }
+    printf("setVolume -> listener:       p50 %7.1f us   p99 %7.1f us\n",
+           percentile(stamped, 50), percentile(stamped, 99));
+    printf("setVolume -> readEvents:     p50 %7.1f us   p99 %7.1f us\n",
+           percentile(delivered, 50), percentile(delivered, 99));
+
+    //Blocked reader with nothing happening
+    double cpuBefore = cpuSeconds();
+    eventWatcher.read(out, 64, 1000);
+    printf("idle read, 1 s timeout:      %8.3f ms CPU\n", (cpuSeconds() - cpuBefore) * 1000.0);
+    printf("dropped events:              %8llu\n", (unsigned long long)eventWatcher.dropped());
+
+    deinit();
+    hal::setBackend(NULL);
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Benchmark of the fade engine (fade.h).
+ *
+ * Runs 1 to 64 concurrent fades against the simulated HAL and reports
+ * how late the fades end compared to their requested duration, the
+ * volume writes per fade, and the CPU time the engine spends per second
+ * of each running fade. Exits with status 1 if a fade does not end at
+ * its target.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_fade [--duration-ms N] [--tick-rate N] [--latency-ns N]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "channels.h"
+#include "fade.h"
+#include "posix.h"
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+//getrusage() only has scheduler tick resolution, far too coarse for a single fade
+static double cpuSeconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv){
+    UInt32 durationMs = 500, tickRate = 100;
+    UInt64 latency = 0;
+    Options options;
+    options.add("--duration-ms", "N", durationMs)
+           .add("--tick-rate", "N", tickRate)
+           .add("--latency-ns", "N", latency);
+    if(!options.parse(argc, argv)) return 2;
+
+    printf("fade duration %u ms, %u ticks/s, simulated HAL latency %llu ns/call\n\n",
+           durationMs, tickRate, (unsigned long long)latency);
+    printf("%6s  %-11s %12s %12s %12s %16s\n", "fades", "curve", "late p50 us", "late p99 us", "writes/fade", "CPU us/fade-sec");
+
+    const char* curveNames[] = { "linear", "equal-power", "dB" };
+    const int fadeCounts[] = { 1, 16, 64 };
+    int failures = 0;
+    for(int count : fadeCounts){
+        for(int curve = FADE_LINEAR; curve <= FADE_DB; curve++){
+            hal::SimBackend sim;
+            sim.populate(count);
+            sim.setLatency(latency);
+            hal::setBackend(&sim);
+            if(!init()){
+                fprintf(stderr, "init() failed\n");
+                return 1;
+            }
+            fadeEngine.setTickRate(tickRate);
+            std::vector<AudioDeviceID> devices = sim.devices();
+            for(AudioDeviceID deviceID : devices) setVolumeScalarForDevice(deviceID, 1.0f);
+
+            sim.resetCallCount();
+            double cpuBefore = cpuSeconds();
+            std::vector<UInt64> started;
+            for(AudioDeviceID deviceID : devices){
+                started.push_back(monotonicNanoseconds());
+                if(fadeEngine.start(deviceID, 0.1f, durationMs, (FadeCurve)curve) == 0){
+                    fprintf(stderr, "fade on device %u did not start\n", deviceID);
+                    return 1;
+                }
+            }
+            std::vector<double> lateness;
+            FadeCompletion completions[64];
+            while(lateness.size() < devices.size()){
+                size_t taken = fadeEngine.read(completions, 64, durationMs * 4);
+                if(taken == 0){
+                    fprintf(stderr, "fades did not finish\n");
+                    return 1;
+                }
+                for(size_t i = 0; i < taken; i++){
+                    size_t index = completions[i].deviceID - devices[0];
+                    UInt64 due = started[index] + (UInt64)durationMs * 1000000ull;
+                    lateness.push_back(((double)completions[i].timestamp - (double)due) / 1000.0);
+                    if(completions[i].status != FADE_DONE) failures++;
+                }
+            }
+            double cpu = cpuSeconds() - cpuBefore;
+            //Reading or setting the volume costs one call per mapped element, start() reads it once
+            double writes = (double)sim.callCount() / devices.size() / channelMaps.lookup(devices[0])->volume.size() - 1;
+
+            for(AudioDeviceID deviceID : devices){
+                if(fabsf(getVolumeScalarForDevice(deviceID) - 0.1f) > 1e-6f) failures++;
+            }
+            printf("%6d  %-11s %12.1f %12.1f %12.1f %16.1f\n", count, curveNames[curve],
+                   percentile(lateness, 50), percentile(lateness, 99), writes,
+                   cpu * 1e6 / devices.size() / (durationMs / 1000.0));
+
+            deinit();
+            hal::setBackend(NULL);
+        }
+    }
+
+    if(failures > 0){
+        fprintf(stderr, "%d fades did not end at their target\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Stress benchmark of default output device following.
+ *
+ * Several threads hammer getVolume/setVolume while the simulated HAL
+ * keeps switching the default output device between a stereo device
+ * with a master element and an 8 channel device without one. Acting on
+ * one device with the channel list of the other fails, so every failed
+ * call is counted as a torn state. Also reports how long it takes until
+ * a switch is picked up.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_follow [--threads N] [--seconds S] [--latency-ns N]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include <stdio.h>
+#include <thread>
+
+int main(int argc, char** argv){
+    int threads = 4;
+    double seconds = 1.0;
+    UInt64 latency = 0;
+    Options options;
+    options.add("--threads", "N", threads)
+           .add("--seconds", "S", seconds)
+           .add("--latency-ns", "N", latency);
+    if(!options.parse(argc, argv)) return 2;
+
+    hal::SimBackend sim;
+    hal::SimDeviceSpec stereo;
+    stereo.name = "Stereo";
+    stereo.uid = "Stereo";
+    AudioDeviceID first = sim.addDevice(stereo);
+    hal::SimDeviceSpec multichannel;
+    multichannel.name = "Multichannel";
+    multichannel.uid = "Multichannel";
+    multichannel.outChannels = 8;
+    multichannel.hasMasterElement = false;
+    AudioDeviceID second = sim.addDevice(multichannel);
+    sim.setLatency(latency);
+    hal::setBackend(&sim);
+
+    if(!init() || !setFollowDefaultDevice(true)){
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+
+    std::atomic<bool> running(true);
+    std::atomic<UInt64> calls(0), failures(0);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; t++){
+        workers.push_back(std::thread([&, t]{
+            UInt64 done = 0, failed = 0;
+            int volume = t;
+            while(running.load(std::memory_order_relaxed)){
+                if(getVolume() < 0) failed++;
+                if(!setVolume(volume)) failed++;
+                volume = (volume + 7) % 101;
+                done += 2;
+            }
+            calls += done;
+            failures += failed;
+        }));
+    }
+
+    typedef std::chrono::steady_clock clock;
+    std::vector<double> switchLatency;
+    clock::time_point end = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+    AudioDeviceID target = first;
+    while(clock::now() < end){
+        target = (target == first) ? second : first;
+        clock::time_point start = clock::now();
+        sim.setDefaultOutputDevice(target);
+        while(outputState()->deviceID != target) std::this_thread::yield();
+        switchLatency.push_back(std::chrono::duration<double, std::micro>(clock::now() - start).count());
+    }
+    running = false;
+    for(std::thread &worker : workers) worker.join();
+
+    printf("threads:             %d\n", threads);
+    printf("device switches:     %zu\n", switchLatency.size());
+    printf("switch picked up:    p50 %.1f us   p99 %.1f us\n",
+           percentile(switchLatency, 50), percentile(switchLatency, 99));
+    printf("API calls:           %llu (%.0f calls/s)\n",
+           (unsigned long long)calls.load(), calls.load() / seconds);
+    printf("failed calls:        %llu\n", (unsigned long long)failures.load());
+
+    bool consistent = outputState()->deviceID == target && failures.load() == 0;
+    deinit();
+    hal::setBackend(NULL);
+    if(!consistent){
+        printf("FAILED: the output state was torn or stale\n");
+        return 1;
+    }
+    return 0;
+}
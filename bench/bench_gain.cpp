@@ -0,0 +1,228 @@
+/*
+ * Benchmark of the software gain stage (gain.h).
+ *
+ * Every vector kernel is first checked against the scalar one for 1 to
+ * 72 channels and every frame count up to a few periods, at a steady
+ * gain (exact) and while ramping (to float rounding, the vector kernels
+ * may fuse the multiply-add). Then the cost of a steady and of a ramping
+ * IO cycle is reported per frame and per sample for several channel
+ * counts. The de-zippering is checked on the stage itself: a change of
+ * gain, a change in the middle of a ramp and mute must move by no more
+ * than one ramp step per frame and land exactly on the new gain. Last,
+ * on a simulated device without controls, the volume calls must fail
+ * and leave the playback alone, and a full-scale clip played through
+ * the simulated HAL's IO thread must meter at the playback gain set.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_gain [--frames N] [--seconds S]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "gain.h"
+#include "meter.h"
+#include "playback.h"
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+static const simd::Level LEVELS[] = { simd::LEVEL_SCALAR, simd::LEVEL_SSE2, simd::LEVEL_AVX2, simd::LEVEL_NEON };
+
+/**
+ * Check the kernel of [level] against the scalar one.
+ *
+ * @result - number of mismatches
+ */
+static int verify(simd::Level level, std::mt19937 &random){
+    std::uniform_real_distribution<Float32> signal(-1.0f, 1.0f), gains(0.0f, 1.0f), steps(-1e-3f, 1e-3f);
+    int mismatches = 0;
+    for(UInt32 channels = 1; channels <= 72; channels++){
+        std::vector<Float32> start(channels), step(channels);
+        for(UInt32 channel = 0; channel < channels; channel++){
+            start[channel] = gains(random);
+            step[channel] = steps(random);
+        }
+        for(UInt32 frames = 0; frames <= 80; frames++){
+            std::vector<Float32> input(frames * channels);
+            for(Float32 &sample : input) sample = signal(random);
+            for(int ramp = 0; ramp < 2; ramp++){
+                //One spare sample after the frames, which no kernel may touch
+                std::vector<Float32> expected(input), actual(input);
+                expected.push_back(-7.0f);
+                actual.push_back(-7.0f);
+                applyGain(simd::LEVEL_SCALAR, expected.data(), frames, channels, start.data(), ramp ? step.data() : NULL);
+                applyGain(level, actual.data(), frames, channels, start.data(), ramp ? step.data() : NULL);
+                bool same = actual.back() == -7.0f;
+                for(size_t i = 0; same && i < input.size(); i++){
+                    same = ramp ? fabsf(actual[i] - expected[i]) <= 1e-6f * fabsf(input[i]) : actual[i] == expected[i];
+                }
+                if(!same){
+                    fprintf(stderr, "%s %s gain of %u channels differs at %u frames\n",
+                            simd::name(level), ramp ? "ramping" : "steady", channels, frames);
+                    mismatches++;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Run [cycles] IO cycles of [frames] frames of full scale through a
+ * stereo stage and append the left channel to [out].
+ */
+static void runStage(SoftwareGain &gain, UInt32 frames, UInt32 cycles, std::vector<Float32> &out){
+    std::vector<Float32> samples(frames * 2);
+    AudioBufferList list;
+    list.mNumberBuffers = 1;
+    list.mBuffers[0].mNumberChannels = 2;
+    list.mBuffers[0].mDataByteSize = frames * 2 * sizeof(Float32);
+    list.mBuffers[0].mData = samples.data();
+    for(UInt32 cycle = 0; cycle < cycles; cycle++){
+        std::fill(samples.begin(), samples.end(), 1.0f);
+        gain.process(NULL, &list, frames, 0);
+        for(UInt32 frame = 0; frame < frames; frame++) out.push_back(samples[frame * 2]);
+    }
+}
+
+/**
+ * Largest change between neighbouring samples of [levels], from [previous] on.
+ */
+static Float32 largestStep(const std::vector<Float32> &levels, Float32 previous){
+    Float32 largest = 0;
+    for(Float32 level : levels){
+        if(fabsf(level - previous) > largest) largest = fabsf(level - previous);
+        previous = level;
+    }
+    return largest;
+}
+
+int main(int argc, char** argv){
+    UInt32 frames = 512;
+    double seconds = 0.1;
+    Options options;
+    options.add("--frames", "N", frames)
+           .add("--seconds", "S", seconds);
+    if(!options.parse(argc, argv)) return 2;
+    bool failed = false;
+
+    std::mt19937 random(1);
+    int mismatches = 0;
+    for(simd::Level level : LEVELS){
+        if(level != simd::LEVEL_SCALAR && simd::supported(level)) mismatches += verify(level, random);
+    }
+    failed = mismatches > 0;
+    printf("%u frames per IO cycle, kernels in use: %s, %s\n\n", frames, simd::name(simd::level()),
+           mismatches == 0 ? "all kernels match the scalar ones" : "MISMATCHES");
+
+    //Cost per IO cycle. Gains alternate between g and about 1/g, so the samples stay in range.
+    printf("%8s %-8s %14s %14s %14s %14s\n", "channels", "kernel", "steady ns/fr", "steady ns/smp",
+           "ramp ns/fr", "ramp ns/smp");
+    const UInt32 channelCounts[] = { 1, 2, 6, 8, 16, 32, 64 };
+    for(UInt32 channels : channelCounts){
+        std::vector<Float32> samples((size_t)frames * channels);
+        std::uniform_real_distribution<Float32> signal(-1.0f, 1.0f);
+        for(Float32 &sample : samples) sample = signal(random);
+        std::vector<Float32> down(channels, 0.5f), up(channels, 2.0f);
+        std::vector<Float32> stepDown(channels, 1e-7f), stepUp(channels, -4e-7f);
+        for(simd::Level level : LEVELS){
+            if(!simd::supported(level)) continue;
+            bool toggle = false;
+            Result steady = measure(NULL, seconds, [&]{
+                toggle = !toggle;
+                applyGain(level, samples.data(), frames, channels, toggle ? down.data() : up.data(), NULL);
+            });
+            Result ramp = measure(NULL, seconds, [&]{
+                toggle = !toggle;
+                applyGain(level, samples.data(), frames, channels, toggle ? down.data() : up.data(),
+                          toggle ? stepDown.data() : stepUp.data());
+            });
+            printf("%8u %-8s %14.3f %14.4f %14.3f %14.4f\n", channels, simd::name(level),
+                   steady.nsPerCall / frames, steady.nsPerCall / frames / channels,
+                   ramp.nsPerCall / frames, ramp.nsPerCall / frames / channels);
+        }
+    }
+
+    //De-zippering, 20 ms ramps at 48 kHz
+    {
+        const UInt32 rampFrames = 960;
+        SoftwareGain gain(2, 48000, 20);
+        std::vector<Float32> levels;
+        gain.setGain(0.25f);
+        runStage(gain, 256, 8, levels);
+        Float32 bound = 0.75f / rampFrames * 1.001f;
+        Float32 largest = largestStep(levels, 1.0f);
+        bool exact = levels[rampFrames] == 0.25f && levels.back() == 0.25f && levels[rampFrames - 1] > 0.25f;
+        printf("\n1.0 -> 0.25:       largest step %.6f per frame (bound %.6f), %s after %u frames\n",
+               largest, bound, exact ? "exact" : "NOT exact", rampFrames);
+        if(largest > bound || !exact) failed = true;
+
+        //Turned up, then down again halfway through the ramp: no jump, just a new slope
+        std::vector<Float32> turned;
+        gain.setGain(1.0f);
+        runStage(gain, 480, 1, turned);
+        gain.setGain(0.5f);
+        runStage(gain, 480, 4, turned);
+        largest = largestStep(turned, 0.25f);
+        printf("turned mid-ramp:   largest step %.6f per frame, ends at %.6f\n", largest, turned.back());
+        if(largest > 0.75f / rampFrames * 1.001f || turned.back() != 0.5f) failed = true;
+
+        std::vector<Float32> muted;
+        gain.setMuted(true);
+        runStage(gain, 512, 4, muted);
+        largest = largestStep(muted, 0.5f);
+        printf("mute:              largest step %.6f per frame, ends at %.6f, gain kept at %.2f\n",
+               largest, muted.back(), gain.gain());
+        if(largest > 0.5f / rampFrames * 1.001f || muted.back() != 0.0f || gain.gain() != 0.5f) failed = true;
+    }
+
+    //Volume and mute calls on a device without controls
+    hal::SimBackend sim;
+    hal::SimDeviceSpec spec;
+    spec.name = "Multi-Output Device";
+    spec.uid = "multi-output";
+    spec.outChannels = 2;
+    spec.hasVolume = false;
+    spec.hasMute = false;
+    AudioDeviceID deviceID = sim.addDevice(spec);
+    sim.setIOBufferFrames(frames);
+    hal::setBackend(&sim);
+    if(!init()){
+        fprintf(stderr, "could not initialize\n");
+        return 1;
+    }
+    //Nothing to scale without a playback
+    bool refused = getVolumeForDevice(deviceID) == -1 && !setVolumeForDevice(deviceID, 50)
+                && getMuteForDevice(deviceID) == -1 && !setMuteForDevice(deviceID, true)
+                && !playbackEngine.setGain(deviceID, 0.5f) && !gainEngine.find(deviceID);
+
+    //Played at full scale, metered after the stage
+    if(playbackEngine.start(deviceID, 4096) != 2 || meterEngine.start(deviceID, METER_OUTPUT, 50, 10) != 2){
+        fprintf(stderr, "could not play to the simulated device\n");
+        return 1;
+    }
+    refused = refused && !setVolumeForDevice(deviceID, 50) && !gainEngine.find(deviceID);
+    bool scaled = playbackEngine.gain(deviceID) == 1.0f && playbackEngine.setGain(deviceID, 0.5f)
+               && playbackEngine.gain(deviceID) == 0.5f && gainEngine.find(deviceID);
+    printf("\nno controls:       volume calls %s, playback gain %s\n",
+           refused ? "refused" : "NOT refused", scaled ? "set" : "NOT set");
+    if(!refused || !scaled) failed = true;
+    std::shared_ptr<Playback> playback = playbackEngine.find(deviceID);
+    std::vector<Float32> clip(48000 / 4 * 2, 1.0f);
+    size_t written = 0;
+    while(written < clip.size() / 2){
+        written += playback->write(&clip[written * 2], clip.size() / 2 - written);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    MeterReading readings[2];
+    meterEngine.find(deviceID, METER_OUTPUT)->read(readings, 2);
+    printf("played at 50%%:     peak %.4f %.4f\n", readings[0].peak, readings[1].peak);
+    if(fabsf(readings[0].peak - 0.5f) > 1e-3f || fabsf(readings[1].peak - 0.5f) > 1e-3f) failed = true;
+
+    //The stage goes with the playback
+    playbackEngine.stop(deviceID);
+    if(gainEngine.find(deviceID) || playbackEngine.gain(deviceID) != -1.0f) failed = true;
+    deinit();
+    hal::setBackend(NULL);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Latency benchmark of the C++ interface against the simulated HAL.
+ *
+ * Reports ns/call, calls/sec and the number of HAL round trips per call
+ * for getVolume, setVolume, getMute and getDevices with 1, 8 and 64
+ * devices present. getDevices is measured both uncached and through the
+ * device registry, warm and after a single device was renamed.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_hal [--latency-ns N] [--seconds S] [--channels C]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "hal_sim.h"
+#include "registry.h"
+#include <stdio.h>
+
+static void report(int devices, const char* operation, const Result &result){
+    printf("%7d  %-12s %12.1f %14.0f %10.1f\n",
+           devices, operation, result.nsPerCall, result.callsPerSec, result.halCallsPerCall);
+}
+
+int main(int argc, char** argv){
+    UInt64 latency = 0;
+    double seconds = 0.2;
+    UInt32 channels = 2;
+    Options options;
+    options.add("--latency-ns", "N", latency)
+           .add("--seconds", "S", seconds)
+           .add("--channels", "C", channels);
+    if(!options.parse(argc, argv)) return 2;
+
+    printf("simulated HAL latency: %llu ns/call, %u output channels per device\n\n",
+           (unsigned long long)latency, channels);
+    printf("%7s  %-12s %12s %14s %10s\n", "devices", "operation", "ns/call", "calls/sec", "HAL/call");
+
+    const int deviceCounts[] = { 1, 8, 64 };
+    for(int devices : deviceCounts){
+        hal::SimBackend sim;
+        sim.populate(devices, channels);
+        sim.setLatency(latency);
+        hal::setBackend(&sim);
+        if(!init()){
+            fprintf(stderr, "init() failed with %d simulated devices\n", devices);
+            return 1;
+        }
+
+        int volume = 0;
+        std::vector<DeviceInfo> list;
+        report(devices, "getVolume", measure(&sim, seconds, []{ getVolume(); }));
+        report(devices, "setVolume", measure(&sim, seconds, [&]{ setVolume(volume); volume = (volume + 1) % 101; }));
+        report(devices, "getMute", measure(&sim, seconds, []{ getMute(); }));
+        report(devices, "getDevices", measure(&sim, seconds, [&]{ list.clear(); getDevices(list); }));
+        report(devices, "registry", measure(&sim, seconds, []{ deviceRegistry.snapshot(); }));
+
+        //One device renamed between two calls, only that entry is queried again
+        AudioDeviceID renamed = sim.devices().back();
+        int renames = 0;
+        Result refresh = measure(&sim, seconds, [&]{
+            sim.setDeviceName(renamed, renames++ % 2 ? "Renamed" : "Renamed again");
+            sim.flushNotifications();
+            deviceRegistry.snapshot();
+        });
+        report(devices, "registry/dirty", refresh);
+
+        deinit();
+        hal::setBackend(NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+"""
+Lazy initialization benchmark, against the simulated HAL.
+
+Every measurement runs in a fresh interpreter, so the first call is
+really the first one. Reports the time of `import CoreAudio` and the
+time and HAL calls of the first call in each of these processes:
+
+    devices     getDevices() without init(); must neither look up the default
+                output device nor scan the channels of any device
+    volume      getVolume() without init(), which initializes on demand
+    eager       init(), then getVolume()
+    threads     getVolume() from --threads threads at once without init();
+                the default output device must be looked up and scanned once
+
+and checks that init()/deinit() can be called any number of times and
+that setLazyInit(False) brings back the "Not initialized" errors.
+
+Build the module first (`python3 setup.py build` on a non-macOS host),
+then run `python3 bench/bench_init.py [--devices N] [--channels N] [--latency-us N] [--threads N]`.
+"""
+import argparse
+import glob
+import json
+import os
+import statistics
+import subprocess
+import sys
+import threading
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = glob.glob(os.path.join(ROOT, "build", "lib*"))
+
+#kAudioHardwarePropertyDefaultOutputDevice, and the stream configuration every channel scan starts with
+DEFAULT_OUTPUT = "dOut"
+STREAM_CONFIGURATION = "slay"
+
+
+def selector_calls(stats, selector, op="getPropertyData"):
+    return stats["hal"].get(op, {}).get(selector, {}).get("calls", 0)
+
+
+def timed(fn):
+    start = time.perf_counter()
+    result = fn()
+    return (time.perf_counter() - start) * 1e6, result
+
+
+def child(options):
+    """Runs in the fresh interpreter, prints what it measured as JSON."""
+    elapsed, _ = timed(lambda: __import__("CoreAudio"))
+    import CoreAudio
+    report = {"import_us": elapsed}
+    if not hasattr(CoreAudio, "_simPopulate"):
+        sys.exit("CoreAudio was not built against the simulated HAL")
+    if options.child == "import":
+        print(json.dumps(report))
+        return
+
+    CoreAudio._simPopulate(options.devices, options.channels)
+    CoreAudio._simSetLatency(options.latency_us * 1000)
+    CoreAudio.resetStats()
+    calls = CoreAudio._simCallCount()
+
+    if options.child == "devices":
+        report["first_us"], devices = timed(CoreAudio.getDevices)
+        report["ok"] = len(devices) == options.devices
+    elif options.child == "volume":
+        report["first_us"], volume = timed(CoreAudio.getVolume)
+        report["ok"] = volume >= 0
+    elif options.child == "eager":
+        report["first_us"], ok = timed(CoreAudio.init)
+        elapsed, volume = timed(CoreAudio.getVolume)
+        report["first_us"] += elapsed
+        report["ok"] = ok and volume >= 0
+    elif options.child == "threads":
+        barrier = threading.Barrier(options.threads)
+        results = []
+
+        def worker():
+            barrier.wait()
+            results.append(CoreAudio.getVolume())
+
+        threads = [threading.Thread(target=worker) for _ in range(options.threads)]
+        start = time.perf_counter()
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        report["first_us"] = (time.perf_counter() - start) * 1e6
+        report["ok"] = len(results) == options.threads and len(set(results)) == 1
+    elif options.child == "lifecycle":
+        report["first_us"] = 0
+        ok = CoreAudio.init() and CoreAudio.init() and CoreAudio.ready()
+        CoreAudio.deinit()
+        CoreAudio.deinit()
+        ok = ok and not CoreAudio.ready() and CoreAudio.getVolume() >= 0 and CoreAudio.ready()
+        CoreAudio.deinit()
+        CoreAudio.setLazyInit(False)
+        try:
+            CoreAudio.getVolume()
+            ok = False
+        except Exception as error:
+            ok = ok and str(error) == "Not initialized"
+        ok = ok and CoreAudio.init() and CoreAudio.getVolume() >= 0
+        CoreAudio.setLazyInit(True)
+        report["ok"] = ok and CoreAudio.getLazyInit()
+
+    stats = CoreAudio.stats()
+    report["calls"] = CoreAudio._simCallCount() - calls
+    report["default_lookups"] = selector_calls(stats, DEFAULT_OUTPUT)
+    report["channel_scans"] = selector_calls(stats, STREAM_CONFIGURATION)
+    CoreAudio.deinit()
+    print(json.dumps(report))
+
+
+def run(options, scenario):
+    command = [sys.executable, os.path.abspath(__file__), "--child", scenario,
+               "--devices", str(options.devices), "--channels", str(options.channels),
+               "--latency-us", str(options.latency_us), "--threads", str(options.threads)]
+    output = subprocess.run(command, check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+    return json.loads(output.splitlines()[-1])
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--devices", type=int, default=16)
+    parser.add_argument("--channels", type=int, default=8)
+    parser.add_argument("--latency-us", type=int, default=20)
+    parser.add_argument("--threads", type=int, default=16)
+    parser.add_argument("--rounds", type=int, default=5)
+    parser.add_argument("--child", help=argparse.SUPPRESS)
+    options = parser.parse_args()
+    if options.child:
+        child(options)
+        return
+
+    failures = []
+    imports = [run(options, "import")["import_us"] for _ in range(options.rounds)]
+    print("%d devices with %d channels, %d us per HAL call" % (options.devices, options.channels, options.latency_us))
+    print("import CoreAudio: %.0f us (median of %d)\n" % (statistics.median(imports), options.rounds))
+
+    print("%-10s %14s %10s %16s %14s %6s" % ("first call", "us", "HAL calls", "default lookups", "channel scans", ""))
+    for scenario in ("devices", "volume", "eager", "threads", "lifecycle"):
+        reports = [run(options, scenario) for _ in range(options.rounds)]
+        report = reports[-1]
+        ok = all(r["ok"] for r in reports)
+        if scenario == "devices":
+            ok = ok and all(r["default_lookups"] == 0 and r["channel_scans"] == 0 for r in reports)
+        elif scenario in ("volume", "eager", "threads"):
+            ok = ok and all(r["default_lookups"] == 1 and r["channel_scans"] == 1 for r in reports)
+        if scenario != "lifecycle":
+            print("%-10s %14.0f %10d %16d %14d %6s" % (scenario, statistics.median(r["first_us"] for r in reports),
+                                                       report["calls"], report["default_lookups"],
+                                                       report["channel_scans"], "ok" if ok else "FAILED"))
+        else:
+            print("%-10s %67s" % ("init/deinit", "ok" if ok else "FAILED"))
+        if not ok:
+            failures.append(scenario)
+
+    if failures:
+        print("failed: %s" % ", ".join(failures))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,189 @@
+/*
+ * Benchmark and consistency check of the device registry's UID/name
+ * index (registry.h).
+ *
+ * Hot-plugs a simulated device list at random - devices are unplugged,
+ * re-plugged under a new ID, added and renamed - and after every change
+ * checks that each UID and name resolves exactly like a scan of the
+ * current device list would. Then reports the cost of a warm lookup, of
+ * the scan it replaces, of a lookup right after a hot-plug, and of a UID
+ * lookup followed by a volume write, for 8 to 256 devices. Exits with
+ * status 1 on any mismatch.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_lookup [--latency-ns N] [--seconds S] [--changes N]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "registry.h"
+#include "hal_sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <random>
+#include <string>
+
+static int failures = 0;
+
+static void report(size_t devices, const char* operation, const Result &result){
+    printf("%8zu  %-24s %12.1f %14.0f %10.1f\n",
+           devices, operation, result.nsPerCall, result.callsPerSec, result.halCallsPerCall);
+}
+
+static hal::SimDeviceSpec spec(unsigned int serial){
+    char buffer[64];
+    hal::SimDeviceSpec device;
+    snprintf(buffer, sizeof(buffer), "Hot-plug Device %u", serial);
+    device.name = buffer;
+    device.manufacturer = "pycoreaudio";
+    snprintf(buffer, sizeof(buffer), "HotPlugDevice:%u", serial);
+    device.uid = buffer;
+    return device;
+}
+
+/**
+ * Compare every lookup against a scan of the simulated device list.
+ */
+static void check(hal::SimBackend &sim, const std::map<std::string, AudioDeviceID> &unplugged){
+    std::map<std::string, AudioDeviceID> lowestByName;
+    for(AudioDeviceID deviceID : sim.devices()){
+        std::string uid = getDeviceUID(deviceID);
+        std::string name = getDeviceName(deviceID);
+        AudioDeviceID found;
+        if(!deviceRegistry.findByUID(uid, found) || found != deviceID){
+            fprintf(stderr, "UID %s does not resolve to %u\n", uid.c_str(), (unsigned int)deviceID);
+            failures++;
+        }
+        if(lowestByName.count(name) == 0 || deviceID < lowestByName[name]) lowestByName[name] = deviceID;
+    }
+    for(const std::pair<const std::string, AudioDeviceID> &entry : lowestByName){
+        AudioDeviceID found;
+        if(!deviceRegistry.findByName(entry.first, found) || found != entry.second){
+            fprintf(stderr, "name %s does not resolve to %u\n", entry.first.c_str(), (unsigned int)entry.second);
+            failures++;
+        }
+    }
+    for(const std::pair<const std::string, AudioDeviceID> &entry : unplugged){
+        AudioDeviceID found;
+        if(deviceRegistry.findByUID(entry.first, found)){
+            fprintf(stderr, "unplugged UID %s still resolves to %u\n", entry.first.c_str(), (unsigned int)found);
+            failures++;
+        }
+    }
+}
+
+/**
+ * Apply [changes] random hot-plug events, checking the index after each.
+ */
+static void hotPlug(hal::SimBackend &sim, size_t devices, int changes, std::minstd_rand &random){
+    std::map<std::string, AudioDeviceID> unplugged;
+    unsigned int serial = 0;
+    for(size_t i = 0; i < devices; i++) sim.addDevice(spec(serial++));
+    sim.flushNotifications();
+    check(sim, unplugged);
+
+    for(int i = 0; i < changes; i++){
+        std::vector<AudioDeviceID> present = sim.devices();
+        AudioDeviceID victim = present[random() % present.size()];
+        switch(random() % 4){
+            case 0:     //unplug
+                if(present.size() > 1){
+                    unplugged[getDeviceUID(victim)] = victim;
+                    sim.removeDevice(victim);
+                }
+                break;
+            case 1:     //re-plug something unplugged, it comes back with a new ID
+                if(!unplugged.empty()){
+                    std::map<std::string, AudioDeviceID>::iterator back = unplugged.begin();
+                    std::advance(back, random() % unplugged.size());
+                    hal::SimDeviceSpec device = spec(0);
+                    device.uid = back->first;
+                    device.name = "Re-plugged " + back->first;
+                    sim.addDevice(device);
+                    unplugged.erase(back);
+                }
+                break;
+            case 2:     //plug in a new one
+                sim.addDevice(spec(serial++));
+                break;
+            case 3: {   //rename, sometimes to the name of another device
+                AudioDeviceID other = present[random() % present.size()];
+                std::string name = random() % 2 ? getDeviceName(other) : "Renamed " + getDeviceUID(victim);
+                sim.setDeviceName(victim, name);
+                break;
+            }
+        }
+        sim.flushNotifications();
+        check(sim, unplugged);
+    }
+}
+
+int main(int argc, char** argv){
+    UInt64 latency = 0;
+    double seconds = 0.2;
+    int changes = 200;
+    Options options;
+    options.add("--latency-ns", "N", latency)
+           .add("--seconds", "S", seconds)
+           .add("--changes", "N", changes);
+    if(!options.parse(argc, argv)) return 2;
+
+    printf("simulated HAL latency: %llu ns/call\n\n", (unsigned long long)latency);
+    printf("%8s  %-24s %12s %14s %10s\n", "devices", "operation", "ns/call", "calls/sec", "HAL/call");
+
+    std::minstd_rand random(42);
+    const size_t deviceCounts[] = { 8, 64, 256 };
+    for(size_t devices : deviceCounts){
+        hal::SimBackend sim;
+        hal::setBackend(&sim);
+        if(!init()){
+            fprintf(stderr, "init() failed\n");
+            return 1;
+        }
+        hotPlug(sim, devices, changes, random);
+
+        std::vector<AudioDeviceID> present = sim.devices();
+        AudioDeviceID target = present[present.size() / 2];
+        std::string uid = getDeviceUID(target);
+        std::string name = getDeviceName(target);
+        sim.setLatency(latency);
+
+        AudioDeviceID found;
+        report(devices, "findByUID", measure(&sim, seconds, [&]{ deviceRegistry.findByUID(uid, found); }));
+        report(devices, "findByName", measure(&sim, seconds, [&]{ deviceRegistry.findByName(name, found); }));
+        report(devices, "scan snapshot", measure(&sim, seconds, [&]{
+            DeviceSnapshot snapshot = deviceRegistry.snapshot();
+            for(const DeviceInfo &info : *snapshot){
+                if(info.uid == uid){
+                    found = info.id;
+                    break;
+                }
+            }
+        }));
+        //A rename of another device forces a refresh of that one entry before the probe
+        AudioDeviceID other = present.front();
+        int renames = 0;
+        report(devices, "findByUID after change", measure(&sim, seconds, [&]{
+            sim.setDeviceName(other, renames++ % 2 ? "Renamed A" : "Renamed B");
+            sim.flushNotifications();
+            deviceRegistry.findByUID(uid, found);
+        }));
+        int volume = 0;
+        report(devices, "findByUID + setVolume", measure(&sim, seconds, [&]{
+            if(deviceRegistry.findByUID(uid, found)) setVolumeForDevice(found, volume);
+            volume = (volume + 1) % 101;
+        }));
+        report(devices, "setVolumeForDevice", measure(&sim, seconds, [&]{
+            setVolumeForDevice(target, volume);
+            volume = (volume + 1) % 101;
+        }));
+
+        deinit();
+        hal::setBackend(NULL);
+    }
+    if(failures > 0){
+        fprintf(stderr, "%d lookups did not match the device list\n", failures);
+        return 1;
+    }
+    return 0;
+}
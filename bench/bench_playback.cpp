@@ -0,0 +1,234 @@
+/*
+ * Benchmark of the playback path (playback.h).
+ *
+ * The ring and the writer's scheduling are run against a simulated
+ * consumer clock: IO cycles and writer wakeups happen in virtual time,
+ * the writer waits exactly as long as Playback::retryDelay() asks (plus
+ * an optional scheduling delay), and nothing sleeps. For several ring
+ * capacities this reports underruns, writer wakeups and the worst
+ * queued latency of a clip written in one call; the device must play
+ * the clip exactly, spread over two mono streams. A second run pauses
+ * the writer mid-clip and checks the underrun accounting against the
+ * silence the device played. Finally the cost of a write and an IO
+ * cycle is measured, and a clip is played through the simulated HAL's
+ * realtime IO thread.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_playback [--frames N] [--seconds S] [--wake-delay-us US]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "playback.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include <thread>
+
+static const UInt32 CHANNELS = 2;
+static const Float64 SAMPLE_RATE = 48000;
+
+/**
+ * A device with two mono output streams, played in virtual time.
+ */
+struct VirtualDevice {
+    Playback &playback;
+    UInt32 frames;
+    std::vector<Float32> left, right;
+    std::vector<char> storage;
+    AudioBufferList* list;
+    UInt64 next;            //stamp of the next frame expected
+    UInt64 cycles;
+    UInt64 silence;         //silent frames before the last frame played
+    UInt64 pendingSilence;  //silent frames since the last frame played
+    bool corrupt;
+
+    VirtualDevice(Playback &playback, UInt32 frames) : playback(playback), frames(frames), left(frames), right(frames),
+                                                       storage(sizeof(AudioBufferList) + sizeof(AudioBuffer)),
+                                                       next(1), cycles(0), silence(0), pendingSilence(0), corrupt(false) {
+        list = (AudioBufferList*)storage.data();
+        list->mNumberBuffers = 2;
+        Float32* data[2] = { left.data(), right.data() };
+        for(UInt32 i = 0; i < 2; i++){
+            list->mBuffers[i].mNumberChannels = 1;
+            list->mBuffers[i].mDataByteSize = frames * sizeof(Float32);
+            list->mBuffers[i].mData = data[i];
+        }
+    }
+
+    void cycle(){
+        std::fill(left.begin(), left.end(), 0.0f);
+        std::fill(right.begin(), right.end(), 0.0f);
+        playback.process(NULL, list, frames, 0);
+        for(UInt32 frame = 0; frame < frames; frame++){
+            if(left[frame] == 0 && right[frame] == 0){
+                pendingSilence++;
+                continue;
+            }
+            if(left[frame] != (Float32)next || right[frame] != -(Float32)next) corrupt = true;
+            next++;
+            silence += pendingSilence;
+            pendingSilence = 0;
+        }
+        cycles++;
+    }
+};
+
+/**
+ * Clip of [frames] frames, stamped 1, 2, ... on the left and negated on the right.
+ */
+static std::vector<Float32> makeClip(size_t frames){
+    std::vector<Float32> clip(frames * CHANNELS);
+    for(size_t frame = 0; frame < frames; frame++){
+        clip[frame * CHANNELS] = (Float32)(frame + 1);
+        clip[frame * CHANNELS + 1] = -(Float32)(frame + 1);
+    }
+    return clip;
+}
+
+struct VirtualRun {
+    UInt64 wakeups;
+    PlaybackStats stats;
+    UInt64 silence;
+    bool exact;
+};
+
+/**
+ * Write a clip in one call, the way writePlayback() does, while the
+ * device plays, all in virtual time. The writer pauses for [pauseNs]
+ * halfway through, and oversleeps every wait by up to [wakeDelayNs].
+ */
+static VirtualRun runVirtual(size_t capacity, UInt32 frames, const std::vector<Float32> &clip,
+                             UInt64 pauseNs, UInt64 wakeDelayNs){
+    Playback playback(CHANNELS, capacity, SAMPLE_RATE);
+    VirtualDevice device(playback, frames);
+    std::mt19937_64 random(1);
+    size_t total = clip.size() / CHANNELS, written = 0;
+    UInt64 period = (UInt64)(frames * 1e9 / SAMPLE_RATE);
+    UInt64 nextCycle = period, writerWake = 0, wakeups = 0;
+    bool paused = pauseNs == 0, drained = false;
+
+    while(!drained || playback.stats().queued > 0){
+        if(!drained && writerWake <= nextCycle){
+            UInt64 now = writerWake;
+            wakeups++;
+            size_t until = paused ? total : total / 2;
+            written += playback.write(&clip[written * CHANNELS], until - written);
+            UInt64 delay;
+            if(written == total){
+                playback.drain();
+                drained = true;
+                continue;
+            } else if(written == until){
+                delay = pauseNs;
+                paused = true;
+            } else {
+                delay = playback.retryDelay(until - written);
+            }
+            if(wakeDelayNs > 0) delay += random() % wakeDelayNs;
+            writerWake = now + (delay > 0 ? delay : 1);
+        } else {
+            device.cycle();
+            nextCycle += period;
+        }
+    }
+    device.cycle();
+
+    VirtualRun run;
+    run.wakeups = wakeups;
+    run.stats = playback.stats();
+    run.silence = device.silence;
+    run.exact = !device.corrupt && device.next == total + 1;
+    return run;
+}
+
+int main(int argc, char** argv){
+    UInt32 frames = 512;
+    double seconds = 10;
+    UInt64 wakeDelayUs = 0;
+    Options options;
+    options.add("--frames", "N", frames)
+           .add("--seconds", "S", seconds)
+           .add("--wake-delay-us", "US", wakeDelayUs);
+    if(!options.parse(argc, argv)) return 2;
+    UInt64 wakeDelayNs = wakeDelayUs * 1000;
+    bool failed = false;
+    std::vector<Float32> clip = makeClip((size_t)(seconds * SAMPLE_RATE));
+
+    //Virtual time: a clip written in one call
+    printf("%.0f s clip, %u frames per IO cycle, writer oversleeping up to %llu us, virtual time\n\n",
+           seconds, frames, (unsigned long long)wakeDelayUs);
+    printf("%10s %10s %12s %14s\n", "capacity", "underruns", "wakeups/s", "max latency ms");
+    const size_t capacities[] = { 256, 512, 1024, 2048, 4096, 16384 };
+    for(size_t capacity : capacities){
+        VirtualRun run = runVirtual(capacity, frames, clip, 0, wakeDelayNs);
+        printf("%10llu %10llu %12.1f %14.2f\n", (unsigned long long)run.stats.capacity,
+               (unsigned long long)run.stats.underruns, run.wakeups / seconds,
+               (run.stats.maxQueued + frames) * 1000.0 / SAMPLE_RATE);
+        if(!run.exact){
+            fprintf(stderr, "capacity %zu: the device did not play the clip exactly\n", capacity);
+            failed = true;
+        }
+        //Without scheduling delay, any ring holding a cycle and a half never runs short
+        if(wakeDelayNs == 0 && capacity >= frames * 3 / 2 && run.stats.underruns > 0){
+            fprintf(stderr, "capacity %zu: underruns with an exact writer\n", capacity);
+            failed = true;
+        }
+    }
+
+    //Virtual time: the writer pauses for 100 ms halfway
+    VirtualRun paused = runVirtual(4096, frames, clip, 100000000, wakeDelayNs);
+    printf("\nwriter paused 100 ms: %llu underruns, %llu frames of silence counted, %llu played\n",
+           (unsigned long long)paused.stats.underruns, (unsigned long long)paused.stats.silence,
+           (unsigned long long)paused.silence);
+    if(!paused.exact || paused.stats.underruns == 0 || paused.stats.silence != paused.silence){
+        fprintf(stderr, "underruns do not match the silence played\n");
+        failed = true;
+    }
+
+    //Cost of a write and an IO cycle
+    {
+        Playback playback(CHANNELS, 4 * frames, SAMPLE_RATE);
+        VirtualDevice device(playback, frames);
+        Result result = measure(NULL, 0.2, [&]{
+            playback.write(clip.data(), frames);
+            playback.process(NULL, device.list, frames, 0);
+        });
+        printf("\nwrite + IO cycle:  %10.1f ns/cycle %8.2f GB/s\n", result.nsPerCall,
+               frames * CHANNELS * sizeof(Float32) / result.nsPerCall);
+    }
+
+    //Realtime: the simulated HAL's IO thread as the consumer
+    hal::SimBackend sim;
+    hal::SimDeviceSpec spec;
+    spec.name = "Output";
+    spec.uid = "output";
+    spec.outChannels = CHANNELS;
+    AudioDeviceID deviceID = sim.addDevice(spec);
+    sim.setIOBufferFrames(frames);
+    hal::setBackend(&sim);
+    if(!init() || playbackEngine.start(deviceID, 4096) != CHANNELS){
+        fprintf(stderr, "could not play to the simulated output device\n");
+        return 1;
+    }
+    std::shared_ptr<Playback> playback = playbackEngine.find(deviceID);
+    size_t total = (size_t)(SAMPLE_RATE / 2), written = 0;
+    UInt64 wakeups = 0;
+    while(written < total){
+        written += playback->write(&clip[written * CHANNELS], total - written);
+        wakeups++;
+        if(written < total) std::this_thread::sleep_for(std::chrono::nanoseconds(playback->retryDelay(total - written)));
+    }
+    playback->drain();
+    while(playback->stats().queued > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    PlaybackStats stats = playback->stats();
+    printf("realtime, 0.5 s:   %llu played, %llu underruns, %llu writer wakeups, max latency %.2f ms\n",
+           (unsigned long long)stats.played, (unsigned long long)stats.underruns, (unsigned long long)wakeups,
+           (stats.maxQueued + stats.cycleFrames) * 1000.0 / SAMPLE_RATE);
+    if(stats.played != total){
+        fprintf(stderr, "the simulated device did not play the whole clip\n");
+        failed = true;
+    }
+    deinit();
+    hal::setBackend(NULL);
+    return failed ? 1 : 0;
+}
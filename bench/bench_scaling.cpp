@@ -0,0 +1,118 @@
+/*
+ * Scaling benchmark of the shared native caches.
+ *
+ * Runs 1 to 32 threads on the read paths every Python thread ends up
+ * in: the device registry snapshot, a cached channel map lookup and
+ * getVolumeForDevice(). The caches are published RCU-style, so with a
+ * zero latency HAL the aggregate rate should grow with the thread count
+ * up to the number of cores. A writer thread can hot-plug devices
+ * meanwhile (--hotplug-hz) to show the cost of invalidations.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_scaling [--seconds S] [--hotplug-hz N]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "channels.h"
+#include "registry.h"
+#include "hal_sim.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+
+/**
+ * Run [fn] on [threads] threads for [seconds] seconds.
+ *
+ * @result - calls per second, all threads together
+ */
+template <typename Fn>
+static double scale(unsigned threads, double seconds, Fn fn){
+    std::atomic<bool> running(true);
+    std::atomic<UInt64> total(0);
+    std::vector<std::thread> pool;
+    for(unsigned t = 0; t < threads; t++){
+        pool.push_back(std::thread([&, t]{
+            UInt64 calls = 0;
+            while(running.load(std::memory_order_relaxed)){
+                for(int i = 0; i < 64; i++) fn(t);
+                calls += 64;
+            }
+            total += calls;
+        }));
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    running = false;
+    for(std::thread &thread : pool) thread.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return total / elapsed;
+}
+
+int main(int argc, char** argv){
+    double seconds = 0.2;
+    double hotplugHz = 0;
+    Options options;
+    options.add("--seconds", "S", seconds)
+           .add("--hotplug-hz", "N", hotplugHz);
+    if(!options.parse(argc, argv)) return 2;
+
+    hal::SimBackend sim;
+    sim.populate(8, 2);
+    hal::setBackend(&sim);
+    if(!init()){
+        fprintf(stderr, "init() failed\n");
+        return 1;
+    }
+    DeviceSnapshot devices = deviceRegistry.snapshot();
+    std::vector<AudioDeviceID> ids;
+    for(const DeviceInfo &device : *devices) ids.push_back(device.id);
+
+    //Keeps adding and removing one device, every change invalidates the caches
+    std::atomic<bool> plugging(hotplugHz > 0);
+    std::thread plugger([&]{
+        AudioDeviceID added = 0;
+        while(plugging){
+            if(added == 0){
+                hal::SimDeviceSpec spec;
+                spec.name = "Hotplug";
+                spec.uid = "hotplug";
+                added = sim.addDevice(spec);
+            } else {
+                sim.removeDevice(added);
+                added = 0;
+            }
+            std::this_thread::sleep_for(std::chrono::duration<double>(1.0 / hotplugHz));
+        }
+        if(added != 0) sim.removeDevice(added);
+    });
+    if(hotplugHz <= 0) plugger.join();
+
+    printf("%u hardware threads, hot-plug %.0f Hz\n\n", std::thread::hardware_concurrency(), hotplugHz);
+    printf("%7s  %-20s %14s %9s\n", "threads", "operation", "calls/sec", "scaling");
+
+    const char* operations[] = { "registry snapshot", "channel map lookup", "getVolumeForDevice" };
+    for(int op = 0; op < 3; op++){
+        double baseline = 0;
+        for(unsigned threads = 1; threads <= 32; threads *= 2){
+            double rate = scale(threads, seconds, [&](unsigned t){
+                AudioDeviceID deviceID = ids[t % ids.size()];
+                switch(op){
+                    case 0: deviceRegistry.snapshot(); break;
+                    case 1: channelMaps.lookup(deviceID); break;
+                    default: getVolumeForDevice(deviceID); break;
+                }
+            });
+            if(baseline == 0) baseline = rate;
+            printf("%7u  %-20s %14.0f %8.2fx\n", threads, operations[op], rate, rate / baseline);
+        }
+    }
+
+    if(hotplugHz > 0){
+        plugging = false;
+        plugger.join();
+    }
+    deinit();
+    hal::setBackend(NULL);
+    return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Benchmark of the call statistics (stats.h).
+ *
+ * The cost of the instrumentation is measured three ways against the
+ * simulated HAL without latency: a HAL call through the counted
+ * shorthand next to the same call straight on the backend, the
+ * bookkeeping of a HAL call on its own, and the timer of a public entry
+ * point on its own. Each should stay under 50 ns. Then the counts are
+ * checked: after a reset, the HAL calls counted must match the ones the
+ * simulated HAL served, entry points must be counted once however they
+ * nest, about one call in stats::TIMED_EVERY must be timed, failed calls
+ * must show up under their OSStatus, and the shards of several threads,
+ * some of which ended, must merge to the total.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_stats [--seconds S] [--threads N]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "hal_sim.h"
+#include "stats.h"
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+static const AudioObjectPropertyAddress VOLUME = {
+    kAudioDevicePropertyVolumeScalar, kAudioDevicePropertyScopeOutput, 1
+};
+
+/**
+ * Best of a few runs of [fn], the least disturbed by the rest of the system.
+ */
+template <typename Fn>
+static double best(double seconds, Fn fn){
+    double ns = 0;
+    for(int run = 0; run < 5; run++){
+        Result result = measure(NULL, seconds / 5, fn);
+        if(run == 0 || result.nsPerCall < ns) ns = result.nsPerCall;
+    }
+    return ns;
+}
+
+/**
+ * Sum of the HAL calls counted, over every call and selector.
+ */
+static UInt64 halCalls(const stats::Snapshot &snapshot){
+    UInt64 calls = 0;
+    for(auto &entry : snapshot.hal) calls += entry.second.calls;
+    return calls;
+}
+
+int main(int argc, char** argv){
+    double seconds = 0.5;
+    int threads = 4;
+    Options options;
+    options.add("--seconds", "S", seconds)
+           .add("--threads", "N", threads);
+    if(!options.parse(argc, argv)) return 2;
+    bool failed = false;
+
+    hal::SimBackend sim;
+    hal::SimDeviceSpec spec;
+    spec.name = "Speaker";
+    spec.uid = "speaker";
+    AudioDeviceID deviceID = sim.addDevice(spec);
+    sim.setDefaultOutputDevice(deviceID);
+    hal::setBackend(&sim);
+    if(!init()){
+        fprintf(stderr, "could not initialize\n");
+        return 1;
+    }
+
+    //Overhead per call
+    Float32 volume;
+    UInt32 size = sizeof(volume);
+    hal::Backend* backend = hal::backend();
+    double bare = best(seconds, [&]{ backend->getPropertyData(deviceID, &VOLUME, 0, NULL, &size, &volume); });
+    double counted = best(seconds, [&]{ hal::getPropertyData(deviceID, &VOLUME, 0, NULL, &size, &volume); });
+    double record = best(seconds, [&]{
+        stats::recordHal(stats::HAL_GET_PROPERTY_DATA, kAudioDevicePropertyVolumeScalar, stats::begin(), noErr);
+    });
+    double api = best(seconds, [&]{ stats::ApiCall call(stats::API_GET_VOLUME); });
+    printf("%-34s %10s\n", "", "ns/call");
+    printf("%-34s %10.1f\n", "getPropertyData on the backend", bare);
+    printf("%-34s %10.1f\n", "getPropertyData counted", counted);
+    printf("%-34s %10.1f\n", "  difference", counted - bare);
+    printf("%-34s %10.1f\n", "HAL call bookkeeping alone", record);
+    printf("%-34s %10.1f\n", "entry point timer alone", api);
+    if(record >= 50 || api >= 50){
+        fprintf(stderr, "instrumentation costs 50 ns/call or more\n");
+        failed = true;
+    }
+
+    //Counts match what the simulated HAL served
+    stats::reset();
+    sim.resetCallCount();
+    const int calls = 1000;
+    for(int i = 0; i < calls; i++){
+        setVolumeForDevice(deviceID, i % 100);
+        getVolume();
+    }
+    UInt32 devices[] = { deviceID, deviceID, deviceID };
+    UInt8 results[3];
+    getVolumeForDevices(devices, 3, results);
+    stats::Snapshot snapshot = stats::read();
+    UInt64 served = sim.callCount();
+    bool matched = halCalls(snapshot) == served
+                && snapshot.api[stats::API_SET_VOLUME_FOR_DEVICE].calls == (UInt64)calls
+                && snapshot.api[stats::API_GET_VOLUME].calls == (UInt64)calls
+                && snapshot.api[stats::API_GET_VOLUME_FOR_DEVICE].calls == 0
+                && snapshot.api[stats::API_GET_VOLUME_FOR_DEVICES].calls == 1;
+    const stats::Timing &timing = snapshot.api[stats::API_GET_VOLUME];
+    UInt64 bucketed = 0;
+    for(UInt32 b = 0; b < stats::BUCKETS; b++) bucketed += timing.buckets[b];
+    double share = (double)timing.timed / timing.calls * stats::TIMED_EVERY;
+    matched = matched && bucketed == timing.timed && share > 0.7 && share < 1.3;
+    printf("\ncounted %llu HAL calls, the simulated HAL served %llu: %s\n", (unsigned long long)halCalls(snapshot),
+           (unsigned long long)served, matched ? "match" : "MISMATCH");
+    if(!matched) failed = true;
+
+    //Failed calls by OSStatus
+    stats::reset();
+    const AudioDeviceID missing = 0xdead;
+    for(int i = 0; i < 10; i++) hal::getPropertyData(missing, &VOLUME, 0, NULL, &size, &volume);
+    snapshot = stats::read();
+    std::pair<UInt32, AudioObjectPropertySelector> key(stats::HAL_GET_PROPERTY_DATA, kAudioDevicePropertyVolumeScalar);
+    bool errors = snapshot.errors.size() == 1 && snapshot.errors[kAudioHardwareBadObjectError] == 10
+               && snapshot.hal[key].errors == 10 && snapshot.api[stats::API_GET_VOLUME].calls == 0;
+    printf("failed calls by OSStatus:          %s\n", errors ? "counted" : "NOT counted");
+    if(!errors) failed = true;
+
+    //Shards of several threads, run twice so the second round reuses the shards of the first
+    stats::reset();
+    const int perThread = 20000;
+    for(int round = 0; round < 2; round++){
+        std::vector<std::thread> workers;
+        for(int t = 0; t < threads; t++){
+            workers.push_back(std::thread([&]{
+                Float32 value;
+                UInt32 valueSize = sizeof(value);
+                for(int i = 0; i < perThread; i++) hal::getPropertyData(deviceID, &VOLUME, 0, NULL, &valueSize, &value);
+            }));
+        }
+        for(std::thread &worker : workers) worker.join();
+    }
+    snapshot = stats::read();
+    bool merged = snapshot.hal[key].calls == (UInt64)threads * perThread * 2;
+    printf("%d threads, twice:                 %s\n", threads, merged ? "merged" : "NOT merged");
+    if(!merged) failed = true;
+
+    deinit();
+    hal::setBackend(NULL);
+    return failed ? 1 : 0;
+}
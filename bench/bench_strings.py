@@ -0,0 +1,93 @@
+"""
+Device string benchmark, against the simulated HAL.
+
+Measures ns and Python allocations per device of the string attributes
+(name, manufacturer, uid) on two sets of device names: ASCII names,
+which CoreFoundation exposes directly (CFStringGetCStringPtr), and
+non-ASCII names, which have to be copied out first. Each is read through
+fresh Device objects (one HAL call per string) and through getDevices()
+served from the warm device registry (no HAL calls).
+
+Fails with status 1 if repeated reads do not return the very same str
+objects, or if the CFStrings handed out by the simulated HAL are not all
+released again.
+
+Build the module first (`python3 setup.py build` on a non-macOS host),
+then run `python3 bench/bench_strings.py [--devices N]`.
+"""
+import argparse
+import glob
+import os
+import sys
+import time
+import tracemalloc
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = glob.glob(os.path.join(ROOT, "build", "lib*"))
+import CoreAudio
+
+if not hasattr(CoreAudio, "_simPopulate"):
+    sys.exit("CoreAudio was not built against the simulated HAL")
+
+
+def device_strings():
+    return [(device.name, device.manufacturer, device.uid) for device in CoreAudio.listDevices()]
+
+
+def registry_strings():
+    return [device[:3] for device in CoreAudio.getDevices()]
+
+
+def measure(read, devices, rounds):
+    read()  #warm-up, fills the string cache
+    start = time.perf_counter()
+    for _ in range(rounds):
+        read()
+    ns = (time.perf_counter() - start) / rounds / devices * 1e9
+
+    tracemalloc.start()
+    read()
+    before = tracemalloc.take_snapshot()
+    first = read()
+    after = tracemalloc.take_snapshot()
+    tracemalloc.stop()
+    stats = after.compare_to(before, "filename")
+    blocks = sum(stat.count_diff for stat in stats if stat.count_diff > 0)
+    return ns, blocks / devices, first
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--devices", type=int, default=40)
+    parser.add_argument("--rounds", type=int, default=200)
+    options = parser.parse_args()
+
+    CoreAudio._simPopulate(options.devices)
+    if not CoreAudio.init():
+        sys.exit("init() failed")
+    references = CoreAudio._simStringReferences()
+    failures = []
+
+    print("%d devices" % options.devices)
+    print("%-10s %-14s %10s %14s" % ("names", "read through", "ns/device", "blocks/device"))
+    for label in ("ASCII", "non-ASCII"):
+        if label == "non-ASCII":
+            for index, deviceID in enumerate(CoreAudio.listDeviceIDs()):
+                CoreAudio._simSetDeviceName(deviceID, "Lautsprecher äöü %d" % index)
+        for source, read in (("Device", device_strings), ("getDevices()", registry_strings)):
+            ns, blocks, first = measure(read, options.devices, options.rounds)
+            print("%-10s %-14s %10.0f %14.2f" % (label, source, ns, blocks))
+            again = read()
+            if any(a is not b for old, new in zip(first, again) for a, b in zip(old, new)):
+                failures.append("%s strings through %s are not interned" % (label, source))
+
+    if CoreAudio._simStringReferences() != references:
+        failures.append("CFString references went from %d to %d" % (references, CoreAudio._simStringReferences()))
+    CoreAudio.deinit()
+    if failures:
+        print("%d failures, first: %s" % (len(failures), failures[0]))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
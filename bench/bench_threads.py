@@ -0,0 +1,136 @@
+"""
+Multi-threaded throughput and stress test, against the simulated HAL.
+
+Runs 1-32 Python threads hammering the module while the simulated HAL
+takes --latency-us per call. --workload picks the calls: "mixed" is
+getVolume/setVolume and the *ForDevice calls, "reads" only the getters
+and "devices" getDevices()/listDeviceIDs(). Every call releases the GIL
+while it waits on the HAL, so throughput should scale with the thread
+count until the HAL itself saturates. On a free-threaded build, the
+module runs without the GIL and "--latency-us 0" shows how the cached
+paths scale across cores. Results are checked along the way; any out of
+range value or exception makes the script exit with status 1.
+
+Build the module first (`python3 setup.py build` on a non-macOS host),
+then run `python3 bench/bench_threads.py [--latency-us N] [--seconds S] [--workload W]`.
+"""
+import argparse
+import glob
+import os
+import sys
+import threading
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = glob.glob(os.path.join(ROOT, "build", "lib*"))
+import CoreAudio
+
+if not hasattr(CoreAudio, "_simPopulate"):
+    sys.exit("CoreAudio was not built against the simulated HAL")
+
+
+def mixed(index, ids, deadline, counts, failures):
+    calls = 0
+    device = ids[index % len(ids)]
+    try:
+        while time.perf_counter() < deadline:
+            volume = 10 + (calls % 80)
+            if not CoreAudio.setVolume(volume):
+                failures.append("setVolume(%d) failed" % volume)
+            if not 0 <= CoreAudio.getVolume() <= 100:
+                failures.append("getVolume() out of range")
+            CoreAudio.setVolumeForDevice(device, volume)
+            if not 0 <= CoreAudio.getVolumeForDevice(device) <= 100:
+                failures.append("getVolumeForDevice() out of range")
+            CoreAudio.setMuteForDevice(device, calls % 2)
+            if CoreAudio.getMuteForDevice(device) not in (0, 1):
+                failures.append("getMuteForDevice() out of range")
+            calls += 6
+    except Exception as error:
+        failures.append(repr(error))
+    counts[index] = calls
+
+
+def reads(index, ids, deadline, counts, failures):
+    calls = 0
+    device = ids[index % len(ids)]
+    try:
+        while time.perf_counter() < deadline:
+            if not 0 <= CoreAudio.getVolume() <= 100:
+                failures.append("getVolume() out of range")
+            if not 0 <= CoreAudio.getVolumeForDevice(device) <= 100:
+                failures.append("getVolumeForDevice() out of range")
+            if CoreAudio.getMuteForDevice(device) not in (0, 1):
+                failures.append("getMuteForDevice() out of range")
+            calls += 3
+    except Exception as error:
+        failures.append(repr(error))
+    counts[index] = calls
+
+
+def devices(index, ids, deadline, counts, failures):
+    calls = 0
+    try:
+        while time.perf_counter() < deadline:
+            if len(CoreAudio.getDevices()) != len(ids):
+                failures.append("getDevices() lost devices")
+            if len(CoreAudio.listDeviceIDs()) != len(ids):
+                failures.append("listDeviceIDs() lost devices")
+            calls += 2
+    except Exception as error:
+        failures.append(repr(error))
+    counts[index] = calls
+
+
+WORKLOADS = {"mixed": mixed, "reads": reads, "devices": devices}
+
+
+def run(workload, threads, ids, seconds):
+    counts = [0] * threads
+    failures = []
+    deadline = time.perf_counter() + seconds
+    pool = [threading.Thread(target=workload, args=(i, ids, deadline, counts, failures))
+            for i in range(threads)]
+    start = time.perf_counter()
+    for thread in pool:
+        thread.start()
+    for thread in pool:
+        thread.join()
+    return sum(counts) / (time.perf_counter() - start), failures
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--latency-us", type=float, default=50.0)
+    parser.add_argument("--seconds", type=float, default=1.0)
+    parser.add_argument("--devices", type=int, default=8)
+    parser.add_argument("--workload", choices=sorted(WORKLOADS), default="mixed")
+    options = parser.parse_args()
+
+    CoreAudio._simPopulate(options.devices)
+    CoreAudio._simSetLatency(int(options.latency_us * 1000))
+    if not CoreAudio.init():
+        sys.exit("init() failed")
+    ids = [device[7] for device in CoreAudio.getDevices()]
+
+    gil = sys._is_gil_enabled() if hasattr(sys, "_is_gil_enabled") else True
+    print("HAL latency %.1f us, %d devices, %s workload, GIL %s, %d CPUs"
+          % (options.latency_us, len(ids), options.workload, "enabled" if gil else "disabled", os.cpu_count()))
+    print("%7s %14s %9s" % ("threads", "calls/s", "scaling"))
+    baseline = None
+    failed = []
+    for threads in (1, 2, 4, 8, 16, 32):
+        throughput, failures = run(WORKLOADS[options.workload], threads, ids, options.seconds)
+        baseline = baseline or throughput
+        print("%7d %14.0f %8.2fx" % (threads, throughput, throughput / baseline))
+        failed += failures
+
+    CoreAudio.deinit()
+    CoreAudio._simSetLatency(0)
+    if failed:
+        print("%d failures, first: %s" % (len(failed), failed[0]))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,199 @@
+/*
+ * Benchmark of the event tracing (trace.h).
+ *
+ * Reports the cost of a traced scope while not tracing, which should be
+ * a branch, and while tracing. Then traces a simulated workload, a
+ * volume storm from several threads while devices are hot-plugged, and
+ * checks the file dump() writes: every line an event, the begin and end
+ * events of each thread balanced and in time order, HAL calls, listener
+ * callbacks and entry points all present. The same is checked with rings
+ * too small for the workload, which must drop the oldest events cleanly,
+ * and with fewer rings than threads, where the threads left over must
+ * record nothing and be counted as untraced.
+ *
+ * Build with `python3 setup.py build_bench`, then run
+ * `build/bench/bench_trace [--seconds S] [--threads N] [--out PATH]`.
+ */
+#include "bench.h"
+#include "audio.h"
+#include "hal_sim.h"
+#include "trace.h"
+#include <atomic>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TraceCheck {
+    long events;
+    long begins;
+    long ends;
+    unsigned long untraced;     //threads that found no ring
+    size_t threads;             //threads with events
+    std::map<std::string, long> categories;
+    bool wellFormed;
+};
+
+/**
+ * Read back a file written by trace::dump(), one event per line.
+ */
+static TraceCheck check(const std::string &path){
+    TraceCheck result = { 0, 0, 0, 0, 0, std::map<std::string, long>(), true };
+    FILE* file = fopen(path.c_str(), "r");
+    if(!file){
+        result.wellFormed = false;
+        return result;
+    }
+    std::map<unsigned int, long> depths;
+    std::map<unsigned int, double> last;
+    char line[512];
+    bool first = true, closed = false;
+    while(fgets(line, sizeof(line), file)){
+        if(first){
+            int end = 0;
+            result.wellFormed = sscanf(line, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"untracedThreads\":%lu},\"traceEvents\":[%n",
+                                       &result.untraced, &end) == 1 && end > 0;
+            first = false;
+            continue;
+        }
+        if(strcmp(line, "]}\n") == 0){
+            closed = true;
+            continue;
+        }
+        if(strstr(line, "\"ph\":\"M\"")) continue;
+        const char* tid = strstr(line, "\"tid\":");
+        const char* ts = strstr(line, "\"ts\":");
+        unsigned int thread;
+        double time;
+        if(!tid || !ts || sscanf(tid, "\"tid\":%u", &thread) != 1 || sscanf(ts, "\"ts\":%lf", &time) != 1){
+            result.wellFormed = false;
+            continue;
+        }
+        if(last.count(thread) && time < last[thread]) result.wellFormed = false;
+        last[thread] = time;
+        result.events++;
+        if(strstr(line, "\"ph\":\"B\"")){
+            result.begins++;
+            depths[thread]++;
+            const char* cat = strstr(line, "\"cat\":\"");
+            if(cat){
+                cat += 7;
+                result.categories[std::string(cat, strchr(cat, '"') - cat)]++;
+            }
+        }
+        else if(strstr(line, "\"ph\":\"E\"")){
+            result.ends++;
+            if(--depths[thread] < 0) result.wellFormed = false;
+        }
+        else result.wellFormed = false;
+    }
+    fclose(file);
+    for(auto &entry : depths){
+        if(entry.second != 0) result.wellFormed = false;
+    }
+    result.wellFormed = result.wellFormed && closed;
+    result.threads = last.size();
+    return result;
+}
+
+/**
+ * Trace a volume storm on [devices] from [threads] threads while the
+ * main thread hot-plugs a device, for about [seconds].
+ */
+static void storm(hal::SimBackend &sim, const std::vector<AudioDeviceID> &devices, int threads, double seconds){
+    std::atomic<bool> running(true);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; t++){
+        workers.push_back(std::thread([&, t]{
+            int volume = t;
+            while(running.load()){
+                for(AudioDeviceID deviceID : devices) setVolumeForDevice(deviceID, volume++ % 100);
+                getVolume();
+            }
+        }));
+    }
+    hal::SimDeviceSpec spec;
+    spec.name = "USB Headset";
+    spec.uid = "usb-headset";
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now()
+                                              + std::chrono::microseconds((long)(seconds * 1e6));
+    std::vector<DeviceInfo> listed;
+    while(std::chrono::steady_clock::now() < end){
+        AudioDeviceID plugged = sim.addDevice(spec);
+        sim.flushNotifications();
+        getDevices(listed);
+        sim.removeDevice(plugged);
+        sim.flushNotifications();
+    }
+    running = false;
+    for(std::thread &worker : workers) worker.join();
+}
+
+int main(int argc, char** argv){
+    double seconds = 0.2;
+    int threads = 4;
+    std::string out = "bench_trace.json";
+    Options options;
+    options.add("--seconds", "S", seconds)
+           .add("--threads", "N", threads)
+           .add("--out", "PATH", out);
+    if(!options.parse(argc, argv)) return 2;
+    bool failed = false;
+
+    hal::SimBackend sim;
+    std::vector<AudioDeviceID> devices;
+    for(int i = 0; i < 4; i++){
+        hal::SimDeviceSpec spec;
+        spec.name = "Speaker " + std::to_string(i + 1);
+        spec.uid = "speaker-" + std::to_string(i + 1);
+        devices.push_back(sim.addDevice(spec));
+    }
+    sim.setDefaultOutputDevice(devices[0]);
+    hal::setBackend(&sim);
+    if(!init()){
+        fprintf(stderr, "could not initialize\n");
+        return 1;
+    }
+
+    //Cost of a traced scope
+    Result off = measure(NULL, seconds, []{ trace::Scope scope(trace::CATEGORY_API, "bench", 1, 2); });
+    trace::start(1 << 12, 1);
+    Result on = measure(NULL, seconds, []{ trace::Scope scope(trace::CATEGORY_API, "bench", 1, 2); });
+    trace::stop();
+    printf("%-26s %10s\n", "", "ns/scope");
+    printf("%-26s %10.1f\n", "not tracing", off.nsPerCall);
+    printf("%-26s %10.1f\n", "tracing (2 events)", on.nsPerCall);
+
+    //A volume storm while devices come and go
+    printf("\n%-10s %6s %10s %10s %10s %10s %10s %9s %8s\n", "ring", "rings", "events", "hal", "listener", "api",
+           "python", "untraced", "file");
+    //The storm threads, this one, the HAL's notification thread and the fan-out workers
+    const size_t enough = (size_t)threads + 16;
+    const struct { size_t capacity, rings; } runs[] = { { 1 << 16, enough }, { 64, enough }, { 1 << 16, 2 } };
+    for(const auto &run : runs){
+        trace::start(run.capacity, run.rings);
+        storm(sim, devices, threads, seconds);
+        trace::stop();
+        long written = trace::dump(out);
+        TraceCheck result = check(out);
+        bool complete = written > 0 && result.events == written && result.begins == result.ends
+                     && result.categories["hal"] > 0 && result.categories["api"] > 0;
+        //Large rings keep the listener callbacks of the whole run, small ones only the last events
+        if(run.capacity > 64 && run.rings == enough) complete = complete && result.categories["listener"] > 0;
+        else complete = complete && (size_t)written <= run.capacity * run.rings;
+        //Every thread gets a ring if there are enough, otherwise the rest is counted
+        if(run.rings == enough) complete = complete && result.untraced == 0;
+        else complete = complete && result.threads <= run.rings && result.untraced > 0;
+        printf("%-10zu %6zu %10ld %10ld %10ld %10ld %10ld %9lu %8s\n", run.capacity, run.rings, written,
+               result.categories["hal"], result.categories["listener"], result.categories["api"],
+               result.categories["python"], result.untraced, result.wellFormed && complete ? "ok" : "BROKEN");
+        if(!result.wellFormed || !complete) failed = true;
+    }
+    printf("\nlast trace written to %s\n", out.c_str());
+
+    deinit();
+    hal::setBackend(NULL);
+    return failed ? 1 : 0;
+}
@@ -1,220 +1,40 @@
 #define PYCOREAUDIO_MODULE
 #include <Python.h>
-#include <CoreAudio/CoreAudio.h>
-#include <stdio.h>
+#include "src/audio.h"
+#include "src/registry.h"
+#include "src/channels.h"
+#include "src/devcache.h"
+#include "src/events.h"
+#include "src/fade.h"
+#include "src/workers.h"
+#include "src/meter.h"
+#include "src/capture.h"
+#include "src/playback.h"
+#include "src/convert.h"
+#include "src/stats.h"
+#include "src/trace.h"
+#ifdef PYCOREAUDIO_SIMULATED_HAL
+    #include "src/hal_sim.h"
+#endif
+#include <deque>
+#include <map>
+#include <memory>
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <vector>
-#include <numeric>
 #include <string>
-#include <iostream>
 
 #ifndef __cplusplus
     #error "C++ required"
 #endif
 
 #define PyBool_FromBool(b) PyBool_FromLong((b) ? 1 : 0)
+//Traces the module function it is used in while tracing, named without the PyCoreAudio_ prefix
+#define TRACE_ENTRY() trace::Scope traceScope(trace::CATEGORY_PYTHON, __func__ + sizeof("PyCoreAudio_") - 1)
 extern const char* MOD_DOCSTR;
 
-namespace properties {
-    //Volume control
-    const AudioObjectPropertyAddress volume = {
-        kAudioDevicePropertyVolumeScalar, //mSelector
-        kAudioDevicePropertyScopeOutput, //mScope
-        0 //mElement
-    };
-    //Mute control
-    const AudioObjectPropertyAddress mute = { 
-        kAudioDevicePropertyMute,
-        kAudioDevicePropertyScopeOutput,
-        0
-    };
-    //Default output device
-    const AudioObjectPropertyAddress defaultOutputDevice = {
-        kAudioHardwarePropertyDefaultOutputDevice,
-        kAudioObjectPropertyScopeGlobal,
-        kAudioObjectPropertyElementMain //kAudioObjectPropertyElementMaster - deprecated since Monterey
-    };
-    //Devices count
-    const AudioObjectPropertyAddress count = {
-        kAudioHardwarePropertyDevices,
-        kAudioObjectPropertyScopeGlobal,
-        kAudioObjectPropertyElementMain
-    }; 
-    //Device name
-    const AudioObjectPropertyAddress name = {
-        kAudioDevicePropertyDeviceNameCFString,
-        kAudioObjectPropertyScopeGlobal,
-        kAudioObjectPropertyElementMain
-    };
-    
-    //Device manufacturer
-    const AudioObjectPropertyAddress manufacturer = {
-        kAudioDevicePropertyDeviceManufacturerCFString,
-        kAudioObjectPropertyScopeGlobal,
-        kAudioObjectPropertyElementMain
-    };
-    //Device input streams
-    const AudioObjectPropertyAddress instreams = {
-        kAudioDevicePropertyStreams,
-        kAudioDevicePropertyScopeInput,
-        0
-    };
-    //Device output streams
-    const AudioObjectPropertyAddress outstreams = {
-        kAudioDevicePropertyStreams,
-        kAudioDevicePropertyScopeOutput,
-        0
-    };
-    //Device UID
-    const AudioObjectPropertyAddress uid = {
-        kAudioDevicePropertyDeviceUID,
-        kAudioDevicePropertyScopeOutput,
-        0
-    };
-};
-
-/* -----------------------------Globals----------------------------------- */
-AudioDeviceID defaultOutputDeviceID = 0;                //ID of the default output device
-std::vector<int> validChannelsForDefaultDevice;         //List of valid channels for the default output device
-bool initialized = false;                               //Just to know wheather we got the default device ID
-/* ----------------------------------------------------------------------- */
-
-
-/* ---------------------------C++ Interface------------------------------- */
-
-/**
- * Get a list of valid channels for the default output device.
- * If deviceID is NULL, it will be set to the default output device.
- *
- * @param deviceID - output device
- * @param maxFailures - number of errors after which the scan is stopped
- * @result - list (vector) of valid channels
- */
-std::vector<int> getValidChannels(AudioDeviceID *deviceID = NULL, int maxFailures = 3){
-    std::vector<int> validChannels;
-    if(deviceID == NULL) deviceID = &defaultOutputDeviceID;
-
-    //During the check we'll be trying to see if the channel has a
-    //volume level property
-    AudioObjectPropertyAddress propertyAddress = properties::volume;
-
-    int channel = 0, errors = 0;
-    while(errors < maxFailures){
-        //Cycle trough channels until the last [maxFailures] channels
-        //are invalid
-        propertyAddress.mElement = channel;
-        if(AudioObjectHasProperty(*deviceID, &propertyAddress)){
-            //Channel is valid, add it to the list
-            validChannels.push_back(channel);
-        } else errors++;
-        channel++;
-    }
-    return validChannels;
-}
-
-bool init(){
-    UInt32 dataSize = sizeof(AudioDeviceID);
-    //Find the default output device
-    OSStatus result = AudioObjectGetPropertyData(kAudioObjectSystemObject,
-                                                 &properties::defaultOutputDevice,
-                                                 0, NULL,
-                                                 &dataSize, &defaultOutputDeviceID);
-    //if(result != kAudioHardwareNoError) return false;
-    if(result != kAudioHardwareNoError) {
-    printf("Error getting default output device: %d\n", result);
-    return false;
-}
-    //Get a list of valid channels
-    validChannelsForDefaultDevice = getValidChannels(&defaultOutputDeviceID);
-    //if(validChannelsForDefaultDevice.size() == 0) return false;   防止设备是多输出设备时出错
-    initialized = true;
-    return initialized;
-}
-
-/**
- * Deinitialize the library.
- */
-void deinit(){
-    defaultOutputDeviceID = 0;
-    validChannelsForDefaultDevice.clear();
-    initialized = false;
-}
-
-/**
- * Set a property of the default output device.
- * This function is universal, thus it can be used to
- * set volume level or set the mute state.
- * 
- * This is an internal function, which will not be
- * accessible from Python.
- *
- * @param data - buffer to read from (value to set)
- * @param propertyAddr - address of the property
- * @param channels - list of valid channels
- * @result - wheather the set failed or succeeded
- */
-template <typename UniversalDataType>
-bool setProperty(UniversalDataType data, AudioObjectPropertyAddress propertyAddr, std::vector<int> channels = validChannelsForDefaultDevice){
-    UInt32 dataSize = sizeof(data);
-
-    std::vector<bool> statuses;
-    OSStatus result;
-    for(std::vector<int>::size_type i = 0; i < channels.size(); i++) {
-        propertyAddr.mElement = channels[i];
-        result = AudioObjectSetPropertyData(defaultOutputDeviceID,
-                                            &propertyAddr,
-                                            0, NULL, dataSize, &data);
-        statuses.push_back(result == kAudioHardwareNoError);
-    }
-    bool error = !std::all_of(statuses.begin(), statuses.end(), [](bool v) { return v; });
-
-    return !error;
-}
-
-/**
- * Get the value of a property of the default output device.
- * This function is universal, thus it can be used to
- * get the volume level or get the mute state.
- * 
- * This is an internal function, which will not be
- * accessible from Python.
- *
- * @param buffer - buffer to write to (should be a vector)
- * @param propertyAddr - address of the property
- * @param channels - list of valid channels
- * @result - wheather the set failed or succeeded
- */
-template <typename UniversalDataType>
-bool getProperty(std::vector<UniversalDataType> &buffer, AudioObjectPropertyAddress propertyAddr, std::vector<int> channels = validChannelsForDefaultDevice){
-    UniversalDataType data;
-    UInt32 dataSize = sizeof(data);
-
-    std::vector<bool> statuses;
-    std::vector<UniversalDataType> dataCollection;
-    OSStatus result;
-    for(std::vector<int>::size_type i = 0; i < channels.size(); i++) {
-        propertyAddr.mElement = channels[i];
-        result = AudioObjectGetPropertyData(defaultOutputDeviceID,
-                                            &propertyAddr,
-                                            0, NULL, &dataSize, &data);
-        statuses.push_back(result == kAudioHardwareNoError);
-        if(result == kAudioHardwareNoError) {
-            dataCollection.push_back(data);
-        }
-    }
-    bool error = !std::all_of(statuses.begin(), statuses.end(), [](bool v) { return v; });
-    if(error) return false;
-
-    for(std::vector<int>::size_type i = 0; i < dataCollection.size(); i++){
-        buffer.push_back(dataCollection[i]);
-    }
-
-    return true;
-}
-
-/* ----------------------------------------------------------------------- */
-
-
 /* ---------------------Python Interface Helpers-------------------------- */
 
 /**
@@ -243,373 +63,733 @@ PyObject* cstring_to_pystr(const char* str){
 }
 
 /**
- * Set the mute state of the default output device.
- * 
- * @param state - muted/unmuted (1/0)
- * @result - wheather the set failed or succeeded
+ * Read fixed-width integer records, e.g. (deviceID, volume) pairs.
+ * Accepts either a buffer of 32 bit integers (array('i'), array('I'),
+ * numpy int32/uint32, ...) holding the records back to back, or a
+ * sequence of records. A record is a [width]-tuple, or a plain integer
+ * when [width] is 1. None inside a record reads as -1.
+ *
+ * @param obj - Python object to read
+ * @param width - number of integers per record
+ * @param out - buffer to write to, [width] integers per record
+ * @result - whether the object could be read, a Python exception is set otherwise
  */
-bool setMute(bool state){
-    //Sometimes we have to use channel 0, idk why                                                              v
-    return setProperty((UInt32)state, properties::mute) ? true : setProperty((UInt32)state, properties::mute, {0});
+bool parseIntRecords(PyObject* obj, Py_ssize_t width, std::vector<long long> &out){
+    if(PyObject_CheckBuffer(obj)){
+        Py_buffer view;
+        if(PyObject_GetBuffer(obj, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0) return false;
+        const char* format = view.format ? view.format : "B";
+        if(strchr("@=<>!", format[0])) format++;
+        bool isSigned = strcmp(format, "i") == 0 || (strcmp(format, "l") == 0 && view.itemsize == 4);
+        bool isUnsigned = strcmp(format, "I") == 0 || (strcmp(format, "L") == 0 && view.itemsize == 4);
+        Py_ssize_t count = view.len / 4;
+        if(view.itemsize != 4 || !(isSigned || isUnsigned) || count % width != 0){
+            PyBuffer_Release(&view);
+            PyErr_Format(PyExc_ValueError, "Expected a buffer of 32 bit integers in groups of %zd", width);
+            return false;
+        }
+        out.resize(count);
+        for(Py_ssize_t i = 0; i < count; i++){
+            out[i] = isSigned ? (long long)((const SInt32*)view.buf)[i] : (long long)((const UInt32*)view.buf)[i];
+        }
+        PyBuffer_Release(&view);
+        return true;
+    }
+
+    PyObject* records = PySequence_Fast(obj, "Expected a sequence or a buffer of 32 bit integers");
+    if(records == NULL) return false;
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(records);
+    out.resize(count * width);
+    for(Py_ssize_t i = 0; i < count; i++){
+        PyObject* record = PySequence_Fast_GET_ITEM(records, i);
+        PyObject* fields = NULL;
+        if(width == 1){
+            fields = PyTuple_Pack(1, record);
+        } else {
+            fields = PySequence_Fast(record, "Expected a sequence of tuples");
+        }
+        if(fields == NULL || PySequence_Fast_GET_SIZE(fields) != width){
+            if(fields != NULL) PyErr_Format(PyExc_ValueError, "Expected records of %zd values", width);
+            Py_XDECREF(fields);
+            Py_DECREF(records);
+            return false;
+        }
+        for(Py_ssize_t j = 0; j < width; j++){
+            PyObject* field = PySequence_Fast_GET_ITEM(fields, j);
+            long long value = field == Py_None ? -1 : PyLong_AsLongLong(field);
+            if(value == -1 && PyErr_Occurred()){
+                Py_DECREF(fields);
+                Py_DECREF(records);
+                return false;
+            }
+            out[i * width + j] = value;
+        }
+        Py_DECREF(fields);
+    }
+    Py_DECREF(records);
+    return true;
 }
 
-/**
- * Get the mute state of the default output device.
- * If the output device has multiple channels and they
- * are not all muted/unmuted then the mute state of the
- * last channel is returned.
+/* ----------------------------------------------------------------------- */
+
+/* -----------------------------Module state------------------------------ */
+/*
+ * Everything the module keeps that involves Python objects lives in the
+ * state of the module object, so every interpreter importing the module
+ * gets its own. The native caches behind it (device registry, channel
+ * maps, output state) stand for the one HAL of the process and are
+ * shared; they are thread-safe and never need the GIL.
  *
- * @result - mute state (0/1)
+ * Without a GIL (free-threaded builds), the module state is guarded by
+ * critical sections on the module object, and the memoized attributes
+ * of a Device by critical sections on the Device.
  */
-bool getMute(){
-    //Warning: Do NOT use bool vector, must be int!
-    std::vector<int> muteStates;
-    bool error = getProperty(muteStates, properties::mute) ? false : !getProperty(muteStates, properties::mute, {0});
-    if(error) return -1;
-
-    bool finalState = true;
-    for(int muteState_as_int : muteStates){
-        bool muteState = (bool)muteState_as_int;
-        finalState = finalState && muteState;
-    }
+#ifdef Py_BEGIN_CRITICAL_SECTION
+    #define BEGIN_LOCKED(object) Py_BEGIN_CRITICAL_SECTION(object)
+    #define END_LOCKED() Py_END_CRITICAL_SECTION()
+#else
+    //Before 3.13, the GIL does the job
+    #define BEGIN_LOCKED(object) {
+    #define END_LOCKED() }
+#endif
 
-    return finalState;
-}
+typedef std::pair<AudioDeviceID, AudioObjectPropertySelector> DeviceStringKey;
 
 /**
- * Get the volume level of the default output device.
- * If the output device has multiple channels and they
- * are set to a different volume level then the
- * averrage is returned.
- *
- * @result - volume level (0-100%) as int
+ * State of the *Async functions, see asyncSubmit().
  */
-int getVolume(){
-    std::vector<Float32> volumes;
-    bool error = !(getProperty(volumes, properties::volume));
-    if(error) return -1.0;
+struct AsyncState {
+    WorkerPool pool;                            //native threads running the calls
+    std::map<UInt64, PyObject*> futures;        //futures of submitted and backlogged jobs, by job ID
+    std::deque<AsyncJob> backlog;               //jobs waiting for room in the pool
+    PyObject* loop;                             //loop the result fd is registered with
+    UInt64 nextID;
+
+    AsyncState() : loop(NULL), nextID(1) {}
+};
 
-    Float32 volumeAvrg = std::accumulate(volumes.begin(), volumes.end(), 0.0f) / volumes.size();
-    int x = int(roundf(volumeAvrg * 100.0f));
-    return x;
+typedef struct {
+    PyObject* deviceType;                               //CoreAudio.Device
+    PyObject* captureBufferType;                        //CoreAudio.CaptureBuffer
+    PyObject* floatArray;                               //array('f', [0.0]), repeated into new float32 arrays
+    std::map<DeviceStringKey, PyObject*>* strings;      //see internDeviceString()
+    AsyncState* async;
+} ModuleState;
+
+static ModuleState* moduleState(PyObject* module){
+    return (ModuleState*)PyModule_GetState(module);
 }
+/* ----------------------------------------------------------------------- */
 
+
+/* ------------------------Python Interface------------------------------- */
 /**
- * Set the volume level of the default output device.
- *
- * @param volume_in_percent - volume level (0-100)
- * @result - wheather the set failed or succeeded
+ * Make sure the module is initialized, initializing it now unless lazy
+ * initialization is off (setLazyInit()). Sets an exception if it is not.
  */
-bool setVolume(int volume_in_percent){
-    Float32 volume = Float32(volume_in_percent) / 100;
-    return setProperty(volume, properties::volume);
+static bool requireInit(){
+    if(initialized.load(std::memory_order_acquire)) return true;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = ensureInitialized();
+    Py_END_ALLOW_THREADS
+    if(!ok) PyErr_SetString(PyExc_Exception, lazyInit ? "Could not initialize" : "Not initialized");
+    return ok;
 }
 
 /**
- * Set the volume level of a specified output device.
- *
- * @param deviceID - ID of the output device
- * @param volume_in_percent - volume level (0-100)
- * @result - whether the set failed or succeeded
+ * Make sure the device caches run, see requireInit(). Does not look up
+ * the default output device.
  */
-bool setVolumeForDevice(AudioDeviceID deviceID, int volume_in_percent) {
-    // 使用现有的 setProperty 函数来设置音量
-    Float32 volume = Float32(volume_in_percent) / 100;
-    AudioObjectPropertyAddress propertyAddr = properties::volume;
-    propertyAddr.mElement = 0; // 通常设置为通道 0
+static bool requireDevices(){
+    if(devicesStarted.load(std::memory_order_acquire)) return true;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = ensureDevices();
+    Py_END_ALLOW_THREADS
+    if(!ok) PyErr_SetString(PyExc_Exception, lazyInit ? "Could not initialize" : "Not initialized");
+    return ok;
+}
 
-    OSStatus result = AudioObjectSetPropertyData(deviceID, &propertyAddr, 0, NULL, sizeof(volume), &volume);
-    return (result == kAudioHardwareNoError);
+static PyObject* PyCoreAudio_init(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    if(initialized) Py_RETURN_TRUE;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = init();
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(ok);
 }
 
-/**
- * Get the volume level of a specified output device.
- *
- * @param deviceID - ID of the output device
- * @result - volume level (0-100) or -1 on error
- */
-int getVolumeForDevice(AudioDeviceID deviceID) {
-    Float32 volume;
-    UInt32 dataSize = sizeof(volume);
-    AudioObjectPropertyAddress propertyAddr = properties::volume;
-    propertyAddr.mElement = 0; // 通常设置为通道 0
+static PyObject* PyCoreAudio_ready(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyBool_FromBool(initialized);
+}
+
+static PyObject* PyCoreAudio_deinit(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    WorkerPool &pool = moduleState(self)->async->pool;
+    Py_BEGIN_ALLOW_THREADS
+    pool.stop();
+    deinit();
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject* PyCoreAudio_setDeviceCache(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    std::string path;
+    if(arg != Py_None){
+        PyObject* pathArg;
+        if(!PyUnicode_FSConverter(arg, &pathArg)) return NULL;
+        path = PyBytes_AS_STRING(pathArg);
+        Py_DECREF(pathArg);
+        if(path.empty()){
+            PyErr_SetString(PyExc_ValueError, "path must not be empty, use None to disable the cache");
+            return NULL;
+        }
+    }
+    deviceCache.setPath(path);
+    Py_RETURN_NONE;
+}
+
+static PyObject* PyCoreAudio_getDeviceCache(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    std::string path = deviceCache.path();
+    if(path.empty()) Py_RETURN_NONE;
+    return PyUnicode_DecodeFSDefaultAndSize(path.data(), path.size());
+}
+
+static PyObject* PyCoreAudio_waitDeviceCache(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    PyObject* timeoutArg = Py_None;
+    if(!PyArg_ParseTuple(args, "|O", &timeoutArg)) return NULL;
+    double timeout = -1;
+    if(timeoutArg != Py_None){
+        timeout = PyFloat_AsDouble(timeoutArg);
+        if(timeout == -1 && PyErr_Occurred()) return NULL;
+        if(timeout < 0){
+            PyErr_SetString(PyExc_ValueError, "timeout must not be negative");
+            return NULL;
+        }
+    }
+    bool done;
+    Py_BEGIN_ALLOW_THREADS
+    done = deviceCache.wait(timeout < 0 ? -1 : (int)(timeout * 1000));
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(done);
+}
+
+static PyObject* PyCoreAudio_setLazyInit(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    int state = PyObject_IsTrue(arg);
+    if(state < 0) return NULL;
+    lazyInit = state != 0;
+    Py_RETURN_NONE;
+}
+
+static PyObject* PyCoreAudio_getLazyInit(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyBool_FromBool(lazyInit);
+}
+
+static PyObject* PyCoreAudio_getValidChannels(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    if(!requireInit()) return NULL;
+    ChannelMapRef map;
+    Py_BEGIN_ALLOW_THREADS
+    map = channelMaps.lookup(outputState()->deviceID);
+    Py_END_ALLOW_THREADS
+    return intVectorToTuple(map->volume);
+}
 
-    OSStatus result = AudioObjectGetPropertyData(deviceID, &propertyAddr, 0, NULL, &dataSize, &volume);
-    if (result != kAudioHardwareNoError) {
-        return -1; // 失败
+static PyObject* PyCoreAudio_getSubDevices(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    if(!requireDevices()) return NULL;
+    AudioDeviceID deviceID;
+    if(!PyArg_ParseTuple(args, "I", &deviceID)) return NULL;
+    ChannelMapRef map;
+    Py_BEGIN_ALLOW_THREADS
+    map = channelMaps.lookup(deviceID);
+    Py_END_ALLOW_THREADS
+    PyObject* tuple = PyTuple_New(map->subDevices.size());
+    if(tuple == NULL) return NULL;
+    for(size_t i = 0; i < map->subDevices.size(); i++){
+        PyTuple_SET_ITEM(tuple, i, PyLong_FromUnsignedLong(map->subDevices[i]));
     }
+    return tuple;
+}
 
-    // 将音量转换为百分比
-    return static_cast<int>(roundf(volume * 100.0f));
+static PyObject* PyCoreAudio_getDeviceCount(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    if(!requireDevices()) return NULL;
+    int count;
+    Py_BEGIN_ALLOW_THREADS
+    count = getDeviceCount();
+    Py_END_ALLOW_THREADS
+    if(count < 0){
+        PyErr_SetString(PyExc_Exception, "Error getting devices from system");
+        return NULL;
+    }
+    return PyLong_FromLong((long)count);
 }
 
+/* ---------------------------Device strings------------------------------ */
+/*
+ * Python strings of device names, manufacturers and UIDs, interned per
+ * device and property. As long as a device reports the same text, every
+ * enumeration hands out the same str object instead of decoding a new
+ * one.
+ */
+
+//Strings of devices that are gone are only dropped beyond this many entries
+static const size_t MAX_DEVICE_STRINGS = 4096;
+
 /**
- * Set the mute status of a specified output device.
+ * Get the Python string of a device string property.
  *
- * @param deviceID - ID of the output device
- * @param mute - true to mute, false to unmute
- * @result - whether the set failed or succeeded
+ * @param module - the module, whose string cache to use
+ * @param deviceID - ID of the device
+ * @param selector - selector of the property
+ * @param data - UTF-8 text
+ * @param size - length of [data] in bytes
+ * @result - new reference, NULL with an exception set on error
  */
-bool setMuteForDevice(AudioDeviceID deviceID, bool mute) {
-    UInt32 muteValue = mute ? 1 : 0; // 将布尔值转换为整数
-    AudioObjectPropertyAddress propertyAddr = properties::mute;
-    propertyAddr.mElement = 0; // 通常设置为通道 0
+static PyObject* internDeviceString(PyObject* module, AudioDeviceID deviceID, AudioObjectPropertySelector selector,
+                                    const char* data, size_t size){
+    std::map<DeviceStringKey, PyObject*> &strings = *moduleState(module)->strings;
+    DeviceStringKey key(deviceID, selector);
+    PyObject* str = NULL;
+    BEGIN_LOCKED(module)
+    std::map<DeviceStringKey, PyObject*>::iterator entry = strings.find(key);
+    if(entry != strings.end()){
+        Py_ssize_t length;
+        const char* cached = PyUnicode_AsUTF8AndSize(entry->second, &length);
+        if(cached != NULL && (size_t)length == size && memcmp(cached, data, size) == 0){
+            str = entry->second;
+            Py_INCREF(str);
+        }
+        PyErr_Clear();
+    } else if(strings.size() >= MAX_DEVICE_STRINGS){
+        for(entry = strings.begin(); entry != strings.end(); ++entry) Py_DECREF(entry->second);
+        strings.clear();
+    }
 
-    OSStatus result = AudioObjectSetPropertyData(deviceID, &propertyAddr, 0, NULL, sizeof(muteValue), &muteValue);
-    return (result == kAudioHardwareNoError);
+    if(str == NULL){
+        str = PyUnicode_DecodeUTF8(data, (Py_ssize_t)size, "replace");
+        if(str != NULL){
+            PyObject*& slot = strings[key];
+            Py_XDECREF(slot);
+            Py_INCREF(str);
+            slot = str;
+        }
+    }
+    END_LOCKED()
+    return str;
 }
 
 /**
- * Get the mute status of a specified output device.
+ * Get the Python string of a CFString read from a device, see
+ * internDeviceString(). Releases [raw].
  *
- * @param deviceID - ID of the output device
- * @result - true if muted, false if not muted, or -1 on error
+ * @param raw - string as returned by copyDeviceString(), may be NULL
+ * @result - new reference, "Unknown" if [raw] is NULL or cannot be decoded
  */
-int getMuteForDevice(AudioDeviceID deviceID) {
-    UInt32 muteValue;
-    UInt32 dataSize = sizeof(muteValue);
-    AudioObjectPropertyAddress propertyAddr = properties::mute;
-    propertyAddr.mElement = 0; // 通常设置为通道 0
-
-    OSStatus result = AudioObjectGetPropertyData(deviceID, &propertyAddr, 0, NULL, &dataSize, &muteValue);
-    if (result != kAudioHardwareNoError) {
-        return -1; // 失败
+static PyObject* internDeviceString(PyObject* module, AudioDeviceID deviceID, AudioObjectPropertySelector selector,
+                                    CFStringRef raw){
+    static const char unknown[] = "Unknown";
+    if(raw == NULL) return internDeviceString(module, deviceID, selector, unknown, sizeof(unknown) - 1);
+    PyObject* str;
+    {
+        CFStringUTF8 utf8(raw);
+        str = utf8.valid() ? internDeviceString(module, deviceID, selector, utf8.data(), utf8.size())
+                           : internDeviceString(module, deviceID, selector, unknown, sizeof(unknown) - 1);
     }
-
-    return (muteValue == 1) ? 1 : 0; // 返回静音状态
+    CFRelease(raw);
+    return str;
 }
+/* ----------------------------------------------------------------------- */
 
-int getDeviceCount(){
-    UInt32 propSize;
-    AudioObjectGetPropertyDataSize(kAudioObjectSystemObject, &properties::count, 0, NULL, &propSize);
-    int deviceCount = propSize / sizeof(AudioDeviceID);
-    return deviceCount;
+/**
+ * Convert a device list to the tuple of tuples getDevices() returns.
+ */
+static PyObject* deviceListToTuple(PyObject* module, const std::vector<DeviceInfo> &devices){
+    PyObject* res = PyTuple_New(devices.size());
+    if(res == NULL) return NULL;
+    for(std::vector<DeviceInfo>::size_type i = 0; i < devices.size(); i++){
+        const DeviceInfo &device = devices[i];
+        bool isMic = device.inStreams > 0;
+        bool isSpeaker = device.outStreams > 0;
+
+        PyObject* name = internDeviceString(module, device.id, properties::name.mSelector, device.name.data(), device.name.size());
+        PyObject* manufacturer = internDeviceString(module, device.id, properties::manufacturer.mSelector,
+                                                    device.manufacturer.data(), device.manufacturer.size());
+        PyObject* uid = internDeviceString(module, device.id, properties::uid.mSelector, device.uid.data(), device.uid.size());
+        if(name == NULL || manufacturer == NULL || uid == NULL){
+            Py_XDECREF(name);
+            Py_XDECREF(manufacturer);
+            Py_XDECREF(uid);
+            Py_DECREF(res);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(res, i, Py_BuildValue("(N, N, N, i, i, N, N, i)",
+            name,
+            manufacturer,
+            uid,
+            device.inStreams,
+            device.outStreams,
+            PyBool_FromBool(isMic),
+            PyBool_FromBool(isSpeaker),
+            (int)device.id
+            ));
+    }
+    return res;
 }
 
-char* CFStringToCString(CFStringRef raw){
-    if(raw == NULL){
+static PyObject* PyCoreAudio_getDevices(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    if(!requireDevices()) return NULL;
+    DeviceSnapshot snapshot;
+    Py_BEGIN_ALLOW_THREADS
+    snapshot = deviceRegistry.snapshot();
+    Py_END_ALLOW_THREADS
+    if(!snapshot){
+        PyErr_SetString(PyExc_Exception, "Error getting devices from system");
+        PyErr_Occurred();
         return NULL;
     }
-    CFIndex length = CFStringGetLength(raw);
-    CFIndex maxSize = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8) + 1;
-    char* buffer = (char*)malloc(maxSize);
-    if(CFStringGetCString(raw, buffer, maxSize,
-                         kCFStringEncodingUTF8)){
-        return buffer;
-    }
-    free(buffer);
-    return NULL;
+
+    return deviceListToTuple(self, *snapshot);
 }
 
-std::string getDeviceName(AudioDeviceID device){
-    UInt32 propSize = sizeof(CFStringRef);
-    CFStringRef result;
-    OSStatus error = AudioObjectGetPropertyData(device, &properties::name, 0, NULL, &propSize, &result);
-    if(error != noErr){
-        return (std::string)"Unknown";
-    }
-    char* str = CFStringToCString(result);
-    if(str == NULL){
-        free(str);
-        return (std::string)"Unknown";
-    }
-    std::string name(str);
-    free(str);
-    return name;
+/* ---------------------------Device objects------------------------------ */
+/*
+ * CoreAudio.Device stands for one device by its ID. Nothing is queried
+ * when it is created; each attribute is fetched from the HAL the first
+ * time it is read and then kept on the object, so enumerating devices
+ * only pays for the attributes that are actually used.
+ */
+enum DeviceField {
+    DEVICE_NAME,
+    DEVICE_MANUFACTURER,
+    DEVICE_UID,
+    DEVICE_IN_STREAMS,
+    DEVICE_OUT_STREAMS,
+    DEVICE_CHANNELS,
+    DEVICE_FIELDS
+};
+
+typedef struct {
+    PyObject_HEAD
+    AudioDeviceID id;
+    PyObject* fields[DEVICE_FIELDS];    //memoized attributes, NULL until first read
+} DeviceObject;
+
+static PyObject* newDevice(PyTypeObject* type, AudioDeviceID deviceID){
+    DeviceObject* device = (DeviceObject*)type->tp_alloc(type, 0);
+    if(device == NULL) return NULL;
+    device->id = deviceID;
+    return (PyObject*)device;
 }
 
-std::string getDeviceManufacturer(AudioDeviceID device){
-    UInt32 propSize = sizeof(CFStringRef);
-    CFStringRef result;
-    OSStatus error = AudioObjectGetPropertyData(device, &properties::manufacturer, 0, NULL, &propSize, &result);
-    if(error != noErr){
-        return (std::string)"Unknown";
+/**
+ * Query a single attribute of a device.
+ *
+ * @param module - the module the Device belongs to
+ * @param deviceID - ID of the device
+ * @param field - one of DeviceField
+ * @result - new reference to the value, NULL with an exception set on error
+ */
+static PyObject* queryDeviceField(PyObject* module, AudioDeviceID deviceID, int field){
+    if(!requireDevices()) return NULL;
+    const Property<CFStringRef, ELEMENT_SINGLE>* stringProperty = &properties::name;
+    if(field == DEVICE_MANUFACTURER) stringProperty = &properties::manufacturer;
+    if(field == DEVICE_UID) stringProperty = &properties::uid;
+
+    CFStringRef text = NULL;
+    int number = 0;
+    ChannelMapRef map;
+    Py_BEGIN_ALLOW_THREADS
+    switch(field){
+        case DEVICE_NAME:
+        case DEVICE_MANUFACTURER:
+        case DEVICE_UID:            text = copyDeviceString(deviceID, *stringProperty); break;
+        case DEVICE_IN_STREAMS:     number = getDeviceStreamCount(deviceID, properties::instreams); break;
+        case DEVICE_OUT_STREAMS:    number = getDeviceStreamCount(deviceID, properties::outstreams); break;
+        case DEVICE_CHANNELS:       map = channelMaps.lookup(deviceID); break;
     }
-    char* str = CFStringToCString(result);
-    if(str == NULL){
-        free(str);
-        return (std::string)"Unknown";
+    Py_END_ALLOW_THREADS
+    switch(field){
+        case DEVICE_IN_STREAMS:
+        case DEVICE_OUT_STREAMS:
+            return PyLong_FromLong(number);
+        case DEVICE_CHANNELS:
+            return intVectorToTuple(map->volume);
+        default:
+            return internDeviceString(module, deviceID, stringProperty->mSelector, text);
     }
-    std::string name(str);
-    free(str);
-    return name;
 }
 
-std::string getDeviceUID(AudioDeviceID device){
-    UInt32 propSize = sizeof(CFStringRef);
-    CFStringRef result;
-    OSStatus error = AudioObjectGetPropertyData(device, &properties::uid, 0, NULL, &propSize, &result);
-    if(error != noErr){
-        return (std::string)"Unknown";
-    }
-    char* str = CFStringToCString(result);
-    if(str == NULL){
-        free(str);
-        return (std::string)"Unknown";
+/**
+ * Get a memoized attribute, querying it on first use.
+ *
+ * @result - new reference, NULL with an exception set on error
+ */
+static PyObject* deviceField(DeviceObject* self, int field){
+    PyObject* value;
+    BEGIN_LOCKED(self)
+    value = self->fields[field];
+    Py_XINCREF(value);
+    END_LOCKED()
+    if(value != NULL) return value;
+
+    PyObject* module = PyType_GetModule(Py_TYPE(self));
+    if(module == NULL) return NULL;
+    value = queryDeviceField(module, self->id, field);
+    if(value == NULL) return NULL;
+    BEGIN_LOCKED(self)
+    //Another thread may have resolved it meanwhile, the first one wins
+    if(self->fields[field] == NULL){
+        Py_INCREF(value);
+        self->fields[field] = value;
+    } else {
+        Py_DECREF(value);
+        value = self->fields[field];
+        Py_INCREF(value);
     }
-    std::string name(str);
-    free(str);
-    return name;
+    END_LOCKED()
+    return value;
 }
 
-int getDeviceStreamCount(AudioDeviceID device, AudioObjectPropertyAddress io_direction){
-    UInt32 dataSize = 0;
-    OSStatus error = AudioObjectGetPropertyDataSize(device, &io_direction, 0, NULL, &dataSize);
-    if(error != noErr){
-        return -1;
-    }
-    UInt32 streamCount = dataSize / sizeof(AudioStreamID);
-    return streamCount;
+static PyObject* Device_new(PyTypeObject* type, PyObject* args, PyObject* kwargs){
+    static const char* keywords[] = {"id", NULL};
+    unsigned int deviceID;
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "I", (char**)keywords, &deviceID)) return NULL;
+    return newDevice(type, deviceID);
 }
 
-/* ----------------------------------------------------------------------- */
+static void Device_dealloc(PyObject* self){
+    DeviceObject* device = (DeviceObject*)self;
+    for(int i = 0; i < DEVICE_FIELDS; i++) Py_CLEAR(device->fields[i]);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
 
+static PyObject* Device_getID(PyObject* self, void* _){
+    return PyLong_FromUnsignedLong(((DeviceObject*)self)->id);
+}
 
-/* ------------------------Python Interface------------------------------- */
-static PyObject* PyCoreAudio_init(PyObject* self, PyObject* _){
-    if(initialized){
-        PyErr_SetString(PyExc_Exception, "Already initialized");
-        PyErr_Occurred();
-        return NULL;
-    }
-    return PyBool_FromBool(init());
+static PyObject* Device_getField(PyObject* self, void* field){
+    return deviceField((DeviceObject*)self, (int)(intptr_t)field);
 }
 
-static PyObject* PyCoreAudio_ready(PyObject* self, PyObject* _){
-    return PyBool_FromBool(initialized);
+//isMic/isSpeaker, the closure is the stream count field they derive from
+static PyObject* Device_hasStreams(PyObject* self, void* field){
+    PyObject* streams = deviceField((DeviceObject*)self, (int)(intptr_t)field);
+    if(streams == NULL) return NULL;
+    bool hasStreams = PyLong_AsLong(streams) > 0;
+    Py_DECREF(streams);
+    return PyBool_FromBool(hasStreams);
 }
 
-static PyObject* PyCoreAudio_deinit(PyObject* self, PyObject* _){
-    if(!initialized){
-        PyErr_SetString(PyExc_Exception, "Not initialized");
-        PyErr_Occurred();
-        return NULL;
+static PyObject* Device_refresh(PyObject* self, PyObject* _){
+    DeviceObject* device = (DeviceObject*)self;
+    PyObject* dropped[DEVICE_FIELDS];
+    BEGIN_LOCKED(self)
+    for(int i = 0; i < DEVICE_FIELDS; i++){
+        dropped[i] = device->fields[i];
+        device->fields[i] = NULL;
     }
-    deinit();
+    END_LOCKED()
+    for(int i = 0; i < DEVICE_FIELDS; i++) Py_XDECREF(dropped[i]);
     Py_RETURN_NONE;
 }
 
-static PyObject* PyCoreAudio_getValidChannels(PyObject* self, PyObject* _){
-    if(!initialized){
-        PyErr_SetString(PyExc_Exception, "Not initialized");
-        PyErr_Occurred();
-        return NULL;
-    }
-    std::vector<int> channels = getValidChannels();
-    return intVectorToTuple(channels);
+static PyObject* Device_repr(PyObject* self){
+    DeviceObject* device = (DeviceObject*)self;
+    PyObject* name;
+    BEGIN_LOCKED(self)
+    name = device->fields[DEVICE_NAME];
+    Py_XINCREF(name);
+    END_LOCKED()
+    //Only show what is known already, a repr should not talk to the HAL
+    if(name == NULL) return PyUnicode_FromFormat("<CoreAudio.Device %u>", (unsigned int)device->id);
+    PyObject* repr = PyUnicode_FromFormat("<CoreAudio.Device %u %R>", (unsigned int)device->id, name);
+    Py_DECREF(name);
+    return repr;
 }
 
-static PyObject* PyCoreAudio_getDeviceCount(PyObject* self, PyObject* _){
-    if(!initialized){
-        PyErr_SetString(PyExc_Exception, "Not initialized");
-        PyErr_Occurred();
-        return NULL;
+static Py_hash_t Device_hash(PyObject* self){
+    Py_hash_t hash = (Py_hash_t)((DeviceObject*)self)->id;
+    return hash == -1 ? -2 : hash;
+}
+
+static PyObject* Device_richcompare(PyObject* self, PyObject* other, int op){
+    if(!PyObject_TypeCheck(other, Py_TYPE(self)) || (op != Py_EQ && op != Py_NE)){
+        Py_RETURN_NOTIMPLEMENTED;
     }
-    return PyLong_FromLong((long)getDeviceCount());
+    bool equal = ((DeviceObject*)self)->id == ((DeviceObject*)other)->id;
+    return PyBool_FromBool(op == Py_EQ ? equal : !equal);
 }
 
-static PyObject* PyCoreAudio_getDevices(PyObject* self, PyObject* _){
-    if(!initialized){
-        PyErr_SetString(PyExc_Exception, "Not initialized");
+static PyGetSetDef DeviceGetSet[] = {
+    {(char*)"id", Device_getID, NULL, (char*)"AudioDeviceID of the device.", NULL},
+    {(char*)"name", Device_getField, NULL, (char*)"Name of the device.", (void*)DEVICE_NAME},
+    {(char*)"manufacturer", Device_getField, NULL, (char*)"Manufacturer of the device.", (void*)DEVICE_MANUFACTURER},
+    {(char*)"uid", Device_getField, NULL, (char*)"UID of the device, stable across reboots.", (void*)DEVICE_UID},
+    {(char*)"inStreams", Device_getField, NULL, (char*)"Number of input streams.", (void*)DEVICE_IN_STREAMS},
+    {(char*)"outStreams", Device_getField, NULL, (char*)"Number of output streams.", (void*)DEVICE_OUT_STREAMS},
+    {(char*)"isMic", Device_hasStreams, NULL, (char*)"Whether the device has input streams.", (void*)DEVICE_IN_STREAMS},
+    {(char*)"isSpeaker", Device_hasStreams, NULL, (char*)"Whether the device has output streams.", (void*)DEVICE_OUT_STREAMS},
+    {(char*)"channels", Device_getField, NULL, (char*)"Output channels with a volume control, main element first.", (void*)DEVICE_CHANNELS},
+    {NULL}
+};
+
+static PyMethodDef DeviceMethods[] = {
+    {"refresh", Device_refresh, METH_NOARGS,
+        "Forget the attributes read so far, they are queried again on next use."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyType_Slot DeviceSlots[] = {
+    {Py_tp_doc, (void*)
+        "Device(id)\n"
+        "An audio device. Attributes are queried from the system when first read and then kept,\n"
+        "call refresh() to query them again. Devices compare equal by ID."},
+    {Py_tp_new, (void*)Device_new},
+    {Py_tp_dealloc, (void*)Device_dealloc},
+    {Py_tp_repr, (void*)Device_repr},
+    {Py_tp_hash, (void*)Device_hash},
+    {Py_tp_richcompare, (void*)Device_richcompare},
+    {Py_tp_getset, DeviceGetSet},
+    {Py_tp_methods, DeviceMethods},
+    {0, NULL}
+};
+
+static PyType_Spec DeviceSpec = {
+    "CoreAudio.Device",
+    sizeof(DeviceObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    DeviceSlots
+};
+
+static PyObject* PyCoreAudio_listDeviceIDs(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    if(!requireDevices()) return NULL;
+    std::vector<AudioDeviceID> deviceIDs;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = getDeviceIDs(deviceIDs);
+    Py_END_ALLOW_THREADS
+    if(!ok){
+        PyErr_SetString(PyExc_Exception, "Error getting devices from system");
         PyErr_Occurred();
         return NULL;
     }
-    PyObject* res = NULL;
-    OSStatus error;
-    const int numDevices = getDeviceCount();
-    UInt32 propSize = numDevices * sizeof(AudioDeviceID);
-    AudioDeviceID* audioDevices = (AudioDeviceID *)malloc(propSize);
-
-    //Grab the devices and store them in audioDevices
-    error = AudioObjectGetPropertyData(kAudioObjectSystemObject, &properties::count, 0, NULL, &propSize, audioDevices);
-    if(error != noErr){
+    PyObject* res = PyTuple_New(deviceIDs.size());
+    if(res == NULL) return NULL;
+    for(size_t i = 0; i < deviceIDs.size(); i++){
+        PyTuple_SET_ITEM(res, i, PyLong_FromUnsignedLong(deviceIDs[i]));
+    }
+    return res;
+}
+
+static PyObject* PyCoreAudio_listDevices(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    if(!requireDevices()) return NULL;
+    std::vector<AudioDeviceID> deviceIDs;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = getDeviceIDs(deviceIDs);
+    Py_END_ALLOW_THREADS
+    if(!ok){
         PyErr_SetString(PyExc_Exception, "Error getting devices from system");
         PyErr_Occurred();
         return NULL;
     }
-
-    res = PyTuple_New(numDevices);
-    propSize = sizeof(CFStringRef);
-    for(int i = 0; i < numDevices; i++){
-        //printf("%u\n",audioDevices[i]);
-        std::string name = getDeviceName(audioDevices[i]);
-        std::string manufacturer = getDeviceManufacturer(audioDevices[i]);
-        std::string uid = getDeviceUID(audioDevices[i]);
-        int in_streams = getDeviceStreamCount(audioDevices[i], properties::instreams);
-        int out_streams = getDeviceStreamCount(audioDevices[i], properties::outstreams);
-        bool isMic = in_streams > 0;
-        bool isSpeaker = out_streams > 0;
-        int devices_id = audioDevices[i];
-
-
-        PyTuple_SetItem(res, i, Py_BuildValue("(s, s, s, i, i, N, N, i)",
-            name.c_str(),
-            manufacturer.c_str(),
-            uid.c_str(),
-            in_streams,
-            out_streams,
-            PyBool_FromBool(isMic),
-            PyBool_FromBool(isSpeaker),
-            devices_id
-            ));
+    PyObject* res = PyTuple_New(deviceIDs.size());
+    if(res == NULL) return NULL;
+    for(size_t i = 0; i < deviceIDs.size(); i++){
+        PyObject* device = newDevice((PyTypeObject*)moduleState(self)->deviceType, deviceIDs[i]);
+        if(device == NULL){
+            Py_DECREF(res);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(res, i, device);
     }
-    free(audioDevices);
     return res;
 }
+/* ----------------------------------------------------------------------- */
 
 static PyObject* PyCoreAudio_getCurrentDevice(PyObject* self, PyObject* _){
-    if(!initialized){
-        PyErr_SetString(PyExc_Exception, "Not initialized");
-        PyErr_Occurred();
-        return NULL;
-    }
-    return cppstring_to_pystr(getDeviceName(defaultOutputDeviceID));
+    TRACE_ENTRY();
+    if(!requireInit()) return NULL;
+    AudioDeviceID deviceID = outputState()->deviceID;
+    CFStringRef name;
+    Py_BEGIN_ALLOW_THREADS
+    name = copyDeviceString(deviceID, properties::name);
+    Py_END_ALLOW_THREADS
+    return internDeviceString(self, deviceID, properties::name.mSelector, name);
 }
 
 static PyObject* PyCoreAudio_setMute(PyObject* self, PyObject* arg){
-    if(!initialized){
-        PyErr_SetString(PyExc_Exception, "Not initialized");
-        PyErr_Occurred();
-        return NULL;
-    }
-    return PyBool_FromBool(setMute(PyObject_IsTrue(arg)));
+    TRACE_ENTRY();
+    if(!requireInit()) return NULL;
+    int state = PyObject_IsTrue(arg);
+    if(state < 0) return NULL;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = setMute(state);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(ok);
 }
 
 static PyObject* PyCoreAudio_getMute(PyObject* self, PyObject* _){
-    if(!initialized){
-        PyErr_SetString(PyExc_Exception, "Not initialized");
-        PyErr_Occurred();
+    TRACE_ENTRY();
+    if(!requireInit()) return NULL;
+    int state;
+    Py_BEGIN_ALLOW_THREADS
+    state = getMute();
+    Py_END_ALLOW_THREADS
+    if(state == -1){
+        PyErr_SetString(PyExc_Exception, "Failed to get mute status");
         return NULL;
     }
-    return PyBool_FromBool(getMute());
+    return PyBool_FromBool(state != 0);
 }
 
 static PyObject* PyCoreAudio_mute(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
     return PyCoreAudio_setMute(self, Py_True);
 }
 
 static PyObject* PyCoreAudio_unmute(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
     return PyCoreAudio_setMute(self, Py_False);
 }
 
 static PyObject* PyCoreAudio_getVolume(PyObject* self, PyObject* _){
-    if(!initialized){
-        PyErr_SetString(PyExc_Exception, "Not initialized");
-        PyErr_Occurred();
-        return NULL;
-    }
-    return PyLong_FromLong((long)getVolume());
+    TRACE_ENTRY();
+    if(!requireInit()) return NULL;
+    int volume;
+    Py_BEGIN_ALLOW_THREADS
+    volume = getVolume();
+    Py_END_ALLOW_THREADS
+    return PyLong_FromLong((long)volume);
 }
 
 static PyObject* PyCoreAudio_setVolume(PyObject* self, PyObject* arg){
-    if(!initialized){
-        PyErr_SetString(PyExc_Exception, "Not initialized");
-        PyErr_Occurred();
-        return NULL;
-    }
+    TRACE_ENTRY();
+    if(!requireInit()) return NULL;
     int value = PyLong_AsLong(arg);
     if(value >= 0 && value <= 100){
-        return PyBool_FromBool(setVolume(value));
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = setVolume(value);
+        Py_END_ALLOW_THREADS
+        return PyBool_FromBool(ok);
     }
     PyErr_SetString(PyExc_Exception, "Value out of range [0;100]");
     PyErr_Occurred();
@@ -617,12 +797,14 @@ static PyObject* PyCoreAudio_setVolume(PyObject* self, PyObject* arg){
 }
 
 static PyObject* PyCoreAudio_setVolumeForDevice(PyObject* self, PyObject* args) {
+    TRACE_ENTRY();
     AudioDeviceID deviceID;
     int volume_in_percent;
 
     if (!PyArg_ParseTuple(args, "Ii", &deviceID, &volume_in_percent)) {
         return NULL; // 参数解析失败
     }
+    if(!requireDevices()) return NULL;
 
     if (volume_in_percent < 0 || volume_in_percent > 100) {
         PyErr_SetString(PyExc_Exception, "Value out of range [0;100]");
@@ -630,18 +812,27 @@ static PyObject* PyCoreAudio_setVolumeForDevice(PyObject* self, PyObject* args)
     }
 
     // 调用新创建的 setVolumeForDevice 函数
-    return PyBool_FromBool(setVolumeForDevice(deviceID, volume_in_percent));
+    bool success;
+    Py_BEGIN_ALLOW_THREADS
+    success = setVolumeForDevice(deviceID, volume_in_percent);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(success);
 }
 
 static PyObject* PyCoreAudio_getVolumeForDevice(PyObject* self, PyObject* args) {
+    TRACE_ENTRY();
     AudioDeviceID deviceID;
 
     if (!PyArg_ParseTuple(args, "i", &deviceID)) {
         return NULL; // 参数解析失败
     }
+    if(!requireDevices()) return NULL;
 
     // 调用新创建的 getVolumeForDevice 函数
-    int volume = getVolumeForDevice(deviceID);
+    int volume;
+    Py_BEGIN_ALLOW_THREADS
+    volume = getVolumeForDevice(deviceID);
+    Py_END_ALLOW_THREADS
     if (volume == -1) {
         PyErr_SetString(PyExc_Exception, "Failed to get volume for device");
         return NULL;
@@ -651,27 +842,37 @@ static PyObject* PyCoreAudio_getVolumeForDevice(PyObject* self, PyObject* args)
 }
 
 static PyObject* PyCoreAudio_setMuteForDevice(PyObject* self, PyObject* args) {
+    TRACE_ENTRY();
     AudioDeviceID deviceID;
     int mute;
 
     if (!PyArg_ParseTuple(args, "iI", &deviceID, &mute)) {
         return NULL; // 参数解析失败
     }
+    if(!requireDevices()) return NULL;
 
     // 调用 setMuteForDevice 函数
-    bool success = setMuteForDevice(deviceID, mute != 0);
+    bool success;
+    Py_BEGIN_ALLOW_THREADS
+    success = setMuteForDevice(deviceID, mute != 0);
+    Py_END_ALLOW_THREADS
     return PyBool_FromLong(success);
 }
 
 static PyObject* PyCoreAudio_getMuteForDevice(PyObject* self, PyObject* args) {
+    TRACE_ENTRY();
     AudioDeviceID deviceID;
 
     if (!PyArg_ParseTuple(args, "i", &deviceID)) {
         return NULL; // 参数解析失败
     }
+    if(!requireDevices()) return NULL;
 
     // 调用 getMuteForDevice 函数
-    int muteStatus = getMuteForDevice(deviceID);
+    int muteStatus;
+    Py_BEGIN_ALLOW_THREADS
+    muteStatus = getMuteForDevice(deviceID);
+    Py_END_ALLOW_THREADS
     if (muteStatus == -1) {
         PyErr_SetString(PyExc_Exception, "Failed to get mute status for device");
         return NULL;
@@ -679,92 +880,2344 @@ static PyObject* PyCoreAudio_getMuteForDevice(PyObject* self, PyObject* args) {
 
     return PyLong_FromLong(muteStatus);
 }
-static PyMethodDef PyCoreAudioMethods[] = {
-    {"init",  PyCoreAudio_init, METH_NOARGS,
-        "Initialize the module. Finds and selects the currently selected audio output device.\n"
-        "This does not open/lock the audio device, so it will not affect other applications\n"
-        "using the same device. You must run this function before using any other one."},
-    
-    {"ready",  PyCoreAudio_ready, METH_NOARGS,
-        "Check if the module is initialized. Returns a boolean."},
-    
-    {"deinit",  PyCoreAudio_deinit, METH_NOARGS,
-        "Deinitialize the module. It is possible to run init() again after this function.\n"
-        "Reinitialization should be done if the currently selected audio output device has\n"
-        "been changed. This change cannot be detected automatically using this module.\n"
-        "If the module is not initialized, an exception will be raised."},
-    
-    {"getValidChannels", PyCoreAudio_getValidChannels, METH_NOARGS,
-        "Get a list of valid channels. Returns a tuple.\n"
-        "If the module is not initialized, an exception will be raised."},
-    
-    {"getMute", PyCoreAudio_getMute, METH_NOARGS,
-        "Get mute status of the current audio output device. Returns a boolean.\n"
-        "If the module is not initialized, an exception will be raised."},
-    
-    {"setMute", PyCoreAudio_setMute, METH_O,
-        "Set mute status of the current audio output device. Returns a boolean, which represents\n"
-        "whether the operation was successful or not.\n"
-        "If the module is not initialized, an exception will be raised."},
-    
-    {"mute", PyCoreAudio_mute, METH_NOARGS,
-        "Mute the current audio output device. Alias to setMute(True)."},
-    
-    {"unmute", PyCoreAudio_unmute, METH_NOARGS,
-        "Unmute the current audio output device. Alias to setMute(False)."},
-    
-    {"getVolume", PyCoreAudio_getVolume, METH_NOARGS,
-        "Get the currently set volume level of the current audio output device.\n"
-        "Returns an in in range [0; 100], indicating the volume level in percentage.\n"
-        "If the module is not initialized, an exception will be raised."},
-    
-    {"setVolume", PyCoreAudio_setVolume, METH_O,
-        "Set volume level of the current audio output device. Takes a single argument - \n"
-        "int. The argument must be in interval [0; 100], indicating the volume level in percentage.\n"
-        "Returns a boolean, which represents whether the operation was successful or not.\n"
-        "If the module is not initialized or the argument is out of range, an exception\n"
-        "will be raised."},
-    
-    {"getDeviceCount", PyCoreAudio_getDeviceCount, METH_NOARGS, 
-        "Get the amount of audio input and output devices available on this system.\n"
-        "If the module is not initialized, an exception will be raised."},
-    
-    {"getDevices", PyCoreAudio_getDevices, METH_NOARGS,
-        "Get all audio input and output devices available on this system along with\n"
-        "some of their properties. Returns a tuple of tuples.\n"
-        "The tuples are structured like this:\n"
-        "(name, manufacturer, uid, number of input streams, number of output streams,\n"
-        "isMicrophone, isSpeaker).\n"
-        "Keep in mind that a single device can have both input and output streams.\n"
-        "In such a case, the last two properties will be True.\n"
-        "If the module fails to get the name of the device, the value \"Unknown\"\n"
-        "will be used.\n"
-        "If the module is not initialized, an exception will be raised."},
-    
-    {"getCurrentDevice", PyCoreAudio_getCurrentDevice, METH_NOARGS,
-        "Get the name of the current audio output device.\n"
-        "If the module is not initialized, an exception will be raised."},
+
+/* --------------------------UID addressing------------------------------- */
+/*
+ * Variants of the *ForDevice functions taking a device UID, which unlike
+ * the AudioDeviceID stays the same across reboots and re-plugs. UIDs and
+ * names are resolved through the device registry's index (registry.h).
+ */
+
+static PyObject* unknownUID(const char* uid){
+    PyErr_Format(PyExc_KeyError, "No device with UID '%s'", uid);
+    return NULL;
+}
+
+static PyObject* PyCoreAudio_getDeviceIDForUID(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    const char* uid;
+    if(!PyArg_ParseTuple(args, "s", &uid)) return NULL;
+    if(!requireDevices()) return NULL;
+    AudioDeviceID deviceID = kAudioObjectUnknown;
+    bool found;
+    Py_BEGIN_ALLOW_THREADS
+    found = deviceRegistry.findByUID(uid, deviceID);
+    Py_END_ALLOW_THREADS
+    if(!found) Py_RETURN_NONE;
+    return PyLong_FromUnsignedLong(deviceID);
+}
+
+static PyObject* PyCoreAudio_getDeviceIDForName(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    const char* name;
+    if(!PyArg_ParseTuple(args, "s", &name)) return NULL;
+    if(!requireDevices()) return NULL;
+    AudioDeviceID deviceID = kAudioObjectUnknown;
+    bool found;
+    Py_BEGIN_ALLOW_THREADS
+    found = deviceRegistry.findByName(name, deviceID);
+    Py_END_ALLOW_THREADS
+    if(!found) Py_RETURN_NONE;
+    return PyLong_FromUnsignedLong(deviceID);
+}
+
+static PyObject* PyCoreAudio_setVolumeForUID(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    const char* uid;
+    int volume_in_percent;
+    if(!PyArg_ParseTuple(args, "si", &uid, &volume_in_percent)) return NULL;
+    if(!requireDevices()) return NULL;
+    if(volume_in_percent < 0 || volume_in_percent > 100){
+        PyErr_SetString(PyExc_Exception, "Value out of range [0;100]");
+        return NULL;
+    }
+    AudioDeviceID deviceID;
+    bool found, success = false;
+    Py_BEGIN_ALLOW_THREADS
+    found = deviceRegistry.findByUID(uid, deviceID);
+    if(found) success = setVolumeForDevice(deviceID, volume_in_percent);
+    Py_END_ALLOW_THREADS
+    if(!found) return unknownUID(uid);
+    return PyBool_FromBool(success);
+}
+
+static PyObject* PyCoreAudio_getVolumeForUID(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    const char* uid;
+    if(!PyArg_ParseTuple(args, "s", &uid)) return NULL;
+    if(!requireDevices()) return NULL;
+    AudioDeviceID deviceID;
+    bool found;
+    int volume = -1;
+    Py_BEGIN_ALLOW_THREADS
+    found = deviceRegistry.findByUID(uid, deviceID);
+    if(found) volume = getVolumeForDevice(deviceID);
+    Py_END_ALLOW_THREADS
+    if(!found) return unknownUID(uid);
+    if(volume == -1){
+        PyErr_SetString(PyExc_Exception, "Failed to get volume for device");
+        return NULL;
+    }
+    return PyLong_FromLong(volume);
+}
+
+static PyObject* PyCoreAudio_setMuteForUID(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    const char* uid;
+    int mute;
+    if(!PyArg_ParseTuple(args, "sp", &uid, &mute)) return NULL;
+    if(!requireDevices()) return NULL;
+    AudioDeviceID deviceID;
+    bool found, success = false;
+    Py_BEGIN_ALLOW_THREADS
+    found = deviceRegistry.findByUID(uid, deviceID);
+    if(found) success = setMuteForDevice(deviceID, mute != 0);
+    Py_END_ALLOW_THREADS
+    if(!found) return unknownUID(uid);
+    return PyBool_FromBool(success);
+}
+
+static PyObject* PyCoreAudio_getMuteForUID(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    const char* uid;
+    if(!PyArg_ParseTuple(args, "s", &uid)) return NULL;
+    if(!requireDevices()) return NULL;
+    AudioDeviceID deviceID;
+    bool found;
+    int muteStatus = -1;
+    Py_BEGIN_ALLOW_THREADS
+    found = deviceRegistry.findByUID(uid, deviceID);
+    if(found) muteStatus = getMuteForDevice(deviceID);
+    Py_END_ALLOW_THREADS
+    if(!found) return unknownUID(uid);
+    if(muteStatus == -1){
+        PyErr_SetString(PyExc_Exception, "Failed to get mute status for device");
+        return NULL;
+    }
+    return PyLong_FromLong(muteStatus);
+}
+/* ----------------------------------------------------------------------- */
+
+static PyObject* PyCoreAudio_setVolumes(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    std::vector<long long> records;
+    if(!parseIntRecords(arg, 2, records)) return NULL;
+    if(!requireDevices()) return NULL;
+    size_t count = records.size() / 2;
+    std::vector<AudioDeviceID> deviceIDs(count);
+    std::vector<int> volumes(count);
+    for(size_t i = 0; i < count; i++){
+        if(records[i * 2 + 1] < 0 || records[i * 2 + 1] > 100){
+            PyErr_SetString(PyExc_Exception, "Value out of range [0;100]");
+            return NULL;
+        }
+        deviceIDs[i] = (AudioDeviceID)records[i * 2];
+        volumes[i] = (int)records[i * 2 + 1];
+    }
+
+    PyObject* res = PyBytes_FromStringAndSize(NULL, count);
+    if(res == NULL) return NULL;
+    UInt8* results = (UInt8*)PyBytes_AS_STRING(res);
+    Py_BEGIN_ALLOW_THREADS
+    setVolumeForDevices(deviceIDs.data(), volumes.data(), count, results);
+    Py_END_ALLOW_THREADS
+    return res;
+}
+
+static PyObject* PyCoreAudio_getVolumes(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    std::vector<long long> records;
+    if(!parseIntRecords(arg, 1, records)) return NULL;
+    if(!requireDevices()) return NULL;
+    std::vector<AudioDeviceID> deviceIDs(records.begin(), records.end());
+
+    PyObject* res = PyBytes_FromStringAndSize(NULL, deviceIDs.size());
+    if(res == NULL) return NULL;
+    UInt8* results = (UInt8*)PyBytes_AS_STRING(res);
+    Py_BEGIN_ALLOW_THREADS
+    getVolumeForDevices(deviceIDs.data(), deviceIDs.size(), results);
+    Py_END_ALLOW_THREADS
+    return res;
+}
+
+static PyObject* PyCoreAudio_setMutes(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    std::vector<long long> records;
+    if(!parseIntRecords(arg, 2, records)) return NULL;
+    if(!requireDevices()) return NULL;
+    size_t count = records.size() / 2;
+    std::vector<AudioDeviceID> deviceIDs(count);
+    std::unique_ptr<bool[]> mutes(new bool[count]);
+    for(size_t i = 0; i < count; i++){
+        deviceIDs[i] = (AudioDeviceID)records[i * 2];
+        mutes[i] = records[i * 2 + 1] != 0;
+    }
+
+    PyObject* res = PyBytes_FromStringAndSize(NULL, count);
+    if(res == NULL) return NULL;
+    UInt8* results = (UInt8*)PyBytes_AS_STRING(res);
+    Py_BEGIN_ALLOW_THREADS
+    setMuteForDevices(deviceIDs.data(), mutes.get(), count, results);
+    Py_END_ALLOW_THREADS
+    return res;
+}
+
+static PyObject* PyCoreAudio_getMutes(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    std::vector<long long> records;
+    if(!parseIntRecords(arg, 1, records)) return NULL;
+    if(!requireDevices()) return NULL;
+    std::vector<AudioDeviceID> deviceIDs(records.begin(), records.end());
+
+    PyObject* res = PyBytes_FromStringAndSize(NULL, deviceIDs.size());
+    if(res == NULL) return NULL;
+    UInt8* results = (UInt8*)PyBytes_AS_STRING(res);
+    Py_BEGIN_ALLOW_THREADS
+    getMuteForDevices(deviceIDs.data(), deviceIDs.size(), results);
+    Py_END_ALLOW_THREADS
+    return res;
+}
+
+static PyObject* PyCoreAudio_applyScene(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    std::vector<long long> records;
+    if(!parseIntRecords(arg, 3, records)) return NULL;
+    if(!requireDevices()) return NULL;
+    size_t count = records.size() / 3;
+    std::vector<SceneEntry> entries(count);
+    for(size_t i = 0; i < count; i++){
+        if(records[i * 3 + 1] < -1 || records[i * 3 + 1] > 100){
+            PyErr_SetString(PyExc_Exception, "Value out of range [0;100]");
+            return NULL;
+        }
+        entries[i].deviceID = (AudioDeviceID)records[i * 3];
+        entries[i].volume = (int)records[i * 3 + 1];
+        entries[i].mute = records[i * 3 + 2] < 0 ? -1 : (records[i * 3 + 2] != 0);
+    }
+
+    PyObject* res = PyBytes_FromStringAndSize(NULL, count);
+    if(res == NULL) return NULL;
+    UInt8* results = (UInt8*)PyBytes_AS_STRING(res);
+    Py_BEGIN_ALLOW_THREADS
+    applyScene(entries.data(), count, results);
+    Py_END_ALLOW_THREADS
+    return res;
+}
+
+#ifdef PYCOREAUDIO_SIMULATED_HAL
+/* ---------------------Simulated HAL controls----------------------------- */
+static hal::SimBackend* simulatedHAL(){
+    return static_cast<hal::SimBackend*>(hal::defaultBackend());
+}
+
+static PyObject* PyCoreAudio_simPopulate(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    int count;
+    unsigned int channels = 2;
+    if(!PyArg_ParseTuple(args, "i|I", &count, &channels)){
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    simulatedHAL()->populate(count, channels);
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject* PyCoreAudio_simSetLatency(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    unsigned long long latency, jitter = 0;
+    if(!PyArg_ParseTuple(args, "K|K", &latency, &jitter)){
+        return NULL;
+    }
+    simulatedHAL()->setLatency(latency);
+    simulatedHAL()->setLatencyJitter(jitter);
+    Py_RETURN_NONE;
+}
+
+static PyObject* PyCoreAudio_simCallCount(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyLong_FromUnsignedLongLong(simulatedHAL()->callCount());
+}
+
+static PyObject* PyCoreAudio_simSetDefaultOutputDevice(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID = (AudioDeviceID)PyLong_AsUnsignedLong(arg);
+    if(PyErr_Occurred()) return NULL;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = simulatedHAL()->setDefaultOutputDevice(deviceID);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(ok);
+}
+
+static PyObject* PyCoreAudio_simSetChannelCount(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    unsigned int deviceID, channels;
+    if(!PyArg_ParseTuple(args, "II", &deviceID, &channels)){
+        return NULL;
+    }
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = simulatedHAL()->setChannelCount(deviceID, channels);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(ok);
+}
+static PyObject* PyCoreAudio_simSetDeviceName(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    unsigned int deviceID;
+    const char* name;
+    if(!PyArg_ParseTuple(args, "Is", &deviceID, &name)){
+        return NULL;
+    }
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = simulatedHAL()->setDeviceName(deviceID, name);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(ok);
+}
+
+static PyObject* PyCoreAudio_simStringReferences(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyLong_FromLong(simulatedHAL()->stringReferences());
+}
+
+static PyObject* PyCoreAudio_simSetStreamCounts(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    unsigned int deviceID, inStreams, outStreams;
+    if(!PyArg_ParseTuple(args, "III", &deviceID, &inStreams, &outStreams)){
+        return NULL;
+    }
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = simulatedHAL()->setStreamCounts(deviceID, inStreams, outStreams);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(ok);
+}
+
+static PyObject* PyCoreAudio_simSetInputSignal(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    unsigned int deviceID;
+    float amplitude, frequency = 440.0f;
+    if(!PyArg_ParseTuple(args, "If|f", &deviceID, &amplitude, &frequency)){
+        return NULL;
+    }
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = simulatedHAL()->setInputSignal(deviceID, amplitude, frequency);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(ok);
+}
+
+static PyObject* PyCoreAudio_simSetIOBufferFrames(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    unsigned long frames = PyLong_AsUnsignedLong(arg);
+    if(PyErr_Occurred()) return NULL;
+    simulatedHAL()->setIOBufferFrames((UInt32)frames);
+    Py_RETURN_NONE;
+}
+/* ----------------------------------------------------------------------- */
+#endif
+
+static PyObject* PyCoreAudio_setFollowDefaultDevice(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    int state = PyObject_IsTrue(arg);
+    if(state < 0) return NULL;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = setFollowDefaultDevice(state);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(ok);
+}
+
+static PyObject* PyCoreAudio_getFollowDefaultDevice(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyBool_FromBool(getFollowDefaultDevice());
+}
+
+static PyObject* PyCoreAudio_watch(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    if(!requireInit()) return NULL;
+    UInt32 events = EVENT_ALL;
+    AudioDeviceID deviceID = outputState()->deviceID;
+    if(!PyArg_ParseTuple(args, "|II", &events, &deviceID)){
+        return NULL;
+    }
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = eventWatcher.watch(deviceID, events);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(ok);
+}
+
+static PyObject* PyCoreAudio_unwatch(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    Py_BEGIN_ALLOW_THREADS
+    eventWatcher.unwatch();
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+/**
+ * Convert an optional timeout in seconds to milliseconds, None meaning
+ * "wait forever" (-1) like poll().
+ */
+static bool timeoutToMs(PyObject* timeoutArg, int* timeoutMs){
+    *timeoutMs = -1;
+    if(timeoutArg == Py_None) return true;
+    double timeout = PyFloat_AsDouble(timeoutArg);
+    if(timeout == -1.0 && PyErr_Occurred()) return false;
+    *timeoutMs = timeout <= 0 ? 0 : (int)ceil(timeout * 1000.0);
+    return true;
+}
+
+static PyObject* PyCoreAudio_readEvents(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    PyObject* timeoutArg = Py_None;
+    int timeoutMs;
+    if(!PyArg_ParseTuple(args, "|O", &timeoutArg) || !timeoutToMs(timeoutArg, &timeoutMs)){
+        return NULL;
+    }
+
+    Event events[256];
+    size_t count = 0;
+    Py_BEGIN_ALLOW_THREADS
+    count = eventWatcher.read(events, 256, timeoutMs);
+    Py_END_ALLOW_THREADS
+
+    PyObject* res = PyTuple_New(count);
+    for(size_t i = 0; i < count; i++){
+        PyTuple_SET_ITEM(res, i, Py_BuildValue("(I, I, I, K)",
+            events[i].kind,
+            events[i].objectID,
+            events[i].element,
+            (unsigned long long)events[i].timestamp
+            ));
+    }
+    return res;
+}
+
+static PyObject* PyCoreAudio_eventFD(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyLong_FromLong((long)eventWatcher.fd());
+}
+
+static PyObject* PyCoreAudio_droppedEvents(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyLong_FromUnsignedLongLong((unsigned long long)eventWatcher.dropped());
+}
+
+static PyObject* PyCoreAudio_fade(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    if(!requireDevices()) return NULL;
+    AudioDeviceID deviceID;
+    double target;
+    unsigned int durationMs;
+    int curve = FADE_LINEAR;
+    if(!PyArg_ParseTuple(args, "IdI|i", &deviceID, &target, &durationMs, &curve)){
+        return NULL;
+    }
+    if(curve != FADE_LINEAR && curve != FADE_EQUAL_POWER && curve != FADE_DB){
+        PyErr_SetString(PyExc_ValueError, "Unknown fade curve");
+        return NULL;
+    }
+    if(target < 0 || target > 100){
+        PyErr_SetString(PyExc_ValueError, "Volume must be in range 0-100");
+        return NULL;
+    }
+    UInt64 id;
+    Py_BEGIN_ALLOW_THREADS
+    id = fadeEngine.start(deviceID, (Float32)(target / 100.0), durationMs, (FadeCurve)curve);
+    Py_END_ALLOW_THREADS
+    return PyLong_FromUnsignedLongLong((unsigned long long)id);
+}
+
+static PyObject* PyCoreAudio_cancelFade(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID = (AudioDeviceID)PyLong_AsUnsignedLong(arg);
+    if(PyErr_Occurred()) return NULL;
+    return PyBool_FromBool(fadeEngine.cancel(deviceID));
+}
+
+static PyObject* PyCoreAudio_waitFade(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    PyObject* timeoutArg = Py_None;
+    int timeoutMs;
+    if(!PyArg_ParseTuple(args, "I|O", &deviceID, &timeoutArg) || !timeoutToMs(timeoutArg, &timeoutMs)){
+        return NULL;
+    }
+    bool idle;
+    Py_BEGIN_ALLOW_THREADS
+    idle = fadeEngine.wait(deviceID, timeoutMs);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(idle);
+}
+
+static PyObject* PyCoreAudio_readFades(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    PyObject* timeoutArg = Py_None;
+    int timeoutMs;
+    if(!PyArg_ParseTuple(args, "|O", &timeoutArg) || !timeoutToMs(timeoutArg, &timeoutMs)){
+        return NULL;
+    }
+
+    FadeCompletion completions[256];
+    size_t count = 0;
+    Py_BEGIN_ALLOW_THREADS
+    count = fadeEngine.read(completions, 256, timeoutMs);
+    Py_END_ALLOW_THREADS
+
+    PyObject* res = PyTuple_New(count);
+    for(size_t i = 0; i < count; i++){
+        PyTuple_SET_ITEM(res, i, Py_BuildValue("(K, I, I, K)",
+            (unsigned long long)completions[i].id,
+            completions[i].deviceID,
+            completions[i].status,
+            (unsigned long long)completions[i].timestamp
+            ));
+    }
+    return res;
+}
+
+static PyObject* PyCoreAudio_fadeFD(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyLong_FromLong((long)fadeEngine.fd());
+}
+
+static PyObject* PyCoreAudio_setFadeTickRate(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    long rate = PyLong_AsLong(arg);
+    if(rate == -1 && PyErr_Occurred()) return NULL;
+    if(rate < 1 || rate > 1000){
+        PyErr_SetString(PyExc_ValueError, "Tick rate must be in range 1-1000");
+        return NULL;
+    }
+    fadeEngine.setTickRate((UInt32)rate);
+    Py_RETURN_NONE;
+}
+
+static PyObject* PyCoreAudio_getFadeTickRate(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyLong_FromUnsignedLong(fadeEngine.tickRate());
+}
+
+static PyObject* PyCoreAudio_activeFades(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyLong_FromSize_t(fadeEngine.active());
+}
+
+/* ------------------------------Metering--------------------------------- */
+static bool parseMeterScope(int scope){
+    if(scope != METER_INPUT && scope != METER_OUTPUT){
+        PyErr_SetString(PyExc_ValueError, "Unknown meter scope");
+        return false;
+    }
+    return true;
+}
+
+static PyObject* PyCoreAudio_startMeter(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    if(!requireDevices()) return NULL;
+    AudioDeviceID deviceID;
+    int scope = METER_INPUT;
+    unsigned int integrationMs = 300, releaseMs = 1500;
+    if(!PyArg_ParseTuple(args, "I|iII", &deviceID, &scope, &integrationMs, &releaseMs) || !parseMeterScope(scope)){
+        return NULL;
+    }
+    UInt32 channels;
+    Py_BEGIN_ALLOW_THREADS
+    channels = meterEngine.start(deviceID, (MeterScope)scope, integrationMs, releaseMs);
+    Py_END_ALLOW_THREADS
+    return PyLong_FromUnsignedLong(channels);
+}
+
+static PyObject* PyCoreAudio_stopMeter(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    int scope = METER_INPUT;
+    if(!PyArg_ParseTuple(args, "I|i", &deviceID, &scope) || !parseMeterScope(scope)){
+        return NULL;
+    }
+    bool stopped;
+    Py_BEGIN_ALLOW_THREADS
+    stopped = meterEngine.stop(deviceID, (MeterScope)scope);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(stopped);
+}
+
+static PyObject* PyCoreAudio_readMeter(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    int scope = METER_INPUT;
+    if(!PyArg_ParseTuple(args, "I|i", &deviceID, &scope) || !parseMeterScope(scope)){
+        return NULL;
+    }
+    //Plain atomic loads, no need to release the GIL
+    std::shared_ptr<const Meter> meter = meterEngine.find(deviceID, (MeterScope)scope);
+    if(!meter) Py_RETURN_NONE;
+    MeterReading readings[MAX_CHANNELS];
+    size_t count = meter->read(readings, MAX_CHANNELS);
+
+    PyObject* res = PyTuple_New(count);
+    if(res == NULL) return NULL;
+    for(size_t i = 0; i < count; i++){
+        PyObject* reading = Py_BuildValue("(d, d, K)", (double)readings[i].peak, (double)readings[i].rms,
+                                          (unsigned long long)readings[i].clips);
+        if(reading == NULL){
+            Py_DECREF(res);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(res, i, reading);
+    }
+    return res;
+}
+
+static PyObject* PyCoreAudio_getMeterFrames(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    int scope = METER_INPUT;
+    if(!PyArg_ParseTuple(args, "I|i", &deviceID, &scope) || !parseMeterScope(scope)){
+        return NULL;
+    }
+    std::shared_ptr<const Meter> meter = meterEngine.find(deviceID, (MeterScope)scope);
+    if(!meter) Py_RETURN_NONE;
+    return PyLong_FromUnsignedLongLong((unsigned long long)meter->frames());
+}
+/* ----------------------------------------------------------------------- */
+
+/* ------------------------------Capture---------------------------------- */
+/*
+ * readCapture() lends a region of a capture's ring to Python as a
+ * CaptureBuffer, which exports it through the buffer protocol as a
+ * read-only (frames, channels) array of floats. memoryview(),
+ * numpy.frombuffer() and the like read the ring in place; the frames are
+ * freed for the IOProc once the CaptureBuffer is released, explicitly or
+ * when it is garbage collected.
+ */
+typedef struct {
+    PyObject_HEAD
+    std::shared_ptr<Capture>* capture;      //NULL once released
+    const Float32* samples;
+    Py_ssize_t shape[2];                    //frames, channels
+    Py_ssize_t strides[2];
+    Py_ssize_t exports;                     //buffers exported and not released yet
+} CaptureBufferObject;
+
+static PyObject* newCaptureBuffer(PyTypeObject* type, const std::shared_ptr<Capture> &capture,
+                                  const Float32* samples, size_t frames){
+    CaptureBufferObject* buffer = (CaptureBufferObject*)type->tp_alloc(type, 0);
+    if(buffer == NULL){
+        capture->release();
+        return NULL;
+    }
+    buffer->capture = new std::shared_ptr<Capture>(capture);
+    buffer->samples = samples;
+    buffer->shape[0] = (Py_ssize_t)frames;
+    buffer->shape[1] = (Py_ssize_t)capture->channels();
+    buffer->strides[0] = buffer->shape[1] * sizeof(Float32);
+    buffer->strides[1] = sizeof(Float32);
+    return (PyObject*)buffer;
+}
+
+//Give the region back to the capture
+static void releaseCaptureBuffer(CaptureBufferObject* buffer){
+    if(buffer->capture == NULL) return;
+    (*buffer->capture)->release();
+    delete buffer->capture;
+    buffer->capture = NULL;
+}
+
+static int CaptureBuffer_getbuffer(PyObject* self, Py_buffer* view, int flags){
+    CaptureBufferObject* buffer = (CaptureBufferObject*)self;
+    int res = 0;
+    BEGIN_LOCKED(self)
+    if(buffer->capture == NULL){
+        PyErr_SetString(PyExc_BufferError, "The capture buffer was released");
+        res = -1;
+    } else if(flags & PyBUF_WRITABLE){
+        PyErr_SetString(PyExc_BufferError, "Capture buffers are read-only");
+        res = -1;
+    } else {
+        view->obj = self;
+        Py_INCREF(self);
+        view->buf = (void*)buffer->samples;
+        view->len = buffer->shape[0] * buffer->strides[0];
+        view->readonly = 1;
+        view->itemsize = sizeof(Float32);
+        view->format = (flags & PyBUF_FORMAT) ? (char*)"f" : NULL;
+        view->ndim = 2;
+        view->shape = (flags & PyBUF_ND) ? buffer->shape : NULL;
+        view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? buffer->strides : NULL;
+        view->suboffsets = NULL;
+        view->internal = NULL;
+        buffer->exports++;
+    }
+    END_LOCKED()
+    return res;
+}
+
+static void CaptureBuffer_releasebuffer(PyObject* self, Py_buffer* view){
+    BEGIN_LOCKED(self)
+    ((CaptureBufferObject*)self)->exports--;
+    END_LOCKED()
+}
+
+static void CaptureBuffer_dealloc(PyObject* self){
+    //Exported buffers hold a reference, so there are none left here
+    releaseCaptureBuffer((CaptureBufferObject*)self);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+static PyObject* CaptureBuffer_release(PyObject* self, PyObject* _){
+    CaptureBufferObject* buffer = (CaptureBufferObject*)self;
+    bool exported;
+    BEGIN_LOCKED(self)
+    exported = buffer->exports > 0;
+    if(!exported) releaseCaptureBuffer(buffer);
+    END_LOCKED()
+    if(exported){
+        PyErr_SetString(PyExc_BufferError, "Views of the capture buffer are still alive");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* CaptureBuffer_enter(PyObject* self, PyObject* _){
+    Py_INCREF(self);
+    return self;
+}
+
+static PyObject* CaptureBuffer_exit(PyObject* self, PyObject* args){
+    return CaptureBuffer_release(self, NULL);
+}
+
+static PyObject* CaptureBuffer_getShape(PyObject* self, void* dimension){
+    return PyLong_FromSsize_t(((CaptureBufferObject*)self)->shape[(intptr_t)dimension]);
+}
+
+static PyObject* CaptureBuffer_getReleased(PyObject* self, void* _){
+    bool released;
+    BEGIN_LOCKED(self)
+    released = ((CaptureBufferObject*)self)->capture == NULL;
+    END_LOCKED()
+    return PyBool_FromBool(released);
+}
+
+static PyGetSetDef CaptureBufferGetSet[] = {
+    {(char*)"frames", CaptureBuffer_getShape, NULL, (char*)"Number of frames.", (void*)0},
+    {(char*)"channels", CaptureBuffer_getShape, NULL, (char*)"Number of channels per frame.", (void*)1},
+    {(char*)"released", CaptureBuffer_getReleased, NULL, (char*)"Whether the frames were given back.", NULL},
+    {NULL}
+};
+
+static PyMethodDef CaptureBufferMethods[] = {
+    {"release", CaptureBuffer_release, METH_NOARGS,
+        "Give the frames back to the capture. Raises BufferError while views of them are alive."},
+    {"__enter__", CaptureBuffer_enter, METH_NOARGS, NULL},
+    {"__exit__", CaptureBuffer_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyType_Slot CaptureBufferSlots[] = {
+    {Py_tp_doc, (void*)
+        "Frames borrowed from a capture by readCapture(), read in place through the buffer protocol\n"
+        "as a read-only (frames, channels) array of float32, e.g. numpy.frombuffer(buffer, 'f4').\n"
+        "The frames are given back by release(), on leaving a with block, or when the object is freed."},
+    {Py_tp_dealloc, (void*)CaptureBuffer_dealloc},
+    {Py_tp_getset, CaptureBufferGetSet},
+    {Py_tp_methods, CaptureBufferMethods},
+#if PY_VERSION_HEX >= 0x03090000
+    {Py_bf_getbuffer, (void*)CaptureBuffer_getbuffer},
+    {Py_bf_releasebuffer, (void*)CaptureBuffer_releasebuffer},
+#endif
+    {0, NULL}
+};
+
+static PyType_Spec CaptureBufferSpec = {
+    "CoreAudio.CaptureBuffer",
+    sizeof(CaptureBufferObject),
+    0,
+#ifdef Py_TPFLAGS_DISALLOW_INSTANTIATION
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+#else
+    Py_TPFLAGS_DEFAULT,
+#endif
+    CaptureBufferSlots
+};
+
+static PyObject* PyCoreAudio_startCapture(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    if(!requireDevices()) return NULL;
+    AudioDeviceID deviceID;
+    Py_ssize_t capacityFrames = 0;
+    if(!PyArg_ParseTuple(args, "I|n", &deviceID, &capacityFrames)) return NULL;
+    if(capacityFrames < 0){
+        PyErr_SetString(PyExc_ValueError, "The capacity must not be negative");
+        return NULL;
+    }
+    UInt32 channels;
+    Py_BEGIN_ALLOW_THREADS
+    channels = captureEngine.start(deviceID, (size_t)capacityFrames);
+    Py_END_ALLOW_THREADS
+    return PyLong_FromUnsignedLong(channels);
+}
+
+static PyObject* PyCoreAudio_stopCapture(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    if(!PyArg_ParseTuple(args, "I", &deviceID)) return NULL;
+    bool stopped;
+    Py_BEGIN_ALLOW_THREADS
+    stopped = captureEngine.stop(deviceID);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(stopped);
+}
+
+static PyObject* PyCoreAudio_readCapture(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    Py_ssize_t maxFrames = 0;
+    PyObject* timeoutArg = NULL;
+    int timeoutMs = 0;
+    if(!PyArg_ParseTuple(args, "I|nO", &deviceID, &maxFrames, &timeoutArg)) return NULL;
+    if(timeoutArg != NULL && !timeoutToMs(timeoutArg, &timeoutMs)) return NULL;
+    std::shared_ptr<Capture> capture = captureEngine.find(deviceID);
+    if(!capture){
+        PyErr_SetString(PyExc_Exception, "The device is not captured");
+        return NULL;
+    }
+
+    size_t frames;
+    const Float32* samples = capture->acquire(maxFrames > 0 ? (size_t)maxFrames : 0, &frames);
+    if(samples != NULL && frames == 0 && timeoutMs != 0){
+        //The IOProc must not wake anyone up, so poll every millisecond
+        Py_BEGIN_ALLOW_THREADS
+        for(int waited = 0; frames == 0 && (timeoutMs < 0 || waited < timeoutMs); waited++){
+            usleep(1000);
+            samples = capture->acquire(maxFrames > 0 ? (size_t)maxFrames : 0, &frames);
+        }
+        Py_END_ALLOW_THREADS
+    }
+    if(samples == NULL){
+        PyErr_SetString(PyExc_BufferError, "A buffer of the capture was not released yet");
+        return NULL;
+    }
+    if(frames == 0) Py_RETURN_NONE;
+    return newCaptureBuffer((PyTypeObject*)moduleState(self)->captureBufferType, capture, samples, frames);
+}
+
+static PyObject* PyCoreAudio_getCaptureStats(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    if(!PyArg_ParseTuple(args, "I", &deviceID)) return NULL;
+    std::shared_ptr<Capture> capture = captureEngine.find(deviceID);
+    if(!capture) Py_RETURN_NONE;
+    CaptureStats stats = capture->stats();
+    return Py_BuildValue("{s:I, s:K, s:K, s:K, s:K, s:K}",
+                         "channels", (unsigned int)capture->channels(),
+                         "captured", (unsigned long long)stats.captured,
+                         "dropped", (unsigned long long)stats.dropped,
+                         "overruns", (unsigned long long)stats.overruns,
+                         "queued", (unsigned long long)stats.queued,
+                         "capacity", (unsigned long long)stats.capacity);
+}
+/* ----------------------------------------------------------------------- */
+
+/* ------------------------------Playback--------------------------------- */
+/*
+ * writePlayback() copies from any buffer of float32 samples into the
+ * ring of a playback with the GIL released, waiting for room as long as
+ * needed, so a whole clip can be written in one call while other threads
+ * run.
+ */
+
+/**
+ * Check that a buffer holds native float32 samples, or plain bytes taken
+ * as such.
+ */
+static bool isFloat32Buffer(const Py_buffer &view){
+    const char* format = view.format;
+    if(format == NULL || strcmp(format, "B") == 0 || strcmp(format, "b") == 0 || strcmp(format, "c") == 0) return true;
+    if(view.itemsize != sizeof(Float32)) return false;
+    if(format[0] == '@' || format[0] == '=') format++;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    else if(format[0] == '<') format++;
+#endif
+    return strcmp(format, "f") == 0;
+}
+
+static PyObject* PyCoreAudio_startPlayback(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    if(!requireDevices()) return NULL;
+    AudioDeviceID deviceID;
+    Py_ssize_t capacityFrames = 0;
+    if(!PyArg_ParseTuple(args, "I|n", &deviceID, &capacityFrames)) return NULL;
+    if(capacityFrames < 0){
+        PyErr_SetString(PyExc_ValueError, "The capacity must not be negative");
+        return NULL;
+    }
+    UInt32 channels;
+    Py_BEGIN_ALLOW_THREADS
+    channels = playbackEngine.start(deviceID, (size_t)capacityFrames);
+    Py_END_ALLOW_THREADS
+    return PyLong_FromUnsignedLong(channels);
+}
+
+static PyObject* PyCoreAudio_stopPlayback(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    if(!PyArg_ParseTuple(args, "I", &deviceID)) return NULL;
+    bool stopped;
+    Py_BEGIN_ALLOW_THREADS
+    stopped = playbackEngine.stop(deviceID);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(stopped);
+}
+
+static PyObject* PyCoreAudio_writePlayback(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    PyObject* data;
+    PyObject* timeoutArg = Py_None;
+    int timeoutMs;
+    if(!PyArg_ParseTuple(args, "IO|O", &deviceID, &data, &timeoutArg) || !timeoutToMs(timeoutArg, &timeoutMs)){
+        return NULL;
+    }
+    std::shared_ptr<Playback> playback = playbackEngine.find(deviceID);
+    if(!playback){
+        PyErr_SetString(PyExc_Exception, "The device has no playback");
+        return NULL;
+    }
+    Py_buffer view;
+    if(PyObject_GetBuffer(data, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) return NULL;
+    size_t frameSize = playback->channels() * sizeof(Float32);
+    if(!isFloat32Buffer(view) || view.len % frameSize != 0){
+        PyBuffer_Release(&view);
+        PyErr_Format(PyExc_ValueError, "Expected float32 samples of %u interleaved channels", (unsigned int)playback->channels());
+        return NULL;
+    }
+
+    const Float32* samples = (const Float32*)view.buf;
+    size_t frames = view.len / frameSize, done = 0;
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::lock_guard<std::mutex> writer(playback->writer());
+        UInt64 waited = 0, limit = timeoutMs < 0 ? UINT64_MAX : (UInt64)timeoutMs * 1000000;
+        for(;;){
+            done += playback->write(samples + done * playback->channels(), frames - done);
+            if(done == frames || playback->closed() || waited >= limit) break;
+            UInt64 delay = playback->retryDelay(frames - done);
+            if(delay > limit - waited) delay = limit - waited;
+            usleep((useconds_t)(delay / 1000));
+            waited += delay;
+        }
+    }
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+    return PyLong_FromSize_t(done);
+}
+
+static PyObject* PyCoreAudio_drainPlayback(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    PyObject* timeoutArg = Py_None;
+    int timeoutMs;
+    if(!PyArg_ParseTuple(args, "I|O", &deviceID, &timeoutArg) || !timeoutToMs(timeoutArg, &timeoutMs)) return NULL;
+    std::shared_ptr<Playback> playback = playbackEngine.find(deviceID);
+    if(!playback){
+        PyErr_SetString(PyExc_Exception, "The device has no playback");
+        return NULL;
+    }
+
+    size_t queued;
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::lock_guard<std::mutex> writer(playback->writer());
+        queued = playback->drain();
+        UInt64 waited = 0, limit = timeoutMs < 0 ? UINT64_MAX : (UInt64)timeoutMs * 1000000;
+        while(queued > 0 && !playback->closed() && waited < limit){
+            //Until the queued frames should have played, at least a millisecond
+            UInt64 delay = (UInt64)(queued * 1e9 / playback->rate());
+            if(delay < 1000000) delay = 1000000;
+            if(delay > limit - waited) delay = limit - waited;
+            usleep((useconds_t)(delay / 1000));
+            waited += delay;
+            queued = playback->stats().queued;
+        }
+    }
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(queued == 0);
+}
+
+static PyObject* PyCoreAudio_getPlaybackStats(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    if(!PyArg_ParseTuple(args, "I", &deviceID)) return NULL;
+    std::shared_ptr<Playback> playback = playbackEngine.find(deviceID);
+    if(!playback) Py_RETURN_NONE;
+    PlaybackStats stats = playback->stats();
+    //What is queued plays after the IO buffer the device is working on
+    double latency = (stats.queued + stats.cycleFrames) / playback->rate();
+    double maxLatency = (stats.maxQueued + stats.cycleFrames) / playback->rate();
+    return Py_BuildValue("{s:I, s:K, s:K, s:K, s:K, s:K, s:K, s:d, s:d}",
+                         "channels", (unsigned int)playback->channels(),
+                         "written", (unsigned long long)stats.written,
+                         "played", (unsigned long long)stats.played,
+                         "underruns", (unsigned long long)stats.underruns,
+                         "silence", (unsigned long long)stats.silence,
+                         "queued", (unsigned long long)stats.queued,
+                         "capacity", (unsigned long long)stats.capacity,
+                         "latency", latency,
+                         "max_latency", maxLatency);
+}
+
+static PyObject* PyCoreAudio_setPlaybackGain(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    float gain;
+    if(!PyArg_ParseTuple(args, "If", &deviceID, &gain)) return NULL;
+    if(!(gain >= 0.0f && gain <= 1.0f)){
+        PyErr_SetString(PyExc_ValueError, "Gain must be in range 0.0-1.0");
+        return NULL;
+    }
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = playbackEngine.setGain(deviceID, gain);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromBool(ok);
+}
+
+static PyObject* PyCoreAudio_getPlaybackGain(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    if(!PyArg_ParseTuple(args, "I", &deviceID)) return NULL;
+    Float32 gain = playbackEngine.gain(deviceID);
+    if(gain < 0) Py_RETURN_NONE;
+    return PyFloat_FromDouble(gain);
+}
+/* ----------------------------------------------------------------------- */
+
+/* -----------------------------Conversion-------------------------------- */
+/*
+ * The sample kernels of convert.h on Python buffers. Buffers are read as
+ * raw bytes in the format given, so numpy arrays, array.array, bytes and
+ * memoryviews of any type work. Results go to a new bytearray, or to
+ * [out] when given so a caller can reuse one buffer.
+ */
+
+//Below this many samples, releasing the GIL costs more than it gives
+static const size_t CONVERT_GIL_THRESHOLD = 1 << 15;
+
+static bool parseSampleFormat(int format){
+    if(format < FORMAT_INT16 || format > FORMAT_FLOAT32){
+        PyErr_SetString(PyExc_ValueError, "Unknown sample format");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Get the buffer to write a result of [size] bytes to: [out] if given,
+ * which has to be large enough, or a new bytearray.
+ *
+ * @param result - set to a new reference of the object written to
+ * @result - whether [view] was filled, a Python exception is set otherwise
+ */
+static bool outputBuffer(PyObject* out, size_t size, Py_buffer* view, PyObject** result){
+    if(out == NULL || out == Py_None){
+        out = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t)size);
+        if(out == NULL) return false;
+    } else {
+        Py_INCREF(out);
+    }
+    if(PyObject_GetBuffer(out, view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0){
+        Py_DECREF(out);
+        return false;
+    }
+    if((size_t)view->len < size){
+        PyBuffer_Release(view);
+        Py_DECREF(out);
+        PyErr_Format(PyExc_ValueError, "The output buffer holds %zd bytes, %zu are needed", view->len, size);
+        return false;
+    }
+    *result = out;
+    return true;
+}
+
+static PyObject* PyCoreAudio_convertSamples(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    PyObject* data;
+    int sourceFormat, targetFormat;
+    PyObject* out = NULL;
+    if(!PyArg_ParseTuple(args, "Oii|O", &data, &sourceFormat, &targetFormat, &out)
+       || !parseSampleFormat(sourceFormat) || !parseSampleFormat(targetFormat)){
+        return NULL;
+    }
+    Py_buffer source;
+    if(PyObject_GetBuffer(data, &source, PyBUF_C_CONTIGUOUS) < 0) return NULL;
+    size_t sourceSize = sampleSize((SampleFormat)sourceFormat), targetSize = sampleSize((SampleFormat)targetFormat);
+    if(source.len % sourceSize != 0){
+        PyBuffer_Release(&source);
+        PyErr_Format(PyExc_ValueError, "The input is not a whole number of %zu byte samples", sourceSize);
+        return NULL;
+    }
+    size_t samples = source.len / sourceSize;
+    Py_buffer target;
+    PyObject* result;
+    if(!outputBuffer(out, samples * targetSize, &target, &result)){
+        PyBuffer_Release(&source);
+        return NULL;
+    }
+
+    PyThreadState* save = samples >= CONVERT_GIL_THRESHOLD ? PyEval_SaveThread() : NULL;
+    if(sourceFormat == FORMAT_FLOAT32){
+        fromFloat32((SampleFormat)targetFormat, (const Float32*)source.buf, target.buf, samples);
+    } else if(targetFormat == FORMAT_FLOAT32){
+        toFloat32((SampleFormat)sourceFormat, source.buf, (Float32*)target.buf, samples);
+    } else {
+        //Integer to integer goes through float, a block at a time
+        Float32 block[1024];
+        for(size_t done = 0; done < samples; done += 1024){
+            size_t count = samples - done < 1024 ? samples - done : 1024;
+            toFloat32((SampleFormat)sourceFormat, (const char*)source.buf + done * sourceSize, block, count);
+            fromFloat32((SampleFormat)targetFormat, block, (char*)target.buf + done * targetSize, count);
+        }
+    }
+    if(save != NULL) PyEval_RestoreThread(save);
+
+    PyBuffer_Release(&source);
+    PyBuffer_Release(&target);
+    return result;
+}
+
+/**
+ * Interleave or deinterleave a float32 buffer, see the wrappers below.
+ */
+static PyObject* convertLayout(PyObject* args, bool toInterleaved){
+    PyObject* data;
+    unsigned int channels;
+    PyObject* out = NULL;
+    if(!PyArg_ParseTuple(args, "OI|O", &data, &channels, &out)) return NULL;
+    if(channels == 0 || channels > MAX_CHANNELS){
+        PyErr_SetString(PyExc_ValueError, "Invalid channel count");
+        return NULL;
+    }
+    Py_buffer source;
+    if(PyObject_GetBuffer(data, &source, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) return NULL;
+    if(!isFloat32Buffer(source) || source.len % (channels * sizeof(Float32)) != 0){
+        PyBuffer_Release(&source);
+        PyErr_Format(PyExc_ValueError, "Expected float32 samples of %u channels", channels);
+        return NULL;
+    }
+    size_t frames = source.len / (channels * sizeof(Float32));
+    Py_buffer target;
+    PyObject* result;
+    if(!outputBuffer(out, (size_t)source.len, &target, &result)){
+        PyBuffer_Release(&source);
+        return NULL;
+    }
+
+    //Planes lie back to back, one per channel
+    Float32* planes[MAX_CHANNELS];
+    Float32* planar = (Float32*)(toInterleaved ? source.buf : target.buf);
+    for(UInt32 channel = 0; channel < channels; channel++) planes[channel] = planar + channel * frames;
+    PyThreadState* save = frames * channels >= CONVERT_GIL_THRESHOLD ? PyEval_SaveThread() : NULL;
+    if(toInterleaved) interleave(planes, channels, frames, (Float32*)target.buf);
+    else deinterleave((const Float32*)source.buf, channels, frames, planes);
+    if(save != NULL) PyEval_RestoreThread(save);
+
+    PyBuffer_Release(&source);
+    PyBuffer_Release(&target);
+    return result;
+}
+
+static PyObject* PyCoreAudio_interleave(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    return convertLayout(args, true);
+}
+
+static PyObject* PyCoreAudio_deinterleave(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    return convertLayout(args, false);
+}
+
+static PyObject* PyCoreAudio_getSimdLevel(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return PyUnicode_FromString(simd::name(simd::level()));
+}
+
+static PyObject* PyCoreAudio_setSimdLevel(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    const char* name = PyUnicode_AsUTF8(arg);
+    if(name == NULL) return NULL;
+    const simd::Level levels[] = { simd::LEVEL_SCALAR, simd::LEVEL_SSE2, simd::LEVEL_AVX2, simd::LEVEL_NEON };
+    for(simd::Level level : levels){
+        if(strcmp(name, simd::name(level)) == 0) return PyBool_FromBool(simd::setLevel(level));
+    }
+    PyErr_Format(PyExc_ValueError, "Unknown SIMD level '%s'", name);
+    return NULL;
+}
+/* ----------------------------------------------------------------------- */
+
+/* ---------------------------Channel volumes----------------------------- */
+/**
+ * Read the devices of a channel volume call: None for the default output
+ * device, an ID, or a sequence or buffer of IDs (see parseIntRecords()),
+ * and initialize what they need.
+ *
+ * @param many - set to whether [arg] lists devices, even if only one
+ * @result - whether [arg] could be read, a Python exception is set otherwise
+ */
+static bool parseVolumeDevices(PyObject* arg, std::vector<AudioDeviceID> &deviceIDs, bool &many){
+    many = false;
+    if(arg == Py_None){
+        if(!requireInit()) return false;
+        deviceIDs.assign(1, outputState()->deviceID);
+        return true;
+    }
+    if(PyLong_Check(arg)){
+        unsigned long deviceID = PyLong_AsUnsignedLong(arg);
+        if(deviceID == (unsigned long)-1 && PyErr_Occurred()) return false;
+        deviceIDs.assign(1, (AudioDeviceID)deviceID);
+    } else {
+        std::vector<long long> records;
+        if(!parseIntRecords(arg, 1, records)) return false;
+        deviceIDs.assign(records.begin(), records.end());
+        many = true;
+    }
+    return requireDevices();
+}
+
+/**
+ * Count the channels of every device, see getChannelVolumeCount().
+ *
+ * @result - total number of channels
+ */
+static size_t channelVolumeCounts(const std::vector<AudioDeviceID> &deviceIDs, std::vector<size_t> &counts){
+    size_t total = 0;
+    counts.resize(deviceIDs.size());
+    Py_BEGIN_ALLOW_THREADS
+    for(size_t i = 0; i < deviceIDs.size(); i++){
+        counts[i] = getChannelVolumeCount(deviceIDs[i]);
+        total += counts[i];
+    }
+    Py_END_ALLOW_THREADS
+    return total;
+}
+
+static PyObject* PyCoreAudio_getVolumeChannels(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    PyObject* device = Py_None;
+    if(!PyArg_ParseTuple(args, "|O", &device)) return NULL;
+    std::vector<AudioDeviceID> deviceIDs;
+    bool many;
+    if(!parseVolumeDevices(device, deviceIDs, many)) return NULL;
+    if(many){
+        PyErr_SetString(PyExc_TypeError, "Expected a single device ID or None");
+        return NULL;
+    }
+    ChannelMapRef map;
+    Py_BEGIN_ALLOW_THREADS
+    map = channelMaps.lookup(deviceIDs[0]);
+    Py_END_ALLOW_THREADS
+    return intVectorToTuple(map->volume);
+}
+
+static PyObject* PyCoreAudio_getChannelVolumes(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    PyObject* devices = Py_None;
+    int decibels = 0;
+    PyObject* out = NULL;
+    if(!PyArg_ParseTuple(args, "|OpO", &devices, &decibels, &out)) return NULL;
+    std::vector<AudioDeviceID> deviceIDs;
+    bool many;
+    if(!parseVolumeDevices(devices, deviceIDs, many)) return NULL;
+    std::vector<size_t> counts;
+    size_t total = channelVolumeCounts(deviceIDs, counts);
+
+    //A new array('f') unless [out] is given, filled in place either way
+    PyObject* created = NULL;
+    if(out == NULL || out == Py_None){
+        created = PySequence_Repeat(moduleState(self)->floatArray, (Py_ssize_t)total);
+        if(created == NULL) return NULL;
+        out = created;
+    }
+    Py_buffer target;
+    PyObject* result;
+    bool ok = outputBuffer(out, total * sizeof(Float32), &target, &result);
+    Py_XDECREF(created);
+    if(!ok) return NULL;
+
+    VolumeUnit unit = decibels ? VOLUME_DECIBELS : VOLUME_SCALAR;
+    std::unique_ptr<UInt8[]> results(new UInt8[deviceIDs.size()]);
+    Py_BEGIN_ALLOW_THREADS
+    if(many) getChannelVolumesForDevices(deviceIDs.data(), counts.data(), deviceIDs.size(), unit, (Float32*)target.buf, results.get());
+    else results[0] = getChannelVolumesForDevice(deviceIDs[0], unit, (Float32*)target.buf, counts[0]) ? 1 : 0;
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&target);
+    if(!many && !results[0]){
+        Py_DECREF(result);
+        PyErr_SetString(PyExc_Exception, "Failed to get channel volumes for device");
+        return NULL;
+    }
+    return result;
+}
+
+static PyObject* PyCoreAudio_setChannelVolumes(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    PyObject* devices;
+    PyObject* data;
+    int decibels = 0;
+    if(!PyArg_ParseTuple(args, "OO|p", &devices, &data, &decibels)) return NULL;
+    std::vector<AudioDeviceID> deviceIDs;
+    bool many;
+    if(!parseVolumeDevices(devices, deviceIDs, many)) return NULL;
+    std::vector<size_t> counts;
+    size_t total = channelVolumeCounts(deviceIDs, counts);
+
+    Py_buffer view;
+    if(PyObject_GetBuffer(data, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) return NULL;
+    if(!isFloat32Buffer(view) || (size_t)view.len != total * sizeof(Float32)){
+        PyBuffer_Release(&view);
+        PyErr_Format(PyExc_ValueError, "Expected %zu float32 values, one per channel", total);
+        return NULL;
+    }
+
+    VolumeUnit unit = decibels ? VOLUME_DECIBELS : VOLUME_SCALAR;
+    PyObject* res = PyBytes_FromStringAndSize(NULL, deviceIDs.size());
+    if(res == NULL){
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    UInt8* results = (UInt8*)PyBytes_AS_STRING(res);
+    Py_BEGIN_ALLOW_THREADS
+    if(many) setChannelVolumesForDevices(deviceIDs.data(), counts.data(), deviceIDs.size(), unit, (const Float32*)view.buf, results);
+    else results[0] = setChannelVolumesForDevice(deviceIDs[0], unit, (const Float32*)view.buf, counts[0]) ? 1 : 0;
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+    if(many) return res;
+    bool success = results[0] != 0;
+    Py_DECREF(res);
+    return PyBool_FromBool(success);
+}
+/* ----------------------------------------------------------------------- */
+
+/* -----------------------------Statistics-------------------------------- */
+/**
+ * Convert a property selector to its four characters, e.g. 'volm'.
+ * Selectors that are not printable are given as a number, 0 as ''.
+ */
+static PyObject* selectorString(AudioObjectPropertySelector selector){
+    if(selector == 0) return PyUnicode_FromString("");
+    char text[5];
+    for(int i = 0; i < 4; i++){
+        text[i] = (char)(selector >> (24 - 8 * i));
+        if(text[i] < 0x20 || text[i] > 0x7e) return PyUnicode_FromFormat("%u", (unsigned int)selector);
+    }
+    text[4] = 0;
+    return PyUnicode_FromString(text);
+}
+
+/**
+ * Convert the counts of one call to a dict.
+ *
+ * @param timing - the counts
+ * @param snapshot - for the bucket bounds
+ * @param errors - whether to include the number of failed calls
+ * @result - new dict or NULL
+ */
+static PyObject* timingDict(const stats::Timing &timing, const stats::Snapshot &snapshot, bool errors){
+    PyObject* histogram = PyList_New(0);
+    if(!histogram) return NULL;
+    for(UInt32 b = 0; b < stats::BUCKETS; b++){
+        if(timing.buckets[b] == 0) continue;
+        double bound = b + 1 < stats::BUCKETS ? snapshot.bucketNs(b) : HUGE_VAL;
+        PyObject* bucket = Py_BuildValue("(dK)", bound, (unsigned long long)timing.buckets[b]);
+        if(!bucket || PyList_Append(histogram, bucket) < 0){
+            Py_XDECREF(bucket);
+            Py_DECREF(histogram);
+            return NULL;
+        }
+        Py_DECREF(bucket);
+    }
+    double mean = timing.timed ? timing.totalNs / timing.timed : 0;
+    if(errors){
+        return Py_BuildValue("{s:K, s:K, s:K, s:d, s:d, s:N}", "calls", (unsigned long long)timing.calls,
+                             "errors", (unsigned long long)timing.errors, "timed", (unsigned long long)timing.timed,
+                             "total_ns", timing.totalNs, "mean_ns", mean, "histogram", histogram);
+    }
+    return Py_BuildValue("{s:K, s:K, s:d, s:d, s:N}", "calls", (unsigned long long)timing.calls,
+                         "timed", (unsigned long long)timing.timed, "total_ns", timing.totalNs,
+                         "mean_ns", mean, "histogram", histogram);
+}
+
+/**
+ * Set dict[key] = value and drop the reference to [value].
+ */
+static bool setItem(PyObject* dict, PyObject* key, PyObject* value){
+    bool ok = key && value && PyDict_SetItem(dict, key, value) == 0;
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    return ok;
+}
+
+static PyObject* PyCoreAudio_stats(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    stats::Snapshot snapshot;
+    Py_BEGIN_ALLOW_THREADS
+    snapshot = stats::read();
+    Py_END_ALLOW_THREADS
+
+    PyObject* result = PyDict_New();
+    PyObject* api = PyDict_New();
+    PyObject* hal = PyDict_New();
+    PyObject* errors = PyDict_New();
+    bool ok = result && api && hal && errors;
+    for(UInt32 i = 0; ok && i < stats::API_COUNT; i++){
+        if(snapshot.api[i].calls == 0) continue;
+        ok = setItem(api, PyUnicode_FromString(stats::name((stats::Api)i)), timingDict(snapshot.api[i], snapshot, false));
+    }
+    for(auto it = snapshot.hal.begin(); ok && it != snapshot.hal.end(); ++it){
+        const char* op = stats::name((stats::HalOp)it->first.first);
+        PyObject* selectors = PyDict_GetItemString(hal, op);
+        if(!selectors){
+            selectors = PyDict_New();
+            ok = selectors && PyDict_SetItemString(hal, op, selectors) == 0;
+            Py_XDECREF(selectors);      //[hal] holds it
+        }
+        ok = ok && setItem(selectors, selectorString(it->first.second), timingDict(it->second, snapshot, true));
+    }
+    for(auto it = snapshot.errors.begin(); ok && it != snapshot.errors.end(); ++it){
+        ok = setItem(errors, PyLong_FromLong(it->first), PyLong_FromUnsignedLongLong(it->second));
+    }
+    ok = ok && PyDict_SetItemString(result, "api", api) == 0 && PyDict_SetItemString(result, "hal", hal) == 0
+            && PyDict_SetItemString(result, "errors", errors) == 0
+            && setItem(result, PyUnicode_FromString("dropped"), PyLong_FromUnsignedLongLong(snapshot.dropped));
+    Py_XDECREF(api);
+    Py_XDECREF(hal);
+    Py_XDECREF(errors);
+    if(!ok){
+        Py_XDECREF(result);
+        return NULL;
+    }
+    return result;
+}
+
+static PyObject* PyCoreAudio_resetStats(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    stats::reset();
+    Py_RETURN_NONE;
+}
+/* ----------------------------------------------------------------------- */
+
+/* -------------------------------Tracing--------------------------------- */
+static PyObject* PyCoreAudio_startTrace(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    Py_ssize_t capacity = 16384;
+    Py_ssize_t threads = 32;
+    if(!PyArg_ParseTuple(args, "|nn", &capacity, &threads)) return NULL;
+    if(capacity <= 0 || threads <= 0){
+        PyErr_SetString(PyExc_ValueError, "capacity and threads must be positive");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    trace::start((size_t)capacity, (size_t)threads);
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject* PyCoreAudio_stopTrace(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    trace::stop();
+    Py_RETURN_NONE;
+}
+
+static PyObject* PyCoreAudio_dumpTrace(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    PyObject* pathArg;
+    if(!PyArg_ParseTuple(args, "O&", PyUnicode_FSConverter, &pathArg)) return NULL;
+    std::string path(PyBytes_AS_STRING(pathArg));
+    Py_DECREF(pathArg);
+    long written;
+    Py_BEGIN_ALLOW_THREADS
+    written = trace::dump(path);
+    Py_END_ALLOW_THREADS
+    if(written < 0){
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+        return NULL;
+    }
+    return PyLong_FromLong(written);
+}
+/* ----------------------------------------------------------------------- */
+
+/* ------------------------------asyncio---------------------------------- */
+/*
+ * The *Async functions return an asyncio future and run the call on the
+ * native worker pool (workers.h). The pool's result fd is registered
+ * with the running loop, whose reader callback resolves the futures
+ * right on the loop thread. Jobs beyond the pool's queue depth wait in a
+ * backlog until results make room. Every module object has its own pool
+ * and state (AsyncState).
+ */
+
+static PyObject* asyncDispatch(PyObject* self, PyObject* _);
+static PyMethodDef asyncDispatchDef = {"_asyncDispatch", asyncDispatch, METH_NOARGS, NULL};
+
+/**
+ * Resolve a future with the result of its job, the way the
+ * synchronous call would have returned or raised.
+ */
+static void asyncResolve(PyObject* module, PyObject* future, const AsyncResult &result){
+    PyObject* done = PyObject_CallMethod(future, "done", NULL);
+    if(done == NULL){
+        PyErr_WriteUnraisable(future);
+        return;
+    }
+    bool cancelled = PyObject_IsTrue(done) == 1;
+    Py_DECREF(done);
+    if(cancelled) return;
+
+    PyObject* value = NULL;
+    const char* error = NULL;
+    switch(result.op){
+        case ASYNC_GET_VOLUME:
+            value = PyLong_FromLong(result.value);
+            break;
+        case ASYNC_GET_MUTE:
+            if(result.value == -1) error = "Failed to get mute status";
+            else value = PyBool_FromBool(result.value != 0);
+            break;
+        case ASYNC_SET_VOLUME:
+        case ASYNC_SET_MUTE:
+        case ASYNC_SET_VOLUME_FOR_DEVICE:
+        case ASYNC_SET_MUTE_FOR_DEVICE:
+            value = PyBool_FromBool(result.value != 0);
+            break;
+        case ASYNC_GET_VOLUME_FOR_DEVICE:
+            if(result.value == -1) error = "Failed to get volume for device";
+            else value = PyLong_FromLong(result.value);
+            break;
+        case ASYNC_GET_MUTE_FOR_DEVICE:
+            if(result.value == -1) error = "Failed to get mute status for device";
+            else value = PyLong_FromLong(result.value);
+            break;
+        case ASYNC_GET_DEVICES:
+            if(!result.devices) error = "Error getting devices from system";
+            else value = deviceListToTuple(module, *result.devices);
+            break;
+    }
+
+    const char* method = "set_result";
+    if(error != NULL){
+        value = PyObject_CallFunction(PyExc_Exception, "s", error);
+        method = "set_exception";
+    }
+    PyObject* res = NULL;
+    if(value != NULL){
+        //Not PyObject_CallMethod(): a tuple result would be unpacked into arguments
+        PyObject* name = PyUnicode_FromString(method);
+        if(name != NULL) res = PyObject_CallMethodObjArgs(future, name, value, NULL);
+        Py_XDECREF(name);
+        Py_DECREF(value);
+    }
+    if(res == NULL) PyErr_WriteUnraisable(future);
+    Py_XDECREF(res);
+}
+
+/**
+ * Reader callback of the result fd: resolve every finished job, then
+ * move backlogged jobs into the room that made.
+ */
+static PyObject* asyncDispatch(PyObject* self, PyObject* _){
+    AsyncState* state = moduleState(self)->async;
+    AsyncResult results[64];
+    size_t count;
+    BEGIN_LOCKED(self)
+    while((count = state->pool.take(results, 64)) > 0){
+        for(size_t i = 0; i < count; i++){
+            std::map<UInt64, PyObject*>::iterator entry = state->futures.find(results[i].id);
+            if(entry == state->futures.end()) continue;     //dropped along with a closed loop
+            PyObject* future = entry->second;
+            state->futures.erase(entry);
+            asyncResolve(self, future, results[i]);
+            Py_DECREF(future);
+            results[i].devices.reset();
+        }
+    }
+    while(!state->backlog.empty() && state->pool.submit(state->backlog.front())){
+        state->backlog.pop_front();
+    }
+    END_LOCKED()
+    Py_RETURN_NONE;
+}
+
+/**
+ * Forget everything that belongs to the loop the result fd is
+ * registered with.
+ */
+static void asyncReleaseLoop(AsyncState* state){
+    for(std::map<UInt64, PyObject*>::iterator it = state->futures.begin(); it != state->futures.end(); ++it){
+        Py_DECREF(it->second);
+    }
+    state->futures.clear();
+    state->backlog.clear();
+    if(state->loop != NULL){
+        PyObject* res = PyObject_CallMethod(state->loop, "remove_reader", "i", state->pool.fd());
+        if(res == NULL) PyErr_Clear();      //the loop may be closed already
+        Py_XDECREF(res);
+        Py_CLEAR(state->loop);
+    }
+}
+
+/**
+ * Make sure the result fd is registered with [loop].
+ */
+static bool asyncAttach(PyObject* module, PyObject* loop){
+    AsyncState* state = moduleState(module)->async;
+    if(loop == state->loop) return true;
+    if(state->loop != NULL){
+        PyObject* closed = PyObject_CallMethod(state->loop, "is_closed", NULL);
+        if(closed == NULL) return false;
+        bool isClosed = PyObject_IsTrue(closed) == 1;
+        Py_DECREF(closed);
+        if(!isClosed && !state->futures.empty()){
+            PyErr_SetString(PyExc_RuntimeError, "Async calls are in use by another event loop");
+            return false;
+        }
+    }
+    asyncReleaseLoop(state);
+
+    PyObject* callback = PyCFunction_New(&asyncDispatchDef, module);
+    if(callback == NULL) return false;
+    PyObject* res = PyObject_CallMethod(loop, "add_reader", "iN", state->pool.fd(), callback);
+    if(res == NULL) return false;
+    Py_DECREF(res);
+    Py_INCREF(loop);
+    state->loop = loop;
+    return true;
+}
+
+/**
+ * Start a job and get the future that resolves with its result.
+ * Must be called from a coroutine or callback running on an asyncio loop.
+ */
+static PyObject* asyncSubmit(PyObject* module, UInt32 op, AudioDeviceID deviceID, int value){
+    //Only the calls on the default output device need it looked up
+    bool defaultDevice = op == ASYNC_GET_VOLUME || op == ASYNC_SET_VOLUME || op == ASYNC_GET_MUTE || op == ASYNC_SET_MUTE;
+    if(!(defaultDevice ? requireInit() : requireDevices())) return NULL;
+    PyObject* asyncio = PyImport_ImportModule("asyncio");
+    if(asyncio == NULL) return NULL;
+    PyObject* loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+    Py_DECREF(asyncio);
+    if(loop == NULL) return NULL;
+
+    AsyncState* state = moduleState(module)->async;
+    PyObject* future = NULL;
+    BEGIN_LOCKED(module)
+    if(asyncAttach(module, loop)) future = PyObject_CallMethod(loop, "create_future", NULL);
+    if(future != NULL){
+        AsyncJob job = { state->nextID++, op, deviceID, value };
+        Py_INCREF(future);
+        state->futures[job.id] = future;
+        //Keep the order: nothing overtakes the backlog
+        if(!state->backlog.empty() || !state->pool.submit(job)) state->backlog.push_back(job);
+    }
+    END_LOCKED()
+    Py_DECREF(loop);
+    return future;
+}
+
+static PyObject* PyCoreAudio_getVolumeAsync(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return asyncSubmit(self, ASYNC_GET_VOLUME, kAudioObjectUnknown, 0);
+}
+
+static PyObject* PyCoreAudio_setVolumeAsync(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    long value = PyLong_AsLong(arg);
+    if(value == -1 && PyErr_Occurred()) return NULL;
+    if(value < 0 || value > 100){
+        PyErr_SetString(PyExc_ValueError, "Volume must be in range 0-100");
+        return NULL;
+    }
+    return asyncSubmit(self, ASYNC_SET_VOLUME, kAudioObjectUnknown, (int)value);
+}
+
+static PyObject* PyCoreAudio_getMuteAsync(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return asyncSubmit(self, ASYNC_GET_MUTE, kAudioObjectUnknown, 0);
+}
+
+static PyObject* PyCoreAudio_setMuteAsync(PyObject* self, PyObject* arg){
+    TRACE_ENTRY();
+    int state = PyObject_IsTrue(arg);
+    if(state < 0) return NULL;
+    return asyncSubmit(self, ASYNC_SET_MUTE, kAudioObjectUnknown, state);
+}
+
+static PyObject* PyCoreAudio_getVolumeForDeviceAsync(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    if(!PyArg_ParseTuple(args, "I", &deviceID)) return NULL;
+    return asyncSubmit(self, ASYNC_GET_VOLUME_FOR_DEVICE, deviceID, 0);
+}
+
+static PyObject* PyCoreAudio_setVolumeForDeviceAsync(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    int volume;
+    if(!PyArg_ParseTuple(args, "Ii", &deviceID, &volume)) return NULL;
+    if(volume < 0 || volume > 100){
+        PyErr_SetString(PyExc_ValueError, "Volume must be in range 0-100");
+        return NULL;
+    }
+    return asyncSubmit(self, ASYNC_SET_VOLUME_FOR_DEVICE, deviceID, volume);
+}
+
+static PyObject* PyCoreAudio_getMuteForDeviceAsync(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    if(!PyArg_ParseTuple(args, "I", &deviceID)) return NULL;
+    return asyncSubmit(self, ASYNC_GET_MUTE_FOR_DEVICE, deviceID, 0);
+}
+
+static PyObject* PyCoreAudio_setMuteForDeviceAsync(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    AudioDeviceID deviceID;
+    int mute;
+    if(!PyArg_ParseTuple(args, "Ip", &deviceID, &mute)) return NULL;
+    return asyncSubmit(self, ASYNC_SET_MUTE_FOR_DEVICE, deviceID, mute);
+}
+
+static PyObject* PyCoreAudio_getDevicesAsync(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    return asyncSubmit(self, ASYNC_GET_DEVICES, kAudioObjectUnknown, 0);
+}
+
+static PyObject* PyCoreAudio_setAsyncLimits(PyObject* self, PyObject* args){
+    TRACE_ENTRY();
+    unsigned int threads, depth;
+    if(!PyArg_ParseTuple(args, "II", &threads, &depth)) return NULL;
+    if(threads < 1 || threads > 64 || depth < 1){
+        PyErr_SetString(PyExc_ValueError, "Need 1-64 threads and a depth of at least 1");
+        return NULL;
+    }
+    WorkerPool &pool = moduleState(self)->async->pool;
+    Py_BEGIN_ALLOW_THREADS
+    pool.configure(threads, depth);
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject* PyCoreAudio_getAsyncLimits(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    WorkerPool &pool = moduleState(self)->async->pool;
+    return Py_BuildValue("(n, n)", (Py_ssize_t)pool.threads(), (Py_ssize_t)pool.depth());
+}
+
+static PyObject* PyCoreAudio_asyncInFlight(PyObject* self, PyObject* _){
+    TRACE_ENTRY();
+    size_t inFlight;
+    BEGIN_LOCKED(self)
+    inFlight = moduleState(self)->async->futures.size();
+    END_LOCKED()
+    return PyLong_FromSize_t(inFlight);
+}
+/* ----------------------------------------------------------------------- */
+
+static PyMethodDef PyCoreAudioMethods[] = {
+    {"init",  PyCoreAudio_init, METH_NOARGS,
+        "Initialize the module. Finds and selects the currently selected audio output device.\n"
+        "This does not open/lock the audio device, so it will not affect other applications\n"
+        "using the same device. Calling it again does nothing and returns True.\n"
+        "Other functions call it on demand, see setLazyInit()."},
+    
+    {"ready",  PyCoreAudio_ready, METH_NOARGS,
+        "Check if the module is initialized. Returns a boolean."},
+    
+    {"deinit",  PyCoreAudio_deinit, METH_NOARGS,
+        "Deinitialize the module. It is possible to run init() again after this function.\n"
+        "Reinitialization should be done if the currently selected audio output device has\n"
+        "been changed, unless setFollowDefaultDevice(True) is used.\n"
+        "If the module is not initialized, this does nothing."},
+
+    {"setLazyInit", PyCoreAudio_setLazyInit, METH_O,
+        "Set whether functions initialize the module on demand: setLazyInit(state). On by default.\n"
+        "The device list and per-device functions then only start the device caches, and the first\n"
+        "function that needs the default output device looks it up and maps its channels, once,\n"
+        "however many threads call at the same time. With setLazyInit(False), functions raise an\n"
+        "exception until init() is called."},
+
+    {"getLazyInit", PyCoreAudio_getLazyInit, METH_NOARGS,
+        "Get whether functions initialize the module on demand, see setLazyInit()."},
+    
+    {"setDeviceCache", PyCoreAudio_setDeviceCache, METH_O,
+        "Set the device cache file, taking effect with the next init(): setDeviceCache(path).\n"
+        "The file keeps the names, stream counts and channel maps of the devices between runs, so\n"
+        "init() and the first calls need not query every device. What it holds is checked again in\n"
+        "the background after init(), and the file is rewritten if anything changed.\n"
+        "None, the default, disables the cache."},
+
+    {"getDeviceCache", PyCoreAudio_getDeviceCache, METH_NOARGS,
+        "Get the device cache file set with setDeviceCache(), None if there is none."},
+
+    {"waitDeviceCache", PyCoreAudio_waitDeviceCache, METH_VARARGS,
+        "Wait until the device cache has been checked and written after init(): waitDeviceCache(timeout=None).\n"
+        "deinit() stops the check where it is, a short-lived process calls this first to have the\n"
+        "file written on its first run. Returns whether the check is done."},
+
+    {"getValidChannels", PyCoreAudio_getValidChannels, METH_NOARGS,
+        "Get a list of valid channels. Returns a tuple.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+
+    {"getSubDevices", PyCoreAudio_getSubDevices, METH_VARARGS,
+        "Get the active sub-devices of an aggregate or multi-output device: getSubDevices(id).\n"
+        "Returns a tuple of device IDs, empty if the device is no aggregate or has volume and mute\n"
+        "controls of its own. Volume and mute calls on an aggregate device without these controls\n"
+        "are applied to all of its sub-devices at once.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+    
+    {"getMute", PyCoreAudio_getMute, METH_NOARGS,
+        "Get mute status of the current audio output device. Returns a boolean,\n"
+        "raises if the mute state cannot be read.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+    
+    {"setMute", PyCoreAudio_setMute, METH_O,
+        "Set mute status of the current audio output device. Returns a boolean, which represents\n"
+        "whether the operation was successful or not.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+    
+    {"mute", PyCoreAudio_mute, METH_NOARGS,
+        "Mute the current audio output device. Alias to setMute(True)."},
+    
+    {"unmute", PyCoreAudio_unmute, METH_NOARGS,
+        "Unmute the current audio output device. Alias to setMute(False)."},
+    
+    {"getVolume", PyCoreAudio_getVolume, METH_NOARGS,
+        "Get the currently set volume level of the current audio output device.\n"
+        "Returns an in in range [0; 100], indicating the volume level in percentage.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+    
+    {"setVolume", PyCoreAudio_setVolume, METH_O,
+        "Set volume level of the current audio output device. Takes a single argument - \n"
+        "int. The argument must be in interval [0; 100], indicating the volume level in percentage.\n"
+        "Returns a boolean, which represents whether the operation was successful or not.\n"
+        "If the argument is out of range, an exception will be raised."},
+    
+    {"getDeviceCount", PyCoreAudio_getDeviceCount, METH_NOARGS, 
+        "Get the amount of audio input and output devices available on this system.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+    
+    {"getDevices", PyCoreAudio_getDevices, METH_NOARGS,
+        "Get all audio input and output devices available on this system along with\n"
+        "some of their properties. Returns a tuple of tuples.\n"
+        "The tuples are structured like this:\n"
+        "(name, manufacturer, uid, number of input streams, number of output streams,\n"
+        "isMicrophone, isSpeaker).\n"
+        "Keep in mind that a single device can have both input and output streams.\n"
+        "In such a case, the last two properties will be True.\n"
+        "If the module fails to get the name of the device, the value \"Unknown\"\n"
+        "will be used.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+
+    {"listDeviceIDs", PyCoreAudio_listDeviceIDs, METH_NOARGS,
+        "Get the IDs of all audio input and output devices available on this system.\n"
+        "Returns a tuple of integers. Nothing but the device list is queried, so this is\n"
+        "much cheaper than getDevices().\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+
+    {"listDevices", PyCoreAudio_listDevices, METH_NOARGS,
+        "Get all audio input and output devices available on this system as a tuple of\n"
+        "Device objects. Their attributes (name, manufacturer, uid, inStreams, outStreams,\n"
+        "isMic, isSpeaker, channels) are only queried when first read, so filtering the\n"
+        "devices by one attribute does not pay for the others.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+    
+    {"getCurrentDevice", PyCoreAudio_getCurrentDevice, METH_NOARGS,
+        "Get the name of the current audio output device.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
     {"setVolumeForDevice", PyCoreAudio_setVolumeForDevice, METH_VARARGS, "Set volume level of a specified output device."},
     {"getVolumeForDevice", PyCoreAudio_getVolumeForDevice, METH_VARARGS, "Get volume level of a specified output device."},
     {"setMuteForDevice", PyCoreAudio_setMuteForDevice, METH_VARARGS, "Set mute status of a specified output device."},
     {"getMuteForDevice", PyCoreAudio_getMuteForDevice, METH_VARARGS, "Get mute status of a specified output device."},
+
+    {"getDeviceIDForUID", PyCoreAudio_getDeviceIDForUID, METH_VARARGS,
+        "Get the ID of the device with the given UID, or None if there is no such device.\n"
+        "Lookups go through an index that is kept up to date as devices come and go."},
+
+    {"getDeviceIDForName", PyCoreAudio_getDeviceIDForName, METH_VARARGS,
+        "Get the ID of the device with the given name, or None if there is no such device.\n"
+        "If several devices have that name, the one with the lowest ID is returned."},
+
+    {"setVolumeForUID", PyCoreAudio_setVolumeForUID, METH_VARARGS,
+        "Like setVolumeForDevice(), but takes the UID of the device: setVolumeForUID(uid, volume).\n"
+        "Raises KeyError if there is no device with that UID."},
+
+    {"getVolumeForUID", PyCoreAudio_getVolumeForUID, METH_VARARGS,
+        "Like getVolumeForDevice(), but takes the UID of the device.\n"
+        "Raises KeyError if there is no device with that UID."},
+
+    {"setMuteForUID", PyCoreAudio_setMuteForUID, METH_VARARGS,
+        "Like setMuteForDevice(), but takes the UID of the device: setMuteForUID(uid, mute).\n"
+        "Raises KeyError if there is no device with that UID."},
+
+    {"getMuteForUID", PyCoreAudio_getMuteForUID, METH_VARARGS,
+        "Like getMuteForDevice(), but takes the UID of the device.\n"
+        "Raises KeyError if there is no device with that UID."},
+
+    {"setVolumes", PyCoreAudio_setVolumes, METH_O,
+        "Set the volume level of several output devices in one call. Takes a sequence of\n"
+        "(deviceID, volume) tuples, or a buffer of 32 bit integers (e.g. array('I')) holding\n"
+        "deviceID, volume pairs back to back. Volumes must be in interval [0; 100].\n"
+        "Returns bytes with one entry per device - 1 if the volume was set, 0 otherwise."},
+
+    {"getVolumes", PyCoreAudio_getVolumes, METH_O,
+        "Get the volume level of several output devices in one call. Takes a sequence or a\n"
+        "buffer of 32 bit integers holding device IDs. Returns bytes with one entry per device -\n"
+        "the volume level in range [0; 100], or 255 if it could not be retrieved."},
+
+    {"setMutes", PyCoreAudio_setMutes, METH_O,
+        "Set the mute status of several output devices in one call. Takes a sequence of\n"
+        "(deviceID, mute) tuples, or a buffer of 32 bit integers holding the pairs back to back.\n"
+        "Returns bytes with one entry per device - 1 if the status was set, 0 otherwise."},
+
+    {"getMutes", PyCoreAudio_getMutes, METH_O,
+        "Get the mute status of several output devices in one call. Takes a sequence or a\n"
+        "buffer of 32 bit integers holding device IDs. Returns bytes with one entry per device -\n"
+        "0 or 1, or 255 if the status could not be retrieved."},
+
+    {"applyScene", PyCoreAudio_applyScene, METH_O,
+        "Apply volume levels and mute states to several output devices in one call. Takes a\n"
+        "sequence of (deviceID, volume, mute) tuples, where volume or mute may be None to leave\n"
+        "it unchanged, or a buffer of 32 bit integers holding the triples back to back with -1\n"
+        "for \"unchanged\". Devices are muted before and unmuted after their volume changes.\n"
+        "Returns bytes with one entry per device - 1 if everything was applied, 0 otherwise."},
+
+    {"getVolumeChannels", PyCoreAudio_getVolumeChannels, METH_VARARGS,
+        "Get the channels with a volume control of a device: getVolumeChannels(id=None), None for\n"
+        "the default output device. Returns a tuple of elements, main element first, in the order\n"
+        "getChannelVolumes() and setChannelVolumes() use."},
+
+    {"getChannelVolumes", PyCoreAudio_getChannelVolumes, METH_VARARGS,
+        "Get the volume of every channel, unaveraged: getChannelVolumes(ids=None, decibels=False, out=None).\n"
+        "ids is None for the default output device, a device ID, or a sequence or buffer of 32 bit\n"
+        "integers holding device IDs. Returns array('f') with one value per channel, the channels\n"
+        "of every device (see getVolumeChannels()) back to back, or fills the writable buffer out\n"
+        "instead. Values are volume scalars (0.0-1.0), or dB if decibels is true. Raises if a single\n"
+        "device could not be read; with several devices, those that could not be read are NaN.\n"
+        "A device without volume control has no channels and fails, take the sub-devices of an\n"
+        "aggregate device instead.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+
+    {"setChannelVolumes", PyCoreAudio_setChannelVolumes, METH_VARARGS,
+        "Set the volume of every channel, each to its own value: setChannelVolumes(ids, values, decibels=False).\n"
+        "ids is as for getChannelVolumes(), values any buffer of float32 (array('f'), numpy float32)\n"
+        "with exactly one value per channel, laid out like getChannelVolumes() returns them, in dB\n"
+        "if decibels is true. A device given a NaN is left alone. Returns whether the device was\n"
+        "set for a single device, bytes with one entry per device - 1 if set, 0 otherwise - for a\n"
+        "sequence. If the module is not initialized, it is initialized first, see setLazyInit()."},
+
+    {"setFollowDefaultDevice", PyCoreAudio_setFollowDefaultDevice, METH_O,
+        "Follow changes of the default output device. Takes a single argument - bool.\n"
+        "When enabled, the module switches to the new default output device (and rescans its\n"
+        "channels) as soon as it changes, so deinit()/init() is not needed anymore. Calls running\n"
+        "concurrently with a switch act either on the old or on the new device, never on a mix.\n"
+        "Returns a boolean, which represents whether the operation was successful or not.\n"
+        "deinit() disables following."},
+
+    {"getFollowDefaultDevice", PyCoreAudio_getFollowDefaultDevice, METH_NOARGS,
+        "Check whether changes of the default output device are followed. Returns a boolean."},
+
+    {"watch", PyCoreAudio_watch, METH_VARARGS,
+        "Start receiving change notifications. Takes two optional arguments - a bit mask of\n"
+        "EVENT_VOLUME, EVENT_MUTE, EVENT_DEFAULT_OUTPUT and EVENT_DEVICE_LIST (default: EVENT_ALL)\n"
+        "and the ID of the device to watch volume/mute changes on (default: current output device).\n"
+        "Can be called multiple times to watch several devices. Returns a boolean, which represents\n"
+        "whether all listeners could be installed. Events are collected with readEvents().\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+
+    {"unwatch", PyCoreAudio_unwatch, METH_NOARGS,
+        "Stop receiving change notifications. Events already collected can still be read."},
+
+    {"readEvents", PyCoreAudio_readEvents, METH_VARARGS,
+        "Read pending change notifications. Takes an optional timeout in seconds - None (default)\n"
+        "blocks until at least one event arrives, 0 does not block at all.\n"
+        "Returns a tuple of (kind, deviceID, channel, timestamp) tuples, which is empty if the\n"
+        "timeout expired. kind is one of the EVENT_* constants, deviceID is 1 (the system object)\n"
+        "for EVENT_DEFAULT_OUTPUT and EVENT_DEVICE_LIST, timestamp is in nanoseconds of the\n"
+        "monotonic clock. The GIL is released while waiting."},
+
+    {"eventFD", PyCoreAudio_eventFD, METH_NOARGS,
+        "Get a file descriptor which becomes readable when events are pending. Use it with\n"
+        "select/poll or asyncio's loop.add_reader() and call readEvents(0) when it fires."},
+
+    {"droppedEvents", PyCoreAudio_droppedEvents, METH_NOARGS,
+        "Get the number of events dropped because they were not read in time."},
+
+    {"fade", PyCoreAudio_fade, METH_VARARGS,
+        "Fade the volume of a device natively: fade(id, target, duration_ms, curve=FADE_LINEAR).\n"
+        "target is a volume level (0-100), curve one of FADE_LINEAR, FADE_EQUAL_POWER or FADE_DB.\n"
+        "Returns right away with the ID of the fade, or 0 if the device's volume could not be read.\n"
+        "Starting a fade on a device cancels the one running there. When a fade ends, a\n"
+        "(fadeID, deviceID, status, timestamp) tuple is queued for readFades(); status is one of\n"
+        "FADE_DONE, FADE_CANCELLED or FADE_FAILED.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+
+    {"cancelFade", PyCoreAudio_cancelFade, METH_O,
+        "Cancel the fade running on a device, leaving its volume where it is.\n"
+        "Returns whether a fade was running."},
+
+    {"waitFade", PyCoreAudio_waitFade, METH_VARARGS,
+        "Wait until no fade runs on a device: waitFade(id, timeout=None).\n"
+        "Returns False if the timeout (in seconds) expired."},
+
+    {"readFades", PyCoreAudio_readFades, METH_VARARGS,
+        "Get the fades that ended, as a tuple of (fadeID, deviceID, status, timestamp) tuples.\n"
+        "Waits for the first one if there are none yet: readFades(timeout=None)."},
+
+    {"fadeFD", PyCoreAudio_fadeFD, METH_NOARGS,
+        "Get a file descriptor that polls readable while readFades() has something to return."},
+
+    {"setFadeTickRate", PyCoreAudio_setFadeTickRate, METH_O,
+        "Set how many times per second running fades update the volume (1-1000, default 100)."},
+
+    {"getFadeTickRate", PyCoreAudio_getFadeTickRate, METH_NOARGS,
+        "Get how many times per second running fades update the volume."},
+
+    {"activeFades", PyCoreAudio_activeFades, METH_NOARGS,
+        "Get the number of running fades."},
+
+    {"startMeter", PyCoreAudio_startMeter, METH_VARARGS,
+        "Start metering a device: startMeter(id, scope=METER_INPUT, integration_ms=300, release_ms=1500).\n"
+        "METER_INPUT measures the input streams of the device, METER_OUTPUT what this module plays\n"
+        "to its output streams (the HAL does not show an IOProc what other applications play).\n"
+        "integration_ms is the time constant of the RMS level, release_ms that of the peak release.\n"
+        "Replaces a meter running on the same device and scope. Returns the number of channels\n"
+        "metered, 0 if the device has none in that scope or its IOProc could not be started.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+
+    {"stopMeter", PyCoreAudio_stopMeter, METH_VARARGS,
+        "Stop metering a device: stopMeter(id, scope=METER_INPUT).\n"
+        "Returns whether a meter was running."},
+
+    {"readMeter", PyCoreAudio_readMeter, METH_VARARGS,
+        "Get the levels of a metered device: readMeter(id, scope=METER_INPUT).\n"
+        "Returns a (peak, rms, clips) tuple per channel, or None if the device is not metered.\n"
+        "peak and rms are linear (1.0 is full scale), clips counts the samples at or beyond full scale.\n"
+        "Updated once per IO cycle; reading takes no lock."},
+
+    {"getMeterFrames", PyCoreAudio_getMeterFrames, METH_VARARGS,
+        "Get the number of frames a meter measured so far: getMeterFrames(id, scope=METER_INPUT).\n"
+        "Returns None if the device is not metered."},
+
+    {"startCapture", PyCoreAudio_startCapture, METH_VARARGS,
+        "Start recording the input of a device: startCapture(id, capacity_frames=0).\n"
+        "The frames of all input streams are interleaved into a ring of at least capacity_frames\n"
+        "frames (0 for one second); frames arriving while it is full are dropped and counted.\n"
+        "Replaces a capture running on the same device. Returns the number of channels captured,\n"
+        "0 if the device has no input or its IOProc could not be started.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+
+    {"stopCapture", PyCoreAudio_stopCapture, METH_VARARGS,
+        "Stop recording a device: stopCapture(id).\n"
+        "Buffers read from the capture stay valid. Returns whether a capture was running."},
+
+    {"readCapture", PyCoreAudio_readCapture, METH_VARARGS,
+        "Borrow the oldest recorded frames of a device: readCapture(id, max_frames=0, timeout=0).\n"
+        "Returns a CaptureBuffer exposing up to max_frames frames (0 for all) in place, without a copy,\n"
+        "or None if none arrived within timeout seconds (None waits forever). A buffer ends at the end\n"
+        "of the ring; the next call returns the frames after it. Only one buffer can be borrowed at a\n"
+        "time, it has to be released before the next read."},
+
+    {"getCaptureStats", PyCoreAudio_getCaptureStats, METH_VARARGS,
+        "Get the counters of a capture: getCaptureStats(id).\n"
+        "Returns a dict with the channels, the frames captured, dropped and queued, the number of\n"
+        "overruns (IO cycles that lost frames) and the capacity of the ring in frames, or None if\n"
+        "the device is not captured."},
+
+    {"startPlayback", PyCoreAudio_startPlayback, METH_VARARGS,
+        "Start playing to the output of a device: startPlayback(id, capacity_frames=0).\n"
+        "Frames written with writePlayback() are queued in a ring of at least capacity_frames frames\n"
+        "(0 for 100 ms), which also bounds the latency. Replaces a playback running on the same device.\n"
+        "Returns the number of interleaved channels to write, over all output streams in order, 0 if\n"
+        "the device has no output or its IOProc could not be started.\n"
+        "If the module is not initialized, it is initialized first, see setLazyInit()."},
+
+    {"stopPlayback", PyCoreAudio_stopPlayback, METH_VARARGS,
+        "Stop playing to a device, dropping what is queued: stopPlayback(id).\n"
+        "Blocked writePlayback() calls return. Returns whether a playback was running."},
+
+    {"writePlayback", PyCoreAudio_writePlayback, METH_VARARGS,
+        "Queue frames for playback: writePlayback(id, data, timeout=None).\n"
+        "data is any buffer of native float32 samples (e.g. a numpy float32 array, array('f')) or raw\n"
+        "bytes of them, holding whole frames of interleaved channels. Copies with the GIL released and\n"
+        "waits for room in the ring as needed, up to timeout seconds (None waits until all is queued).\n"
+        "Returns the number of frames queued."},
+
+    {"drainPlayback", PyCoreAudio_drainPlayback, METH_VARARGS,
+        "Declare the end of what is to be played and wait for it to play: drainPlayback(id, timeout=None).\n"
+        "The ring running empty after that is not counted as an underrun until the next write.\n"
+        "Returns whether everything queued was played within timeout seconds."},
+
+    {"getPlaybackStats", PyCoreAudio_getPlaybackStats, METH_VARARGS,
+        "Get the counters of a playback: getPlaybackStats(id).\n"
+        "Returns a dict with the channels, the frames written and played, the underruns (IO cycles\n"
+        "that ran short while not drained) and the frames of silence they played, the frames queued,\n"
+        "the capacity of the ring, and the latency of the next frame written now and its maximum so\n"
+        "far in seconds, or None if the device has no playback."},
+
+    {"setPlaybackGain", PyCoreAudio_setPlaybackGain, METH_VARARGS,
+        "Scale what is played to a device: setPlaybackGain(id, gain), gain a float in 0.0-1.0.\n"
+        "Applied in software in the module's IOProc, with every change ramped over 20 ms. This only\n"
+        "affects what writePlayback() plays, not other applications, and not the volume of the device.\n"
+        "Lasts until stopPlayback(). Returns False if the device has no playback."},
+
+    {"getPlaybackGain", PyCoreAudio_getPlaybackGain, METH_VARARGS,
+        "Get the gain set with setPlaybackGain(): getPlaybackGain(id).\n"
+        "Returns a float, 1.0 until set, or None if the device has no playback."},
+
+    {"convertSamples", PyCoreAudio_convertSamples, METH_VARARGS,
+        "Convert samples between formats: convertSamples(data, source_format, target_format, out=None).\n"
+        "Formats are FORMAT_INT16, FORMAT_INT24 (packed), FORMAT_INT32 and FORMAT_FLOAT32, native-endian;\n"
+        "data is read as raw bytes of source_format. Floats are clipped to full scale and rounded to\n"
+        "nearest when converted to integers. Writes to out if given, a writable buffer large enough,\n"
+        "and returns it, otherwise returns a new bytearray. Uses the SIMD kernels of getSimdLevel()."},
+
+    {"interleave", PyCoreAudio_interleave, METH_VARARGS,
+        "Interleave planar float32 samples: interleave(data, channels, out=None).\n"
+        "data holds one plane per channel back to back, e.g. a (channels, frames) numpy array.\n"
+        "Writes the (frames, channels) result to out if given and returns it, otherwise returns a new bytearray."},
+
+    {"deinterleave", PyCoreAudio_deinterleave, METH_VARARGS,
+        "Split interleaved float32 samples into planes: deinterleave(data, channels, out=None).\n"
+        "data holds (frames, channels) samples; the result holds one plane per channel back to back.\n"
+        "Writes to out if given and returns it, otherwise returns a new bytearray."},
+
+    {"getSimdLevel", PyCoreAudio_getSimdLevel, METH_NOARGS,
+        "Get the instruction set of the sample kernels: 'scalar', 'sse2', 'avx2' or 'neon'.\n"
+        "The best one the CPU supports is used unless changed with setSimdLevel()."},
+
+    {"setSimdLevel", PyCoreAudio_setSimdLevel, METH_O,
+        "Make the sample kernels use another instruction set, e.g. setSimdLevel('scalar').\n"
+        "Returns False, changing nothing, if the CPU or the build does not support it."},
+
+    {"stats", PyCoreAudio_stats, METH_NOARGS,
+        "Get the call statistics counted since the module was loaded or resetStats() was called.\n"
+        "Returns a dict: 'api' maps every entry point called (e.g. 'setVolume') to its counts, 'hal'\n"
+        "maps every CoreAudio call made (e.g. 'getPropertyData') to a dict of counts by property\n"
+        "selector (e.g. 'volm', '' for calls without one), 'errors' maps the OSStatus values\n"
+        "returned by failed CoreAudio calls to how often they came, and 'dropped' counts CoreAudio\n"
+        "calls whose selector or OSStatus could not be told apart. Counts are dicts with 'calls',\n"
+        "'errors' (CoreAudio calls only), 'timed', 'total_ns', 'mean_ns' and 'histogram', a list\n"
+        "of (upper bound in ns, calls) for every non-empty power-of-two latency bucket. Every call\n"
+        "is counted but only a random sample of about one in four is timed: 'timed' calls make up\n"
+        "the histogram, 'total_ns' and 'mean_ns'. Only the outermost entry point is counted when\n"
+        "one calls another."},
+
+    {"resetStats", PyCoreAudio_resetStats, METH_NOARGS,
+        "Start counting the call statistics of stats() from zero."},
+
+    {"startTrace", PyCoreAudio_startTrace, METH_VARARGS,
+        "Start recording trace events, dropping those recorded before: startTrace(capacity=16384, threads=32).\n"
+        "Every CoreAudio call, property listener callback, C++ entry point and function of this module\n"
+        "then records a begin and an end event, with the object and property selector where there is\n"
+        "one. Each thread records into a ring of capacity events (rounded up to a power of two) and\n"
+        "overwrites its oldest events when the ring is full. The rings of the first threads threads to\n"
+        "record are allocated here; any further thread records nothing until the next startTrace().\n"
+        "While not tracing, this costs a single branch per call."},
+
+    {"stopTrace", PyCoreAudio_stopTrace, METH_NOARGS,
+        "Stop recording trace events. The events recorded are kept for dumpTrace()."},
+
+    {"dumpTrace", PyCoreAudio_dumpTrace, METH_VARARGS,
+        "Write the trace events recorded since startTrace() to a file: dumpTrace(path).\n"
+        "The file is Chrome trace event JSON, which chrome://tracing and https://ui.perfetto.dev open.\n"
+        "Can be called while tracing. Returns the number of events written."},
+
+    {"getVolumeAsync", PyCoreAudio_getVolumeAsync, METH_NOARGS,
+        "Awaitable getVolume(). Must be called while an asyncio event loop is running.\n"
+        "Every *Async function returns an asyncio future that resolves to what the synchronous\n"
+        "call would return, or raises what it would raise. The call runs on a small pool of\n"
+        "native threads and the loop is woken through a file descriptor, so the loop never blocks."},
+
+    {"setVolumeAsync", PyCoreAudio_setVolumeAsync, METH_O,
+        "Awaitable setVolume(volume)."},
+
+    {"getMuteAsync", PyCoreAudio_getMuteAsync, METH_NOARGS,
+        "Awaitable getMute()."},
+
+    {"setMuteAsync", PyCoreAudio_setMuteAsync, METH_O,
+        "Awaitable setMute(state)."},
+
+    {"getVolumeForDeviceAsync", PyCoreAudio_getVolumeForDeviceAsync, METH_VARARGS,
+        "Awaitable getVolumeForDevice(id)."},
+
+    {"setVolumeForDeviceAsync", PyCoreAudio_setVolumeForDeviceAsync, METH_VARARGS,
+        "Awaitable setVolumeForDevice(id, volume)."},
+
+    {"getMuteForDeviceAsync", PyCoreAudio_getMuteForDeviceAsync, METH_VARARGS,
+        "Awaitable getMuteForDevice(id)."},
+
+    {"setMuteForDeviceAsync", PyCoreAudio_setMuteForDeviceAsync, METH_VARARGS,
+        "Awaitable setMuteForDevice(id, mute)."},
+
+    {"getDevicesAsync", PyCoreAudio_getDevicesAsync, METH_NOARGS,
+        "Awaitable getDevices()."},
+
+    {"setAsyncLimits", PyCoreAudio_setAsyncLimits, METH_VARARGS,
+        "Set the number of native threads running *Async calls and how many calls may be queued\n"
+        "on them: setAsyncLimits(threads, depth). Defaults to 4 threads and a depth of 256.\n"
+        "Calls beyond the depth wait in order until earlier ones finish."},
+
+    {"getAsyncLimits", PyCoreAudio_getAsyncLimits, METH_NOARGS,
+        "Get the (threads, depth) set with setAsyncLimits()."},
+
+    {"asyncInFlight", PyCoreAudio_asyncInFlight, METH_NOARGS,
+        "Get the number of *Async calls that have not finished yet."},
+
+#ifdef PYCOREAUDIO_SIMULATED_HAL
+    {"_simPopulate", PyCoreAudio_simPopulate, METH_VARARGS,
+        "Simulated HAL only. Replace all devices with N generic ones: _simPopulate(N, channels=2)."},
+    {"_simSetLatency", PyCoreAudio_simSetLatency, METH_VARARGS,
+        "Simulated HAL only. Set the latency added to every HAL call, in nanoseconds:\n"
+        "_simSetLatency(ns, jitter=0). A random extra of up to jitter ns is added to every call."},
+    {"_simCallCount", PyCoreAudio_simCallCount, METH_NOARGS,
+        "Simulated HAL only. Get the number of HAL calls made so far."},
+    {"_simSetDefaultOutputDevice", PyCoreAudio_simSetDefaultOutputDevice, METH_O,
+        "Simulated HAL only. Make another device the default output device."},
+    {"_simSetChannelCount", PyCoreAudio_simSetChannelCount, METH_VARARGS,
+        "Simulated HAL only. Change the number of output channels of a device: _simSetChannelCount(id, channels)."},
+    {"_simSetStreamCounts", PyCoreAudio_simSetStreamCounts, METH_VARARGS,
+        "Simulated HAL only. Change the number of streams of a device: _simSetStreamCounts(id, in, out)."},
+    {"_simSetDeviceName", PyCoreAudio_simSetDeviceName, METH_VARARGS,
+        "Simulated HAL only. Rename a device: _simSetDeviceName(id, name)."},
+    {"_simStringReferences", PyCoreAudio_simStringReferences, METH_NOARGS,
+        "Simulated HAL only. Total reference count of the device strings, see SimBackend::stringReferences()."},
+    {"_simSetInputSignal", PyCoreAudio_simSetInputSignal, METH_VARARGS,
+        "Simulated HAL only. Feed the input streams of a device with a sine: _simSetInputSignal(id, amplitude, hz=440)."},
+    {"_simSetIOBufferFrames", PyCoreAudio_simSetIOBufferFrames, METH_O,
+        "Simulated HAL only. Set the IO buffer size of every device, in frames (default 512 at 48 kHz)."},
+#endif
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
+static int execModule(PyObject* module){
+    ModuleState* state = moduleState(module);
+    state->strings = new std::map<DeviceStringKey, PyObject*>();
+    state->async = new AsyncState();
+    state->deviceType = PyType_FromModuleAndSpec(module, &DeviceSpec, NULL);
+    if(state->deviceType == NULL) return -1;
+    Py_INCREF(state->deviceType);
+    if(PyModule_AddObject(module, "Device", state->deviceType) < 0){
+        Py_DECREF(state->deviceType);
+        return -1;
+    }
+    state->captureBufferType = PyType_FromModuleAndSpec(module, &CaptureBufferSpec, NULL);
+    if(state->captureBufferType == NULL) return -1;
+    Py_INCREF(state->captureBufferType);
+    if(PyModule_AddObject(module, "CaptureBuffer", state->captureBufferType) < 0){
+        Py_DECREF(state->captureBufferType);
+        return -1;
+    }
+    PyObject* arrayModule = PyImport_ImportModule("array");
+    if(arrayModule == NULL) return -1;
+    state->floatArray = PyObject_CallMethod(arrayModule, "array", "s[d]", "f", 0.0);
+    Py_DECREF(arrayModule);
+    if(state->floatArray == NULL) return -1;
+    if(PyModule_AddIntConstant(module, "EVENT_VOLUME", EVENT_VOLUME) < 0
+       || PyModule_AddIntConstant(module, "EVENT_MUTE", EVENT_MUTE) < 0
+       || PyModule_AddIntConstant(module, "EVENT_DEFAULT_OUTPUT", EVENT_DEFAULT_OUTPUT) < 0
+       || PyModule_AddIntConstant(module, "EVENT_DEVICE_LIST", EVENT_DEVICE_LIST) < 0
+       || PyModule_AddIntConstant(module, "EVENT_ALL", EVENT_ALL) < 0
+       || PyModule_AddIntConstant(module, "FADE_LINEAR", FADE_LINEAR) < 0
+       || PyModule_AddIntConstant(module, "FADE_EQUAL_POWER", FADE_EQUAL_POWER) < 0
+       || PyModule_AddIntConstant(module, "FADE_DB", FADE_DB) < 0
+       || PyModule_AddIntConstant(module, "FADE_DONE", FADE_DONE) < 0
+       || PyModule_AddIntConstant(module, "FADE_CANCELLED", FADE_CANCELLED) < 0
+       || PyModule_AddIntConstant(module, "FADE_FAILED", FADE_FAILED) < 0
+       || PyModule_AddIntConstant(module, "METER_INPUT", METER_INPUT) < 0
+       || PyModule_AddIntConstant(module, "METER_OUTPUT", METER_OUTPUT) < 0
+       || PyModule_AddIntConstant(module, "FORMAT_INT16", FORMAT_INT16) < 0
+       || PyModule_AddIntConstant(module, "FORMAT_INT24", FORMAT_INT24) < 0
+       || PyModule_AddIntConstant(module, "FORMAT_INT32", FORMAT_INT32) < 0
+       || PyModule_AddIntConstant(module, "FORMAT_FLOAT32", FORMAT_FLOAT32) < 0){
+        return -1;
+    }
+    return 0;
+}
+
+static int traverseModule(PyObject* module, visitproc visit, void* arg){
+    ModuleState* state = moduleState(module);
+    if(state == NULL) return 0;
+    Py_VISIT(state->deviceType);
+    Py_VISIT(state->captureBufferType);
+    Py_VISIT(state->floatArray);
+    if(state->async != NULL){
+        Py_VISIT(state->async->loop);
+        for(std::map<UInt64, PyObject*>::iterator it = state->async->futures.begin(); it != state->async->futures.end(); ++it){
+            Py_VISIT(it->second);
+        }
+    }
+    return 0;
+}
+
+static int clearModule(PyObject* module){
+    ModuleState* state = moduleState(module);
+    if(state == NULL) return 0;
+    Py_CLEAR(state->deviceType);
+    Py_CLEAR(state->captureBufferType);
+    Py_CLEAR(state->floatArray);
+    if(state->strings != NULL){
+        for(std::map<DeviceStringKey, PyObject*>::iterator it = state->strings->begin(); it != state->strings->end(); ++it){
+            Py_DECREF(it->second);
+        }
+        state->strings->clear();
+    }
+    if(state->async != NULL) asyncReleaseLoop(state->async);
+    return 0;
+}
+
+static void freeModule(void* module){
+    clearModule((PyObject*)module);
+    ModuleState* state = moduleState((PyObject*)module);
+    if(state == NULL) return;
+    delete state->strings;
+    //Joins the pool's threads, they never need the GIL
+    delete state->async;
+    state->strings = NULL;
+    state->async = NULL;
+}
+
+static PyModuleDef_Slot PyCoreAudioSlots[] = {
+    {Py_mod_exec, (void*)execModule},
+#ifdef Py_mod_multiple_interpreters
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_mod_gil
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}
+};
+
 static struct PyModuleDef modpycoreaudio = {
     PyModuleDef_HEAD_INIT,
     "CoreAudio",   /* name of module */
     MOD_DOCSTR,          /* module documentation, may be NULL */
-    -1,            /* size of per-interpreter state of the module,
-                      or -1 if the module keeps state in global variables. */
-    PyCoreAudioMethods
+    sizeof(ModuleState),    /* size of per-interpreter state of the module */
+    PyCoreAudioMethods,
+    PyCoreAudioSlots,
+    traverseModule,
+    clearModule,
+    freeModule
 };
 
 /* ----------------------------------------------------------------------- */
 
 
 PyMODINIT_FUNC PyInit_CoreAudio(){
-    return PyModule_Create(&modpycoreaudio);
+    return PyModuleDef_Init(&modpycoreaudio);
 }
 
 const char* MOD_DOCSTR = \
@@ -772,8 +3225,10 @@ const char* MOD_DOCSTR = \
 "This includes getting and setting the mute status as well as the volume\n"
 "of an audio output devices. The module can only work with one device,\n"
 "which is selected when running init(). To change this device, you must\n"
-"change the currently selected default audio output device.\n"
-"Make sure to run init() before using any other functions.\n"
+"change the currently selected default audio output device. With\n"
+"setFollowDefaultDevice(True), such a change is picked up automatically.\n"
+"The module initializes itself on the first call that needs it, see\n"
+"setLazyInit(); init() does it right away.\n"
 "It is also possible to retrieve basic information about all the audio I/O\n"
 "devices available on the system.\n\n"
 "Module written by br0kenpixel.";
\ No newline at end of file
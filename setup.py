@@ -1,11 +1,58 @@
-from distutils.core import setup, Extension
+import os
+import sys
+from distutils.core import setup, Extension, Command
+from distutils.ccompiler import new_compiler
+from distutils.sysconfig import customize_compiler
+
+#C++ interface shared by the module and the benchmarks
+core_sources = ["src/audio.cpp", "src/hal.cpp", "src/hal_sim.cpp", "src/registry.cpp", "src/channels.cpp", "src/events.cpp", "src/fade.cpp", "src/workers.cpp", "src/simd.cpp", "src/io.cpp", "src/meter.cpp", "src/capture.cpp", "src/playback.cpp", "src/convert.cpp", "src/gain.cpp", "src/fanout.cpp", "src/stats.cpp", "src/trace.cpp", "src/devcache.cpp"]
+compile_args = ["-std=c++11"]
+
+if sys.platform == "darwin":
+    macros = []
+    link_args = ["-framework", "CoreAudio", "-framework", "CoreFoundation"]
+else:
+    #No CoreAudio here, run against the simulated HAL instead
+    macros = [("PYCOREAUDIO_SIMULATED_HAL", "1")]
+    link_args = ["-pthread"]
 
 modcoreaudio = Extension("CoreAudio",
-                    sources = ["libpycoreaudio.cpp"],
-                    extra_link_args=["-framework", "CoreAudio", "-framework", "CoreFoundation"],
-                    extra_compile_args=["-std=c++11"])
+                    sources = ["libpycoreaudio.cpp"] + core_sources,
+                    define_macros = macros,
+                    extra_link_args = link_args,
+                    extra_compile_args = compile_args)
+
+class build_bench(Command):
+    """Build the C++ benchmarks in bench/, always against the simulated HAL."""
+
+    description = "build the benchmarks (bench/*.cpp)"
+    user_options = [("build-dir=", "b", "directory for the benchmark executables")]
+
+    def initialize_options(self):
+        self.build_dir = None
+
+    def finalize_options(self):
+        if self.build_dir is None:
+            self.build_dir = os.path.join("build", "bench")
+
+    def run(self):
+        compiler = new_compiler()
+        customize_compiler(compiler)
+        bench_macros = [("PYCOREAUDIO_SIMULATED_HAL", "1")]
+        bench_args = compile_args + ["-O2", "-pthread"]
+        objects = compiler.compile(core_sources, output_dir=self.build_dir, macros=bench_macros,
+                                   include_dirs=["src"], extra_postargs=bench_args)
+        for source in sorted(os.listdir("bench")):
+            if not source.endswith(".cpp"):
+                continue
+            name = os.path.splitext(source)[0]
+            main = compiler.compile([os.path.join("bench", source)], output_dir=self.build_dir,
+                                    macros=bench_macros, include_dirs=["src"], extra_postargs=bench_args)
+            compiler.link_executable(main + objects, name, output_dir=self.build_dir,
+                                     extra_postargs=link_args, target_lang="c++")
 
 setup (name = "CoreAudio",
        version = "1.0",
        description = "An interface for Apple's CoreAudio",
-       ext_modules = [modcoreaudio])
\ No newline at end of file
+       ext_modules = [modcoreaudio],
+       cmdclass = {"build_bench": build_bench})
@@ -0,0 +1,811 @@
+#include "audio.h"
+#include "hal.h"
+#include "trace.h"
+#include "registry.h"
+#include "channels.h"
+#include "devcache.h"
+#include "fade.h"
+#include "events.h"
+#include "io.h"
+#include "meter.h"
+#include "capture.h"
+#include "playback.h"
+#include "fanout.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+
+/* -----------------------------Globals----------------------------------- */
+static OutputStateRef currentOutput(new OutputState()); //Default output device, see outputState()
+static std::mutex outputMutex;                          //Serializes updates of currentOutput
+static std::mutex followMutex;                          //Guards the default device listener
+static bool following = false;                          //Whether the default device listener is installed
+static std::mutex lifecycleMutex;                       //Serializes init() and deinit()
+std::atomic<bool> initialized(false);                   //Just to know wheather we got the default device ID
+std::atomic<bool> devicesStarted(false);                //Whether the device caches run, see initDevices()
+std::atomic<bool> lazyInit(true);                       //Whether entry points initialize on demand
+/* ----------------------------------------------------------------------- */
+
+
+/* ---------------------------C++ Interface------------------------------- */
+
+/**
+ * Get a list of valid channels for the default output device.
+ * If deviceID is NULL, it will be set to the default output device.
+ *
+ * @param deviceID - output device
+ * @param maxFailures - number of errors after which the scan is stopped
+ * @result - list (vector) of valid channels
+ */
+std::vector<int> getValidChannels(AudioDeviceID *deviceID, int maxFailures){
+    std::vector<int> validChannels;
+    AudioDeviceID defaultOutputDeviceID = outputState()->deviceID;
+    if(deviceID == NULL) deviceID = &defaultOutputDeviceID;
+
+    //During the check we'll be trying to see if the channel has a
+    //volume level property
+    AudioObjectPropertyAddress propertyAddress = properties::volume;
+
+    int channel = 0, errors = 0;
+    while(errors < maxFailures){
+        //Cycle trough channels until the last [maxFailures] channels
+        //are invalid
+        propertyAddress.mElement = channel;
+        if(hal::hasProperty(*deviceID, &propertyAddress)){
+            //Channel is valid, add it to the list
+            validChannels.push_back(channel);
+        } else errors++;
+        channel++;
+    }
+    return validChannels;
+}
+
+OutputStateRef outputState(){
+    return std::atomic_load(&currentOutput);
+}
+
+/**
+ * Look up the default output device and publish it as the new output
+ * state. Its channels come from the channel map cache (channels.h).
+ *
+ * @result - whether the default output device could be retrieved
+ */
+static bool refreshOutputState(){
+    std::lock_guard<std::mutex> lock(outputMutex);
+    AudioDeviceID deviceID = kAudioObjectUnknown;
+    UInt32 dataSize = sizeof(AudioDeviceID);
+    //Find the default output device
+    OSStatus result = hal::getPropertyData(kAudioObjectSystemObject,
+                                           &properties::defaultOutputDevice,
+                                           0, NULL,
+                                           &dataSize, &deviceID);
+    //The OSStatus is counted in stats()
+    if(result != kAudioHardwareNoError) return false;
+
+    OutputStateRef previous = std::atomic_load(&currentOutput);
+    if(previous->deviceID == deviceID && deviceID != kAudioObjectUnknown) return true;
+
+    std::shared_ptr<OutputState> state(new OutputState());
+    state->deviceID = deviceID;
+    //Map the channels right away rather than on the first call
+    channelMaps.lookup(deviceID);
+    std::atomic_store(&currentOutput, OutputStateRef(state));
+    return true;
+}
+
+static OSStatus onDefaultOutputChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                       const AudioObjectPropertyAddress* addresses, void* clientData){
+    trace::Scope scope(trace::CATEGORY_LISTENER, "onDefaultOutputChanged", objectID, numberAddresses ? addresses[0].mSelector : 0);
+    if(initialized) refreshOutputState();
+    return kAudioHardwareNoError;
+}
+
+bool setFollowDefaultDevice(bool state){
+    std::lock_guard<std::mutex> lock(followMutex);
+    if(state == following) return true;
+    if(!state){
+        hal::removePropertyListener(kAudioObjectSystemObject, &properties::defaultOutputDevice,
+                                    onDefaultOutputChanged, NULL);
+        following = false;
+        return true;
+    }
+
+    OSStatus result = hal::addPropertyListener(kAudioObjectSystemObject, &properties::defaultOutputDevice,
+                                               onDefaultOutputChanged, NULL);
+    if(result != kAudioHardwareNoError) return false;
+    following = true;
+    //The device may have changed before the listener was in place
+    return !initialized || refreshOutputState();
+}
+
+bool getFollowDefaultDevice(){
+    std::lock_guard<std::mutex> lock(followMutex);
+    return following;
+}
+
+/**
+ * Undo startDevices(), also after it failed halfway.
+ * [lifecycleMutex] must be held.
+ */
+static void stopDevices(){
+    deviceCache.stop();
+    deviceRegistry.stop();
+    channelMaps.stop();
+    devicesStarted = false;
+}
+
+/**
+ * Start caching channel maps and device metadata, getDevices() is served
+ * from the registry. With a device cache, both start out with what the
+ * last run saw and are validated in the background.
+ * [lifecycleMutex] must be held.
+ *
+ * @result - whether the device list listeners could be installed. Without
+ *           them the caches would never learn of changes, so nothing is
+ *           started.
+ */
+static bool startDevices(){
+    if(devicesStarted) return true;
+    if(!channelMaps.start()) return false;
+    deviceCache.load();
+    if(!deviceRegistry.start()){
+        stopDevices();
+        return false;
+    }
+    deviceCache.seed();
+    deviceCache.validate();
+    devicesStarted.store(true, std::memory_order_release);
+    return true;
+}
+
+bool init(){
+    stats::ApiCall call(stats::API_INIT);
+    std::lock_guard<std::mutex> lock(lifecycleMutex);
+    if(initialized) return true;
+    bool started = devicesStarted;
+    if(!startDevices()) return false;
+    if(!refreshOutputState()){
+        if(!started) stopDevices();
+        return false;
+    }
+    initialized.store(true, std::memory_order_release);
+    return true;
+}
+
+bool initDevices(){
+    std::lock_guard<std::mutex> lock(lifecycleMutex);
+    return startDevices();
+}
+
+/**
+ * Deinitialize the library.
+ */
+void deinit(){
+    stats::ApiCall call(stats::API_DEINIT);
+    std::lock_guard<std::mutex> lock(lifecycleMutex);
+    fadeEngine.stop();
+    meterEngine.stop();
+    captureEngine.stop();
+    playbackEngine.stop();
+    ioHost.stop();
+    fanOut.stop();
+    setFollowDefaultDevice(false);
+    eventWatcher.unwatch();
+    stopDevices();
+    std::atomic_store(&currentOutput, OutputStateRef(new OutputState()));
+    initialized = false;
+}
+
+/**
+ * Set the mute state of the default output device.
+ * 
+ * @param state - muted/unmuted (1/0)
+ * @result - wheather the set failed or succeeded
+ */
+bool setMute(bool state){
+    stats::ApiCall call(stats::API_SET_MUTE);
+    AudioDeviceID deviceID = outputState()->deviceID;
+    ChannelMapRef map = channelMaps.lookup(deviceID);
+    if(map->mute.empty() && !map->subDevices.empty()) return setMuteForDevice(deviceID, state);
+    //Sometimes we have to use channel 0, idk why
+    return property::set(deviceID, properties::mute, map->muteChannels(), (UInt32)state)
+        || property::set(deviceID, properties::mute, ChannelSpan(MAIN_CHANNEL), (UInt32)state);
+}
+
+/**
+ * Get the mute state of the default output device.
+ * If the output device has multiple channels and they
+ * are not all muted/unmuted then the mute state of the
+ * last channel is returned.
+ *
+ * @result - mute state (0/1), -1 on error
+ */
+int getMute(){
+    stats::ApiCall call(stats::API_GET_MUTE);
+    //Warning: Do NOT use bool, must be UInt32!
+    ChannelValues<UInt32, MAX_CHANNELS> muteStates;
+    AudioDeviceID deviceID = outputState()->deviceID;
+    ChannelMapRef map = channelMaps.lookup(deviceID);
+    if(map->mute.empty() && !map->subDevices.empty()) return getMuteForDevice(deviceID);
+    bool error = !property::get(deviceID, properties::mute, map->muteChannels(), muteStates)
+              && !property::get(deviceID, properties::mute, ChannelSpan(MAIN_CHANNEL), muteStates);
+    if(error) return -1;
+
+    bool finalState = true;
+    for(UInt32 muteState_as_int : muteStates){
+        bool muteState = (bool)muteState_as_int;
+        finalState = finalState && muteState;
+    }
+
+    return finalState ? 1 : 0;
+}
+
+/**
+ * Get the volume level of the default output device.
+ * If the output device has multiple channels and they
+ * are set to a different volume level then the
+ * averrage is returned.
+ *
+ * @result - volume level (0-100%) as int
+ */
+int getVolume(){
+    stats::ApiCall call(stats::API_GET_VOLUME);
+    return getVolumeForDevice(outputState()->deviceID);
+}
+
+/**
+ * Set the volume level of the default output device.
+ *
+ * @param volume_in_percent - volume level (0-100)
+ * @result - wheather the set failed or succeeded
+ */
+bool setVolume(int volume_in_percent){
+    stats::ApiCall call(stats::API_SET_VOLUME);
+    return setVolumeForDevice(outputState()->deviceID, volume_in_percent);
+}
+
+/**
+ * Set the volume level of a specified output device, on every
+ * element of its channel map.
+ *
+ * @param deviceID - ID of the output device
+ * @param volume_in_percent - volume level (0-100)
+ * @result - whether the set failed or succeeded
+ */
+bool setVolumeForDevice(AudioDeviceID deviceID, int volume_in_percent) {
+    stats::ApiCall call(stats::API_SET_VOLUME_FOR_DEVICE);
+    return setVolumeScalarForDevice(deviceID, Float32(volume_in_percent) / 100);
+}
+
+/**
+ * Get the volume level of a specified output device.
+ * If its channels are set to a different volume level
+ * then the averrage is returned.
+ *
+ * @param deviceID - ID of the output device
+ * @result - volume level (0-100) or -1 on error
+ */
+int getVolumeForDevice(AudioDeviceID deviceID) {
+    stats::ApiCall call(stats::API_GET_VOLUME_FOR_DEVICE);
+    Float32 volume = getVolumeScalarForDevice(deviceID);
+    if (volume < 0) {
+        return -1; // 失败
+    }
+
+    // 将音量转换为百分比
+    return static_cast<int>(roundf(volume * 100.0f));
+}
+
+/**
+ * Call [task](index, subDeviceID) for every active sub-device of an
+ * aggregate device, all at once on the fan-out threads (see FanOut), so
+ * the call takes about one HAL round trip however many sub-devices
+ * there are.
+ */
+template <typename Task>
+static void forSubDevices(const ChannelMap &map, const Task &task){
+    fanOut.run(map.subDevices.size(), [&map, &task](size_t i){ task(i, map.subDevices[i]); });
+}
+
+/*
+ * The *ForDevice calls below, on the channel map of the device, with
+ * [fanOut] telling whether an aggregate device without the control is
+ * handled through its sub-devices. The calls on the sub-devices
+ * themselves do not fan out again.
+ */
+static bool setVolumeScalar(AudioDeviceID deviceID, const ChannelMap &map, Float32 volume, bool fanOut){
+    if(!map.volume.empty()) return property::set(deviceID, properties::volume, map.volumeChannels(), volume);
+    if(fanOut && !map.subDevices.empty()){
+        std::atomic<size_t> failed(0);
+        forSubDevices(map, [volume, &failed](size_t, AudioDeviceID subDevice){
+            if(!setVolumeScalar(subDevice, *channelMaps.lookup(subDevice), volume, false)) failed++;
+        });
+        return failed == 0;
+    }
+    return false;
+}
+
+static Float32 getVolumeScalar(AudioDeviceID deviceID, const ChannelMap &map, bool fanOut){
+    if(map.volume.empty() && fanOut && !map.subDevices.empty()){
+        std::vector<Float32> volumes(map.subDevices.size());
+        forSubDevices(map, [&volumes](size_t i, AudioDeviceID subDevice){
+            volumes[i] = getVolumeScalar(subDevice, *channelMaps.lookup(subDevice), false);
+        });
+        Float32 sum = 0;
+        size_t count = 0;
+        for(Float32 volume : volumes){
+            if(volume < 0) continue;
+            sum += volume;
+            count++;
+        }
+        return count > 0 ? sum / count : -1;
+    }
+    ChannelValues<Float32, MAX_CHANNELS> volumes;
+    if(!property::get(deviceID, properties::volume, map.volumeChannels(), volumes) || volumes.size() == 0){
+        return -1;
+    }
+    return std::accumulate(volumes.begin(), volumes.end(), 0.0f) / volumes.size();
+}
+
+static bool setDeviceMute(AudioDeviceID deviceID, const ChannelMap &map, bool mute, bool fanOut){
+    if(!map.mute.empty()) return property::set(deviceID, properties::mute, map.muteChannels(), (UInt32)(mute ? 1 : 0));
+    if(fanOut && !map.subDevices.empty()){
+        std::atomic<size_t> failed(0);
+        forSubDevices(map, [mute, &failed](size_t, AudioDeviceID subDevice){
+            if(!setDeviceMute(subDevice, *channelMaps.lookup(subDevice), mute, false)) failed++;
+        });
+        return failed == 0;
+    }
+    return false;
+}
+
+static int getDeviceMute(AudioDeviceID deviceID, const ChannelMap &map, bool fanOut){
+    if(map.mute.empty() && fanOut && !map.subDevices.empty()){
+        std::vector<int> mutes(map.subDevices.size());
+        forSubDevices(map, [&mutes](size_t i, AudioDeviceID subDevice){
+            mutes[i] = getDeviceMute(subDevice, *channelMaps.lookup(subDevice), false);
+        });
+        int result = -1;
+        for(int mute : mutes){
+            if(mute < 0) continue;
+            result = (result != 0 && mute == 1) ? 1 : 0;
+        }
+        return result;
+    }
+    ChannelValues<UInt32, MAX_CHANNELS> muteValues;
+    if (!property::get(deviceID, properties::mute, map.muteChannels(), muteValues) || muteValues.size() == 0) {
+        return -1; // 失败
+    }
+
+    for(UInt32 muteValue : muteValues){
+        if(muteValue != 1) return 0;
+    }
+    return 1; // 返回静音状态
+}
+
+/**
+ * Set the volume scalar of a specified output device, on every
+ * element of its channel map. An aggregate device without volume
+ * control is set on all its sub-devices at once.
+ *
+ * @param deviceID - ID of the output device
+ * @param volume - volume scalar (0.0-1.0)
+ * @result - whether the set failed or succeeded, on every sub-device of an aggregate device
+ */
+bool setVolumeScalarForDevice(AudioDeviceID deviceID, Float32 volume){
+    stats::ApiCall call(stats::API_SET_VOLUME_SCALAR_FOR_DEVICE);
+    return setVolumeScalar(deviceID, *channelMaps.lookup(deviceID), volume, true);
+}
+
+/**
+ * Get the volume scalar of a specified output device, averaged
+ * over its channels, or over the sub-devices of an aggregate device
+ * without volume control.
+ *
+ * @param deviceID - ID of the output device
+ * @result - volume scalar (0.0-1.0) or -1 on error
+ */
+Float32 getVolumeScalarForDevice(AudioDeviceID deviceID){
+    stats::ApiCall call(stats::API_GET_VOLUME_SCALAR_FOR_DEVICE);
+    return getVolumeScalar(deviceID, *channelMaps.lookup(deviceID), true);
+}
+
+/**
+ * Set the mute status of a specified output device, on every
+ * element of its channel map. Devices without mute control are
+ * handled like in setVolumeScalarForDevice().
+ *
+ * @param deviceID - ID of the output device
+ * @param mute - true to mute, false to unmute
+ * @result - whether the set failed or succeeded
+ */
+bool setMuteForDevice(AudioDeviceID deviceID, bool mute) {
+    stats::ApiCall call(stats::API_SET_MUTE_FOR_DEVICE);
+    return setDeviceMute(deviceID, *channelMaps.lookup(deviceID), mute, true);
+}
+
+/**
+ * Get the mute status of a specified output device.
+ * The device counts as muted if all its channels are, an aggregate
+ * device without mute control if all its sub-devices are.
+ *
+ * @param deviceID - ID of the output device
+ * @result - true if muted, false if not muted, or -1 on error
+ */
+int getMuteForDevice(AudioDeviceID deviceID) {
+    stats::ApiCall call(stats::API_GET_MUTE_FOR_DEVICE);
+    return getDeviceMute(deviceID, *channelMaps.lookup(deviceID), true);
+}
+
+/**
+ * Call [task](index, map) with the channel map of every device of a
+ * batch. The maps of up to BATCH_CHUNK devices at a time are looked up
+ * together, see ChannelMapCache::lookup().
+ */
+template <typename Task>
+static void forDeviceMaps(const AudioDeviceID* deviceIDs, size_t count, const Task &task){
+    static const size_t BATCH_CHUNK = 64;
+    ChannelMapRef maps[BATCH_CHUNK];
+    for(size_t first = 0; first < count; first += BATCH_CHUNK){
+        size_t chunk = std::min(BATCH_CHUNK, count - first);
+        channelMaps.lookup(deviceIDs + first, chunk, maps);
+        for(size_t i = 0; i < chunk; i++) task(first + i, *maps[i]);
+    }
+}
+
+/**
+ * Set the volume level of several output devices in one go.
+ *
+ * @param deviceIDs - IDs of the output devices
+ * @param volumes - volume level (0-100) for every device
+ * @param count - number of devices
+ * @param results - receives 1 for every device that was set, 0 otherwise
+ */
+void setVolumeForDevices(const AudioDeviceID* deviceIDs, const int* volumes, size_t count, UInt8* results){
+    stats::ApiCall call(stats::API_SET_VOLUME_FOR_DEVICES);
+    forDeviceMaps(deviceIDs, count, [deviceIDs, volumes, results](size_t i, const ChannelMap &map){
+        results[i] = setVolumeScalar(deviceIDs[i], map, Float32(volumes[i]) / 100, true) ? 1 : 0;
+    });
+}
+
+/**
+ * Get the volume level of several output devices in one go.
+ *
+ * @param deviceIDs - IDs of the output devices
+ * @param count - number of devices
+ * @param results - receives the volume level (0-100) of every device, or BATCH_ERROR
+ */
+void getVolumeForDevices(const AudioDeviceID* deviceIDs, size_t count, UInt8* results){
+    stats::ApiCall call(stats::API_GET_VOLUME_FOR_DEVICES);
+    forDeviceMaps(deviceIDs, count, [deviceIDs, results](size_t i, const ChannelMap &map){
+        Float32 volume = getVolumeScalar(deviceIDs[i], map, true);
+        results[i] = volume < 0 ? BATCH_ERROR : (UInt8)roundf(volume * 100.0f);
+    });
+}
+
+/**
+ * Set the mute status of several output devices in one go.
+ *
+ * @param deviceIDs - IDs of the output devices
+ * @param mutes - mute status for every device
+ * @param count - number of devices
+ * @param results - receives 1 for every device that was set, 0 otherwise
+ */
+void setMuteForDevices(const AudioDeviceID* deviceIDs, const bool* mutes, size_t count, UInt8* results){
+    stats::ApiCall call(stats::API_SET_MUTE_FOR_DEVICES);
+    forDeviceMaps(deviceIDs, count, [deviceIDs, mutes, results](size_t i, const ChannelMap &map){
+        results[i] = setDeviceMute(deviceIDs[i], map, mutes[i], true) ? 1 : 0;
+    });
+}
+
+/**
+ * Get the mute status of several output devices in one go.
+ *
+ * @param deviceIDs - IDs of the output devices
+ * @param count - number of devices
+ * @param results - receives the mute status (0/1) of every device, or BATCH_ERROR
+ */
+void getMuteForDevices(const AudioDeviceID* deviceIDs, size_t count, UInt8* results){
+    stats::ApiCall call(stats::API_GET_MUTE_FOR_DEVICES);
+    forDeviceMaps(deviceIDs, count, [deviceIDs, results](size_t i, const ChannelMap &map){
+        int mute = getDeviceMute(deviceIDs[i], map, true);
+        results[i] = mute < 0 ? BATCH_ERROR : (UInt8)mute;
+    });
+}
+
+/**
+ * Apply volume levels and mute states to several output devices.
+ * A device that gets muted is muted before its volume changes, one that
+ * gets unmuted is unmuted after, so no device plays at a stale level.
+ *
+ * @param entries - changes to apply
+ * @param count - number of entries
+ * @param results - receives 1 for every entry that was fully applied, 0 otherwise
+ */
+void applyScene(const SceneEntry* entries, size_t count, UInt8* results){
+    stats::ApiCall call(stats::API_APPLY_SCENE);
+    for(size_t i = 0; i < count; i++){
+        const SceneEntry &entry = entries[i];
+        bool ok = true;
+        if(entry.mute == 1) ok = setMuteForDevice(entry.deviceID, true) && ok;
+        if(entry.volume >= 0) ok = setVolumeForDevice(entry.deviceID, entry.volume) && ok;
+        if(entry.mute == 0) ok = setMuteForDevice(entry.deviceID, false) && ok;
+        results[i] = ok ? 1 : 0;
+    }
+}
+
+static const Property<Float32, ELEMENT_PER_CHANNEL> &volumeProperty(VolumeUnit unit){
+    return unit == VOLUME_DECIBELS ? properties::volumeDecibels : properties::volume;
+}
+
+/**
+ * Get the number of channels getChannelVolumesForDevice() reads.
+ *
+ * @param deviceID - ID of the output device
+ * @result - number of elements with a volume control, 0 if none or unknown
+ */
+size_t getChannelVolumeCount(AudioDeviceID deviceID){
+    return channelMaps.lookup(deviceID)->volume.size();
+}
+
+/**
+ * Get the volume of every channel of a specified output device, as the
+ * device reports it.
+ *
+ * @param deviceID - ID of the output device
+ * @param unit - scalar or dB
+ * @param values - receives one value per channel, NaN for a channel that could not be read
+ * @param count - number of values, must be getChannelVolumeCount()
+ * @result - whether every channel was read, false for a device without channels
+ */
+bool getChannelVolumesForDevice(AudioDeviceID deviceID, VolumeUnit unit, Float32* values, size_t count){
+    stats::ApiCall call(stats::API_GET_CHANNEL_VOLUMES_FOR_DEVICE);
+    std::fill(values, values + count, NAN);
+    ChannelMapRef map = channelMaps.lookup(deviceID);
+    if(map->volume.empty() || map->volume.size() != count) return false;
+    return property::get(deviceID, volumeProperty(unit), map->volumeChannels(), values);
+}
+
+/**
+ * Set the volume of every channel of a specified output device, each
+ * to its own value. Nothing is set if a value is NaN.
+ *
+ * @param deviceID - ID of the output device
+ * @param unit - scalar or dB
+ * @param values - one value per channel
+ * @param count - number of values, must be getChannelVolumeCount()
+ * @result - whether every channel was set, false for a device without channels
+ */
+bool setChannelVolumesForDevice(AudioDeviceID deviceID, VolumeUnit unit, const Float32* values, size_t count){
+    stats::ApiCall call(stats::API_SET_CHANNEL_VOLUMES_FOR_DEVICE);
+    ChannelMapRef map = channelMaps.lookup(deviceID);
+    if(map->volume.empty() || map->volume.size() != count) return false;
+    for(size_t i = 0; i < count; i++){
+        if(values[i] != values[i]) return false;
+    }
+    return property::set(deviceID, volumeProperty(unit), map->volumeChannels(), values);
+}
+
+/**
+ * Get the channel volumes of several output devices in one go.
+ *
+ * @param deviceIDs - IDs of the output devices
+ * @param counts - number of channels of every device, see getChannelVolumeCount()
+ * @param count - number of devices
+ * @param unit - scalar or dB
+ * @param values - receives the values of every device back to back
+ * @param results - receives 1 for every device that was fully read, 0 otherwise
+ */
+void getChannelVolumesForDevices(const AudioDeviceID* deviceIDs, const size_t* counts, size_t count, VolumeUnit unit,
+                                 Float32* values, UInt8* results){
+    stats::ApiCall call(stats::API_GET_CHANNEL_VOLUMES_FOR_DEVICES);
+    for(size_t i = 0; i < count; i++){
+        results[i] = getChannelVolumesForDevice(deviceIDs[i], unit, values, counts[i]) ? 1 : 0;
+        values += counts[i];
+    }
+}
+
+/**
+ * Set the channel volumes of several output devices in one go.
+ *
+ * @param deviceIDs - IDs of the output devices
+ * @param counts - number of channels of every device, see getChannelVolumeCount()
+ * @param count - number of devices
+ * @param unit - scalar or dB
+ * @param values - the values of every device back to back
+ * @param results - receives 1 for every device that was fully set, 0 otherwise
+ */
+void setChannelVolumesForDevices(const AudioDeviceID* deviceIDs, const size_t* counts, size_t count, VolumeUnit unit,
+                                 const Float32* values, UInt8* results){
+    stats::ApiCall call(stats::API_SET_CHANNEL_VOLUMES_FOR_DEVICES);
+    for(size_t i = 0; i < count; i++){
+        results[i] = setChannelVolumesForDevice(deviceIDs[i], unit, values, counts[i]) ? 1 : 0;
+        values += counts[i];
+    }
+}
+
+/**
+ * Get the number of audio devices available on this system.
+ *
+ * @result - number of devices, -1 if it could not be read
+ */
+int getDeviceCount(){
+    stats::ApiCall call(stats::API_GET_DEVICE_COUNT);
+    UInt32 propSize = 0;
+    OSStatus error = hal::getPropertyDataSize(kAudioObjectSystemObject, &properties::count, 0, NULL, &propSize);
+    if(error != noErr) return -1;
+    return propSize / sizeof(AudioDeviceID);
+}
+
+CFStringUTF8::CFStringUTF8(CFStringRef str) : text(NULL), length(0) {
+    if(str == NULL) return;
+    const char* direct = CFStringGetCStringPtr(str, kCFStringEncodingUTF8);
+    if(direct != NULL){
+        text = direct;
+        length = strlen(direct);
+        return;
+    }
+    CFIndex maxSize = CFStringGetMaximumSizeForEncoding(CFStringGetLength(str), kCFStringEncodingUTF8) + 1;
+    char* buffer = local;
+    if(maxSize > (CFIndex)sizeof(local)){
+        heap.resize(maxSize);
+        buffer = heap.data();
+    }
+    if(CFStringGetCString(str, buffer, maxSize, kCFStringEncodingUTF8)){
+        text = buffer;
+        length = strlen(buffer);
+    }
+}
+
+CFStringRef copyDeviceString(AudioDeviceID device, const Property<CFStringRef, ELEMENT_SINGLE> &property){
+    CFStringRef result = NULL;
+    if(!property::get(device, property, result)) return NULL;
+    return result;
+}
+
+/**
+ * Read a string property of a device into an std::string.
+ *
+ * @result - the string, "Unknown" if it could not be retrieved
+ */
+static std::string getDeviceString(AudioDeviceID device, const Property<CFStringRef, ELEMENT_SINGLE> &property){
+    CFStringRef raw = copyDeviceString(device, property);
+    if(raw == NULL){
+        return (std::string)"Unknown";
+    }
+    std::string result;
+    {
+        CFStringUTF8 utf8(raw);
+        result = utf8.valid() ? std::string(utf8.data(), utf8.size()) : (std::string)"Unknown";
+    }
+    CFRelease(raw);
+    return result;
+}
+
+std::string getDeviceName(AudioDeviceID device){
+    return getDeviceString(device, properties::name);
+}
+
+std::string getDeviceManufacturer(AudioDeviceID device){
+    return getDeviceString(device, properties::manufacturer);
+}
+
+std::string getDeviceUID(AudioDeviceID device){
+    return getDeviceString(device, properties::uid);
+}
+
+int getDeviceStreamCount(AudioDeviceID device, AudioObjectPropertyAddress io_direction){
+    UInt32 dataSize = 0;
+    OSStatus error = hal::getPropertyDataSize(device, &io_direction, 0, NULL, &dataSize);
+    if(error != noErr){
+        return -1;
+    }
+    UInt32 streamCount = dataSize / sizeof(AudioStreamID);
+    return streamCount;
+}
+
+/**
+ * Get the number of channels of the input or output streams of a device,
+ * i.e. the number of interleaved channels its IOProcs see.
+ *
+ * @param device - ID of the device
+ * @param input - whether to count the input channels
+ * @result - number of channels, -1 if the stream configuration could not be read
+ */
+int getDeviceChannelCount(AudioDeviceID device, bool input){
+    const AudioObjectPropertyAddress* address = input ? &properties::inputStreamConfiguration
+                                                      : &properties::streamConfiguration;
+    UInt32 dataSize = 0;
+    if(hal::getPropertyDataSize(device, address, 0, NULL, &dataSize) != noErr || dataSize < sizeof(UInt32)){
+        return -1;
+    }
+    std::vector<char> storage(dataSize);
+    AudioBufferList* streams = (AudioBufferList*)storage.data();
+    if(hal::getPropertyData(device, address, 0, NULL, &dataSize, streams) != noErr){
+        return -1;
+    }
+    int channels = 0;
+    for(UInt32 i = 0; i < streams->mNumberBuffers; i++) channels += streams->mBuffers[i].mNumberChannels;
+    return channels;
+}
+
+/**
+ * Get the nominal sample rate of a device.
+ *
+ * @result - sample rate in Hz, 0 if it could not be read
+ */
+Float64 getDeviceSampleRate(AudioDeviceID device){
+    Float64 rate = 0;
+    if(!property::get(device, properties::nominalSampleRate, rate)) return 0;
+    return rate;
+}
+
+/**
+ * Get the IDs of all audio input and output devices available on this system.
+ *
+ * @param deviceIDs - buffer to write to
+ * @result - whether the device list could be retrieved
+ */
+bool getDeviceIDs(std::vector<AudioDeviceID> &deviceIDs){
+    const int numDevices = getDeviceCount();
+    if(numDevices < 0){
+        deviceIDs.clear();
+        return false;
+    }
+    UInt32 propSize = numDevices * sizeof(AudioDeviceID);
+    deviceIDs.resize(numDevices);
+
+    //Grab the devices and store them in deviceIDs
+    OSStatus error = hal::getPropertyData(kAudioObjectSystemObject, &properties::count, 0, NULL, &propSize, deviceIDs.data());
+    if(error != noErr){
+        deviceIDs.clear();
+        return false;
+    }
+    deviceIDs.resize(propSize / sizeof(AudioDeviceID));
+    return true;
+}
+
+/**
+ * Query the properties of a single device.
+ *
+ * @param deviceID - ID of the device
+ * @result - properties of the device
+ */
+DeviceInfo getDeviceInfo(AudioDeviceID deviceID){
+    DeviceInfo info;
+    info.id = deviceID;
+    info.name = getDeviceName(deviceID);
+    info.manufacturer = getDeviceManufacturer(deviceID);
+    info.uid = getDeviceUID(deviceID);
+    info.inStreams = getDeviceStreamCount(deviceID, properties::instreams);
+    info.outStreams = getDeviceStreamCount(deviceID, properties::outstreams);
+    return info;
+}
+
+/**
+ * Get all audio input and output devices available on this system
+ * along with some of their properties. Every call goes to the HAL,
+ * see registry.h for the cached variant.
+ *
+ * @param devices - buffer to write to
+ * @result - whether the device list could be retrieved
+ */
+bool getDevices(std::vector<DeviceInfo> &devices){
+    stats::ApiCall call(stats::API_GET_DEVICES);
+    std::vector<AudioDeviceID> audioDevices;
+    if(!getDeviceIDs(audioDevices)){
+        return false;
+    }
+    for(AudioDeviceID deviceID : audioDevices){
+        devices.push_back(getDeviceInfo(deviceID));
+    }
+    return true;
+}
+
+/* ----------------------------------------------------------------------- */
+
+
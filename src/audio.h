@@ -0,0 +1,305 @@
+#ifndef PYCOREAUDIO_AUDIO_H
+#define PYCOREAUDIO_AUDIO_H
+
+#include "cacompat.h"
+#include "property.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * C++ interface of the module.
+ * Everything in here talks to the HAL through the backend layer (hal.h)
+ * and knows nothing about Python.
+ */
+
+/*
+ * Properties used by the module, see property.h. The value type of a
+ * list property (count, instreams, outstreams, streamConfiguration,
+ * preferredStereo, activeSubDevices) is its item type.
+ */
+namespace properties {
+    //Volume control
+    constexpr Property<Float32, ELEMENT_PER_CHANNEL> volume(
+        kAudioDevicePropertyVolumeScalar, //mSelector
+        kAudioDevicePropertyScopeOutput, //mScope
+        0 //mElement
+    );
+    //Volume control in dB, on the same elements as [volume]
+    constexpr Property<Float32, ELEMENT_PER_CHANNEL> volumeDecibels(
+        kAudioDevicePropertyVolumeDecibels,
+        kAudioDevicePropertyScopeOutput,
+        0
+    );
+    //Mute control
+    constexpr Property<UInt32, ELEMENT_PER_CHANNEL> mute(
+        kAudioDevicePropertyMute,
+        kAudioDevicePropertyScopeOutput,
+        0
+    );
+    //Default output device
+    constexpr Property<AudioDeviceID, ELEMENT_SINGLE> defaultOutputDevice(
+        kAudioHardwarePropertyDefaultOutputDevice,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMain //kAudioObjectPropertyElementMaster - deprecated since Monterey
+    );
+    //Devices count
+    constexpr Property<AudioDeviceID, ELEMENT_SINGLE> count(
+        kAudioHardwarePropertyDevices,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMain
+    );
+    //Device name
+    constexpr Property<CFStringRef, ELEMENT_SINGLE> name(
+        kAudioDevicePropertyDeviceNameCFString,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMain
+    );
+
+    //Device manufacturer
+    constexpr Property<CFStringRef, ELEMENT_SINGLE> manufacturer(
+        kAudioDevicePropertyDeviceManufacturerCFString,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMain
+    );
+    //Device input streams
+    constexpr Property<AudioStreamID, ELEMENT_SINGLE> instreams(
+        kAudioDevicePropertyStreams,
+        kAudioDevicePropertyScopeInput,
+        0
+    );
+    //Device output streams
+    constexpr Property<AudioStreamID, ELEMENT_SINGLE> outstreams(
+        kAudioDevicePropertyStreams,
+        kAudioDevicePropertyScopeOutput,
+        0
+    );
+    //Channel layout of the output streams, an AudioBufferList
+    constexpr Property<AudioBuffer, ELEMENT_SINGLE> streamConfiguration(
+        kAudioDevicePropertyStreamConfiguration,
+        kAudioDevicePropertyScopeOutput,
+        kAudioObjectPropertyElementMain
+    );
+    //Channel layout of the input streams
+    constexpr Property<AudioBuffer, ELEMENT_SINGLE> inputStreamConfiguration(
+        kAudioDevicePropertyStreamConfiguration,
+        kAudioDevicePropertyScopeInput,
+        kAudioObjectPropertyElementMain
+    );
+    //Nominal sample rate, in Hz
+    constexpr Property<Float64, ELEMENT_SINGLE> nominalSampleRate(
+        kAudioDevicePropertyNominalSampleRate,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMain
+    );
+    //Preferred stereo pair of output channels
+    constexpr Property<UInt32, ELEMENT_SINGLE> preferredStereo(
+        kAudioDevicePropertyPreferredChannelsForStereo,
+        kAudioDevicePropertyScopeOutput,
+        kAudioObjectPropertyElementMain
+    );
+    //Active sub-devices of an aggregate or multi-output device
+    constexpr Property<AudioObjectID, ELEMENT_SINGLE> activeSubDevices(
+        kAudioAggregateDevicePropertyActiveSubDeviceList,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMain
+    );
+    //Device UID
+    constexpr Property<CFStringRef, ELEMENT_SINGLE> uid(
+        kAudioDevicePropertyDeviceUID,
+        kAudioDevicePropertyScopeOutput,
+        0
+    );
+};
+
+/**
+ * Properties of a single audio device, as reported by getDevices().
+ */
+struct DeviceInfo {
+    AudioDeviceID id;
+    std::string name;
+    std::string manufacturer;
+    std::string uid;
+    int inStreams;
+    int outStreams;
+};
+
+/**
+ * The default output device. Its channels are looked up in the channel
+ * map cache (channels.h).
+ * A state is never modified once published; a change of the default
+ * output device publishes a new one.
+ */
+struct OutputState {
+    AudioDeviceID deviceID;
+    OutputState() : deviceID(kAudioObjectUnknown) {}
+};
+typedef std::shared_ptr<const OutputState> OutputStateRef;
+
+/* -----------------------------Globals----------------------------------- */
+extern std::atomic<bool> initialized;                   //Just to know wheather we got the default device ID
+extern std::atomic<bool> devicesStarted;                //Whether the device caches run, see initDevices()
+extern std::atomic<bool> lazyInit;                      //Whether entry points initialize on demand
+/* ----------------------------------------------------------------------- */
+
+std::vector<int> getValidChannels(AudioDeviceID *deviceID = NULL, int maxFailures = 3);
+
+/**
+ * Start the device caches and resolve the default output device and its
+ * channels. Does nothing if already done; concurrent calls wait for the
+ * first one.
+ *
+ * @result - whether the default output device could be retrieved
+ */
+bool init();
+
+/**
+ * Start only the device caches (registry.h, channels.h, devcache.h), as
+ * needed by the device list and per-device calls. Does not look up the
+ * default output device, init() does that later if needed.
+ *
+ * @result - whether the caches run, false if their device list listeners
+ *           could not be installed
+ */
+bool initDevices();
+
+/**
+ * Stop everything init() and initDevices() started. Does nothing if not
+ * initialized.
+ */
+void deinit();
+
+/**
+ * Make sure init() ran, running it now if [lazyInit] is set. After the
+ * first call, this is a single atomic load.
+ *
+ * @result - whether the library is initialized
+ */
+inline bool ensureInitialized(){
+    return initialized.load(std::memory_order_acquire) || (lazyInit.load(std::memory_order_relaxed) && init());
+}
+
+/**
+ * Make sure the device caches run, see initDevices() and ensureInitialized().
+ */
+inline bool ensureDevices(){
+    return devicesStarted.load(std::memory_order_acquire)
+        || (lazyInit.load(std::memory_order_relaxed) && initDevices());
+}
+
+/**
+ * Get the current output state. Never NULL; before init() and after
+ * deinit() the device is kAudioObjectUnknown.
+ */
+OutputStateRef outputState();
+
+/**
+ * Keep the output state current by listening for changes of the default
+ * output device, instead of fixing it at init().
+ *
+ * @param state - enable/disable
+ * @result - whether the listener could be installed
+ */
+bool setFollowDefaultDevice(bool state);
+bool getFollowDefaultDevice();
+
+bool setMute(bool state);
+int getMute();
+int getVolume();
+bool setVolume(int volume_in_percent);
+
+bool setVolumeForDevice(AudioDeviceID deviceID, int volume_in_percent);
+int getVolumeForDevice(AudioDeviceID deviceID);
+bool setMuteForDevice(AudioDeviceID deviceID, bool mute);
+int getMuteForDevice(AudioDeviceID deviceID);
+
+//Unrounded variants of the above, the volume scalar is 0.0-1.0
+bool setVolumeScalarForDevice(AudioDeviceID deviceID, Float32 volume);
+Float32 getVolumeScalarForDevice(AudioDeviceID deviceID);
+
+//Batch variants of the above, see audio.cpp. Results are one byte per device.
+const UInt8 BATCH_ERROR = 0xFF;
+
+/**
+ * One device's part of a scene, see applyScene().
+ */
+struct SceneEntry {
+    AudioDeviceID deviceID;
+    int volume;     //volume level (0-100), or -1 to leave it unchanged
+    int mute;       //mute status (0/1), or -1 to leave it unchanged
+};
+
+void setVolumeForDevices(const AudioDeviceID* deviceIDs, const int* volumes, size_t count, UInt8* results);
+void getVolumeForDevices(const AudioDeviceID* deviceIDs, size_t count, UInt8* results);
+void setMuteForDevices(const AudioDeviceID* deviceIDs, const bool* mutes, size_t count, UInt8* results);
+void getMuteForDevices(const AudioDeviceID* deviceIDs, size_t count, UInt8* results);
+void applyScene(const SceneEntry* entries, size_t count, UInt8* results);
+
+/*
+ * Per-channel volume, unaveraged and unrounded. The channels of a device
+ * are the elements of its channel map with a volume control, main
+ * element first (see ChannelMap::volume); values are packed in that
+ * order, several devices back to back. A device without volume control
+ * has no channels here, pass the sub-devices of an aggregate device.
+ */
+enum VolumeUnit {
+    VOLUME_SCALAR,      //kAudioDevicePropertyVolumeScalar, 0.0-1.0
+    VOLUME_DECIBELS     //kAudioDevicePropertyVolumeDecibels
+};
+
+size_t getChannelVolumeCount(AudioDeviceID deviceID);
+bool getChannelVolumesForDevice(AudioDeviceID deviceID, VolumeUnit unit, Float32* values, size_t count);
+bool setChannelVolumesForDevice(AudioDeviceID deviceID, VolumeUnit unit, const Float32* values, size_t count);
+void getChannelVolumesForDevices(const AudioDeviceID* deviceIDs, const size_t* counts, size_t count, VolumeUnit unit,
+                                 Float32* values, UInt8* results);
+void setChannelVolumesForDevices(const AudioDeviceID* deviceIDs, const size_t* counts, size_t count, VolumeUnit unit,
+                                 const Float32* values, UInt8* results);
+
+/**
+ * The UTF-8 contents of a CFString, without a heap allocation in the
+ * common case. Points right into the string when CoreFoundation exposes
+ * its buffer (CFStringGetCStringPtr), otherwise into a copy that is kept
+ * on the stack unless the string is long. Only valid as long as the
+ * CFString is.
+ */
+class CFStringUTF8 {
+public:
+    explicit CFStringUTF8(CFStringRef str);
+
+    bool valid() const { return text != NULL; }
+    const char* data() const { return text; }
+    size_t size() const { return length; }
+
+private:
+    CFStringUTF8(const CFStringUTF8&);
+    CFStringUTF8& operator=(const CFStringUTF8&);
+
+    const char* text;
+    size_t length;
+    char local[256];
+    std::vector<char> heap;     //only for strings that do not fit [local]
+};
+
+int getDeviceCount();
+
+/**
+ * Copy a string property of a device (name, manufacturer, uid).
+ * The caller owns the result and must CFRelease() it.
+ *
+ * @param device - ID of the device
+ * @param property - one of the CFStringRef properties
+ * @result - the string, or NULL if it could not be retrieved
+ */
+CFStringRef copyDeviceString(AudioDeviceID device, const Property<CFStringRef, ELEMENT_SINGLE> &property);
+std::string getDeviceName(AudioDeviceID device);
+std::string getDeviceManufacturer(AudioDeviceID device);
+std::string getDeviceUID(AudioDeviceID device);
+int getDeviceStreamCount(AudioDeviceID device, AudioObjectPropertyAddress io_direction);
+int getDeviceChannelCount(AudioDeviceID device, bool input);
+Float64 getDeviceSampleRate(AudioDeviceID device);
+bool getDeviceIDs(std::vector<AudioDeviceID> &deviceIDs);
+DeviceInfo getDeviceInfo(AudioDeviceID deviceID);
+bool getDevices(std::vector<DeviceInfo> &devices);
+
+#endif //PYCOREAUDIO_AUDIO_H
@@ -0,0 +1,192 @@
+#ifndef PYCOREAUDIO_CACOMPAT_H
+#define PYCOREAUDIO_CACOMPAT_H
+
+/*
+ * CoreAudio/CoreFoundation declarations used by the module.
+ *
+ * On macOS this simply includes the real frameworks. Everywhere else a
+ * minimal, source compatible subset is declared here, so that the C++
+ * interface, the simulated HAL and the benchmarks can be built off a Mac.
+ * Only the pieces the module actually uses are provided.
+ */
+
+#ifdef __APPLE__
+
+#include <CoreAudio/CoreAudio.h>
+#include <CoreFoundation/CoreFoundation.h>
+
+#else
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+
+#define PYCOREAUDIO_FOURCC(a, b, c, d) \
+    (((UInt32)(a) << 24) | ((UInt32)(b) << 16) | ((UInt32)(c) << 8) | (UInt32)(d))
+
+/* ------------------------------Types------------------------------------ */
+typedef uint8_t  Boolean;
+typedef uint8_t  UInt8;
+typedef int16_t  SInt16;
+typedef uint32_t UInt32;
+typedef int32_t  SInt32;
+typedef uint64_t UInt64;
+typedef float    Float32;
+typedef double   Float64;
+typedef SInt32   OSStatus;
+
+typedef UInt32 AudioObjectID;
+typedef AudioObjectID AudioDeviceID;
+typedef AudioObjectID AudioStreamID;
+typedef UInt32 AudioObjectPropertySelector;
+typedef UInt32 AudioObjectPropertyScope;
+typedef UInt32 AudioObjectPropertyElement;
+
+struct AudioObjectPropertyAddress {
+    AudioObjectPropertySelector mSelector;
+    AudioObjectPropertyScope    mScope;
+    AudioObjectPropertyElement  mElement;
+};
+
+struct AudioBuffer {
+    UInt32 mNumberChannels;
+    UInt32 mDataByteSize;
+    void*  mData;
+};
+
+struct AudioBufferList {
+    UInt32      mNumberBuffers;
+    AudioBuffer mBuffers[1];    //variable length
+};
+
+typedef OSStatus (*AudioObjectPropertyListenerProc)(AudioObjectID inObjectID,
+                                                    UInt32 inNumberAddresses,
+                                                    const AudioObjectPropertyAddress* inAddresses,
+                                                    void* inClientData);
+
+//Only the fields the module reads; the real one also carries word clock and SMPTE time
+struct AudioTimeStamp {
+    Float64 mSampleTime;
+    UInt64  mHostTime;
+    Float64 mRateScalar;
+    UInt32  mFlags;
+};
+
+const UInt32 kAudioTimeStampSampleTimeValid = 1u << 0;
+const UInt32 kAudioTimeStampHostTimeValid   = 1u << 1;
+
+typedef OSStatus (*AudioDeviceIOProc)(AudioObjectID inDevice,
+                                      const AudioTimeStamp* inNow,
+                                      const AudioBufferList* inInputData,
+                                      const AudioTimeStamp* inInputTime,
+                                      AudioBufferList* outOutputData,
+                                      const AudioTimeStamp* inOutputTime,
+                                      void* inClientData);
+typedef AudioDeviceIOProc AudioDeviceIOProcID;
+
+/* ----------------------------Error codes-------------------------------- */
+const OSStatus noErr                                   = 0;
+const OSStatus kAudioHardwareNoError                   = 0;
+const OSStatus kAudioHardwareUnspecifiedError          = PYCOREAUDIO_FOURCC('w','h','a','t');
+const OSStatus kAudioHardwareUnknownPropertyError      = PYCOREAUDIO_FOURCC('w','h','o','?');
+const OSStatus kAudioHardwareBadPropertySizeError      = PYCOREAUDIO_FOURCC('!','s','i','z');
+const OSStatus kAudioHardwareIllegalOperationError     = PYCOREAUDIO_FOURCC('n','o','p','e');
+const OSStatus kAudioHardwareBadObjectError            = PYCOREAUDIO_FOURCC('!','o','b','j');
+const OSStatus kAudioHardwareUnsupportedOperationError = PYCOREAUDIO_FOURCC('u','n','o','p');
+
+/* -----------------------------Objects----------------------------------- */
+const AudioObjectID kAudioObjectUnknown      = 0;
+const AudioObjectID kAudioObjectSystemObject = 1;
+
+/* ------------------------Selectors and scopes--------------------------- */
+const AudioObjectPropertySelector kAudioObjectPropertySelectorWildcard           = PYCOREAUDIO_FOURCC('*','*','*','*');
+const AudioObjectPropertySelector kAudioHardwarePropertyDevices                  = PYCOREAUDIO_FOURCC('d','e','v','#');
+const AudioObjectPropertySelector kAudioHardwarePropertyDefaultOutputDevice      = PYCOREAUDIO_FOURCC('d','O','u','t');
+const AudioObjectPropertySelector kAudioDevicePropertyDeviceNameCFString         = PYCOREAUDIO_FOURCC('l','n','a','m');
+const AudioObjectPropertySelector kAudioDevicePropertyDeviceManufacturerCFString = PYCOREAUDIO_FOURCC('l','m','a','k');
+const AudioObjectPropertySelector kAudioDevicePropertyDeviceUID                  = PYCOREAUDIO_FOURCC('u','i','d',' ');
+const AudioObjectPropertySelector kAudioDevicePropertyStreams                    = PYCOREAUDIO_FOURCC('s','t','m','#');
+const AudioObjectPropertySelector kAudioDevicePropertyStreamConfiguration        = PYCOREAUDIO_FOURCC('s','l','a','y');
+const AudioObjectPropertySelector kAudioDevicePropertyPreferredChannelsForStereo = PYCOREAUDIO_FOURCC('d','c','h','2');
+const AudioObjectPropertySelector kAudioDevicePropertyVolumeScalar               = PYCOREAUDIO_FOURCC('v','o','l','m');
+const AudioObjectPropertySelector kAudioDevicePropertyVolumeDecibels             = PYCOREAUDIO_FOURCC('v','o','l','d');
+const AudioObjectPropertySelector kAudioDevicePropertyMute                       = PYCOREAUDIO_FOURCC('m','u','t','e');
+const AudioObjectPropertySelector kAudioDevicePropertyNominalSampleRate           = PYCOREAUDIO_FOURCC('n','s','r','t');
+const AudioObjectPropertySelector kAudioDevicePropertyBufferFrameSize            = PYCOREAUDIO_FOURCC('f','s','i','z');
+const AudioObjectPropertySelector kAudioAggregateDevicePropertyActiveSubDeviceList = PYCOREAUDIO_FOURCC('a','g','r','p');
+
+const AudioObjectPropertyScope kAudioObjectPropertyScopeGlobal   = PYCOREAUDIO_FOURCC('g','l','o','b');
+const AudioObjectPropertyScope kAudioObjectPropertyScopeWildcard = PYCOREAUDIO_FOURCC('*','*','*','*');
+const AudioObjectPropertyScope kAudioDevicePropertyScopeInput    = PYCOREAUDIO_FOURCC('i','n','p','t');
+const AudioObjectPropertyScope kAudioDevicePropertyScopeOutput   = PYCOREAUDIO_FOURCC('o','u','t','p');
+
+const AudioObjectPropertyElement kAudioObjectPropertyElementMain     = 0;
+const AudioObjectPropertyElement kAudioObjectPropertyElementWildcard = 0xFFFFFFFF;
+
+/* ----------------------------CFString----------------------------------- */
+/*
+ * A reference counted UTF-8 string standing in for CFString. It covers
+ * the handful of calls the module makes; strings handed out by the
+ * simulated HAL follow the usual CoreFoundation "Copy" ownership rules.
+ */
+typedef long CFIndex;
+typedef UInt32 CFStringEncoding;
+typedef const void* CFTypeRef;
+typedef const void* CFAllocatorRef;
+
+struct __CFString {
+    mutable std::atomic<long> refCount;
+    std::string utf8;
+    __CFString(const char* str) : refCount(1), utf8(str) {}
+};
+typedef const struct __CFString* CFStringRef;
+
+const CFStringEncoding kCFStringEncodingUTF8 = 0x08000100;
+const CFAllocatorRef kCFAllocatorDefault = NULL;
+
+inline CFStringRef CFStringCreateWithCString(CFAllocatorRef, const char* cStr, CFStringEncoding){
+    return new __CFString(cStr);
+}
+
+inline CFTypeRef CFRetain(CFTypeRef cf){
+    static_cast<CFStringRef>(cf)->refCount.fetch_add(1, std::memory_order_relaxed);
+    return cf;
+}
+
+inline void CFRelease(CFTypeRef cf){
+    CFStringRef str = static_cast<CFStringRef>(cf);
+    if(str->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete str;
+}
+
+//Length in UTF-16 code units, like the real thing
+inline CFIndex CFStringGetLength(CFStringRef str){
+    CFIndex length = 0;
+    for(unsigned char c : str->utf8){
+        if((c & 0xC0) != 0x80) length++;      //lead byte
+        if((c & 0xF8) == 0xF0) length++;      //4-byte sequence -> surrogate pair
+    }
+    return length;
+}
+
+inline CFIndex CFStringGetMaximumSizeForEncoding(CFIndex length, CFStringEncoding){
+    return length * 3;
+}
+
+inline Boolean CFStringGetCString(CFStringRef str, char* buffer, CFIndex bufferSize, CFStringEncoding){
+    if(bufferSize <= (CFIndex)str->utf8.size()) return false;
+    memcpy(buffer, str->utf8.c_str(), str->utf8.size() + 1);
+    return true;
+}
+
+//Like CoreFoundation, only exposes the buffer of strings it can store as 8 bit (ASCII here)
+inline const char* CFStringGetCStringPtr(CFStringRef str, CFStringEncoding){
+    for(unsigned char c : str->utf8){
+        if(c >= 0x80) return NULL;
+    }
+    return str->utf8.c_str();
+}
+
+#endif //__APPLE__
+
+#endif //PYCOREAUDIO_CACOMPAT_H
@@ -0,0 +1,148 @@
+#include "capture.h"
+#include "audio.h"
+#include <string.h>
+
+CaptureEngine captureEngine;
+
+/* ------------------------------Capture---------------------------------- */
+Capture::Capture(UInt32 channels, size_t capacityFrames) :
+    channelCount(channels),
+    ring(capacityFrames, channels),
+    captured(0),
+    dropped(0),
+    overruns(0),
+    borrowed(0),
+    lent(false) {}
+
+void Capture::process(const AudioBufferList* input, AudioBufferList* output, UInt32 frames, Float64 sampleTime){
+    if(input == NULL) return;
+
+    size_t done = 0;
+    while(done < frames){
+        size_t writable;
+        Float32* region = ring.writeRegion(&writable);
+        if(writable == 0) break;
+        size_t count = frames - done < writable ? frames - done : writable;
+
+        //Interleave the streams in order; channels a changed layout has no room for stay silent
+        UInt32 offset = 0;
+        for(UInt32 i = 0; i < input->mNumberBuffers; i++){
+            const AudioBuffer &buffer = input->mBuffers[i];
+            UInt32 channels = buffer.mNumberChannels;
+            if(offset + channels > channelCount || buffer.mData == NULL) break;
+            if(buffer.mDataByteSize < (UInt64)frames * channels * sizeof(Float32)) break;
+            const Float32* source = (const Float32*)buffer.mData + done * channels;
+            if(channels == channelCount){
+                memcpy(region, source, count * channels * sizeof(Float32));
+            } else {
+                for(size_t frame = 0; frame < count; frame++){
+                    Float32* target = region + frame * channelCount + offset;
+                    for(UInt32 channel = 0; channel < channels; channel++) target[channel] = source[frame * channels + channel];
+                }
+            }
+            offset += channels;
+        }
+        for(size_t frame = 0; offset < channelCount && frame < count; frame++){
+            memset(region + frame * channelCount + offset, 0, (channelCount - offset) * sizeof(Float32));
+        }
+        ring.produce(count);
+        done += count;
+    }
+
+    captured.store(captured.load(std::memory_order_relaxed) + done, std::memory_order_relaxed);
+    if(done < frames){
+        dropped.store(dropped.load(std::memory_order_relaxed) + (frames - done), std::memory_order_relaxed);
+        overruns.store(overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+const Float32* Capture::acquire(size_t maxFrames, size_t* frames){
+    std::lock_guard<std::mutex> lock(readerMutex);
+    *frames = 0;
+    if(lent) return NULL;
+    size_t readable;
+    const Float32* region = ring.readRegion(&readable);
+    if(maxFrames > 0 && readable > maxFrames) readable = maxFrames;
+    if(readable > 0){
+        borrowed = readable;
+        lent = true;
+    }
+    *frames = readable;
+    return region;
+}
+
+void Capture::release(){
+    std::lock_guard<std::mutex> lock(readerMutex);
+    if(!lent) return;
+    ring.consume(borrowed);
+    borrowed = 0;
+    lent = false;
+}
+
+CaptureStats Capture::stats(){
+    CaptureStats stats;
+    stats.captured = captured.load(std::memory_order_relaxed);
+    stats.dropped = dropped.load(std::memory_order_relaxed);
+    stats.overruns = overruns.load(std::memory_order_relaxed);
+    stats.queued = ring.readable();
+    stats.capacity = ring.capacity();
+    return stats;
+}
+/* ----------------------------------------------------------------------- */
+
+/* ---------------------------CaptureEngine------------------------------- */
+UInt32 CaptureEngine::start(AudioDeviceID deviceID, size_t capacityFrames){
+    int channels = getDeviceChannelCount(deviceID, true);
+    if(channels <= 0) return 0;
+    if(capacityFrames == 0){
+        Float64 sampleRate = getDeviceSampleRate(deviceID);
+        capacityFrames = sampleRate > 0 ? (size_t)sampleRate : 48000;
+    }
+    std::shared_ptr<Capture> capture(new Capture((UInt32)channels, capacityFrames));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    CaptureTable::iterator running = captures.find(deviceID);
+    if(running != captures.end()){
+        ioHost.remove(deviceID, running->second);
+        captures.erase(running);
+    }
+    if(!ioHost.add(deviceID, IO_POSITION_INPUT, capture)){
+        publish();
+        return 0;
+    }
+    captures[deviceID] = capture;
+    publish();
+    return (UInt32)channels;
+}
+
+bool CaptureEngine::stop(AudioDeviceID deviceID){
+    std::lock_guard<std::mutex> lock(mutex);
+    CaptureTable::iterator running = captures.find(deviceID);
+    if(running == captures.end()) return false;
+    ioHost.remove(deviceID, running->second);
+    captures.erase(running);
+    publish();
+    return true;
+}
+
+void CaptureEngine::stop(){
+    std::lock_guard<std::mutex> lock(mutex);
+    for(CaptureTable::iterator it = captures.begin(); it != captures.end(); ++it){
+        ioHost.remove(it->first, it->second);
+    }
+    captures.clear();
+    publish();
+}
+
+std::shared_ptr<Capture> CaptureEngine::find(AudioDeviceID deviceID){
+    std::shared_ptr<const CaptureTable> table = std::atomic_load(&published);
+    if(!table) return std::shared_ptr<Capture>();
+    CaptureTable::const_iterator found = table->find(deviceID);
+    if(found == table->end()) return std::shared_ptr<Capture>();
+    return found->second;
+}
+
+void CaptureEngine::publish(){
+    std::atomic_store(&published, std::shared_ptr<const CaptureTable>(new CaptureTable(captures)));
+}
+/* ----------------------------------------------------------------------- */
@@ -0,0 +1,122 @@
+#ifndef PYCOREAUDIO_CAPTURE_H
+#define PYCOREAUDIO_CAPTURE_H
+
+#include "cacompat.h"
+#include "io.h"
+#include "ring.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/**
+ * Counters of a capture.
+ */
+struct CaptureStats {
+    UInt64 captured;        //frames written to the ring
+    UInt64 dropped;         //frames lost because the ring was full
+    UInt64 overruns;        //IO cycles that lost frames
+    UInt64 queued;          //frames waiting to be read
+    UInt64 capacity;        //size of the ring in frames
+};
+
+/**
+ * Recording of the input streams of a device, run as a stage of its
+ * IOProc.
+ *
+ * Every IO cycle, the frames of all input streams are interleaved into a
+ * preallocated FrameRing; what does not fit is dropped and counted as an
+ * overrun. The reader borrows regions of the ring in place (acquire()),
+ * so the samples are never copied once they are in the ring. There is
+ * one reader at a time and at most one borrowed region.
+ */
+class Capture : public IOStage {
+public:
+    /**
+     * @param channels - number of input channels of the device
+     * @param capacityFrames - minimum size of the ring, in frames
+     */
+    Capture(UInt32 channels, size_t capacityFrames);
+
+    void process(const AudioBufferList* input, AudioBufferList* output, UInt32 frames, Float64 sampleTime) override;
+
+    /**
+     * Borrow the oldest queued frames, up to the end of the ring. They stay
+     * valid and unchanged until release().
+     *
+     * @param maxFrames - maximum number of frames, 0 for no limit
+     * @param frames - set to the number of frames borrowed, 0 if none are queued
+     * @result - first sample of the frames, NULL if a region is borrowed already
+     */
+    const Float32* acquire(size_t maxFrames, size_t* frames);
+
+    /**
+     * Give back the region borrowed with acquire(), freeing its frames.
+     */
+    void release();
+
+    /**
+     * Get the counters of the capture.
+     */
+    CaptureStats stats();
+
+    UInt32 channels() const { return channelCount; }
+
+private:
+    UInt32 channelCount;
+    FrameRing<Float32> ring;
+    std::atomic<UInt64> captured;
+    std::atomic<UInt64> dropped;
+    std::atomic<UInt64> overruns;
+
+    std::mutex readerMutex;             //makes every reader thread the ring's single consumer
+    size_t borrowed;                    //frames of the borrowed region
+    bool lent;                          //a region is borrowed
+};
+
+/**
+ * The captures of all devices, at most one per device. find() takes no
+ * lock; the table of captures is published RCU-style.
+ */
+class CaptureEngine {
+public:
+    /**
+     * Start capturing the input of a device. A capture running there
+     * already is replaced.
+     *
+     * @param deviceID - ID of the device
+     * @param capacityFrames - minimum size of the ring in frames, 0 for one second
+     * @result - number of channels captured, 0 if the device has no input or the IOProc could not be started
+     */
+    UInt32 start(AudioDeviceID deviceID, size_t capacityFrames);
+
+    /**
+     * Stop capturing a device. Regions borrowed from it stay valid.
+     *
+     * @result - whether a capture was running
+     */
+    bool stop(AudioDeviceID deviceID);
+
+    /**
+     * Stop every capture.
+     */
+    void stop();
+
+    /**
+     * Get the capture of a device, NULL if it is not captured.
+     */
+    std::shared_ptr<Capture> find(AudioDeviceID deviceID);
+
+private:
+    typedef std::map<AudioDeviceID, std::shared_ptr<Capture> > CaptureTable;
+
+    void publish();     //[mutex] must be held
+
+    std::mutex mutex;                               //guards [captures]
+    CaptureTable captures;
+    std::shared_ptr<const CaptureTable> published;  //copy of [captures] for find(), atomic access only
+};
+
+extern CaptureEngine captureEngine;
+
+#endif //PYCOREAUDIO_CAPTURE_H
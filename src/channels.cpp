@@ -0,0 +1,212 @@
+#include "channels.h"
+#include "audio.h"
+#include "hal.h"
+#include "trace.h"
+#include <stdlib.h>
+
+ChannelMapCache channelMaps;
+
+ChannelMapCache::ChannelMapCache() : listening(false), dirty(false), listDirty(false) {}
+
+bool ChannelMapCache::start(){
+    std::lock_guard<std::mutex> lock(mapMutex);
+    return listen();
+}
+
+bool ChannelMapCache::listen(){
+    if(listening) return true;
+    OSStatus result = hal::addPropertyListener(kAudioObjectSystemObject, &properties::count,
+                                               onDeviceListChanged, this);
+    listening = (result == kAudioHardwareNoError);
+    return listening;
+}
+
+void ChannelMapCache::stop(){
+    std::lock_guard<std::mutex> lock(mapMutex);
+    if(listening){
+        hal::removePropertyListener(kAudioObjectSystemObject, &properties::count, onDeviceListChanged, this);
+    }
+    unwatchAll();
+    publish();
+    listening = false;
+
+    std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+    dirty = false;
+    listDirty = false;
+    dirtyDevices.clear();
+}
+
+void ChannelMapCache::unwatchAll(){
+    //Fails harmlessly for devices that are already gone
+    for(AudioDeviceID deviceID : watched){
+        hal::removePropertyListener(deviceID, &properties::streamConfiguration, onDeviceChanged, this);
+        hal::removePropertyListener(deviceID, &properties::activeSubDevices, onDeviceChanged, this);
+    }
+    watched.clear();
+    maps.clear();
+}
+
+void ChannelMapCache::publish(){
+    std::atomic_store(&published, std::shared_ptr<const MapTable>(new MapTable(maps)));
+}
+
+void ChannelMapCache::takeDirty(){
+    bool listChanged;
+    std::set<AudioDeviceID> changed;
+    {
+        std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+        listChanged = listDirty;
+        listDirty = false;
+        changed.swap(dirtyDevices);
+    }
+    //Device IDs may have been reused by a new device, start over
+    if(listChanged) unwatchAll();
+    for(AudioDeviceID deviceID : changed) maps.erase(deviceID);
+    publish();
+
+    //Only now let lookups skip the lock again, they must not see the dropped maps
+    std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+    if(!listDirty && dirtyDevices.empty()) dirty = false;
+}
+
+ChannelMapRef ChannelMapCache::lookup(AudioDeviceID deviceID){
+    if(!dirty.load(std::memory_order_acquire)){
+        std::shared_ptr<const MapTable> table = std::atomic_load(&published);
+        if(table){
+            MapTable::const_iterator cached = table->find(deviceID);
+            if(cached != table->end()) return cached->second;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mapMutex);
+    if(dirty.load(std::memory_order_acquire)) takeDirty();
+    std::map<AudioDeviceID, ChannelMapRef>::const_iterator cached = maps.find(deviceID);
+    if(cached != maps.end()) return cached->second;
+
+    //Listen before building, so a change in between is not lost
+    listen();
+    watch(deviceID);
+    std::shared_ptr<ChannelMap> map(new ChannelMap());
+    bool valid = build(deviceID, *map);
+    if(valid && watched.count(deviceID) != 0){
+        maps[deviceID] = map;
+        publish();
+    }
+    return map;
+}
+
+void ChannelMapCache::lookup(const AudioDeviceID* deviceIDs, size_t count, ChannelMapRef* maps){
+    std::shared_ptr<const MapTable> table;
+    if(!dirty.load(std::memory_order_acquire)) table = std::atomic_load(&published);
+    for(size_t i = 0; i < count; i++){
+        MapTable::const_iterator cached;
+        if(table && (cached = table->find(deviceIDs[i])) != table->end()) maps[i] = cached->second;
+        else maps[i] = lookup(deviceIDs[i]);
+    }
+}
+
+void ChannelMapCache::watch(AudioDeviceID deviceID){
+    if(!listening || watched.count(deviceID) != 0) return;
+    OSStatus result = hal::addPropertyListener(deviceID, &properties::streamConfiguration,
+                                               onDeviceChanged, this);
+    if(result == kAudioHardwareNoError) watched.insert(deviceID);
+    //Only aggregate devices have sub-devices
+    if(result == kAudioHardwareNoError && hal::hasProperty(deviceID, &properties::activeSubDevices)){
+        hal::addPropertyListener(deviceID, &properties::activeSubDevices, onDeviceChanged, this);
+    }
+}
+
+void ChannelMapCache::seed(AudioDeviceID deviceID, const ChannelMap &map){
+    std::lock_guard<std::mutex> lock(mapMutex);
+    if(!listening || watched.count(deviceID) != 0) return;
+    maps[deviceID] = ChannelMapRef(new ChannelMap(map));
+    publish();
+}
+
+ChannelMapRef ChannelMapCache::validate(AudioDeviceID deviceID){
+    std::lock_guard<std::mutex> lock(mapMutex);
+    if(dirty.load(std::memory_order_acquire)) takeDirty();
+    listen();
+    watch(deviceID);
+    std::shared_ptr<ChannelMap> map(new ChannelMap());
+    if(build(deviceID, *map) && watched.count(deviceID) != 0) maps[deviceID] = map;
+    else maps.erase(deviceID);
+    publish();
+    return map;
+}
+
+bool ChannelMapCache::build(AudioDeviceID deviceID, ChannelMap &map){
+    UInt32 dataSize = 0;
+    OSStatus result = hal::getPropertyDataSize(deviceID, &properties::streamConfiguration, 0, NULL, &dataSize);
+    if(result != kAudioHardwareNoError || dataSize < sizeof(UInt32)) return false;
+
+    AudioBufferList* streams = (AudioBufferList*)malloc(dataSize);
+    result = hal::getPropertyData(deviceID, &properties::streamConfiguration, 0, NULL, &dataSize, streams);
+    if(result != kAudioHardwareNoError){
+        free(streams);
+        return false;
+    }
+    map.outputChannels = 0;
+    for(UInt32 i = 0; i < streams->mNumberBuffers; i++){
+        map.outputChannels += streams->mBuffers[i].mNumberChannels;
+    }
+    free(streams);
+
+    UInt32 stereo[2] = { 0, 0 };
+    dataSize = sizeof(stereo);
+    if(hal::getPropertyData(deviceID, &properties::preferredStereo, 0, NULL, &dataSize, stereo) == kAudioHardwareNoError){
+        map.stereo[0] = (int)stereo[0];
+        map.stereo[1] = (int)stereo[1];
+    }
+
+    //The main element, every channel of the stream configuration, and the
+    //stereo pair in case the device reports it outside of its streams
+    std::vector<int> elements;
+    for(int channel = 0; channel <= (int)map.outputChannels; channel++) elements.push_back(channel);
+    for(int channel : map.stereo){
+        if(channel > (int)map.outputChannels && (elements.back() != channel)) elements.push_back(channel);
+    }
+
+    for(int channel : elements){
+        AudioObjectPropertyAddress volume = properties::volume.on(channel);
+        AudioObjectPropertyAddress mute = properties::mute.on(channel);
+        if(hal::hasProperty(deviceID, &volume)) map.volume.push_back(channel);
+        if(hal::hasProperty(deviceID, &mute)) map.mute.push_back(channel);
+    }
+
+    //Only looked for where the controls would be missing, as on multi-output devices
+    if(map.volume.empty() || map.mute.empty()){
+        dataSize = 0;
+        if(hal::getPropertyDataSize(deviceID, &properties::activeSubDevices, 0, NULL, &dataSize) == kAudioHardwareNoError
+           && dataSize >= sizeof(AudioObjectID)){
+            map.subDevices.resize(dataSize / sizeof(AudioObjectID));
+            if(hal::getPropertyData(deviceID, &properties::activeSubDevices, 0, NULL, &dataSize,
+                                    map.subDevices.data()) == kAudioHardwareNoError){
+                map.subDevices.resize(dataSize / sizeof(AudioObjectID));
+            } else {
+                map.subDevices.clear();
+            }
+        }
+    }
+    return true;
+}
+
+OSStatus ChannelMapCache::onDeviceChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                          const AudioObjectPropertyAddress* addresses, void* clientData){
+    trace::Scope scope(trace::CATEGORY_LISTENER, "ChannelMapCache::onDeviceChanged", objectID, numberAddresses ? addresses[0].mSelector : 0);
+    ChannelMapCache* cache = static_cast<ChannelMapCache*>(clientData);
+    std::lock_guard<std::mutex> lock(cache->dirtyMutex);
+    cache->dirtyDevices.insert(objectID);
+    cache->dirty = true;
+    return kAudioHardwareNoError;
+}
+
+OSStatus ChannelMapCache::onDeviceListChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                              const AudioObjectPropertyAddress* addresses, void* clientData){
+    trace::Scope scope(trace::CATEGORY_LISTENER, "ChannelMapCache::onDeviceListChanged", objectID, numberAddresses ? addresses[0].mSelector : 0);
+    ChannelMapCache* cache = static_cast<ChannelMapCache*>(clientData);
+    std::lock_guard<std::mutex> lock(cache->dirtyMutex);
+    cache->listDirty = true;
+    cache->dirty = true;
+    return kAudioHardwareNoError;
+}
@@ -0,0 +1,145 @@
+#ifndef PYCOREAUDIO_CHANNELS_H
+#define PYCOREAUDIO_CHANNELS_H
+
+#include "cacompat.h"
+#include "property.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+/**
+ * The elements of a device that carry output controls.
+ */
+struct ChannelMap {
+    std::vector<int> volume;        //elements with a volume control, main element first
+    std::vector<int> mute;          //elements with a mute control, main element first
+    UInt32 outputChannels;          //channels in the output stream configuration
+    int stereo[2];                  //preferred stereo pair, 0 if the device has none
+    std::vector<AudioDeviceID> subDevices;  //active sub-devices of an aggregate device, empty otherwise
+
+    ChannelMap() : outputChannels(0) { stereo[0] = stereo[1] = 0; }
+
+    ChannelSpan volumeChannels() const { return ChannelSpan(volume.data(), volume.size()); }
+    ChannelSpan muteChannels() const { return ChannelSpan(mute.data(), mute.size()); }
+};
+typedef std::shared_ptr<const ChannelMap> ChannelMapRef;
+
+/**
+ * Per-device cache of channel maps.
+ *
+ * A map is built once per device from its output stream configuration
+ * (kAudioDevicePropertyStreamConfiguration) and preferred stereo pair,
+ * checking exactly the elements the device reports instead of probing
+ * until a few misses in a row. The map of an aggregate device also lists
+ * its active sub-devices (kAudioAggregateDevicePropertyActiveSubDeviceList).
+ * The cache listens for changes of the stream configuration and
+ * sub-devices of every mapped device and of the device list, and drops
+ * the maps they affect. It starts listening at start() or at the first
+ * lookup(), whichever comes first, so a map is built once whether or not
+ * anything started the cache; only stop() ends that, until the next
+ * lookup(). A map is not cached while its listener cannot be installed.
+ *
+ * Maps are immutable and shared, they stay valid after being dropped.
+ * The table of cached maps is published RCU-style: lookups of a cached
+ * map take no lock unless a change is pending, so any number of threads
+ * can look up concurrently.
+ */
+class ChannelMapCache {
+public:
+    ChannelMapCache();
+
+    /**
+     * Start listening for device list changes ahead of the first
+     * lookup(), see DeviceRegistry::start().
+     *
+     * @result - whether the device list listener could be installed
+     */
+    bool start();
+
+    /**
+     * Remove all listeners and drop every cached map. A later lookup()
+     * starts listening again.
+     */
+    void stop();
+
+    /**
+     * Get the channel map of a device, building it if needed.
+     * Never NULL; a device that is gone or has no controls gets an
+     * empty map.
+     *
+     * @param deviceID - ID of the device
+     * @result - channel map of the device
+     */
+    ChannelMapRef lookup(AudioDeviceID deviceID);
+
+    /**
+     * Get the channel maps of several devices, like lookup() for each,
+     * reading the table of cached maps once for all of them.
+     *
+     * @param deviceIDs - IDs of the devices
+     * @param count - number of devices
+     * @param maps - receives the channel map of every device
+     */
+    void lookup(const AudioDeviceID* deviceIDs, size_t count, ChannelMapRef* maps);
+
+    /**
+     * Build the channel map of a device, bypassing the cache.
+     *
+     * @param deviceID - ID of the device
+     * @param map - map to fill
+     * @result - whether the stream configuration could be read
+     */
+    static bool build(AudioDeviceID deviceID, ChannelMap &map);
+
+    /**
+     * Put a map known from elsewhere (devcache.h) in place of building
+     * it. It is served as is, without listening for changes, until the
+     * device is validated or the device list changes. Does nothing for
+     * a device whose map was built here.
+     *
+     * @param deviceID - ID of the device
+     * @param map - map to serve
+     */
+    void seed(AudioDeviceID deviceID, const ChannelMap &map);
+
+    /**
+     * Build the map of a device again and start listening for its
+     * changes, replacing whatever is cached for it.
+     *
+     * @param deviceID - ID of the device
+     * @result - the map now cached, see lookup()
+     */
+    ChannelMapRef validate(AudioDeviceID deviceID);
+
+private:
+    static OSStatus onDeviceChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                    const AudioObjectPropertyAddress* addresses, void* clientData);
+    static OSStatus onDeviceListChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                        const AudioObjectPropertyAddress* addresses, void* clientData);
+
+    typedef std::map<AudioDeviceID, ChannelMapRef> MapTable;
+
+    void takeDirty();
+    bool listen();                          //[mapMutex] must be held
+    void watch(AudioDeviceID deviceID);     //[mapMutex] must be held
+    void unwatchAll();
+    void publish();     //[mapMutex] must be held
+
+    std::mutex mapMutex;                        //guards the maps and the listener bookkeeping
+    MapTable maps;
+    std::shared_ptr<const MapTable> published;  //copy of [maps] for lock-free lookups, atomic access only
+    std::set<AudioDeviceID> watched;
+    bool listening;
+
+    std::mutex dirtyMutex;                      //guards the change flags set by the listeners
+    std::atomic<bool> dirty;                    //whether any flag below is set
+    bool listDirty;
+    std::set<AudioDeviceID> dirtyDevices;
+};
+
+extern ChannelMapCache channelMaps;
+
+#endif //PYCOREAUDIO_CHANNELS_H
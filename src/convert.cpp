@@ -0,0 +1,503 @@
+#include "convert.h"
+#include <math.h>
+#include <string.h>
+#if defined(PYCOREAUDIO_SIMD_X86)
+    #include <immintrin.h>
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+    #include <arm_neon.h>
+#endif
+
+//Full scale of the integer formats
+static const Float32 INT16_SCALE = 32768.0f;
+static const Float32 INT24_SCALE = 8388608.0f;
+static const Float32 INT32_SCALE = 2147483648.0f;
+//Largest floats that round to a value in range; 2^31 itself does not fit an int32
+static const Float32 INT16_HIGH = 32767.0f;
+static const Float32 INT24_HIGH = 8388607.0f;
+static const Float32 INT32_HIGH = 2147483520.0f;
+
+size_t sampleSize(SampleFormat format){
+    switch(format){
+        case FORMAT_INT16: return 2;
+        case FORMAT_INT24: return 3;
+        default: return 4;
+    }
+}
+
+/* ----------------------------Scalar kernels----------------------------- */
+/*
+ * The reference every vector kernel has to match bit for bit. Clipping
+ * is written the way the vector max/min instructions work, so NaN ends
+ * up at the low end in all of them.
+ */
+static inline Float32 clip(Float32 value, Float32 low, Float32 high){
+    value = value > low ? value : low;
+    return value < high ? value : high;
+}
+
+static void int16ToFloatScalar(const SInt16* source, Float32* target, size_t samples){
+    for(size_t i = 0; i < samples; i++) target[i] = (Float32)source[i] * (1.0f / INT16_SCALE);
+}
+
+static void int24ToFloatScalar(const UInt8* source, Float32* target, size_t samples){
+    for(size_t i = 0; i < samples; i++, source += 3){
+        SInt32 value = (SInt32)((UInt32)source[0] << 8 | (UInt32)source[1] << 16 | (UInt32)source[2] << 24) >> 8;
+        target[i] = (Float32)value * (1.0f / INT24_SCALE);
+    }
+}
+
+static void int32ToFloatScalar(const SInt32* source, Float32* target, size_t samples){
+    for(size_t i = 0; i < samples; i++) target[i] = (Float32)source[i] * (1.0f / INT32_SCALE);
+}
+
+static void floatToInt16Scalar(const Float32* source, SInt16* target, size_t samples){
+    for(size_t i = 0; i < samples; i++) target[i] = (SInt16)lrintf(clip(source[i] * INT16_SCALE, -INT16_SCALE, INT16_HIGH));
+}
+
+static void floatToInt24Scalar(const Float32* source, UInt8* target, size_t samples){
+    for(size_t i = 0; i < samples; i++, target += 3){
+        SInt32 value = (SInt32)lrintf(clip(source[i] * INT24_SCALE, -INT24_SCALE, INT24_HIGH));
+        target[0] = (UInt8)value;
+        target[1] = (UInt8)(value >> 8);
+        target[2] = (UInt8)(value >> 16);
+    }
+}
+
+static void floatToInt32Scalar(const Float32* source, SInt32* target, size_t samples){
+    for(size_t i = 0; i < samples; i++) target[i] = (SInt32)lrintf(clip(source[i] * INT32_SCALE, -INT32_SCALE, INT32_HIGH));
+}
+
+static void interleaveScalar(const Float32* const* planes, UInt32 channels, size_t frames, Float32* target){
+    for(UInt32 channel = 0; channel < channels; channel++){
+        const Float32* plane = planes[channel];
+        for(size_t frame = 0; frame < frames; frame++) target[frame * channels + channel] = plane[frame];
+    }
+}
+
+static void deinterleaveScalar(const Float32* source, UInt32 channels, size_t frames, Float32* const* planes){
+    for(UInt32 channel = 0; channel < channels; channel++){
+        Float32* plane = planes[channel];
+        for(size_t frame = 0; frame < frames; frame++) plane[frame] = source[frame * channels + channel];
+    }
+}
+/* ----------------------------------------------------------------------- */
+
+/* -----------------------------x86 kernels------------------------------- */
+/*
+ * Packed 24 bit samples need byte shuffles, which SSE2 does not have;
+ * they only get AVX2 kernels. AVX2 interleaves 4 channels with the SSE2
+ * kernels. Every kernel does whole vectors and leaves the rest to the
+ * scalar one.
+ */
+#if defined(PYCOREAUDIO_SIMD_X86)
+static void int16ToFloatSSE2(const SInt16* source, Float32* target, size_t samples){
+    const __m128 scale = _mm_set1_ps(1.0f / INT16_SCALE);
+    size_t i = 0;
+    for(; i + 8 <= samples; i += 8){
+        __m128i x = _mm_loadu_si128((const __m128i*)(source + i));
+        //Widen by putting each sample in the top half and shifting it down with its sign
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(target + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+        _mm_storeu_ps(target + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+    }
+    int16ToFloatScalar(source + i, target + i, samples - i);
+}
+
+static void int32ToFloatSSE2(const SInt32* source, Float32* target, size_t samples){
+    const __m128 scale = _mm_set1_ps(1.0f / INT32_SCALE);
+    size_t i = 0;
+    for(; i + 4 <= samples; i += 4){
+        __m128i x = _mm_loadu_si128((const __m128i*)(source + i));
+        _mm_storeu_ps(target + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+    }
+    int32ToFloatScalar(source + i, target + i, samples - i);
+}
+
+static void floatToInt16SSE2(const Float32* source, SInt16* target, size_t samples){
+    const __m128 scale = _mm_set1_ps(INT16_SCALE), low = _mm_set1_ps(-INT16_SCALE), high = _mm_set1_ps(INT16_HIGH);
+    size_t i = 0;
+    for(; i + 8 <= samples; i += 8){
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(source + i), scale), low), high);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(source + i + 4), scale), low), high);
+        _mm_storeu_si128((__m128i*)(target + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+    floatToInt16Scalar(source + i, target + i, samples - i);
+}
+
+static void floatToInt32SSE2(const Float32* source, SInt32* target, size_t samples){
+    const __m128 scale = _mm_set1_ps(INT32_SCALE), low = _mm_set1_ps(-INT32_SCALE), high = _mm_set1_ps(INT32_HIGH);
+    size_t i = 0;
+    for(; i + 4 <= samples; i += 4){
+        __m128 x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(source + i), scale), low), high);
+        _mm_storeu_si128((__m128i*)(target + i), _mm_cvtps_epi32(x));
+    }
+    floatToInt32Scalar(source + i, target + i, samples - i);
+}
+
+static void interleaveSSE2(const Float32* const* planes, UInt32 channels, size_t frames, Float32* target){
+    size_t frame = 0;
+    if(channels == 2){
+        for(; frame + 4 <= frames; frame += 4){
+            __m128 left = _mm_loadu_ps(planes[0] + frame), right = _mm_loadu_ps(planes[1] + frame);
+            _mm_storeu_ps(target + frame * 2, _mm_unpacklo_ps(left, right));
+            _mm_storeu_ps(target + frame * 2 + 4, _mm_unpackhi_ps(left, right));
+        }
+    } else if(channels == 4){
+        for(; frame + 4 <= frames; frame += 4){
+            __m128 a = _mm_loadu_ps(planes[0] + frame), b = _mm_loadu_ps(planes[1] + frame);
+            __m128 c = _mm_loadu_ps(planes[2] + frame), d = _mm_loadu_ps(planes[3] + frame);
+            _MM_TRANSPOSE4_PS(a, b, c, d);
+            _mm_storeu_ps(target + frame * 4, a);
+            _mm_storeu_ps(target + frame * 4 + 4, b);
+            _mm_storeu_ps(target + frame * 4 + 8, c);
+            _mm_storeu_ps(target + frame * 4 + 12, d);
+        }
+    } else {
+        interleaveScalar(planes, channels, frames, target);
+        return;
+    }
+    const Float32* rest[4];
+    for(UInt32 channel = 0; channel < channels; channel++) rest[channel] = planes[channel] + frame;
+    interleaveScalar(rest, channels, frames - frame, target + frame * channels);
+}
+
+static void deinterleaveSSE2(const Float32* source, UInt32 channels, size_t frames, Float32* const* planes){
+    size_t frame = 0;
+    if(channels == 2){
+        for(; frame + 4 <= frames; frame += 4){
+            __m128 a = _mm_loadu_ps(source + frame * 2), b = _mm_loadu_ps(source + frame * 2 + 4);
+            _mm_storeu_ps(planes[0] + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(planes[1] + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    } else if(channels == 4){
+        for(; frame + 4 <= frames; frame += 4){
+            __m128 a = _mm_loadu_ps(source + frame * 4), b = _mm_loadu_ps(source + frame * 4 + 4);
+            __m128 c = _mm_loadu_ps(source + frame * 4 + 8), d = _mm_loadu_ps(source + frame * 4 + 12);
+            _MM_TRANSPOSE4_PS(a, b, c, d);
+            _mm_storeu_ps(planes[0] + frame, a);
+            _mm_storeu_ps(planes[1] + frame, b);
+            _mm_storeu_ps(planes[2] + frame, c);
+            _mm_storeu_ps(planes[3] + frame, d);
+        }
+    } else {
+        deinterleaveScalar(source, channels, frames, planes);
+        return;
+    }
+    Float32* rest[4];
+    for(UInt32 channel = 0; channel < channels; channel++) rest[channel] = planes[channel] + frame;
+    deinterleaveScalar(source + frame * channels, channels, frames - frame, rest);
+}
+
+PYCOREAUDIO_TARGET_AVX2 static void int16ToFloatAVX2(const SInt16* source, Float32* target, size_t samples){
+    const __m256 scale = _mm256_set1_ps(1.0f / INT16_SCALE);
+    size_t i = 0;
+    for(; i + 16 <= samples; i += 16){
+        __m256i a = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(source + i)));
+        __m256i b = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(source + i + 8)));
+        _mm256_storeu_ps(target + i, _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+        _mm256_storeu_ps(target + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(b), scale));
+    }
+    int16ToFloatScalar(source + i, target + i, samples - i);
+}
+
+PYCOREAUDIO_TARGET_AVX2 static void int24ToFloatAVX2(const UInt8* source, Float32* target, size_t samples){
+    const __m256 scale = _mm256_set1_ps(1.0f / INT24_SCALE);
+    //Per 128 bit lane: four samples of three bytes into the top of four int32s
+    const __m256i spread = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    size_t i = 0;
+    //Each lane loads 16 bytes for its 12, so stop while 4 bytes past the last vector are still in the buffer
+    for(; i + 10 <= samples; i += 8){
+        const UInt8* bytes = source + i * 3;
+        __m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)bytes)),
+                                            _mm_loadu_si128((const __m128i*)(bytes + 12)), 1);
+        __m256i values = _mm256_srai_epi32(_mm256_shuffle_epi8(x, spread), 8);
+        _mm256_storeu_ps(target + i, _mm256_mul_ps(_mm256_cvtepi32_ps(values), scale));
+    }
+    int24ToFloatScalar(source + i * 3, target + i, samples - i);
+}
+
+PYCOREAUDIO_TARGET_AVX2 static void int32ToFloatAVX2(const SInt32* source, Float32* target, size_t samples){
+    const __m256 scale = _mm256_set1_ps(1.0f / INT32_SCALE);
+    size_t i = 0;
+    for(; i + 8 <= samples; i += 8){
+        __m256i x = _mm256_loadu_si256((const __m256i*)(source + i));
+        _mm256_storeu_ps(target + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+    }
+    int32ToFloatScalar(source + i, target + i, samples - i);
+}
+
+PYCOREAUDIO_TARGET_AVX2 static void floatToInt16AVX2(const Float32* source, SInt16* target, size_t samples){
+    const __m256 scale = _mm256_set1_ps(INT16_SCALE), low = _mm256_set1_ps(-INT16_SCALE), high = _mm256_set1_ps(INT16_HIGH);
+    size_t i = 0;
+    for(; i + 16 <= samples; i += 16){
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i), scale), low), high);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i + 8), scale), low), high);
+        //Packing works per lane, the permute puts the 64 bit quarters back in order
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        _mm256_storeu_si256((__m256i*)(target + i), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    floatToInt16Scalar(source + i, target + i, samples - i);
+}
+
+PYCOREAUDIO_TARGET_AVX2 static void floatToInt24AVX2(const Float32* source, UInt8* target, size_t samples){
+    const __m256 scale = _mm256_set1_ps(INT24_SCALE), low = _mm256_set1_ps(-INT24_SCALE), high = _mm256_set1_ps(INT24_HIGH);
+    //Per 128 bit lane: the low three bytes of four int32s to the first 12 bytes
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t i = 0;
+    //Each lane stores 16 bytes for its 12, the excess is overwritten by the next store
+    for(; i + 10 <= samples; i += 8){
+        __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i), scale), low), high);
+        __m256i packed = _mm256_shuffle_epi8(_mm256_cvtps_epi32(x), pack);
+        UInt8* bytes = target + i * 3;
+        _mm_storeu_si128((__m128i*)bytes, _mm256_castsi256_si128(packed));
+        _mm_storeu_si128((__m128i*)(bytes + 12), _mm256_extracti128_si256(packed, 1));
+    }
+    floatToInt24Scalar(source + i, target + i * 3, samples - i);
+}
+
+PYCOREAUDIO_TARGET_AVX2 static void floatToInt32AVX2(const Float32* source, SInt32* target, size_t samples){
+    const __m256 scale = _mm256_set1_ps(INT32_SCALE), low = _mm256_set1_ps(-INT32_SCALE), high = _mm256_set1_ps(INT32_HIGH);
+    size_t i = 0;
+    for(; i + 8 <= samples; i += 8){
+        __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i), scale), low), high);
+        _mm256_storeu_si256((__m256i*)(target + i), _mm256_cvtps_epi32(x));
+    }
+    floatToInt32Scalar(source + i, target + i, samples - i);
+}
+
+PYCOREAUDIO_TARGET_AVX2 static void interleaveAVX2(const Float32* const* planes, UInt32 channels, size_t frames, Float32* target){
+    if(channels != 2){
+        interleaveSSE2(planes, channels, frames, target);
+        return;
+    }
+    size_t frame = 0;
+    for(; frame + 8 <= frames; frame += 8){
+        __m256 left = _mm256_loadu_ps(planes[0] + frame), right = _mm256_loadu_ps(planes[1] + frame);
+        __m256 low = _mm256_unpacklo_ps(left, right), high = _mm256_unpackhi_ps(left, right);
+        _mm256_storeu_ps(target + frame * 2, _mm256_permute2f128_ps(low, high, 0x20));
+        _mm256_storeu_ps(target + frame * 2 + 8, _mm256_permute2f128_ps(low, high, 0x31));
+    }
+    const Float32* rest[2] = { planes[0] + frame, planes[1] + frame };
+    interleaveSSE2(rest, 2, frames - frame, target + frame * 2);
+}
+
+PYCOREAUDIO_TARGET_AVX2 static void deinterleaveAVX2(const Float32* source, UInt32 channels, size_t frames, Float32* const* planes){
+    if(channels != 2){
+        deinterleaveSSE2(source, channels, frames, planes);
+        return;
+    }
+    size_t frame = 0;
+    for(; frame + 8 <= frames; frame += 8){
+        __m256 a = _mm256_loadu_ps(source + frame * 2), b = _mm256_loadu_ps(source + frame * 2 + 8);
+        __m256 first = _mm256_permute2f128_ps(a, b, 0x20), second = _mm256_permute2f128_ps(a, b, 0x31);
+        _mm256_storeu_ps(planes[0] + frame, _mm256_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm256_storeu_ps(planes[1] + frame, _mm256_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    Float32* rest[2] = { planes[0] + frame, planes[1] + frame };
+    deinterleaveSSE2(source + frame * 2, 2, frames - frame, rest);
+}
+#endif
+/* ----------------------------------------------------------------------- */
+
+/* -----------------------------NEON kernels------------------------------ */
+#if defined(PYCOREAUDIO_SIMD_NEON)
+static void int16ToFloatNEON(const SInt16* source, Float32* target, size_t samples){
+    const float32x4_t scale = vdupq_n_f32(1.0f / INT16_SCALE);
+    size_t i = 0;
+    for(; i + 8 <= samples; i += 8){
+        int16x8_t x = vld1q_s16(source + i);
+        vst1q_f32(target + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), scale));
+        vst1q_f32(target + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), scale));
+    }
+    int16ToFloatScalar(source + i, target + i, samples - i);
+}
+
+static void int32ToFloatNEON(const SInt32* source, Float32* target, size_t samples){
+    const float32x4_t scale = vdupq_n_f32(1.0f / INT32_SCALE);
+    size_t i = 0;
+    for(; i + 4 <= samples; i += 4) vst1q_f32(target + i, vmulq_f32(vcvtq_f32_s32(vld1q_s32(source + i)), scale));
+    int32ToFloatScalar(source + i, target + i, samples - i);
+}
+
+//maxnm/minnm take the number when one side is NaN, like the scalar clip()
+static void floatToInt16NEON(const Float32* source, SInt16* target, size_t samples){
+    const float32x4_t scale = vdupq_n_f32(INT16_SCALE), low = vdupq_n_f32(-INT16_SCALE), high = vdupq_n_f32(INT16_HIGH);
+    size_t i = 0;
+    for(; i + 8 <= samples; i += 8){
+        float32x4_t a = vminnmq_f32(vmaxnmq_f32(vmulq_f32(vld1q_f32(source + i), scale), low), high);
+        float32x4_t b = vminnmq_f32(vmaxnmq_f32(vmulq_f32(vld1q_f32(source + i + 4), scale), low), high);
+        vst1q_s16(target + i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b))));
+    }
+    floatToInt16Scalar(source + i, target + i, samples - i);
+}
+
+static void floatToInt32NEON(const Float32* source, SInt32* target, size_t samples){
+    const float32x4_t scale = vdupq_n_f32(INT32_SCALE), low = vdupq_n_f32(-INT32_SCALE), high = vdupq_n_f32(INT32_HIGH);
+    size_t i = 0;
+    for(; i + 4 <= samples; i += 4){
+        float32x4_t x = vminnmq_f32(vmaxnmq_f32(vmulq_f32(vld1q_f32(source + i), scale), low), high);
+        vst1q_s32(target + i, vcvtnq_s32_f32(x));
+    }
+    floatToInt32Scalar(source + i, target + i, samples - i);
+}
+
+static void interleaveNEON(const Float32* const* planes, UInt32 channels, size_t frames, Float32* target){
+    size_t frame = 0;
+    if(channels == 2){
+        for(; frame + 4 <= frames; frame += 4){
+            float32x4x2_t x = { { vld1q_f32(planes[0] + frame), vld1q_f32(planes[1] + frame) } };
+            vst2q_f32(target + frame * 2, x);
+        }
+    } else if(channels == 4){
+        for(; frame + 4 <= frames; frame += 4){
+            float32x4x4_t x = { { vld1q_f32(planes[0] + frame), vld1q_f32(planes[1] + frame),
+                                  vld1q_f32(planes[2] + frame), vld1q_f32(planes[3] + frame) } };
+            vst4q_f32(target + frame * 4, x);
+        }
+    } else {
+        interleaveScalar(planes, channels, frames, target);
+        return;
+    }
+    const Float32* rest[4];
+    for(UInt32 channel = 0; channel < channels; channel++) rest[channel] = planes[channel] + frame;
+    interleaveScalar(rest, channels, frames - frame, target + frame * channels);
+}
+
+static void deinterleaveNEON(const Float32* source, UInt32 channels, size_t frames, Float32* const* planes){
+    size_t frame = 0;
+    if(channels == 2){
+        for(; frame + 4 <= frames; frame += 4){
+            float32x4x2_t x = vld2q_f32(source + frame * 2);
+            vst1q_f32(planes[0] + frame, x.val[0]);
+            vst1q_f32(planes[1] + frame, x.val[1]);
+        }
+    } else if(channels == 4){
+        for(; frame + 4 <= frames; frame += 4){
+            float32x4x4_t x = vld4q_f32(source + frame * 4);
+            for(int channel = 0; channel < 4; channel++) vst1q_f32(planes[channel] + frame, x.val[channel]);
+        }
+    } else {
+        deinterleaveScalar(source, channels, frames, planes);
+        return;
+    }
+    Float32* rest[4];
+    for(UInt32 channel = 0; channel < channels; channel++) rest[channel] = planes[channel] + frame;
+    deinterleaveScalar(source + frame * channels, channels, frames - frame, rest);
+}
+#endif
+/* ----------------------------------------------------------------------- */
+
+/* -------------------------------Dispatch-------------------------------- */
+void toFloat32(simd::Level level, SampleFormat format, const void* source, Float32* target, size_t samples){
+    switch(format){
+        case FORMAT_INT16:
+            switch(level){
+#if defined(PYCOREAUDIO_SIMD_X86)
+                case simd::LEVEL_SSE2: int16ToFloatSSE2((const SInt16*)source, target, samples); return;
+                case simd::LEVEL_AVX2: int16ToFloatAVX2((const SInt16*)source, target, samples); return;
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+                case simd::LEVEL_NEON: int16ToFloatNEON((const SInt16*)source, target, samples); return;
+#endif
+                default: int16ToFloatScalar((const SInt16*)source, target, samples); return;
+            }
+        case FORMAT_INT24:
+            switch(level){
+#if defined(PYCOREAUDIO_SIMD_X86)
+                case simd::LEVEL_AVX2: int24ToFloatAVX2((const UInt8*)source, target, samples); return;
+#endif
+                default: int24ToFloatScalar((const UInt8*)source, target, samples); return;
+            }
+        case FORMAT_INT32:
+            switch(level){
+#if defined(PYCOREAUDIO_SIMD_X86)
+                case simd::LEVEL_SSE2: int32ToFloatSSE2((const SInt32*)source, target, samples); return;
+                case simd::LEVEL_AVX2: int32ToFloatAVX2((const SInt32*)source, target, samples); return;
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+                case simd::LEVEL_NEON: int32ToFloatNEON((const SInt32*)source, target, samples); return;
+#endif
+                default: int32ToFloatScalar((const SInt32*)source, target, samples); return;
+            }
+        default:
+            memmove(target, source, samples * sizeof(Float32));
+            return;
+    }
+}
+
+void toFloat32(SampleFormat format, const void* source, Float32* target, size_t samples){
+    toFloat32(simd::level(), format, source, target, samples);
+}
+
+void fromFloat32(simd::Level level, SampleFormat format, const Float32* source, void* target, size_t samples){
+    switch(format){
+        case FORMAT_INT16:
+            switch(level){
+#if defined(PYCOREAUDIO_SIMD_X86)
+                case simd::LEVEL_SSE2: floatToInt16SSE2(source, (SInt16*)target, samples); return;
+                case simd::LEVEL_AVX2: floatToInt16AVX2(source, (SInt16*)target, samples); return;
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+                case simd::LEVEL_NEON: floatToInt16NEON(source, (SInt16*)target, samples); return;
+#endif
+                default: floatToInt16Scalar(source, (SInt16*)target, samples); return;
+            }
+        case FORMAT_INT24:
+            switch(level){
+#if defined(PYCOREAUDIO_SIMD_X86)
+                case simd::LEVEL_AVX2: floatToInt24AVX2(source, (UInt8*)target, samples); return;
+#endif
+                default: floatToInt24Scalar(source, (UInt8*)target, samples); return;
+            }
+        case FORMAT_INT32:
+            switch(level){
+#if defined(PYCOREAUDIO_SIMD_X86)
+                case simd::LEVEL_SSE2: floatToInt32SSE2(source, (SInt32*)target, samples); return;
+                case simd::LEVEL_AVX2: floatToInt32AVX2(source, (SInt32*)target, samples); return;
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+                case simd::LEVEL_NEON: floatToInt32NEON(source, (SInt32*)target, samples); return;
+#endif
+                default: floatToInt32Scalar(source, (SInt32*)target, samples); return;
+            }
+        default:
+            memmove(target, source, samples * sizeof(Float32));
+            return;
+    }
+}
+
+void fromFloat32(SampleFormat format, const Float32* source, void* target, size_t samples){
+    fromFloat32(simd::level(), format, source, target, samples);
+}
+
+void interleave(simd::Level level, const Float32* const* planes, UInt32 channels, size_t frames, Float32* target){
+    switch(level){
+#if defined(PYCOREAUDIO_SIMD_X86)
+        case simd::LEVEL_SSE2: interleaveSSE2(planes, channels, frames, target); return;
+        case simd::LEVEL_AVX2: interleaveAVX2(planes, channels, frames, target); return;
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+        case simd::LEVEL_NEON: interleaveNEON(planes, channels, frames, target); return;
+#endif
+        default: interleaveScalar(planes, channels, frames, target); return;
+    }
+}
+
+void interleave(const Float32* const* planes, UInt32 channels, size_t frames, Float32* target){
+    interleave(simd::level(), planes, channels, frames, target);
+}
+
+void deinterleave(simd::Level level, const Float32* source, UInt32 channels, size_t frames, Float32* const* planes){
+    switch(level){
+#if defined(PYCOREAUDIO_SIMD_X86)
+        case simd::LEVEL_SSE2: deinterleaveSSE2(source, channels, frames, planes); return;
+        case simd::LEVEL_AVX2: deinterleaveAVX2(source, channels, frames, planes); return;
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+        case simd::LEVEL_NEON: deinterleaveNEON(source, channels, frames, planes); return;
+#endif
+        default: deinterleaveScalar(source, channels, frames, planes); return;
+    }
+}
+
+void deinterleave(const Float32* source, UInt32 channels, size_t frames, Float32* const* planes){
+    deinterleave(simd::level(), source, channels, frames, planes);
+}
+/* ----------------------------------------------------------------------- */
@@ -0,0 +1,77 @@
+#ifndef PYCOREAUDIO_CONVERT_H
+#define PYCOREAUDIO_CONVERT_H
+
+#include "cacompat.h"
+#include "simd.h"
+#include <stddef.h>
+
+/*
+ * Sample format conversion and interleaving kernels.
+ *
+ * Integer samples are native-endian signed PCM, 24 bit ones packed into
+ * three bytes. Float samples are Float32 with full scale at 1.0;
+ * converting to integers scales, clips to the integer range and rounds
+ * to nearest, ties to even. NaN converts to the most negative value.
+ *
+ * Every function uses the vector kernels of simd::level(), or of
+ * [level] if given. Conversions the level has no kernel for run scalar;
+ * every kernel gives exactly the results of the scalar one.
+ */
+
+enum SampleFormat {
+    FORMAT_INT16   = 0,
+    FORMAT_INT24   = 1,     //packed, three bytes per sample
+    FORMAT_INT32   = 2,
+    FORMAT_FLOAT32 = 3
+};
+
+/**
+ * Get the size of a sample in bytes.
+ */
+size_t sampleSize(SampleFormat format);
+
+/**
+ * Convert integer or float samples to Float32.
+ *
+ * @param format - format of [source]
+ * @param source - [samples] samples
+ * @param target - buffer for [samples] samples
+ * @param samples - number of samples
+ */
+void toFloat32(SampleFormat format, const void* source, Float32* target, size_t samples);
+void toFloat32(simd::Level level, SampleFormat format, const void* source, Float32* target, size_t samples);
+
+/**
+ * Convert Float32 samples to integer or float samples.
+ *
+ * @param format - format of [target]
+ * @param source - [samples] samples
+ * @param target - buffer for [samples] samples
+ * @param samples - number of samples
+ */
+void fromFloat32(SampleFormat format, const Float32* source, void* target, size_t samples);
+void fromFloat32(simd::Level level, SampleFormat format, const Float32* source, void* target, size_t samples);
+
+/**
+ * Interleave one plane of samples per channel into frames.
+ *
+ * @param planes - [channels] planes of [frames] samples
+ * @param channels - number of channels
+ * @param frames - number of frames
+ * @param target - buffer for [frames] frames
+ */
+void interleave(const Float32* const* planes, UInt32 channels, size_t frames, Float32* target);
+void interleave(simd::Level level, const Float32* const* planes, UInt32 channels, size_t frames, Float32* target);
+
+/**
+ * Split frames into one plane of samples per channel.
+ *
+ * @param source - [frames] frames of [channels] samples
+ * @param channels - number of channels
+ * @param frames - number of frames
+ * @param planes - [channels] buffers for [frames] samples
+ */
+void deinterleave(const Float32* source, UInt32 channels, size_t frames, Float32* const* planes);
+void deinterleave(simd::Level level, const Float32* source, UInt32 channels, size_t frames, Float32* const* planes);
+
+#endif //PYCOREAUDIO_CONVERT_H
@@ -0,0 +1,408 @@
+#include "devcache.h"
+#include "registry.h"
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+DeviceCache deviceCache;
+
+namespace {
+
+const char MAGIC[8] = { 'P', 'C', 'A', 'C', 'A', 'C', 'H', 'E' };
+const UInt32 VERSION = 2;
+const UInt32 BYTE_ORDER_MARK = 0x01020304;     //reads back otherwise on a machine of the other byte order
+
+struct FileHeader {
+    char magic[8];
+    UInt32 version;
+    UInt32 byteOrder;
+    UInt32 count;               //records
+    UInt32 elementCount;        //entries of the element pool
+    UInt32 stringBytes;         //bytes of the string pool
+    UInt32 reserved;
+};
+
+//Strings are offsets into the string pool, lists ranges of the element pool
+struct FileRecord {
+    UInt32 deviceID;
+    UInt32 uid;
+    UInt32 name;
+    UInt32 manufacturer;
+    SInt32 inStreams;
+    SInt32 outStreams;
+    UInt32 hasMap;
+    UInt32 outputChannels;
+    SInt32 stereo[2];
+    UInt32 volume, volumeCount;
+    UInt32 mute, muteCount;
+    UInt32 subDevices, subDeviceCount;      //UIDs, offsets into the string pool
+};
+
+inline const FileHeader* header(const char* data){
+    return reinterpret_cast<const FileHeader*>(data);
+}
+
+inline const FileRecord* records(const char* data){
+    return reinterpret_cast<const FileRecord*>(data + sizeof(FileHeader));
+}
+
+inline const UInt32* elements(const char* data){
+    return reinterpret_cast<const UInt32*>(records(data) + header(data)->count);
+}
+
+inline const char* strings(const char* data){
+    return reinterpret_cast<const char*>(elements(data) + header(data)->elementCount);
+}
+
+inline bool inPool(UInt32 offset, UInt32 count, UInt32 poolSize){
+    return (UInt64)offset + count <= poolSize;
+}
+
+/**
+ * Builds the contents of a cache file.
+ */
+struct Writer {
+    std::vector<FileRecord> records;
+    std::vector<UInt32> elements;
+    std::string strings;
+
+    UInt32 string(const std::string &text){
+        UInt32 offset = (UInt32)strings.size();
+        strings.append(text.c_str(), text.size() + 1);
+        return offset;
+    }
+
+    template <typename T>
+    UInt32 list(const std::vector<T> &values, UInt32 &count){
+        UInt32 offset = (UInt32)elements.size();
+        for(T value : values) elements.push_back((UInt32)value);
+        count = (UInt32)values.size();
+        return offset;
+    }
+
+    UInt32 stringList(const std::vector<std::string> &texts, UInt32 &count){
+        std::vector<UInt32> offsets;
+        for(const std::string &text : texts) offsets.push_back(string(text));
+        return list(offsets, count);
+    }
+
+    std::vector<char> bytes(){
+        FileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.byteOrder = BYTE_ORDER_MARK;
+        header.count = (UInt32)records.size();
+        header.elementCount = (UInt32)elements.size();
+        header.stringBytes = (UInt32)strings.size();
+        std::vector<char> out(sizeof(header) + records.size() * sizeof(FileRecord)
+                              + elements.size() * sizeof(UInt32) + strings.size());
+        char* at = out.data();
+        memcpy(at, &header, sizeof(header));
+        at += sizeof(header);
+        if(!records.empty()) memcpy(at, records.data(), records.size() * sizeof(FileRecord));
+        at += records.size() * sizeof(FileRecord);
+        if(!elements.empty()) memcpy(at, elements.data(), elements.size() * sizeof(UInt32));
+        at += elements.size() * sizeof(UInt32);
+        if(!strings.empty()) memcpy(at, strings.data(), strings.size());
+        return out;
+    }
+};
+
+/**
+ * Get the UIDs of the sub-devices of a map from the device list.
+ *
+ * @result - whether every sub-device is in [devices] with a UID
+ */
+bool subDeviceUIDs(const std::vector<DeviceInfo> &devices, const ChannelMap &map, std::vector<std::string> &uids){
+    uids.clear();
+    for(AudioDeviceID subDevice : map.subDevices){
+        std::vector<DeviceInfo>::const_iterator found = std::find_if(devices.begin(), devices.end(),
+            [subDevice](const DeviceInfo &info){ return info.id == subDevice; });
+        if(found == devices.end() || found->uid == "Unknown") return false;
+        uids.push_back(found->uid);
+    }
+    return true;
+}
+
+/**
+ * Fill in the current IDs of the sub-devices of a cached map.
+ *
+ * @param deviceIDs, uids - the devices present and their UIDs
+ * @result - whether every sub-device is present
+ */
+bool resolveSubDevices(CachedDevice &device, const std::vector<AudioDeviceID> &deviceIDs,
+                       const std::vector<std::string> &uids){
+    for(const std::string &uid : device.subDevices){
+        std::vector<std::string>::const_iterator found = std::find(uids.begin(), uids.end(), uid);
+        if(found == uids.end()) return false;
+        device.map.subDevices.push_back(deviceIDs[found - uids.begin()]);
+    }
+    return true;
+}
+
+}; //namespace
+
+DeviceCache::DeviceCache() : data(NULL), size(0), validating(false), stopping(false) {}
+
+DeviceCache::~DeviceCache(){
+    stop();
+}
+
+void DeviceCache::setPath(const std::string &path){
+    std::lock_guard<std::mutex> lock(mutex);
+    file = path;
+}
+
+std::string DeviceCache::path(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return file;
+}
+
+bool DeviceCache::map(){
+    unmap();
+    int fd = open(file.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat info;
+    void* mapped = MAP_FAILED;
+    if(fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(FileHeader)){
+        mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    //The mapping outlives the descriptor
+    close(fd);
+    if(mapped == MAP_FAILED) return false;
+    data = static_cast<const char*>(mapped);
+    size = (size_t)info.st_size;
+
+    //Everything read() and search() rely on is checked once, here
+    const FileHeader* head = header(data);
+    bool valid = memcmp(head->magic, MAGIC, sizeof(MAGIC)) == 0 && head->version == VERSION
+              && head->byteOrder == BYTE_ORDER_MARK
+              && size == sizeof(FileHeader) + (UInt64)head->count * sizeof(FileRecord)
+                         + (UInt64)head->elementCount * sizeof(UInt32) + head->stringBytes;
+    //With the pool ending in a NUL, every offset into it is a terminated string
+    valid = valid && (head->stringBytes == 0 || strings(data)[head->stringBytes - 1] == 0);
+    for(UInt32 i = 0; valid && i < head->count; i++){
+        const FileRecord &record = records(data)[i];
+        valid = record.uid < head->stringBytes && record.name < head->stringBytes
+             && record.manufacturer < head->stringBytes
+             && inPool(record.volume, record.volumeCount, head->elementCount)
+             && inPool(record.mute, record.muteCount, head->elementCount)
+             && inPool(record.subDevices, record.subDeviceCount, head->elementCount)
+             && (i == 0 || strcmp(strings(data) + records(data)[i - 1].uid, strings(data) + record.uid) < 0);
+        for(UInt32 j = 0; valid && j < record.subDeviceCount; j++){
+            valid = elements(data)[record.subDevices + j] < head->stringBytes;
+        }
+    }
+    if(!valid) unmap();
+    return valid;
+}
+
+void DeviceCache::unmap(){
+    if(data) munmap(const_cast<char*>(data), size);
+    data = NULL;
+    size = 0;
+}
+
+bool DeviceCache::read(size_t index, CachedDevice &device){
+    if(!data || index >= header(data)->count) return false;
+    const FileRecord &record = records(data)[index];
+    const char* pool = strings(data);
+    const UInt32* pooled = elements(data);
+    device.info.id = record.deviceID;
+    device.info.uid = pool + record.uid;
+    device.info.name = pool + record.name;
+    device.info.manufacturer = pool + record.manufacturer;
+    device.info.inStreams = record.inStreams;
+    device.info.outStreams = record.outStreams;
+    device.hasMap = record.hasMap != 0;
+    device.map = ChannelMap();
+    device.subDevices.clear();
+    if(!device.hasMap) return true;
+    device.map.outputChannels = record.outputChannels;
+    device.map.stereo[0] = record.stereo[0];
+    device.map.stereo[1] = record.stereo[1];
+    device.map.volume.assign(pooled + record.volume, pooled + record.volume + record.volumeCount);
+    device.map.mute.assign(pooled + record.mute, pooled + record.mute + record.muteCount);
+    for(UInt32 i = 0; i < record.subDeviceCount; i++) device.subDevices.push_back(pool + pooled[record.subDevices + i]);
+    return true;
+}
+
+bool DeviceCache::search(const std::string &uid, CachedDevice &device){
+    if(!data) return false;
+    const FileRecord* first = records(data);
+    const FileRecord* last = first + header(data)->count;
+    const char* pool = strings(data);
+    const FileRecord* found = std::lower_bound(first, last, uid.c_str(), [pool](const FileRecord &record, const char* key){
+        return strcmp(pool + record.uid, key) < 0;
+    });
+    if(found == last || uid != pool + found->uid) return false;
+    return read(found - first, device);
+}
+
+bool DeviceCache::find(const std::string &uid, CachedDevice &device){
+    std::lock_guard<std::mutex> lock(mutex);
+    return search(uid, device);
+}
+
+bool DeviceCache::load(){
+    std::lock_guard<std::mutex> lock(mutex);
+    seeded.clear();
+    devices.clear();
+    if(file.empty() || !map()) return false;
+
+    //Device IDs are not stable across runs, so every record is matched to
+    //a device present now by UID: the device list plus one call per device
+    std::vector<AudioDeviceID> deviceIDs;
+    if(!getDeviceIDs(deviceIDs)) return false;
+    std::vector<std::string> uids;
+    for(AudioDeviceID deviceID : deviceIDs) uids.push_back(getDeviceUID(deviceID));
+    AudioDeviceID defaultDevice = kAudioObjectUnknown;
+    property::get(kAudioObjectSystemObject, properties::defaultOutputDevice, defaultDevice);
+
+    //The registry is only seeded if the file knows every device, a new one would be missing from it
+    bool complete = true;
+    CachedDevice device;
+    for(size_t i = 0; i < deviceIDs.size(); i++){
+        AudioDeviceID deviceID = deviceIDs[i];
+        if(!search(uids[i], device)){
+            complete = false;
+            continue;
+        }
+        device.info.id = deviceID;
+        devices.push_back(device.info);
+        //A map whose sub-devices cannot all be found is built on its first lookup instead
+        if(!device.hasMap || !resolveSubDevices(device, deviceIDs, uids)) continue;
+        channelMaps.seed(deviceID, device.map);
+        seeded.insert(deviceID == defaultDevice ? seeded.begin() : seeded.end(), deviceID);
+    }
+    if(!complete) devices.clear();
+    std::sort(devices.begin(), devices.end(), [](const DeviceInfo &a, const DeviceInfo &b){ return a.id < b.id; });
+    return true;
+}
+
+void DeviceCache::seed(){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!devices.empty()) deviceRegistry.seed(devices);
+    devices.clear();
+}
+
+void DeviceCache::validate(){
+    if(validator.joinable()) validator.join();
+    std::lock_guard<std::mutex> lock(mutex);
+    if(file.empty()) return;
+    stopping = false;
+    validating = true;
+    validator = std::thread(&DeviceCache::run, this);
+}
+
+bool DeviceCache::wait(int timeoutMs){
+    std::unique_lock<std::mutex> lock(mutex);
+    if(timeoutMs < 0){
+        finished.wait(lock, [this]{ return !validating; });
+        return true;
+    }
+    return finished.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return !validating; });
+}
+
+void DeviceCache::stop(){
+    stopping = true;
+    if(validator.joinable()) validator.join();
+    std::lock_guard<std::mutex> lock(mutex);
+    validating = false;
+    seeded.clear();
+    devices.clear();
+    unmap();
+    finished.notify_all();
+}
+
+void DeviceCache::run(){
+    std::vector<AudioDeviceID> deviceIDs;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        deviceIDs = seeded;
+    }
+    //The channel maps first, the volume calls are served from them
+    for(AudioDeviceID deviceID : deviceIDs){
+        if(stopping) break;
+        channelMaps.validate(deviceID);
+    }
+    if(!stopping) deviceRegistry.revalidate();
+
+    //Every output device gets its map cached, also the ones not seeded
+    DeviceSnapshot devices = stopping ? DeviceSnapshot() : deviceRegistry.snapshot();
+    std::vector<ChannelMapRef> maps;
+    if(devices){
+        for(const DeviceInfo &info : *devices){
+            if(stopping) break;
+            maps.push_back(info.outStreams > 0 ? channelMaps.lookup(info.id) : ChannelMapRef());
+        }
+    }
+    if(!stopping && devices) save(*devices, maps);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    validating = false;
+    finished.notify_all();
+}
+
+bool DeviceCache::save(const std::vector<DeviceInfo> &devices, const std::vector<ChannelMapRef> &maps){
+    //By UID, skipping devices whose UID could not be read or is taken
+    std::vector<size_t> order;
+    for(size_t i = 0; i < devices.size(); i++){
+        if(devices[i].uid != "Unknown") order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&devices](size_t a, size_t b){ return devices[a].uid < devices[b].uid; });
+    order.erase(std::unique(order.begin(), order.end(), [&devices](size_t a, size_t b){
+        return devices[a].uid == devices[b].uid;
+    }), order.end());
+
+    Writer writer;
+    for(size_t i : order){
+        const DeviceInfo &info = devices[i];
+        FileRecord record;
+        memset(&record, 0, sizeof(record));
+        record.deviceID = info.id;
+        record.uid = writer.string(info.uid);
+        record.name = writer.string(info.name);
+        record.manufacturer = writer.string(info.manufacturer);
+        record.inStreams = info.inStreams;
+        record.outStreams = info.outStreams;
+        const ChannelMapRef map = i < maps.size() ? maps[i] : ChannelMapRef();
+        //An empty map is what a device that could not be mapped gets, it is not cached;
+        //neither is one with a sub-device that could not be named by UID
+        std::vector<std::string> subDevices;
+        if(map && map->outputChannels > 0 && subDeviceUIDs(devices, *map, subDevices)){
+            record.hasMap = 1;
+            record.outputChannels = map->outputChannels;
+            record.stereo[0] = map->stereo[0];
+            record.stereo[1] = map->stereo[1];
+            record.volume = writer.list(map->volume, record.volumeCount);
+            record.mute = writer.list(map->mute, record.muteCount);
+            record.subDevices = writer.stringList(subDevices, record.subDeviceCount);
+        }
+        writer.records.push_back(record);
+    }
+    std::vector<char> bytes = writer.bytes();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(file.empty()) return false;
+    if(data && size == bytes.size() && memcmp(data, bytes.data(), size) == 0) return true;
+
+    //Written aside and renamed over the file, so no reader ever sees half of it
+    std::string temporary = file + ".tmp." + std::to_string((long)getpid());
+    FILE* out = fopen(temporary.c_str(), "wb");
+    if(!out) return false;
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+    ok = fclose(out) == 0 && ok;
+    if(!ok || rename(temporary.c_str(), file.c_str()) != 0){
+        unlink(temporary.c_str());
+        return false;
+    }
+    map();
+    return true;
+}
@@ -0,0 +1,133 @@
+#ifndef PYCOREAUDIO_DEVCACHE_H
+#define PYCOREAUDIO_DEVCACHE_H
+
+#include "audio.h"
+#include "channels.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A device as last seen, read back from the cache file.
+ */
+struct CachedDevice {
+    DeviceInfo info;            //info.id is the ID the device had then
+    bool hasMap;                //whether [map] was cached, only for output devices
+    ChannelMap map;             //without map.subDevices, their IDs do not last across runs either
+    std::vector<std::string> subDevices;    //UIDs of the sub-devices of [map]
+};
+
+/**
+ * Persistent cache of the device metadata and channel maps, for a fast
+ * start of short-lived processes.
+ *
+ * init() maps the cache file and seeds the device registry and the
+ * channel map cache from it, so the first calls are served without
+ * querying every device and probing its channels first. Entries are
+ * keyed by device UID, as device IDs may change between runs: every
+ * device present is matched to its entry by UID right away, so the IDs
+ * served are always current. Until a background thread has validated
+ * them, the names, stream counts and channel maps served are those of
+ * the file, stale only for a device whose configuration changed under
+ * the same UID. That thread queries every device again, puts the
+ * current entries in place where anything changed, and rewrites the
+ * file if its contents differ. If a device present has no entry, the
+ * registry is not seeded and the first device list is queried as usual.
+ * The sub-devices of an aggregate device are stored by UID as well; a map
+ * is only seeded if all of them are present, with their current IDs.
+ *
+ * The file holds a header, fixed-size records sorted by UID, a pool of
+ * channel elements and sub-device UID offsets, and a pool of
+ * NUL-terminated strings, in native byte order. A file that is not exactly that is
+ * ignored and replaced.
+ */
+class DeviceCache {
+public:
+    DeviceCache();
+    ~DeviceCache();
+
+    /**
+     * Set the cache file, takes effect with the next init().
+     *
+     * @param path - path of the file, empty disables the cache
+     */
+    void setPath(const std::string &path);
+    std::string path();
+
+    /**
+     * Map the cache file and seed the channel map cache from it, before
+     * the default output device is looked up. Reads the device list and
+     * the UID of every device to match the entries to the current device
+     * IDs; entries of devices that are gone are skipped, and so are the
+     * maps of aggregate devices with a sub-device that is gone.
+     *
+     * @result - whether a valid file was mapped
+     */
+    bool load();
+
+    /**
+     * Seed the device registry with what load() read, once it is started.
+     */
+    void seed();
+
+    /**
+     * Find the entry of a device in the mapped file.
+     *
+     * @param uid - UID of the device
+     * @param device - receives the entry
+     * @result - whether the file has an entry for [uid]
+     */
+    bool find(const std::string &uid, CachedDevice &device);
+
+    /**
+     * Start validating the seeded entries and rewriting the file in the
+     * background.
+     */
+    void validate();
+
+    /**
+     * Wait until the background validation is done.
+     *
+     * @param timeoutMs - longest wait, negative waits forever
+     * @result - whether it is done
+     */
+    bool wait(int timeoutMs);
+
+    /**
+     * Stop the background validation and unmap the file.
+     */
+    void stop();
+
+    /**
+     * Write the devices and channel maps to the cache file, unless it
+     * already holds exactly them.
+     *
+     * @result - whether the file holds them now
+     */
+    bool save(const std::vector<DeviceInfo> &devices, const std::vector<ChannelMapRef> &maps);
+
+private:
+    bool map();                 //[mutex] must be held
+    void unmap();               //[mutex] must be held
+    bool read(size_t index, CachedDevice &device);      //[mutex] must be held
+    bool search(const std::string &uid, CachedDevice &device);   //[mutex] must be held
+    void run();
+
+    std::mutex mutex;           //guards everything below
+    std::string file;
+    const char* data;           //the mapped file, NULL if none
+    size_t size;
+    std::vector<AudioDeviceID> seeded;      //IDs the channel maps were seeded under, the default device first
+    std::vector<DeviceInfo> devices;        //what load() read, by current ID, until seed(); empty if incomplete
+    std::thread validator;
+    std::condition_variable finished;       //the validation is done
+    bool validating;
+    std::atomic<bool> stopping;
+};
+
+extern DeviceCache deviceCache;
+
+#endif //PYCOREAUDIO_DEVCACHE_H
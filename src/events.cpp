@@ -0,0 +1,147 @@
+#include "events.h"
+#include "hal.h"
+#include "posix.h"
+#include "trace.h"
+#include <errno.h>
+#include <poll.h>
+
+EventWatcher eventWatcher;
+
+EventWatcher::EventWatcher(size_t capacity) : ring(capacity), droppedEvents(0) {
+}
+
+EventWatcher::~EventWatcher(){
+    unwatch();
+}
+
+bool EventWatcher::watch(AudioDeviceID deviceID, UInt32 events){
+    std::vector<Registration> wanted;
+    if(events & EVENT_VOLUME){
+        Registration r = { deviceID, { kAudioDevicePropertyVolumeScalar, kAudioDevicePropertyScopeOutput, kAudioObjectPropertyElementWildcard } };
+        wanted.push_back(r);
+    }
+    if(events & EVENT_MUTE){
+        Registration r = { deviceID, { kAudioDevicePropertyMute, kAudioDevicePropertyScopeOutput, kAudioObjectPropertyElementWildcard } };
+        wanted.push_back(r);
+    }
+    if(events & EVENT_DEFAULT_OUTPUT){
+        Registration r = { kAudioObjectSystemObject, { kAudioHardwarePropertyDefaultOutputDevice, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMain } };
+        wanted.push_back(r);
+    }
+    if(events & EVENT_DEVICE_LIST){
+        Registration r = { kAudioObjectSystemObject, { kAudioHardwarePropertyDevices, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMain } };
+        wanted.push_back(r);
+    }
+
+    std::lock_guard<std::mutex> lock(registrationMutex);
+    bool ok = true;
+    for(const Registration &registration : wanted){
+        bool known = false;
+        for(const Registration &existing : registrations){
+            known = known || (existing.objectID == registration.objectID
+                              && existing.address.mSelector == registration.address.mSelector);
+        }
+        if(known) continue;
+
+        OSStatus result = hal::addPropertyListener(registration.objectID, &registration.address, onPropertyChanged, this);
+        if(result == kAudioHardwareNoError) registrations.push_back(registration);
+        else ok = false;
+    }
+    return ok;
+}
+
+void EventWatcher::unwatch(){
+    std::lock_guard<std::mutex> lock(registrationMutex);
+    for(const Registration &registration : registrations){
+        hal::removePropertyListener(registration.objectID, &registration.address, onPropertyChanged, this);
+    }
+    registrations.clear();
+}
+
+size_t EventWatcher::drain(Event* out, size_t max){
+    std::lock_guard<std::mutex> lock(consumerMutex);
+    //Clear the wakeup before looking at the ring, so a push racing with us re-arms it
+    clearWakeup();
+    size_t count = 0;
+    while(count < max){
+        size_t taken = ring.pop(out + count, max - count);
+        if(taken == 0) break;
+        count += taken;
+    }
+    if(!ring.empty()) wakeup();     //[out] was too small, keep fd() readable
+    return count;
+}
+
+size_t EventWatcher::read(Event* out, size_t max, int timeoutMs){
+    size_t count = drain(out, max);
+    if(count > 0 || timeoutMs == 0) return count;
+
+    //A wakeup may be spurious, keep waiting until the deadline
+    UInt64 deadline = monotonicNanoseconds() + (UInt64)timeoutMs * 1000000ull;
+    int remaining = timeoutMs;
+    while(true){
+        wait(remaining);
+        count = drain(out, max);
+        if(count > 0) return count;
+        if(timeoutMs < 0) continue;
+        UInt64 now = monotonicNanoseconds();
+        if(now >= deadline) return 0;
+        remaining = (int)((deadline - now + 999999) / 1000000);
+    }
+}
+
+bool EventWatcher::wait(int timeoutMs){
+    if(!ring.empty()) return true;
+    struct pollfd pfd = { wakeupPipe.fd(), POLLIN, 0 };
+    int result;
+    do {
+        result = poll(&pfd, 1, timeoutMs);
+    } while(result < 0 && errno == EINTR);
+    return result > 0 || !ring.empty();
+}
+
+int EventWatcher::fd() const {
+    return wakeupPipe.fd();
+}
+
+UInt64 EventWatcher::dropped() const {
+    return droppedEvents.load(std::memory_order_relaxed);
+}
+
+void EventWatcher::wakeup(){
+    wakeupPipe.signal();
+}
+
+void EventWatcher::clearWakeup(){
+    wakeupPipe.drain();
+}
+
+OSStatus EventWatcher::onPropertyChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                         const AudioObjectPropertyAddress* addresses, void* clientData){
+    trace::Scope scope(trace::CATEGORY_LISTENER, "EventWatcher::onPropertyChanged", objectID, numberAddresses ? addresses[0].mSelector : 0);
+    EventWatcher* watcher = static_cast<EventWatcher*>(clientData);
+    UInt64 timestamp = monotonicNanoseconds();
+    bool needsWakeup = false;
+    for(UInt32 i = 0; i < numberAddresses; i++){
+        Event event;
+        switch(addresses[i].mSelector){
+            case kAudioDevicePropertyVolumeScalar:           event.kind = EVENT_VOLUME; break;
+            case kAudioDevicePropertyMute:                   event.kind = EVENT_MUTE; break;
+            case kAudioHardwarePropertyDefaultOutputDevice: event.kind = EVENT_DEFAULT_OUTPUT; break;
+            case kAudioHardwarePropertyDevices:              event.kind = EVENT_DEVICE_LIST; break;
+            default: continue;
+        }
+        event.objectID = objectID;
+        event.element = addresses[i].mElement;
+        event.timestamp = timestamp;
+
+        bool wasEmpty = false;
+        if(watcher->ring.push(event, &wasEmpty)){
+            needsWakeup = needsWakeup || wasEmpty;
+        } else {
+            watcher->droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if(needsWakeup) watcher->wakeup();
+    return kAudioHardwareNoError;
+}
@@ -0,0 +1,125 @@
+#ifndef PYCOREAUDIO_EVENTS_H
+#define PYCOREAUDIO_EVENTS_H
+
+#include "cacompat.h"
+#include "posix.h"
+#include "ring.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+//Kinds of change notifications, usable as a bit mask in EventWatcher::watch()
+enum EventKind {
+    EVENT_VOLUME         = 1 << 0,  //kAudioDevicePropertyVolumeScalar of a device changed
+    EVENT_MUTE           = 1 << 1,  //kAudioDevicePropertyMute of a device changed
+    EVENT_DEFAULT_OUTPUT = 1 << 2,  //the default output device changed
+    EVENT_DEVICE_LIST    = 1 << 3,  //a device was added or removed
+    EVENT_ALL            = EVENT_VOLUME | EVENT_MUTE | EVENT_DEFAULT_OUTPUT | EVENT_DEVICE_LIST
+};
+
+/**
+ * A single change notification.
+ */
+struct Event {
+    UInt32 kind;                //one of EventKind
+    AudioObjectID objectID;     //device, or kAudioObjectSystemObject for system wide events
+    UInt32 element;             //channel the change happened on
+    UInt64 timestamp;           //monotonic clock, nanoseconds
+};
+
+/**
+ * Push-based change notifications.
+ *
+ * watch() installs HAL property listeners. The listeners only stamp the
+ * change and push it into a preallocated lock-free ring, then poke a pipe
+ * if the consumer may be sleeping. They never allocate, block or touch
+ * Python. The consumer drains the ring in batches, either after wait() or
+ * whenever fd() polls readable.
+ *
+ * The HAL delivers property notifications serially, which makes the
+ * listeners the single producer of the ring. Consumers are serialized by
+ * a mutex in drain(), so any number of threads may read.
+ */
+class EventWatcher {
+public:
+    explicit EventWatcher(size_t capacity = 4096);
+    ~EventWatcher();
+
+    /**
+     * Start watching for changes.
+     * Volume and mute are watched on [deviceID], default output device
+     * and device list changes are system wide.
+     *
+     * @param deviceID - device to watch volume/mute changes on
+     * @param events - EventKind bit mask
+     * @result - whether all listeners could be installed
+     */
+    bool watch(AudioDeviceID deviceID, UInt32 events);
+
+    /**
+     * Remove every listener installed by watch().
+     * Events already in the ring stay there.
+     */
+    void unwatch();
+
+    /**
+     * Take up to [max] pending events.
+     *
+     * @param out - buffer to write to
+     * @param max - capacity of [out]
+     * @result - number of events taken
+     */
+    size_t drain(Event* out, size_t max);
+
+    /**
+     * Take up to [max] pending events, waiting for the first one if
+     * there are none yet.
+     *
+     * @param out - buffer to write to
+     * @param max - capacity of [out]
+     * @param timeoutMs - timeout in milliseconds, negative to wait forever
+     * @result - number of events taken, 0 if the timeout expired
+     */
+    size_t read(Event* out, size_t max, int timeoutMs);
+
+    /**
+     * Wait until events are pending.
+     *
+     * @param timeoutMs - timeout in milliseconds, negative to wait forever
+     * @result - whether events are (likely) pending
+     */
+    bool wait(int timeoutMs);
+
+    /**
+     * Get a file descriptor that polls readable while events are pending.
+     */
+    int fd() const;
+
+    /**
+     * Get the number of events dropped because the ring was full.
+     */
+    UInt64 dropped() const;
+
+private:
+    struct Registration {
+        AudioObjectID objectID;
+        AudioObjectPropertyAddress address;
+    };
+
+    static OSStatus onPropertyChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                      const AudioObjectPropertyAddress* addresses, void* clientData);
+    void wakeup();
+    void clearWakeup();
+
+    std::mutex registrationMutex;
+    std::vector<Registration> registrations;
+
+    std::mutex consumerMutex;       //serializes the consumer side of [ring]
+    SpscRing<Event> ring;
+    WakeupPipe wakeupPipe;
+    std::atomic<UInt64> droppedEvents;
+};
+
+extern EventWatcher eventWatcher;
+
+#endif //PYCOREAUDIO_EVENTS_H
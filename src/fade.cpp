@@ -0,0 +1,209 @@
+#include "fade.h"
+#include "audio.h"
+#include "posix.h"
+#include <math.h>
+#include <chrono>
+
+FadeEngine fadeEngine;
+
+//Completions nobody reads are dropped, oldest first, beyond this
+static const size_t MAX_COMPLETIONS = 4096;
+
+FadeEngine::FadeEngine(UInt32 tickRate) : nextID(1), tickNs(1000000000ull / tickRate), stopping(false) {
+}
+
+FadeEngine::~FadeEngine(){
+    stop();
+}
+
+Float32 FadeEngine::level(FadeCurve curve, Float32 from, Float32 to, Float64 progress){
+    if(progress >= 1.0) return to;
+    if(progress <= 0.0) return from;
+    switch(curve){
+        case FADE_EQUAL_POWER:
+            return (Float32)sqrt(from * from * (1.0 - progress) + to * to * progress);
+        case FADE_DB: {
+            Float64 floor = pow(10.0, FADE_FLOOR_DB / 20.0);
+            Float64 fromDb = 20.0 * log10(from > floor ? from : floor);
+            Float64 toDb = 20.0 * log10(to > floor ? to : floor);
+            Float64 value = pow(10.0, (fromDb + (toDb - fromDb) * progress) / 20.0);
+            return value <= floor ? 0.0f : (Float32)value;
+        }
+        case FADE_LINEAR:
+        default:
+            return (Float32)(from + (to - from) * progress);
+    }
+}
+
+UInt64 FadeEngine::start(AudioDeviceID deviceID, Float32 target, UInt32 durationMs, FadeCurve curve){
+    //Read the starting level outside the lock, it is a HAL round trip
+    Float32 from = getVolumeScalarForDevice(deviceID);
+    if(from < 0) return 0;
+    target = target < 0.0f ? 0.0f : (target > 1.0f ? 1.0f : target);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<AudioDeviceID, Fade>::iterator running = fades.find(deviceID);
+    if(running != fades.end()){
+        //Continue from where the running fade is, not from a stale reading
+        from = running->second.written;
+        complete(running->second.id, deviceID, FADE_CANCELLED);
+        fades.erase(running);
+    }
+
+    Fade fade;
+    fade.id = nextID++;
+    fade.from = from;
+    fade.to = target;
+    fade.written = from;
+    fade.curve = curve;
+    fade.startNs = monotonicNanoseconds();
+    fade.durationNs = (UInt64)durationMs * 1000000ull;
+    fades[deviceID] = fade;
+
+    if(!timer.joinable()) timer = std::thread(&FadeEngine::run, this);
+    condition.notify_all();
+    return fade.id;
+}
+
+bool FadeEngine::cancel(AudioDeviceID deviceID){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<AudioDeviceID, Fade>::iterator running = fades.find(deviceID);
+    if(running == fades.end()) return false;
+    complete(running->second.id, deviceID, FADE_CANCELLED);
+    fades.erase(running);
+    return true;
+}
+
+void FadeEngine::stop(){
+    std::thread stopped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(const std::pair<const AudioDeviceID, Fade> &entry : fades){
+            complete(entry.second.id, entry.first, FADE_CANCELLED);
+        }
+        fades.clear();
+        stopping = true;
+        stopped.swap(timer);
+    }
+    condition.notify_all();
+    if(stopped.joinable()) stopped.join();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = false;
+}
+
+bool FadeEngine::wait(AudioDeviceID deviceID, int timeoutMs){
+    std::unique_lock<std::mutex> lock(mutex);
+    if(timeoutMs < 0){
+        completed.wait(lock, [&]{ return fades.count(deviceID) == 0; });
+        return true;
+    }
+    return completed.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                              [&]{ return fades.count(deviceID) == 0; });
+}
+
+size_t FadeEngine::read(FadeCompletion* out, size_t max, int timeoutMs){
+    std::unique_lock<std::mutex> lock(mutex);
+    if(timeoutMs < 0){
+        completed.wait(lock, [this]{ return !completions.empty(); });
+    } else if(timeoutMs > 0){
+        completed.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return !completions.empty(); });
+    }
+
+    size_t count = 0;
+    while(count < max && !completions.empty()){
+        out[count++] = completions.front();
+        completions.pop_front();
+    }
+    if(completions.empty()) wakeupPipe.drain();
+    return count;
+}
+
+int FadeEngine::fd() const {
+    return wakeupPipe.fd();
+}
+
+void FadeEngine::setTickRate(UInt32 ticksPerSecond){
+    ticksPerSecond = ticksPerSecond < 1 ? 1 : (ticksPerSecond > 1000 ? 1000 : ticksPerSecond);
+    std::lock_guard<std::mutex> lock(mutex);
+    tickNs = 1000000000ull / ticksPerSecond;
+    condition.notify_all();
+}
+
+UInt32 FadeEngine::tickRate(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return (UInt32)(1000000000ull / tickNs);
+}
+
+size_t FadeEngine::active(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return fades.size();
+}
+
+void FadeEngine::complete(UInt64 id, AudioDeviceID deviceID, FadeStatus status){
+    FadeCompletion completion = { id, deviceID, (UInt32)status, monotonicNanoseconds() };
+    if(completions.size() >= MAX_COMPLETIONS) completions.pop_front();
+    completions.push_back(completion);
+    if(completions.size() == 1) wakeupPipe.signal();
+    completed.notify_all();
+}
+
+void FadeEngine::run(){
+    std::vector<Write> writes;
+    std::vector<UInt8> succeeded;
+    std::unique_lock<std::mutex> lock(mutex);
+    UInt64 nextTick = 0;
+    while(!stopping){
+        if(fades.empty()){
+            condition.wait(lock, [this]{ return stopping || !fades.empty(); });
+            nextTick = 0;
+            continue;
+        }
+        UInt64 now = monotonicNanoseconds();
+        if(now < nextTick){
+            //Woken early by a new fade or a tick rate change, just wait out the tick
+            condition.wait_for(lock, std::chrono::nanoseconds(nextTick - now));
+            continue;
+        }
+        //A late tick is not made up for, the levels only depend on the time
+        nextTick = (nextTick == 0 || nextTick + tickNs <= now) ? now + tickNs : nextTick + tickNs;
+
+        writes.clear();
+        for(std::map<AudioDeviceID, Fade>::iterator it = fades.begin(); it != fades.end();){
+            Fade &fade = it->second;
+            Float64 progress = fade.durationNs == 0 ? 1.0 : (Float64)(now - fade.startNs) / fade.durationNs;
+            Float32 value = level(fade.curve, fade.from, fade.to, progress);
+            bool last = progress >= 1.0;
+            if(value == fade.written){
+                //Nothing to write; a finished fade whose target was already set is done
+                if(last){
+                    complete(fade.id, it->first, FADE_DONE);
+                    it = fades.erase(it);
+                    continue;
+                }
+            } else {
+                fade.written = value;
+                Write write = { it->first, fade.id, value, last };
+                writes.push_back(write);
+            }
+            ++it;
+        }
+
+        //The HAL may block, never hold the lock across it
+        lock.unlock();
+        succeeded.assign(writes.size(), 0);
+        for(size_t i = 0; i < writes.size(); i++){
+            succeeded[i] = setVolumeScalarForDevice(writes[i].deviceID, writes[i].value) ? 1 : 0;
+        }
+        lock.lock();
+
+        for(size_t i = 0; i < writes.size(); i++){
+            if(succeeded[i] && !writes[i].last) continue;
+            //The fade may have been replaced or cancelled meanwhile
+            std::map<AudioDeviceID, Fade>::iterator running = fades.find(writes[i].deviceID);
+            if(running == fades.end() || running->second.id != writes[i].id) continue;
+            complete(writes[i].id, writes[i].deviceID, succeeded[i] ? FADE_DONE : FADE_FAILED);
+            fades.erase(running);
+        }
+    }
+}
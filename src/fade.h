@@ -0,0 +1,158 @@
+#ifndef PYCOREAUDIO_FADE_H
+#define PYCOREAUDIO_FADE_H
+
+#include "cacompat.h"
+#include "posix.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Shape of a fade, see FadeEngine::start()
+enum FadeCurve {
+    FADE_LINEAR      = 0,   //volume scalar moves linearly
+    FADE_EQUAL_POWER = 1,   //power (volume squared) moves linearly
+    FADE_DB          = 2    //level in decibels moves linearly, down to FADE_FLOOR_DB
+};
+
+//How a fade ended
+enum FadeStatus {
+    FADE_DONE      = 0,     //the target was reached
+    FADE_CANCELLED = 1,     //replaced by another fade on the device, or cancelled
+    FADE_FAILED    = 2      //the device rejected a volume change
+};
+
+//Level treated as silence by FADE_DB
+const Float64 FADE_FLOOR_DB = -60.0;
+
+/**
+ * A finished fade.
+ */
+struct FadeCompletion {
+    UInt64 id;                  //as returned by FadeEngine::start()
+    AudioDeviceID deviceID;
+    UInt32 status;              //one of FadeStatus
+    UInt64 timestamp;           //monotonic clock, nanoseconds
+};
+
+/**
+ * Volume fades, run natively.
+ *
+ * A single timer thread services every running fade. On each tick it
+ * computes the level of every fade and writes it, at most once per
+ * device and only if it changed, so the write rate is bounded by the
+ * tick rate no matter how many fades run. There is at most one fade per
+ * device; starting another one cancels the running one.
+ *
+ * start() returns right away. Finished fades are queued as
+ * FadeCompletions, which can be read with read(), or after fd() polled
+ * readable.
+ */
+class FadeEngine {
+public:
+    explicit FadeEngine(UInt32 tickRate = 100);
+    ~FadeEngine();
+
+    /**
+     * Start fading the volume of a device.
+     *
+     * @param deviceID - ID of the output device
+     * @param target - volume scalar to fade to (0.0-1.0)
+     * @param durationMs - duration of the fade, 0 jumps to [target] on the next tick
+     * @param curve - one of FadeCurve
+     * @result - ID of the fade, 0 if the current volume could not be read
+     */
+    UInt64 start(AudioDeviceID deviceID, Float32 target, UInt32 durationMs, FadeCurve curve);
+
+    /**
+     * Cancel the fade running on a device, leaving the volume where it is.
+     *
+     * @result - whether a fade was running
+     */
+    bool cancel(AudioDeviceID deviceID);
+
+    /**
+     * Cancel every fade and stop the timer thread.
+     */
+    void stop();
+
+    /**
+     * Wait until no fade runs on a device.
+     *
+     * @param deviceID - ID of the output device
+     * @param timeoutMs - timeout in milliseconds, negative to wait forever
+     * @result - false if the timeout expired
+     */
+    bool wait(AudioDeviceID deviceID, int timeoutMs);
+
+    /**
+     * Take up to [max] completions, waiting for the first one if there
+     * are none yet.
+     *
+     * @param out - buffer to write to
+     * @param max - capacity of [out]
+     * @param timeoutMs - timeout in milliseconds, negative to wait forever
+     * @result - number of completions taken
+     */
+    size_t read(FadeCompletion* out, size_t max, int timeoutMs);
+
+    /**
+     * Get a file descriptor that polls readable while completions are pending.
+     */
+    int fd() const;
+
+    /**
+     * Set the number of ticks per second (1-1000).
+     */
+    void setTickRate(UInt32 ticksPerSecond);
+    UInt32 tickRate();
+
+    /**
+     * Get the number of running fades.
+     */
+    size_t active();
+
+    /**
+     * Level of a fade from [from] to [to] after [progress] (0.0-1.0) of it.
+     */
+    static Float32 level(FadeCurve curve, Float32 from, Float32 to, Float64 progress);
+
+private:
+    struct Fade {
+        UInt64 id;
+        Float32 from;
+        Float32 to;
+        Float32 written;        //last level written
+        FadeCurve curve;
+        UInt64 startNs;
+        UInt64 durationNs;
+    };
+
+    struct Write {
+        AudioDeviceID deviceID;
+        UInt64 id;
+        Float32 value;
+        bool last;
+    };
+
+    void run();
+    void complete(UInt64 id, AudioDeviceID deviceID, FadeStatus status);   //[mutex] must be held
+
+    std::mutex mutex;                           //guards everything below
+    std::condition_variable condition;          //fades added/removed, tick rate changed, stopping
+    std::map<AudioDeviceID, Fade> fades;
+    UInt64 nextID;
+    UInt64 tickNs;
+    bool stopping;
+    std::thread timer;
+
+    std::condition_variable completed;
+    std::deque<FadeCompletion> completions;
+    WakeupPipe wakeupPipe;
+};
+
+extern FadeEngine fadeEngine;
+
+#endif //PYCOREAUDIO_FADE_H
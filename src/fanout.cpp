@@ -0,0 +1,79 @@
+#include "fanout.h"
+#include <algorithm>
+
+//Enough for the sub-devices of a typical aggregate device to be set at once
+FanOut fanOut(7);
+
+FanOut::FanOut(size_t threads) : threadCount(threads), stopping(false) {}
+
+FanOut::~FanOut(){
+    stop();
+}
+
+void FanOut::run(size_t count, const std::function<void(size_t)> &task){
+    if(count == 0) return;
+    if(count == 1 || threadCount == 0){
+        for(size_t i = 0; i < count; i++) task(i);
+        return;
+    }
+
+    Batch batch = { &task, count, 0, 0 };
+    std::unique_lock<std::mutex> lock(mutex);
+    if(workers.empty() && !stopping){
+        for(size_t i = 0; i < threadCount; i++) workers.push_back(std::thread(&FanOut::work, this));
+    }
+    batches.push_back(&batch);
+    available.notify_all();
+
+    //Work on our own tasks until they are all picked up, then wait for the rest
+    while(batch.next < batch.count){
+        size_t index = batch.next++;
+        if(batch.next == batch.count) batches.erase(std::find(batches.begin(), batches.end(), &batch));
+        lock.unlock();
+        task(index);
+        lock.lock();
+        finish(&batch);
+    }
+    finished.wait(lock, [&batch]{ return batch.done == batch.count; });
+}
+
+bool FanOut::take(Batch* &batch, size_t &index){
+    if(batches.empty()) return false;
+    batch = batches.front();
+    index = batch->next++;
+    if(batch->next == batch->count) batches.pop_front();
+    return true;
+}
+
+void FanOut::finish(Batch* batch){
+    batch->done++;
+    if(batch->done == batch->count) finished.notify_all();
+}
+
+void FanOut::work(){
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true){
+        available.wait(lock, [this]{ return stopping || !batches.empty(); });
+        Batch* batch;
+        size_t index;
+        if(!take(batch, index)) return;
+        lock.unlock();
+        (*batch->task)(index);
+        lock.lock();
+        //The caller returns once this is counted, [batch] is gone after unlocking
+        finish(batch);
+    }
+}
+
+void FanOut::stop(){
+    std::vector<std::thread> stopped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        stopped.swap(workers);
+    }
+    available.notify_all();
+    for(std::thread &worker : stopped) worker.join();
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = false;
+}
@@ -0,0 +1,66 @@
+#ifndef PYCOREAUDIO_FANOUT_H
+#define PYCOREAUDIO_FANOUT_H
+
+#include "cacompat.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A few threads to run the HAL calls of one operation concurrently,
+ * e.g. a volume change on every sub-device of an aggregate device, so
+ * the operation takes about one HAL round trip instead of one per call.
+ *
+ * run() hands the tasks out to the threads and works on them itself
+ * too, so it never waits for a task nobody picked up: a task may fan
+ * out again, and calls from any number of threads share the pool
+ * without deadlocking. The threads are started on first use.
+ */
+class FanOut {
+public:
+    /**
+     * @param threads - number of threads besides the caller's
+     */
+    explicit FanOut(size_t threads);
+    ~FanOut();
+
+    /**
+     * Run task(0) to task(count - 1) and wait for all of them.
+     *
+     * @param count - number of tasks
+     * @param task - the tasks, called from any of the threads
+     */
+    void run(size_t count, const std::function<void(size_t)> &task);
+
+    /**
+     * Stop the threads. They are started again if needed.
+     */
+    void stop();
+
+private:
+    struct Batch {
+        const std::function<void(size_t)>* task;
+        size_t count;
+        size_t next;        //first task nobody picked up yet
+        size_t done;
+    };
+
+    void work();
+    bool take(Batch* &batch, size_t &index);    //[mutex] must be held
+    void finish(Batch* batch);                  //[mutex] must be held
+
+    std::mutex mutex;                           //guards everything below and the batches
+    std::condition_variable available;          //a batch has tasks left, or stopping
+    std::condition_variable finished;           //a batch is done
+    std::deque<Batch*> batches;                 //batches with tasks left
+    std::vector<std::thread> workers;
+    size_t threadCount;
+    bool stopping;
+};
+
+extern FanOut fanOut;
+
+#endif //PYCOREAUDIO_FANOUT_H
@@ -0,0 +1,329 @@
+#include "gain.h"
+#include "audio.h"
+#include <string.h>
+#if defined(PYCOREAUDIO_SIMD_X86)
+    #include <immintrin.h>
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+    #include <arm_neon.h>
+#endif
+
+GainEngine gainEngine;
+
+//Time a change of gain is spread over
+static const UInt32 RAMP_MS = 20;
+
+/* ------------------------------Kernels----------------------------------- */
+/*
+ * Like the meter kernels (meter.cpp), the vector kernels work in periods
+ * of lcm(channels, width) samples, after which the channels line up with
+ * the lanes again. One period's worth of per-lane gains is laid out
+ * once per call and applied straight down the periods; while ramping,
+ * every lane also knows its frame within the period, so the gain of a
+ * lane is start + step * frame exactly like in the scalar kernel. What
+ * is left after the last whole period is done by the scalar kernel.
+ */
+
+//Largest period the lanes are laid out for, that of 64 channels with AVX2
+static const UInt32 MAX_PERIOD = 512;
+//Periods are doubled up to this many samples, so short ones do not run one vector per loop
+static const UInt32 MIN_PERIOD = 32;
+
+static UInt32 gcd(UInt32 a, UInt32 b){
+    while(b != 0){
+        UInt32 rest = a % b;
+        a = b;
+        b = rest;
+    }
+    return a;
+}
+
+static void gainScalar(Float32* samples, UInt32 first, UInt32 frames, UInt32 channels,
+                       const Float32* start, const Float32* step){
+    samples += (size_t)first * channels;
+    for(UInt32 frame = first; frame < frames; frame++, samples += channels){
+        if(step == NULL){
+            for(UInt32 channel = 0; channel < channels; channel++) samples[channel] *= start[channel];
+        } else {
+            Float32 position = (Float32)frame;
+            for(UInt32 channel = 0; channel < channels; channel++) samples[channel] *= start[channel] + step[channel] * position;
+        }
+    }
+}
+
+/**
+ * Gains of one period of lanes.
+ */
+struct GainLanes {
+    UInt32 period;                  //samples per period
+    UInt32 frames;                  //frames per period
+    Float32 start[MAX_PERIOD];
+    Float32 step[MAX_PERIOD];
+    Float32 position[MAX_PERIOD];   //frame of every lane within the period
+};
+
+/**
+ * Lay out the gains of [channels] channels over a period of [width] lane vectors.
+ *
+ * @result - false if the period is too long
+ */
+static bool layLanes(UInt32 width, UInt32 channels, const Float32* start, const Float32* step, GainLanes &lanes){
+    UInt32 period = channels / gcd(channels, width) * width;
+    if(period > MAX_PERIOD) return false;
+    while(period < MIN_PERIOD) period *= 2;
+    lanes.period = period;
+    lanes.frames = period / channels;
+    for(UInt32 lane = 0; lane < period; lane++){
+        UInt32 channel = lane % channels;
+        lanes.start[lane] = start[channel];
+        lanes.step[lane] = step == NULL ? 0.0f : step[channel];
+        lanes.position[lane] = (Float32)(lane / channels);
+    }
+    return true;
+}
+
+/**
+ * Apply the gains to every whole period of [frames] frames.
+ *
+ * @result - number of frames done
+ */
+typedef UInt32 (*GainPass)(Float32* samples, UInt32 frames, const GainLanes &lanes, bool ramp);
+
+#if defined(PYCOREAUDIO_SIMD_X86)
+static UInt32 passSSE2(Float32* samples, UInt32 frames, const GainLanes &lanes, bool ramp){
+    UInt32 blocks = frames / lanes.frames;
+    Float32* row = samples;
+    for(UInt32 block = 0; block < blocks; block++, row += lanes.period){
+        if(!ramp){
+            for(UInt32 lane = 0; lane < lanes.period; lane += 4){
+                _mm_storeu_ps(row + lane, _mm_mul_ps(_mm_loadu_ps(row + lane), _mm_loadu_ps(lanes.start + lane)));
+            }
+            continue;
+        }
+        __m128 base = _mm_set1_ps((Float32)(block * lanes.frames));
+        for(UInt32 lane = 0; lane < lanes.period; lane += 4){
+            __m128 position = _mm_add_ps(_mm_loadu_ps(lanes.position + lane), base);
+            __m128 gain = _mm_add_ps(_mm_loadu_ps(lanes.start + lane), _mm_mul_ps(_mm_loadu_ps(lanes.step + lane), position));
+            _mm_storeu_ps(row + lane, _mm_mul_ps(_mm_loadu_ps(row + lane), gain));
+        }
+    }
+    return blocks * lanes.frames;
+}
+
+PYCOREAUDIO_TARGET_AVX2 static UInt32 passAVX2(Float32* samples, UInt32 frames, const GainLanes &lanes, bool ramp){
+    UInt32 blocks = frames / lanes.frames;
+    Float32* row = samples;
+    for(UInt32 block = 0; block < blocks; block++, row += lanes.period){
+        if(!ramp){
+            for(UInt32 lane = 0; lane < lanes.period; lane += 8){
+                _mm256_storeu_ps(row + lane, _mm256_mul_ps(_mm256_loadu_ps(row + lane), _mm256_loadu_ps(lanes.start + lane)));
+            }
+            continue;
+        }
+        __m256 base = _mm256_set1_ps((Float32)(block * lanes.frames));
+        for(UInt32 lane = 0; lane < lanes.period; lane += 8){
+            __m256 position = _mm256_add_ps(_mm256_loadu_ps(lanes.position + lane), base);
+            __m256 gain = _mm256_fmadd_ps(_mm256_loadu_ps(lanes.step + lane), position, _mm256_loadu_ps(lanes.start + lane));
+            _mm256_storeu_ps(row + lane, _mm256_mul_ps(_mm256_loadu_ps(row + lane), gain));
+        }
+    }
+    return blocks * lanes.frames;
+}
+#endif
+
+#if defined(PYCOREAUDIO_SIMD_NEON)
+static UInt32 passNEON(Float32* samples, UInt32 frames, const GainLanes &lanes, bool ramp){
+    UInt32 blocks = frames / lanes.frames;
+    Float32* row = samples;
+    for(UInt32 block = 0; block < blocks; block++, row += lanes.period){
+        if(!ramp){
+            for(UInt32 lane = 0; lane < lanes.period; lane += 4){
+                vst1q_f32(row + lane, vmulq_f32(vld1q_f32(row + lane), vld1q_f32(lanes.start + lane)));
+            }
+            continue;
+        }
+        float32x4_t base = vdupq_n_f32((Float32)(block * lanes.frames));
+        for(UInt32 lane = 0; lane < lanes.period; lane += 4){
+            float32x4_t position = vaddq_f32(vld1q_f32(lanes.position + lane), base);
+            float32x4_t gain = vmlaq_f32(vld1q_f32(lanes.start + lane), vld1q_f32(lanes.step + lane), position);
+            vst1q_f32(row + lane, vmulq_f32(vld1q_f32(row + lane), gain));
+        }
+    }
+    return blocks * lanes.frames;
+}
+#endif
+
+/**
+ * Run a vector kernel over all whole periods, see above.
+ */
+static void gainVector(GainPass pass, UInt32 width, Float32* samples, UInt32 frames, UInt32 channels,
+                       const Float32* start, const Float32* step){
+    GainLanes lanes;
+    UInt32 done = 0;
+    if(layLanes(width, channels, start, step, lanes)) done = pass(samples, frames, lanes, step != NULL);
+    gainScalar(samples, done, frames, channels, start, step);
+}
+
+void applyGain(simd::Level level, Float32* samples, UInt32 frames, UInt32 channels,
+               const Float32* start, const Float32* step){
+    if(channels == 0) return;
+    switch(level){
+#if defined(PYCOREAUDIO_SIMD_X86)
+        case simd::LEVEL_SSE2: gainVector(passSSE2, 4, samples, frames, channels, start, step); return;
+        case simd::LEVEL_AVX2: gainVector(passAVX2, 8, samples, frames, channels, start, step); return;
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+        case simd::LEVEL_NEON: gainVector(passNEON, 4, samples, frames, channels, start, step); return;
+#endif
+        default: gainScalar(samples, 0, frames, channels, start, step); return;
+    }
+}
+
+void applyGain(Float32* samples, UInt32 frames, UInt32 channels, const Float32* start, const Float32* step){
+    applyGain(simd::level(), samples, frames, channels, start, step);
+}
+/* ----------------------------------------------------------------------- */
+
+/* ----------------------------SoftwareGain------------------------------- */
+SoftwareGain::SoftwareGain(UInt32 channels, Float64 sampleRate, UInt32 rampMs) :
+    channelCount(channels),
+    rampFrames((UInt32)((sampleRate > 0 ? sampleRate : 48000.0) * rampMs / 1000)),
+    targets(new std::atomic<Float32>[channels]),
+    mute(false),
+    generation(0),
+    seen(0),
+    current(channels, 1.0f),
+    step(channels, 0.0f),
+    target(channels, 1.0f),
+    rampLeft(0),
+    unity(true),
+    silent(false) {
+    if(rampFrames == 0) rampFrames = 1;
+    for(UInt32 i = 0; i < channels; i++) targets[i].store(1.0f, std::memory_order_relaxed);
+}
+
+void SoftwareGain::retarget(){
+    seen = generation.load(std::memory_order_acquire);
+    bool muting = mute.load(std::memory_order_relaxed);
+    bool moving = false;
+    unity = true;
+    silent = true;
+    for(UInt32 channel = 0; channel < channelCount; channel++){
+        Float32 gain = muting ? 0.0f : targets[channel].load(std::memory_order_relaxed);
+        target[channel] = gain;
+        step[channel] = (gain - current[channel]) / rampFrames;
+        moving = moving || gain != current[channel];
+        unity = unity && gain == 1.0f;
+        silent = silent && gain == 0.0f;
+    }
+    rampLeft = moving ? rampFrames : 0;
+}
+
+void SoftwareGain::process(const AudioBufferList* input, AudioBufferList* output, UInt32 frames, Float64 sampleTime){
+    if(output == NULL) return;
+    if(generation.load(std::memory_order_relaxed) != seen) retarget();
+    if(rampLeft == 0 && unity) return;
+
+    //Streams are scaled in order; a layout that changed under us is scaled as far as it fits
+    UInt32 ramped = rampLeft < frames ? rampLeft : frames;
+    UInt32 offset = 0;
+    for(UInt32 i = 0; i < output->mNumberBuffers; i++){
+        AudioBuffer &buffer = output->mBuffers[i];
+        UInt32 channels = buffer.mNumberChannels;
+        if(offset + channels > channelCount || buffer.mData == NULL) break;
+        if(buffer.mDataByteSize < (UInt64)frames * channels * sizeof(Float32)) break;
+        Float32* samples = (Float32*)buffer.mData;
+        if(ramped > 0) applyGain(samples, ramped, channels, &current[offset], &step[offset]);
+        if(ramped < frames){
+            Float32* rest = samples + (size_t)ramped * channels;
+            if(silent) memset(rest, 0, (size_t)(frames - ramped) * channels * sizeof(Float32));
+            else if(!unity) applyGain(rest, frames - ramped, channels, &target[offset], NULL);
+        }
+        offset += channels;
+    }
+
+    if(ramped == 0) return;
+    rampLeft -= ramped;
+    for(UInt32 channel = 0; channel < channelCount; channel++){
+        current[channel] = rampLeft == 0 ? target[channel] : current[channel] + step[channel] * ramped;
+    }
+}
+
+void SoftwareGain::setGain(Float32 gain){
+    gain = gain > 0.0f ? (gain < 1.0f ? gain : 1.0f) : 0.0f;
+    for(UInt32 i = 0; i < channelCount; i++) targets[i].store(gain, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+}
+
+bool SoftwareGain::setGain(UInt32 channel, Float32 gain){
+    if(channel >= channelCount) return false;
+    gain = gain > 0.0f ? (gain < 1.0f ? gain : 1.0f) : 0.0f;
+    targets[channel].store(gain, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+Float32 SoftwareGain::gain() const {
+    if(channelCount == 0) return 0.0f;
+    Float32 sum = 0.0f;
+    for(UInt32 i = 0; i < channelCount; i++) sum += targets[i].load(std::memory_order_relaxed);
+    return sum / channelCount;
+}
+
+Float32 SoftwareGain::gain(UInt32 channel) const {
+    if(channel >= channelCount) return -1.0f;
+    return targets[channel].load(std::memory_order_relaxed);
+}
+
+void SoftwareGain::setMuted(bool state){
+    mute.store(state, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+}
+/* ----------------------------------------------------------------------- */
+
+/* -----------------------------GainEngine-------------------------------- */
+GainEngine::GainEngine() {}
+
+std::shared_ptr<SoftwareGain> GainEngine::start(AudioDeviceID deviceID){
+    std::lock_guard<std::mutex> lock(mutex);
+    GainTable::iterator running = gains.find(deviceID);
+    if(running != gains.end()) return running->second;
+
+    int channels = getDeviceChannelCount(deviceID, false);
+    if(channels <= 0) return std::shared_ptr<SoftwareGain>();
+    std::shared_ptr<SoftwareGain> gain(new SoftwareGain((UInt32)channels, getDeviceSampleRate(deviceID), RAMP_MS));
+    if(!ioHost.add(deviceID, IO_POSITION_EFFECT, gain)) return std::shared_ptr<SoftwareGain>();
+    gains[deviceID] = gain;
+    publish();
+    return gain;
+}
+
+bool GainEngine::stop(AudioDeviceID deviceID){
+    std::lock_guard<std::mutex> lock(mutex);
+    GainTable::iterator running = gains.find(deviceID);
+    if(running == gains.end()) return false;
+    ioHost.remove(deviceID, running->second);
+    gains.erase(running);
+    publish();
+    return true;
+}
+
+void GainEngine::stop(){
+    std::lock_guard<std::mutex> lock(mutex);
+    for(GainTable::iterator it = gains.begin(); it != gains.end(); ++it){
+        ioHost.remove(it->first, it->second);
+    }
+    gains.clear();
+    publish();
+}
+
+std::shared_ptr<SoftwareGain> GainEngine::find(AudioDeviceID deviceID){
+    std::shared_ptr<const GainTable> table = std::atomic_load(&published);
+    if(!table) return std::shared_ptr<SoftwareGain>();
+    GainTable::const_iterator found = table->find(deviceID);
+    if(found == table->end()) return std::shared_ptr<SoftwareGain>();
+    return found->second;
+}
+
+void GainEngine::publish(){
+    std::atomic_store(&published, std::shared_ptr<const GainTable>(new GainTable(gains)));
+}
+/* ----------------------------------------------------------------------- */
@@ -0,0 +1,151 @@
+#ifndef PYCOREAUDIO_GAIN_H
+#define PYCOREAUDIO_GAIN_H
+
+#include "cacompat.h"
+#include "io.h"
+#include "simd.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Scale interleaved Float32 samples by a per-channel gain that moves
+ * linearly: the sample of [channel] in frame f is multiplied by
+ * start[channel] + step[channel] * f, or by start[channel] if [step] is
+ * NULL. Uses the vector kernels of simd::level(), or of [level] if given.
+ *
+ * @param samples - [frames] frames of [channels] interleaved samples
+ * @param frames - number of frames, below 2^24
+ * @param channels - number of channels
+ * @param start - gain of every channel at the first frame
+ * @param step - change of the gain of every channel per frame, or NULL
+ */
+void applyGain(Float32* samples, UInt32 frames, UInt32 channels, const Float32* start, const Float32* step);
+void applyGain(simd::Level level, Float32* samples, UInt32 frames, UInt32 channels,
+               const Float32* start, const Float32* step);
+
+/**
+ * Gain and mute applied in software, run as an effect stage of the
+ * IOProc of a device. Scales what the module plays to the device, see
+ * PlaybackEngine::setGain().
+ *
+ * Gains are set from any thread and picked up by the next IO cycle,
+ * which ramps every channel linearly from where it is to its new gain
+ * over the ramp time, so changes do not click. Muting ramps to silence
+ * the same way and keeps the gains.
+ *
+ * Like every stage, this only sees what the module itself plays to the
+ * device (see IOHost), not the output of other applications.
+ */
+class SoftwareGain : public IOStage {
+public:
+    /**
+     * @param channels - number of output channels of the device
+     * @param sampleRate - sample rate of the device, in Hz
+     * @param rampMs - time a change of gain is spread over
+     */
+    SoftwareGain(UInt32 channels, Float64 sampleRate, UInt32 rampMs);
+
+    void process(const AudioBufferList* input, AudioBufferList* output, UInt32 frames, Float64 sampleTime) override;
+
+    /**
+     * Set the gain of every channel.
+     *
+     * @param gain - linear gain, 0.0-1.0
+     */
+    void setGain(Float32 gain);
+
+    /**
+     * Set the gain of one channel.
+     *
+     * @result - false if the device has no such channel
+     */
+    bool setGain(UInt32 channel, Float32 gain);
+
+    /**
+     * Get the gain of every channel, averaged.
+     */
+    Float32 gain() const;
+
+    /**
+     * Get the gain of one channel, -1 if the device has no such channel.
+     */
+    Float32 gain(UInt32 channel) const;
+
+    void setMuted(bool state);
+    bool muted() const { return mute.load(std::memory_order_relaxed); }
+
+    UInt32 channels() const { return channelCount; }
+
+private:
+    void retarget();    //IO thread: start ramping towards the gains set last
+
+    UInt32 channelCount;
+    UInt32 rampFrames;
+    std::unique_ptr<std::atomic<Float32>[]> targets;   //gains set by the callers
+    std::atomic<bool> mute;
+    std::atomic<UInt32> generation;                     //bumped on every change of the above
+
+    //Owned by the IO thread
+    UInt32 seen;                        //generation the ramp heads for
+    std::vector<Float32> current;       //gain of every channel at the start of the next cycle
+    std::vector<Float32> step;          //change per frame while ramping
+    std::vector<Float32> target;        //gain every channel ramps to
+    UInt32 rampLeft;                    //frames until the ramp is done
+    bool unity;                         //every channel is at 1.0, the cycle can be left alone
+    bool silent;                        //every channel is at 0.0
+};
+
+/**
+ * The software gain stages of all devices, at most one per device.
+ * find() takes no lock; the table of stages is published RCU-style.
+ *
+ * A stage keeps the IOProc of its device running, so the playback
+ * engine only starts one for a device it plays to, and stops it with
+ * the playback.
+ */
+class GainEngine {
+public:
+    GainEngine();
+
+    /**
+     * Start applying gain to a device. A stage running there already is
+     * kept, with its gains.
+     *
+     * @param deviceID - ID of the device
+     * @result - stage of the device, NULL if it has no output or the IOProc could not be started
+     */
+    std::shared_ptr<SoftwareGain> start(AudioDeviceID deviceID);
+
+    /**
+     * Stop applying gain to a device, it plays at full level again.
+     *
+     * @result - whether a stage was running
+     */
+    bool stop(AudioDeviceID deviceID);
+
+    /**
+     * Stop every stage.
+     */
+    void stop();
+
+    /**
+     * Get the stage of a device, NULL if there is none.
+     */
+    std::shared_ptr<SoftwareGain> find(AudioDeviceID deviceID);
+
+private:
+    typedef std::map<AudioDeviceID, std::shared_ptr<SoftwareGain> > GainTable;
+
+    void publish();     //[mutex] must be held
+
+    std::mutex mutex;                               //guards [gains]
+    GainTable gains;
+    std::shared_ptr<const GainTable> published;     //copy of [gains] for find(), atomic access only
+};
+
+extern GainEngine gainEngine;
+
+#endif //PYCOREAUDIO_GAIN_H
@@ -0,0 +1,91 @@
+#include "hal.h"
+
+#if defined(PYCOREAUDIO_SIMULATED_HAL)
+    #include "hal_sim.h"
+#elif !defined(__APPLE__)
+    #error "CoreAudio is only available on macOS, build with PYCOREAUDIO_SIMULATED_HAL"
+#endif
+
+namespace hal {
+
+namespace detail {
+    std::atomic<Backend*> installedBackend(NULL);
+};
+
+#ifdef __APPLE__
+/**
+ * Backend forwarding every call to CoreAudio.
+ */
+class CoreAudioBackend : public Backend {
+public:
+    Boolean hasProperty(AudioObjectID objectID, const AudioObjectPropertyAddress* address) override {
+        return AudioObjectHasProperty(objectID, address);
+    }
+
+    OSStatus getPropertyDataSize(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                 UInt32 qualifierDataSize, const void* qualifierData,
+                                 UInt32* outDataSize) override {
+        return AudioObjectGetPropertyDataSize(objectID, address, qualifierDataSize, qualifierData, outDataSize);
+    }
+
+    OSStatus getPropertyData(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                             UInt32 qualifierDataSize, const void* qualifierData,
+                             UInt32* ioDataSize, void* outData) override {
+        return AudioObjectGetPropertyData(objectID, address, qualifierDataSize, qualifierData, ioDataSize, outData);
+    }
+
+    OSStatus setPropertyData(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                             UInt32 qualifierDataSize, const void* qualifierData,
+                             UInt32 dataSize, const void* data) override {
+        return AudioObjectSetPropertyData(objectID, address, qualifierDataSize, qualifierData, dataSize, data);
+    }
+
+    OSStatus addPropertyListener(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                 AudioObjectPropertyListenerProc listener, void* clientData) override {
+        return AudioObjectAddPropertyListener(objectID, address, listener, clientData);
+    }
+
+    OSStatus removePropertyListener(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                    AudioObjectPropertyListenerProc listener, void* clientData) override {
+        return AudioObjectRemovePropertyListener(objectID, address, listener, clientData);
+    }
+
+    OSStatus createIOProcID(AudioObjectID deviceID, AudioDeviceIOProc proc, void* clientData,
+                            AudioDeviceIOProcID* outProcID) override {
+        return AudioDeviceCreateIOProcID(deviceID, proc, clientData, outProcID);
+    }
+
+    OSStatus destroyIOProcID(AudioObjectID deviceID, AudioDeviceIOProcID procID) override {
+        return AudioDeviceDestroyIOProcID(deviceID, procID);
+    }
+
+    OSStatus deviceStart(AudioObjectID deviceID, AudioDeviceIOProcID procID) override {
+        return AudioDeviceStart(deviceID, procID);
+    }
+
+    OSStatus deviceStop(AudioObjectID deviceID, AudioDeviceIOProcID procID) override {
+        return AudioDeviceStop(deviceID, procID);
+    }
+};
+#endif
+
+Backend* defaultBackend(){
+#ifdef PYCOREAUDIO_SIMULATED_HAL
+    //Intentionally leaked, listeners may still fire during interpreter shutdown
+    static SimBackend* simulated = []{
+        SimBackend* backend = new SimBackend();
+        backend->populate(2);
+        return backend;
+    }();
+    return simulated;
+#else
+    static CoreAudioBackend coreAudio;
+    return &coreAudio;
+#endif
+}
+
+void setBackend(Backend* backend){
+    detail::installedBackend.store(backend, std::memory_order_release);
+}
+
+}; //namespace hal
@@ -0,0 +1,192 @@
+#ifndef PYCOREAUDIO_HAL_H
+#define PYCOREAUDIO_HAL_H
+
+#include "cacompat.h"
+#include "stats.h"
+#include "trace.h"
+#include <atomic>
+
+/*
+ * Backend layer for all AudioObject calls.
+ *
+ * The module never calls AudioObject* functions directly. It goes through
+ * the shorthands at the bottom of this file, which forward to the currently
+ * installed backend. On macOS the default backend talks to CoreAudio; with
+ * PYCOREAUDIO_SIMULATED_HAL defined it is an in-process simulated HAL (see
+ * hal_sim.h), which is what the Linux builds and the benchmarks use.
+ * Every call through the shorthands is counted (see stats.h) and traced
+ * while tracing (see trace.h).
+ */
+namespace hal {
+
+/**
+ * An AudioObject property server.
+ * Every method mirrors the CoreAudio function of the same name
+ * (AudioObjectHasProperty, AudioObjectGetPropertyData, ...,
+ * AudioDeviceCreateIOProcID, AudioDeviceStart, ...) including its
+ * arguments and return codes.
+ * Implementations must be safe to call from multiple threads.
+ */
+class Backend {
+public:
+    virtual ~Backend(){}
+
+    virtual Boolean hasProperty(AudioObjectID objectID,
+                                const AudioObjectPropertyAddress* address) = 0;
+
+    virtual OSStatus getPropertyDataSize(AudioObjectID objectID,
+                                         const AudioObjectPropertyAddress* address,
+                                         UInt32 qualifierDataSize, const void* qualifierData,
+                                         UInt32* outDataSize) = 0;
+
+    virtual OSStatus getPropertyData(AudioObjectID objectID,
+                                     const AudioObjectPropertyAddress* address,
+                                     UInt32 qualifierDataSize, const void* qualifierData,
+                                     UInt32* ioDataSize, void* outData) = 0;
+
+    virtual OSStatus setPropertyData(AudioObjectID objectID,
+                                     const AudioObjectPropertyAddress* address,
+                                     UInt32 qualifierDataSize, const void* qualifierData,
+                                     UInt32 dataSize, const void* data) = 0;
+
+    virtual OSStatus addPropertyListener(AudioObjectID objectID,
+                                         const AudioObjectPropertyAddress* address,
+                                         AudioObjectPropertyListenerProc listener,
+                                         void* clientData) = 0;
+
+    virtual OSStatus removePropertyListener(AudioObjectID objectID,
+                                            const AudioObjectPropertyAddress* address,
+                                            AudioObjectPropertyListenerProc listener,
+                                            void* clientData) = 0;
+
+    virtual OSStatus createIOProcID(AudioObjectID deviceID, AudioDeviceIOProc proc,
+                                    void* clientData, AudioDeviceIOProcID* outProcID) = 0;
+
+    virtual OSStatus destroyIOProcID(AudioObjectID deviceID, AudioDeviceIOProcID procID) = 0;
+
+    //AudioDeviceStart/AudioDeviceStop: stopping waits for a running IOProc call to return
+    virtual OSStatus deviceStart(AudioObjectID deviceID, AudioDeviceIOProcID procID) = 0;
+
+    virtual OSStatus deviceStop(AudioObjectID deviceID, AudioDeviceIOProcID procID) = 0;
+};
+
+/**
+ * Get the backend used by the platform when nothing else is installed.
+ * This is CoreAudio on macOS, or a simulated HAL populated with a couple
+ * of devices when built with PYCOREAUDIO_SIMULATED_HAL.
+ */
+Backend* defaultBackend();
+
+namespace detail {
+    extern std::atomic<Backend*> installedBackend;   //NULL means "use the default"
+};
+
+/**
+ * Get the currently installed backend.
+ */
+inline Backend* backend(){
+    Backend* installed = detail::installedBackend.load(std::memory_order_acquire);
+    return installed ? installed : defaultBackend();
+}
+
+/**
+ * Install a backend. The caller keeps ownership and must keep it alive
+ * until another backend is installed.
+ *
+ * @param backend - the new backend, NULL restores the default one
+ */
+void setBackend(Backend* backend);
+
+/* ---------------------------Shorthands---------------------------------- */
+inline Boolean hasProperty(AudioObjectID objectID, const AudioObjectPropertyAddress* address){
+    trace::Scope scope(trace::CATEGORY_HAL, "hasProperty", objectID, address->mSelector);
+    UInt64 start = stats::begin();
+    Boolean result = backend()->hasProperty(objectID, address);
+    stats::recordHal(stats::HAL_HAS_PROPERTY, address->mSelector, start, noErr);
+    return result;
+}
+
+inline OSStatus getPropertyDataSize(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                    UInt32 qualifierDataSize, const void* qualifierData,
+                                    UInt32* outDataSize){
+    trace::Scope scope(trace::CATEGORY_HAL, "getPropertyDataSize", objectID, address->mSelector);
+    UInt64 start = stats::begin();
+    OSStatus result = backend()->getPropertyDataSize(objectID, address, qualifierDataSize, qualifierData, outDataSize);
+    stats::recordHal(stats::HAL_GET_PROPERTY_DATA_SIZE, address->mSelector, start, result);
+    return result;
+}
+
+inline OSStatus getPropertyData(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                UInt32 qualifierDataSize, const void* qualifierData,
+                                UInt32* ioDataSize, void* outData){
+    trace::Scope scope(trace::CATEGORY_HAL, "getPropertyData", objectID, address->mSelector);
+    UInt64 start = stats::begin();
+    OSStatus result = backend()->getPropertyData(objectID, address, qualifierDataSize, qualifierData, ioDataSize, outData);
+    stats::recordHal(stats::HAL_GET_PROPERTY_DATA, address->mSelector, start, result);
+    return result;
+}
+
+inline OSStatus setPropertyData(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                UInt32 qualifierDataSize, const void* qualifierData,
+                                UInt32 dataSize, const void* data){
+    trace::Scope scope(trace::CATEGORY_HAL, "setPropertyData", objectID, address->mSelector);
+    UInt64 start = stats::begin();
+    OSStatus result = backend()->setPropertyData(objectID, address, qualifierDataSize, qualifierData, dataSize, data);
+    stats::recordHal(stats::HAL_SET_PROPERTY_DATA, address->mSelector, start, result);
+    return result;
+}
+
+inline OSStatus addPropertyListener(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                    AudioObjectPropertyListenerProc listener, void* clientData){
+    trace::Scope scope(trace::CATEGORY_HAL, "addPropertyListener", objectID, address->mSelector);
+    UInt64 start = stats::begin();
+    OSStatus result = backend()->addPropertyListener(objectID, address, listener, clientData);
+    stats::recordHal(stats::HAL_ADD_PROPERTY_LISTENER, address->mSelector, start, result);
+    return result;
+}
+
+inline OSStatus removePropertyListener(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                       AudioObjectPropertyListenerProc listener, void* clientData){
+    trace::Scope scope(trace::CATEGORY_HAL, "removePropertyListener", objectID, address->mSelector);
+    UInt64 start = stats::begin();
+    OSStatus result = backend()->removePropertyListener(objectID, address, listener, clientData);
+    stats::recordHal(stats::HAL_REMOVE_PROPERTY_LISTENER, address->mSelector, start, result);
+    return result;
+}
+
+inline OSStatus createIOProcID(AudioObjectID deviceID, AudioDeviceIOProc proc, void* clientData,
+                               AudioDeviceIOProcID* outProcID){
+    trace::Scope scope(trace::CATEGORY_HAL, "createIOProcID", deviceID);
+    UInt64 start = stats::begin();
+    OSStatus result = backend()->createIOProcID(deviceID, proc, clientData, outProcID);
+    stats::recordHal(stats::HAL_CREATE_IO_PROC_ID, 0, start, result);
+    return result;
+}
+
+inline OSStatus destroyIOProcID(AudioObjectID deviceID, AudioDeviceIOProcID procID){
+    trace::Scope scope(trace::CATEGORY_HAL, "destroyIOProcID", deviceID);
+    UInt64 start = stats::begin();
+    OSStatus result = backend()->destroyIOProcID(deviceID, procID);
+    stats::recordHal(stats::HAL_DESTROY_IO_PROC_ID, 0, start, result);
+    return result;
+}
+
+inline OSStatus deviceStart(AudioObjectID deviceID, AudioDeviceIOProcID procID){
+    trace::Scope scope(trace::CATEGORY_HAL, "deviceStart", deviceID);
+    UInt64 start = stats::begin();
+    OSStatus result = backend()->deviceStart(deviceID, procID);
+    stats::recordHal(stats::HAL_DEVICE_START, 0, start, result);
+    return result;
+}
+
+inline OSStatus deviceStop(AudioObjectID deviceID, AudioDeviceIOProcID procID){
+    trace::Scope scope(trace::CATEGORY_HAL, "deviceStop", deviceID);
+    UInt64 start = stats::begin();
+    OSStatus result = backend()->deviceStop(deviceID, procID);
+    stats::recordHal(stats::HAL_DEVICE_STOP, 0, start, result);
+    return result;
+}
+
+}; //namespace hal
+
+#endif //PYCOREAUDIO_HAL_H
@@ -0,0 +1,772 @@
+#include "hal_sim.h"
+#include "posix.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <math.h>
+
+namespace hal {
+
+//Latencies below this are busy-waited, longer ones sleep like a blocked IPC call would
+static const UInt64 SPIN_LIMIT_NS = 20000;
+
+//The volume in dB of a silent element, the bottom of the range
+static const Float32 MIN_DECIBELS = -96.0f;
+
+static Float32 scalarToDecibels(Float32 volume){
+    return volume > 0 ? std::max(MIN_DECIBELS, 20.0f * log10f(volume)) : MIN_DECIBELS;
+}
+
+static Float32 decibelsToScalar(Float32 decibels){
+    return decibels > MIN_DECIBELS ? std::min(1.0f, powf(10.0f, decibels / 20.0f)) : 0.0f;
+}
+
+static bool addressMatches(const AudioObjectPropertyAddress &listening, const AudioObjectPropertyAddress &changed){
+    return (listening.mSelector == kAudioObjectPropertySelectorWildcard || listening.mSelector == changed.mSelector)
+        && (listening.mScope == kAudioObjectPropertyScopeWildcard || listening.mScope == changed.mScope)
+        && (listening.mElement == kAudioObjectPropertyElementWildcard || listening.mElement == changed.mElement);
+}
+
+static bool sameAddress(const AudioObjectPropertyAddress &a, const AudioObjectPropertyAddress &b){
+    return a.mSelector == b.mSelector && a.mScope == b.mScope && a.mElement == b.mElement;
+}
+
+SimBackend::SimBackend() :
+    defaultOutput(kAudioObjectUnknown),
+    nextObjectID(kAudioObjectSystemObject + 1),
+    latencyNs(0),
+    jitterNs(0),
+    calls(0),
+    nextIOProcID(1),
+    bufferFrames(512),
+    delivering(false),
+    stopping(false) {}
+
+SimBackend::~SimBackend(){
+    {
+        std::unique_lock<std::mutex> lock(ioMutex);
+        while(!ioThreads.empty()) stopIOThread(lock, ioThreads.begin()->first);
+    }
+    {
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        stopping = true;
+    }
+    listenerCondition.notify_all();
+    if(notifier.joinable()) notifier.join();
+
+    for(Device &device : deviceList) releaseDevice(device);
+}
+
+void SimBackend::releaseDevice(Device &device){
+    CFRelease(device.name);
+    CFRelease(device.manufacturer);
+    CFRelease(device.uid);
+}
+
+void SimBackend::populate(int count, UInt32 outChannels){
+    for(AudioDeviceID deviceID : devices()) removeDevice(deviceID);
+
+    for(int i = 0; i < count; i++){
+        char buffer[64];
+        SimDeviceSpec spec;
+        snprintf(buffer, sizeof(buffer), "Simulated Device %d", i + 1);
+        spec.name = buffer;
+        spec.manufacturer = "pycoreaudio";
+        snprintf(buffer, sizeof(buffer), "SimulatedDevice:%d", i + 1);
+        spec.uid = buffer;
+        spec.inStreams = (i % 2 == 1) ? 1 : 0;
+        spec.outChannels = outChannels;
+        addDevice(spec);
+    }
+}
+
+AudioDeviceID SimBackend::addDevice(const SimDeviceSpec &spec){
+    std::lock_guard<std::mutex> lock(mutex);
+    Device device;
+    device.id = nextObjectID++;
+    device.spec = spec;
+    device.name = CFStringCreateWithCString(kCFAllocatorDefault, spec.name.c_str(), kCFStringEncodingUTF8);
+    device.manufacturer = CFStringCreateWithCString(kCFAllocatorDefault, spec.manufacturer.c_str(), kCFStringEncodingUTF8);
+    device.uid = CFStringCreateWithCString(kCFAllocatorDefault, spec.uid.c_str(), kCFStringEncodingUTF8);
+    device.volume.assign(spec.outChannels + 1, 0.5f);
+    device.mute.assign(spec.outChannels + 1, 0);
+    device.signalAmplitude = 0.0f;
+    device.signalFrequency = 440.0f;
+    deviceList.push_back(device);
+
+    notify(kAudioObjectSystemObject, kAudioHardwarePropertyDevices);
+    if(defaultOutput == kAudioObjectUnknown && spec.outStreams > 0){
+        defaultOutput = device.id;
+        notify(kAudioObjectSystemObject, kAudioHardwarePropertyDefaultOutputDevice);
+    }
+    return device.id;
+}
+
+bool SimBackend::removeDevice(AudioDeviceID deviceID){
+    std::lock_guard<std::mutex> lock(mutex);
+    for(std::vector<Device>::iterator it = deviceList.begin(); it != deviceList.end(); ++it){
+        if(it->id != deviceID) continue;
+        releaseDevice(*it);
+        deviceList.erase(it);
+        notify(kAudioObjectSystemObject, kAudioHardwarePropertyDevices);
+        for(Device &aggregate : deviceList){
+            std::vector<AudioDeviceID> &subDevices = aggregate.spec.subDevices;
+            std::vector<AudioDeviceID>::iterator member = std::find(subDevices.begin(), subDevices.end(), deviceID);
+            if(member == subDevices.end()) continue;
+            subDevices.erase(member);
+            notify(aggregate.id, kAudioAggregateDevicePropertyActiveSubDeviceList);
+        }
+        if(defaultOutput == deviceID){
+            defaultOutput = kAudioObjectUnknown;
+            notify(kAudioObjectSystemObject, kAudioHardwarePropertyDefaultOutputDevice);
+        }
+        return true;
+    }
+    return false;
+}
+
+std::vector<AudioDeviceID> SimBackend::devices(){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<AudioDeviceID> ids;
+    for(const Device &device : deviceList) ids.push_back(device.id);
+    return ids;
+}
+
+bool SimBackend::setDefaultOutputDevice(AudioDeviceID deviceID){
+    AudioObjectPropertyAddress address = {
+        kAudioHardwarePropertyDefaultOutputDevice,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMain
+    };
+    return setPropertyData(kAudioObjectSystemObject, &address, 0, NULL, sizeof(deviceID), &deviceID) == kAudioHardwareNoError;
+}
+
+bool SimBackend::setDeviceName(AudioDeviceID deviceID, const std::string &name){
+    std::lock_guard<std::mutex> lock(mutex);
+    Device* device = findDevice(deviceID);
+    if(device == NULL) return false;
+    CFRelease(device->name);
+    device->spec.name = name;
+    device->name = CFStringCreateWithCString(kCFAllocatorDefault, name.c_str(), kCFStringEncodingUTF8);
+    notify(deviceID, kAudioDevicePropertyDeviceNameCFString);
+    return true;
+}
+
+long SimBackend::stringReferences(){
+    std::lock_guard<std::mutex> lock(mutex);
+    long references = 0;
+    for(const Device &device : deviceList){
+        references += device.name->refCount.load() + device.manufacturer->refCount.load() + device.uid->refCount.load();
+    }
+    return references;
+}
+
+bool SimBackend::setStreamCounts(AudioDeviceID deviceID, UInt32 inStreams, UInt32 outStreams){
+    std::lock_guard<std::mutex> lock(mutex);
+    Device* device = findDevice(deviceID);
+    if(device == NULL) return false;
+    if(device->spec.inStreams != inStreams){
+        device->spec.inStreams = inStreams;
+        notify(deviceID, kAudioDevicePropertyStreams, kAudioDevicePropertyScopeInput);
+        notify(deviceID, kAudioDevicePropertyStreamConfiguration, kAudioDevicePropertyScopeInput);
+    }
+    if(device->spec.outStreams != outStreams){
+        device->spec.outStreams = outStreams;
+        notify(deviceID, kAudioDevicePropertyStreams, kAudioDevicePropertyScopeOutput);
+        notify(deviceID, kAudioDevicePropertyStreamConfiguration, kAudioDevicePropertyScopeOutput);
+    }
+    return true;
+}
+
+bool SimBackend::setSubDevices(AudioDeviceID deviceID, const std::vector<AudioDeviceID> &subDevices){
+    std::lock_guard<std::mutex> lock(mutex);
+    Device* device = findDevice(deviceID);
+    if(device == NULL) return false;
+    if(device->spec.subDevices == subDevices) return true;
+    device->spec.subDevices = subDevices;
+    notify(deviceID, kAudioAggregateDevicePropertyActiveSubDeviceList);
+    return true;
+}
+
+bool SimBackend::setChannelCount(AudioDeviceID deviceID, UInt32 outChannels){
+    std::lock_guard<std::mutex> lock(mutex);
+    Device* device = findDevice(deviceID);
+    if(device == NULL) return false;
+    if(device->spec.outChannels == outChannels) return true;
+    device->spec.outChannels = outChannels;
+    device->volume.resize(outChannels + 1, device->volume[0]);
+    device->mute.resize(outChannels + 1, device->mute[0]);
+    notify(deviceID, kAudioDevicePropertyStreamConfiguration, kAudioDevicePropertyScopeOutput);
+    return true;
+}
+
+bool SimBackend::setInputSignal(AudioDeviceID deviceID, Float32 amplitude, Float32 frequency){
+    std::lock_guard<std::mutex> lock(mutex);
+    Device* device = findDevice(deviceID);
+    if(device == NULL) return false;
+    device->signalAmplitude = amplitude;
+    device->signalFrequency = frequency;
+    return true;
+}
+
+void SimBackend::setIOBufferFrames(UInt32 frames){
+    bufferFrames.store(frames > 0 ? frames : 1, std::memory_order_relaxed);
+}
+
+UInt32 SimBackend::ioBufferFrames() const {
+    return bufferFrames.load(std::memory_order_relaxed);
+}
+
+UInt64 SimBackend::ioCycles(AudioDeviceID deviceID){
+    std::lock_guard<std::mutex> lock(ioMutex);
+    std::map<AudioDeviceID, IOThread*>::iterator io = ioThreads.find(deviceID);
+    return io == ioThreads.end() ? 0 : io->second->cycles;
+}
+
+void SimBackend::setLatency(UInt64 nanoseconds){
+    latencyNs.store(nanoseconds, std::memory_order_relaxed);
+}
+
+UInt64 SimBackend::latency() const {
+    return latencyNs.load(std::memory_order_relaxed);
+}
+
+void SimBackend::setLatencyJitter(UInt64 nanoseconds){
+    jitterNs.store(nanoseconds, std::memory_order_relaxed);
+}
+
+UInt64 SimBackend::callCount() const {
+    return calls.load(std::memory_order_relaxed);
+}
+
+void SimBackend::resetCallCount(){
+    calls.store(0, std::memory_order_relaxed);
+}
+
+void SimBackend::simulateLatency(){
+    calls.fetch_add(1, std::memory_order_relaxed);
+    UInt64 ns = latencyNs.load(std::memory_order_relaxed);
+    UInt64 jitter = jitterNs.load(std::memory_order_relaxed);
+    if(jitter > 0){
+        static thread_local std::minstd_rand random(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        ns += random() % (jitter + 1);
+    }
+    if(ns == 0) return;
+    if(ns >= SPIN_LIMIT_NS){
+        std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+        return;
+    }
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+    while(std::chrono::steady_clock::now() < deadline){}
+}
+
+SimBackend::Device* SimBackend::findDevice(AudioObjectID objectID){
+    for(Device &device : deviceList){
+        if(device.id == objectID) return &device;
+    }
+    return NULL;
+}
+
+UInt32 SimBackend::streamChannels(const Device &device, AudioObjectPropertyScope scope, UInt32 stream){
+    if(scope == kAudioDevicePropertyScopeInput) return 2;
+    UInt32 share = device.spec.outChannels / device.spec.outStreams;
+    if(stream + 1 < device.spec.outStreams) return share;
+    return device.spec.outChannels - share * stream;     //the last stream takes the rest
+}
+
+bool SimBackend::hasElementControl(const Device &device, const AudioObjectPropertyAddress* address){
+    if(address->mScope != kAudioDevicePropertyScopeOutput) return false;
+    bool volume = address->mSelector == kAudioDevicePropertyVolumeScalar
+               || address->mSelector == kAudioDevicePropertyVolumeDecibels;
+    if(volume && !device.spec.hasVolume) return false;
+    if(address->mSelector == kAudioDevicePropertyMute && !device.spec.hasMute) return false;
+    if(address->mElement == kAudioObjectPropertyElementMain) return device.spec.hasMasterElement;
+    return address->mElement <= device.spec.outChannels;
+}
+
+OSStatus SimBackend::propertySize(AudioObjectID objectID, const AudioObjectPropertyAddress* address, UInt32* outSize){
+    if(objectID == kAudioObjectSystemObject){
+        switch(address->mSelector){
+            case kAudioHardwarePropertyDevices:
+                *outSize = (UInt32)(deviceList.size() * sizeof(AudioDeviceID));
+                return kAudioHardwareNoError;
+            case kAudioHardwarePropertyDefaultOutputDevice:
+                *outSize = sizeof(AudioDeviceID);
+                return kAudioHardwareNoError;
+        }
+        return kAudioHardwareUnknownPropertyError;
+    }
+
+    Device* device = findDevice(objectID);
+    if(device == NULL) return kAudioHardwareBadObjectError;
+    switch(address->mSelector){
+        case kAudioDevicePropertyDeviceNameCFString:
+        case kAudioDevicePropertyDeviceManufacturerCFString:
+        case kAudioDevicePropertyDeviceUID:
+            *outSize = sizeof(CFStringRef);
+            return kAudioHardwareNoError;
+        case kAudioDevicePropertyStreams:
+            if(address->mScope == kAudioDevicePropertyScopeInput){
+                *outSize = device->spec.inStreams * sizeof(AudioStreamID);
+            } else if(address->mScope == kAudioDevicePropertyScopeOutput){
+                *outSize = device->spec.outStreams * sizeof(AudioStreamID);
+            } else {
+                *outSize = (device->spec.inStreams + device->spec.outStreams) * sizeof(AudioStreamID);
+            }
+            return kAudioHardwareNoError;
+        case kAudioDevicePropertyStreamConfiguration: {
+            UInt32 streams;
+            if(address->mScope == kAudioDevicePropertyScopeInput) streams = device->spec.inStreams;
+            else if(address->mScope == kAudioDevicePropertyScopeOutput) streams = device->spec.outStreams;
+            else return kAudioHardwareUnknownPropertyError;
+            *outSize = (UInt32)(offsetof(AudioBufferList, mBuffers) + streams * sizeof(AudioBuffer));
+            return kAudioHardwareNoError;
+        }
+        case kAudioDevicePropertyPreferredChannelsForStereo:
+            if(address->mScope != kAudioDevicePropertyScopeOutput || device->spec.outChannels == 0){
+                return kAudioHardwareUnknownPropertyError;
+            }
+            *outSize = 2 * sizeof(UInt32);
+            return kAudioHardwareNoError;
+        case kAudioDevicePropertyVolumeScalar:
+        case kAudioDevicePropertyVolumeDecibels:
+            if(!hasElementControl(*device, address)) return kAudioHardwareUnknownPropertyError;
+            *outSize = sizeof(Float32);
+            return kAudioHardwareNoError;
+        case kAudioDevicePropertyMute:
+            if(!hasElementControl(*device, address)) return kAudioHardwareUnknownPropertyError;
+            *outSize = sizeof(UInt32);
+            return kAudioHardwareNoError;
+        case kAudioDevicePropertyNominalSampleRate:
+            *outSize = sizeof(Float64);
+            return kAudioHardwareNoError;
+        case kAudioDevicePropertyBufferFrameSize:
+            *outSize = sizeof(UInt32);
+            return kAudioHardwareNoError;
+        case kAudioAggregateDevicePropertyActiveSubDeviceList:
+            if(device->spec.subDevices.empty()) return kAudioHardwareUnknownPropertyError;
+            *outSize = (UInt32)(device->spec.subDevices.size() * sizeof(AudioObjectID));
+            return kAudioHardwareNoError;
+    }
+    return kAudioHardwareUnknownPropertyError;
+}
+
+Boolean SimBackend::hasProperty(AudioObjectID objectID, const AudioObjectPropertyAddress* address){
+    simulateLatency();
+    std::lock_guard<std::mutex> lock(mutex);
+    UInt32 size;
+    return propertySize(objectID, address, &size) == kAudioHardwareNoError;
+}
+
+OSStatus SimBackend::getPropertyDataSize(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                         UInt32 qualifierDataSize, const void* qualifierData,
+                                         UInt32* outDataSize){
+    simulateLatency();
+    std::lock_guard<std::mutex> lock(mutex);
+    return propertySize(objectID, address, outDataSize);
+}
+
+OSStatus SimBackend::getPropertyData(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                     UInt32 qualifierDataSize, const void* qualifierData,
+                                     UInt32* ioDataSize, void* outData){
+    simulateLatency();
+    std::lock_guard<std::mutex> lock(mutex);
+    UInt32 size;
+    OSStatus status = propertySize(objectID, address, &size);
+    if(status != kAudioHardwareNoError) return status;
+
+    //Arrays are truncated to the caller's buffer, everything else must fit
+    bool isArray = address->mSelector == kAudioHardwarePropertyDevices || address->mSelector == kAudioDevicePropertyStreams
+                || address->mSelector == kAudioAggregateDevicePropertyActiveSubDeviceList;
+    if(isArray){
+        size = std::min(size, *ioDataSize - *ioDataSize % (UInt32)sizeof(AudioObjectID));
+    } else if(*ioDataSize < size){
+        return kAudioHardwareBadPropertySizeError;
+    }
+
+    if(objectID == kAudioObjectSystemObject){
+        if(address->mSelector == kAudioHardwarePropertyDevices){
+            AudioDeviceID* ids = static_cast<AudioDeviceID*>(outData);
+            for(UInt32 i = 0; i < size / sizeof(AudioDeviceID); i++) ids[i] = deviceList[i].id;
+        } else {
+            *static_cast<AudioDeviceID*>(outData) = defaultOutput;
+        }
+        *ioDataSize = size;
+        return kAudioHardwareNoError;
+    }
+
+    Device* device = findDevice(objectID);
+    switch(address->mSelector){
+        case kAudioDevicePropertyDeviceNameCFString:
+            *static_cast<CFStringRef*>(outData) = (CFStringRef)CFRetain(device->name);
+            break;
+        case kAudioDevicePropertyDeviceManufacturerCFString:
+            *static_cast<CFStringRef*>(outData) = (CFStringRef)CFRetain(device->manufacturer);
+            break;
+        case kAudioDevicePropertyDeviceUID:
+            *static_cast<CFStringRef*>(outData) = (CFStringRef)CFRetain(device->uid);
+            break;
+        case kAudioDevicePropertyStreams: {
+            AudioStreamID* ids = static_cast<AudioStreamID*>(outData);
+            for(UInt32 i = 0; i < size / sizeof(AudioStreamID); i++) ids[i] = (device->id << 8) | i;
+            break;
+        }
+        case kAudioDevicePropertyStreamConfiguration: {
+            AudioBufferList* list = static_cast<AudioBufferList*>(outData);
+            list->mNumberBuffers = (UInt32)((size - offsetof(AudioBufferList, mBuffers)) / sizeof(AudioBuffer));
+            for(UInt32 i = 0; i < list->mNumberBuffers; i++){
+                list->mBuffers[i].mNumberChannels = streamChannels(*device, address->mScope, i);
+                list->mBuffers[i].mDataByteSize = 0;
+                list->mBuffers[i].mData = NULL;
+            }
+            break;
+        }
+        case kAudioDevicePropertyPreferredChannelsForStereo: {
+            UInt32* channels = static_cast<UInt32*>(outData);
+            channels[0] = 1;
+            channels[1] = device->spec.outChannels > 1 ? 2 : 1;
+            break;
+        }
+        case kAudioDevicePropertyVolumeScalar:
+            *static_cast<Float32*>(outData) = device->volume[address->mElement];
+            break;
+        case kAudioDevicePropertyVolumeDecibels:
+            *static_cast<Float32*>(outData) = scalarToDecibels(device->volume[address->mElement]);
+            break;
+        case kAudioDevicePropertyMute:
+            *static_cast<UInt32*>(outData) = device->mute[address->mElement];
+            break;
+        case kAudioDevicePropertyNominalSampleRate:
+            *static_cast<Float64*>(outData) = SAMPLE_RATE;
+            break;
+        case kAudioDevicePropertyBufferFrameSize:
+            *static_cast<UInt32*>(outData) = bufferFrames.load(std::memory_order_relaxed);
+            break;
+        case kAudioAggregateDevicePropertyActiveSubDeviceList: {
+            AudioObjectID* ids = static_cast<AudioObjectID*>(outData);
+            for(UInt32 i = 0; i < size / sizeof(AudioObjectID); i++) ids[i] = device->spec.subDevices[i];
+            break;
+        }
+    }
+    *ioDataSize = size;
+    return kAudioHardwareNoError;
+}
+
+OSStatus SimBackend::setPropertyData(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                     UInt32 qualifierDataSize, const void* qualifierData,
+                                     UInt32 dataSize, const void* data){
+    simulateLatency();
+    std::lock_guard<std::mutex> lock(mutex);
+    UInt32 size;
+    OSStatus status = propertySize(objectID, address, &size);
+    if(status != kAudioHardwareNoError) return status;
+    if(dataSize != size) return kAudioHardwareBadPropertySizeError;
+
+    if(objectID == kAudioObjectSystemObject){
+        if(address->mSelector != kAudioHardwarePropertyDefaultOutputDevice) return kAudioHardwareIllegalOperationError;
+        AudioDeviceID deviceID = *static_cast<const AudioDeviceID*>(data);
+        Device* device = findDevice(deviceID);
+        if(device == NULL || device->spec.outStreams == 0) return kAudioHardwareIllegalOperationError;
+        if(defaultOutput != deviceID){
+            defaultOutput = deviceID;
+            notify(kAudioObjectSystemObject, kAudioHardwarePropertyDefaultOutputDevice);
+        }
+        return kAudioHardwareNoError;
+    }
+
+    Device* device = findDevice(objectID);
+    switch(address->mSelector){
+        case kAudioDevicePropertyVolumeScalar:
+        case kAudioDevicePropertyVolumeDecibels: {
+            Float32 volume = *static_cast<const Float32*>(data);
+            if(address->mSelector == kAudioDevicePropertyVolumeDecibels) volume = decibelsToScalar(volume);
+            volume = std::max(0.0f, std::min(1.0f, volume));
+            if(device->volume[address->mElement] != volume){
+                device->volume[address->mElement] = volume;
+                //Both views of the one control change, like on a real device
+                notify(objectID, kAudioDevicePropertyVolumeScalar, address->mScope, address->mElement);
+                notify(objectID, kAudioDevicePropertyVolumeDecibels, address->mScope, address->mElement);
+            }
+            return kAudioHardwareNoError;
+        }
+        case kAudioDevicePropertyMute: {
+            UInt32 mute = *static_cast<const UInt32*>(data) ? 1 : 0;
+            if(device->mute[address->mElement] != mute){
+                device->mute[address->mElement] = mute;
+                notify(objectID, address->mSelector, address->mScope, address->mElement);
+            }
+            return kAudioHardwareNoError;
+        }
+    }
+    return kAudioHardwareIllegalOperationError;
+}
+
+OSStatus SimBackend::addPropertyListener(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                         AudioObjectPropertyListenerProc listener, void* clientData){
+    simulateLatency();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(objectID != kAudioObjectSystemObject && findDevice(objectID) == NULL) return kAudioHardwareBadObjectError;
+    }
+    std::lock_guard<std::mutex> lock(listenerMutex);
+    Listener entry = { objectID, *address, listener, clientData };
+    listeners.push_back(entry);
+    if(!notifier.joinable()) notifier = std::thread(&SimBackend::notificationLoop, this);
+    return kAudioHardwareNoError;
+}
+
+OSStatus SimBackend::removePropertyListener(AudioObjectID objectID, const AudioObjectPropertyAddress* address,
+                                            AudioObjectPropertyListenerProc listener, void* clientData){
+    simulateLatency();
+    std::lock_guard<std::mutex> lock(listenerMutex);
+    for(std::vector<Listener>::iterator it = listeners.begin(); it != listeners.end(); ++it){
+        if(it->objectID == objectID && sameAddress(it->address, *address)
+           && it->proc == listener && it->clientData == clientData){
+            listeners.erase(it);
+            return kAudioHardwareNoError;
+        }
+    }
+    return kAudioHardwareIllegalOperationError;
+}
+
+/* ------------------------------IOProcs---------------------------------- */
+/*
+ * Every device with a started IOProc gets an IO thread. Once per buffer
+ * (ioBufferFrames() at SAMPLE_RATE, on the wall clock) it fills the input
+ * buffers with the device's input signal, zeroes the output buffers and
+ * calls the started IOProcs of the device in the order they were created,
+ * as the HAL does. Output is not kept, like audio played to nobody.
+ */
+SimBackend::IOProc* SimBackend::findIOProc(AudioDeviceID deviceID, AudioDeviceIOProcID procID){
+    for(IOProc &entry : ioProcs){
+        if(entry.id == procID && entry.deviceID == deviceID) return &entry;
+    }
+    return NULL;
+}
+
+OSStatus SimBackend::createIOProcID(AudioObjectID deviceID, AudioDeviceIOProc proc,
+                                    void* clientData, AudioDeviceIOProcID* outProcID){
+    simulateLatency();
+    if(proc == NULL || outProcID == NULL) return kAudioHardwareIllegalOperationError;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(findDevice(deviceID) == NULL) return kAudioHardwareBadObjectError;
+    }
+    std::lock_guard<std::mutex> lock(ioMutex);
+    //Opaque like the real thing, never called
+    IOProc entry = { reinterpret_cast<AudioDeviceIOProcID>((uintptr_t)nextIOProcID++), deviceID, proc, clientData, false };
+    ioProcs.push_back(entry);
+    *outProcID = entry.id;
+    return kAudioHardwareNoError;
+}
+
+OSStatus SimBackend::destroyIOProcID(AudioObjectID deviceID, AudioDeviceIOProcID procID){
+    OSStatus status = deviceStop(deviceID, procID);
+    if(status != kAudioHardwareNoError) return status;
+    std::lock_guard<std::mutex> lock(ioMutex);
+    for(std::vector<IOProc>::iterator it = ioProcs.begin(); it != ioProcs.end(); ++it){
+        if(it->id == procID && it->deviceID == deviceID){
+            ioProcs.erase(it);
+            break;
+        }
+    }
+    return kAudioHardwareNoError;
+}
+
+OSStatus SimBackend::deviceStart(AudioObjectID deviceID, AudioDeviceIOProcID procID){
+    simulateLatency();
+    std::lock_guard<std::mutex> lock(ioMutex);
+    IOProc* entry = findIOProc(deviceID, procID);
+    if(entry == NULL) return kAudioHardwareIllegalOperationError;
+    entry->running = true;
+    if(ioThreads.count(deviceID) == 0){
+        IOThread* io = new IOThread();
+        io->stopping = false;
+        io->inCycle = false;
+        io->cycles = 0;
+        io->thread = std::thread(&SimBackend::ioLoop, this, deviceID, io);
+        ioThreads[deviceID] = io;
+    }
+    return kAudioHardwareNoError;
+}
+
+OSStatus SimBackend::deviceStop(AudioObjectID deviceID, AudioDeviceIOProcID procID){
+    simulateLatency();
+    std::unique_lock<std::mutex> lock(ioMutex);
+    IOProc* entry = findIOProc(deviceID, procID);
+    if(entry == NULL) return kAudioHardwareIllegalOperationError;
+    entry->running = false;
+
+    std::map<AudioDeviceID, IOThread*>::iterator io = ioThreads.find(deviceID);
+    if(io == ioThreads.end() || io->second->thread.get_id() == std::this_thread::get_id()) return kAudioHardwareNoError;
+    //Like the HAL, return only once the IOProc is not being called anymore
+    IOThread* thread = io->second;
+    ioCondition.wait(lock, [thread]{ return !thread->inCycle; });
+
+    bool idle = true;
+    for(const IOProc &other : ioProcs){
+        if(other.deviceID == deviceID && other.running) idle = false;
+    }
+    if(idle) stopIOThread(lock, deviceID);
+    return kAudioHardwareNoError;
+}
+
+void SimBackend::stopIOThread(std::unique_lock<std::mutex> &lock, AudioDeviceID deviceID){
+    std::map<AudioDeviceID, IOThread*>::iterator io = ioThreads.find(deviceID);
+    if(io == ioThreads.end()) return;
+    IOThread* thread = io->second;
+    ioThreads.erase(io);
+    thread->stopping = true;
+    ioCondition.notify_all();
+    lock.unlock();
+    thread->thread.join();
+    delete thread;
+    lock.lock();
+}
+
+void SimBackend::ioLoop(AudioDeviceID deviceID, IOThread* io){
+    std::vector<IOProc> procs;
+    std::vector<Float32> inputData, outputData;
+    std::vector<char> inputList, outputList;
+    Float64 phase = 0;
+    Float64 sampleTime = 0;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(ioMutex);
+    while(!io->stopping){
+        procs.clear();
+        for(const IOProc &entry : ioProcs){
+            if(entry.deviceID == deviceID && entry.running) procs.push_back(entry);
+        }
+        UInt32 frames = bufferFrames.load(std::memory_order_relaxed);
+        io->inCycle = true;
+        lock.unlock();
+
+        //Stream layout and input signal of the device, as of this cycle
+        UInt32 inStreams = 0, outStreams = 0;
+        std::vector<UInt32> outChannels;
+        Float32 amplitude = 0, frequency = 0;
+        bool present;
+        {
+            std::lock_guard<std::mutex> deviceLock(mutex);
+            Device* device = findDevice(deviceID);
+            present = device != NULL;
+            if(present){
+                inStreams = device->spec.inStreams;
+                outStreams = device->spec.outStreams;
+                for(UInt32 i = 0; i < outStreams; i++) outChannels.push_back(streamChannels(*device, kAudioDevicePropertyScopeOutput, i));
+                amplitude = device->signalAmplitude;
+                frequency = device->signalFrequency;
+            }
+        }
+
+        if(present){
+            inputList.assign(offsetof(AudioBufferList, mBuffers) + (inStreams + 1) * sizeof(AudioBuffer), 0);
+            outputList.assign(offsetof(AudioBufferList, mBuffers) + (outStreams + 1) * sizeof(AudioBuffer), 0);
+            AudioBufferList* input = (AudioBufferList*)inputList.data();
+            AudioBufferList* output = (AudioBufferList*)outputList.data();
+
+            //Input: every stream has two channels carrying the same sine
+            inputData.resize((size_t)inStreams * 2 * frames);
+            Float64 step = 2.0 * M_PI * frequency / SAMPLE_RATE;
+            for(UInt32 frame = 0; frame < frames; frame++){
+                Float32 sample = amplitude == 0 ? 0.0f : (Float32)(amplitude * sin(phase + step * frame));
+                for(UInt32 channel = 0; channel < inStreams * 2; channel++){
+                    inputData[(size_t)channel / 2 * 2 * frames + (size_t)frame * 2 + channel % 2] = sample;
+                }
+            }
+            phase = fmod(phase + step * frames, 2.0 * M_PI);
+            input->mNumberBuffers = inStreams;
+            for(UInt32 i = 0; i < inStreams; i++){
+                input->mBuffers[i].mNumberChannels = 2;
+                input->mBuffers[i].mDataByteSize = 2 * frames * sizeof(Float32);
+                input->mBuffers[i].mData = &inputData[(size_t)i * 2 * frames];
+            }
+
+            size_t totalOut = 0;
+            for(UInt32 channels : outChannels) totalOut += channels;
+            outputData.resize(totalOut * frames);
+            output->mNumberBuffers = outStreams;
+            size_t offset = 0;
+            for(UInt32 i = 0; i < outStreams; i++){
+                output->mBuffers[i].mNumberChannels = outChannels[i];
+                output->mBuffers[i].mDataByteSize = outChannels[i] * frames * sizeof(Float32);
+                output->mBuffers[i].mData = &outputData[offset];
+                offset += (size_t)outChannels[i] * frames;
+            }
+
+            AudioTimeStamp now = { sampleTime, monotonicNanoseconds(), 1.0,
+                                   kAudioTimeStampSampleTimeValid | kAudioTimeStampHostTimeValid };
+            AudioTimeStamp inputTime = now, outputTime = now;
+            inputTime.mSampleTime -= frames;
+            outputTime.mSampleTime += frames;
+            for(const IOProc &entry : procs){
+                //Every IOProc gets output buffers of its own, the HAL mixes them
+                std::fill(outputData.begin(), outputData.end(), 0.0f);
+                entry.proc(deviceID, &now, inStreams ? input : NULL, &inputTime,
+                           outStreams ? output : NULL, &outputTime, entry.clientData);
+            }
+            sampleTime += frames;
+        }
+
+        lock.lock();
+        io->inCycle = false;
+        io->cycles++;
+        ioCondition.notify_all();
+        deadline += std::chrono::nanoseconds((UInt64)frames * 1000000000ull / SAMPLE_RATE);
+        //A late cycle is not made up for, like a HAL overload
+        if(deadline < std::chrono::steady_clock::now()) deadline = std::chrono::steady_clock::now();
+        ioCondition.wait_until(lock, deadline, [io]{ return io->stopping; });
+    }
+}
+/* ----------------------------------------------------------------------- */
+
+void SimBackend::notify(AudioObjectID objectID, AudioObjectPropertySelector selector,
+                        AudioObjectPropertyScope scope, AudioObjectPropertyElement element){
+    std::lock_guard<std::mutex> lock(listenerMutex);
+    Notification notification = { objectID, { selector, scope, element } };
+    for(const Listener &entry : listeners){
+        if(entry.objectID == objectID && addressMatches(entry.address, notification.address)){
+            pending.push_back(notification);
+            listenerCondition.notify_all();
+            return;
+        }
+    }
+}
+
+void SimBackend::flushNotifications(){
+    std::unique_lock<std::mutex> lock(listenerMutex);
+    listenerCondition.wait(lock, [this]{ return stopping || (pending.empty() && !delivering); });
+}
+
+void SimBackend::notificationLoop(){
+    std::unique_lock<std::mutex> lock(listenerMutex);
+    while(true){
+        listenerCondition.wait(lock, [this]{ return stopping || !pending.empty(); });
+        if(stopping) return;
+
+        Notification notification = pending.front();
+        pending.pop_front();
+        std::vector<Listener> targets;
+        for(const Listener &entry : listeners){
+            if(entry.objectID == notification.objectID && addressMatches(entry.address, notification.address)){
+                targets.push_back(entry);
+            }
+        }
+
+        //Listeners may call back into the backend, so deliver without holding the lock
+        delivering = true;
+        lock.unlock();
+        for(const Listener &entry : targets){
+            entry.proc(notification.objectID, 1, &notification.address, entry.clientData);
+        }
+        lock.lock();
+        delivering = false;
+        listenerCondition.notify_all();
+    }
+}
+
+}; //namespace hal
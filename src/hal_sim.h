@@ -0,0 +1,283 @@
+#ifndef PYCOREAUDIO_HAL_SIM_H
+#define PYCOREAUDIO_HAL_SIM_H
+
+#include "hal.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hal {
+
+/**
+ * Description of a simulated device.
+ * Output channels are exposed as elements 1..outChannels, element 0 is
+ * the master element. Volume and mute are modelled per element; the
+ * volume in dB is 20*log10 of the scalar, down to -96 dB for 0. The
+ * output channels are spread evenly over the output streams in the
+ * stream configuration; every input stream has two channels.
+ */
+struct SimDeviceSpec {
+    std::string name;
+    std::string manufacturer;
+    std::string uid;
+    UInt32 inStreams = 0;
+    UInt32 outStreams = 1;
+    UInt32 outChannels = 2;
+    bool hasMasterElement = true;   //element 0 has volume/mute controls
+    bool hasVolume = true;          //elements have kAudioDevicePropertyVolumeScalar and ...VolumeDecibels
+    bool hasMute = true;            //elements have kAudioDevicePropertyMute
+    std::vector<AudioDeviceID> subDevices;  //active sub-devices, an aggregate device if not empty
+};
+
+/**
+ * In-process simulated HAL.
+ *
+ * Models the system object (device list, default output device) and any
+ * number of devices with names, stream counts and per-element volume and
+ * mute controls. Every call can be slowed down by a configurable latency
+ * to mimic a busy coreaudiod, and every call is counted.
+ *
+ * Property listeners are supported. Like the real HAL, they are invoked
+ * asynchronously from a notification thread owned by the backend, never
+ * from inside the call that changed the property.
+ */
+class SimBackend : public Backend {
+public:
+    SimBackend();
+    ~SimBackend();
+
+    /**
+     * Remove all devices and add [count] generic ones. The first device
+     * that has output streams becomes the default output device.
+     *
+     * @param count - number of devices
+     * @param outChannels - number of output channels of every device
+     */
+    void populate(int count, UInt32 outChannels = 2);
+
+    /**
+     * Add a device.
+     *
+     * @param spec - device description
+     * @result - ID of the new device
+     */
+    AudioDeviceID addDevice(const SimDeviceSpec &spec);
+
+    /**
+     * Remove a device. If it was the default output device, the
+     * default output device becomes kAudioObjectUnknown.
+     *
+     * @result - whether the device existed
+     */
+    bool removeDevice(AudioDeviceID deviceID);
+
+    /**
+     * Get the IDs of all devices, in the order the HAL reports them.
+     */
+    std::vector<AudioDeviceID> devices();
+
+    /**
+     * Change the default output device, as if the user picked another
+     * one in the system settings.
+     */
+    bool setDefaultOutputDevice(AudioDeviceID deviceID);
+
+    /**
+     * Rename a device, as the HAL does when a device is renamed in
+     * Audio MIDI Setup.
+     */
+    bool setDeviceName(AudioDeviceID deviceID, const std::string &name);
+
+    /**
+     * Change the number of input and output streams of a device, as
+     * happens when its configuration is changed in Audio MIDI Setup.
+     */
+    bool setStreamCounts(AudioDeviceID deviceID, UInt32 inStreams, UInt32 outStreams);
+
+    /**
+     * Change the number of output channels of a device, as happens when
+     * a multi-channel interface switches to another configuration.
+     * Channels that are added start at the device's master level.
+     */
+    bool setChannelCount(AudioDeviceID deviceID, UInt32 outChannels);
+
+    /**
+     * Change the active sub-devices of an aggregate device, as happens
+     * when one is ticked or unticked in Audio MIDI Setup. A device that
+     * is removed also leaves every aggregate device it was part of.
+     */
+    bool setSubDevices(AudioDeviceID deviceID, const std::vector<AudioDeviceID> &subDevices);
+
+    /**
+     * Feed the input streams of a device with a sine wave, the same on
+     * every channel. An amplitude of 0, the default, is silence; above
+     * 1.0 the samples clip.
+     */
+    bool setInputSignal(AudioDeviceID deviceID, Float32 amplitude, Float32 frequency = 440.0f);
+
+    /**
+     * Set the IO buffer size of every device, in frames. Takes effect
+     * with the next IO cycle.
+     */
+    void setIOBufferFrames(UInt32 frames);
+    UInt32 ioBufferFrames() const;
+
+    /**
+     * Get the number of IO cycles run on a device so far.
+     */
+    UInt64 ioCycles(AudioDeviceID deviceID);
+
+    /**
+     * Set the artificial latency added to every call.
+     *
+     * @param nanoseconds - latency per call, 0 disables it
+     */
+    void setLatency(UInt64 nanoseconds);
+    UInt64 latency() const;
+
+    /**
+     * Add a random extra latency to every call, uniformly distributed
+     * between 0 and [nanoseconds], to mimic a coreaudiod under load.
+     */
+    void setLatencyJitter(UInt64 nanoseconds);
+
+    /**
+     * Get the total reference count of the device strings (name,
+     * manufacturer, uid) currently held by anybody, the simulated HAL's
+     * own references included. A count that keeps growing is a leak.
+     */
+    long stringReferences();
+
+    /**
+     * Get/reset the number of calls made into this backend.
+     */
+    UInt64 callCount() const;
+    void resetCallCount();
+
+    /**
+     * Block until every pending property change notification has been
+     * delivered to the listeners.
+     */
+    void flushNotifications();
+
+    Boolean hasProperty(AudioObjectID objectID,
+                        const AudioObjectPropertyAddress* address) override;
+    OSStatus getPropertyDataSize(AudioObjectID objectID,
+                                 const AudioObjectPropertyAddress* address,
+                                 UInt32 qualifierDataSize, const void* qualifierData,
+                                 UInt32* outDataSize) override;
+    OSStatus getPropertyData(AudioObjectID objectID,
+                             const AudioObjectPropertyAddress* address,
+                             UInt32 qualifierDataSize, const void* qualifierData,
+                             UInt32* ioDataSize, void* outData) override;
+    OSStatus setPropertyData(AudioObjectID objectID,
+                             const AudioObjectPropertyAddress* address,
+                             UInt32 qualifierDataSize, const void* qualifierData,
+                             UInt32 dataSize, const void* data) override;
+    OSStatus addPropertyListener(AudioObjectID objectID,
+                                 const AudioObjectPropertyAddress* address,
+                                 AudioObjectPropertyListenerProc listener,
+                                 void* clientData) override;
+    OSStatus removePropertyListener(AudioObjectID objectID,
+                                    const AudioObjectPropertyAddress* address,
+                                    AudioObjectPropertyListenerProc listener,
+                                    void* clientData) override;
+    OSStatus createIOProcID(AudioObjectID deviceID, AudioDeviceIOProc proc,
+                            void* clientData, AudioDeviceIOProcID* outProcID) override;
+    OSStatus destroyIOProcID(AudioObjectID deviceID, AudioDeviceIOProcID procID) override;
+    OSStatus deviceStart(AudioObjectID deviceID, AudioDeviceIOProcID procID) override;
+    OSStatus deviceStop(AudioObjectID deviceID, AudioDeviceIOProcID procID) override;
+
+    //Nominal sample rate of every simulated device
+    static const UInt32 SAMPLE_RATE = 48000;
+
+private:
+    struct Device {
+        AudioDeviceID id;
+        SimDeviceSpec spec;
+        CFStringRef name;
+        CFStringRef manufacturer;
+        CFStringRef uid;
+        std::vector<Float32> volume;    //indexed by element
+        std::vector<UInt32> mute;       //indexed by element
+        Float32 signalAmplitude;        //see setInputSignal()
+        Float32 signalFrequency;
+    };
+
+    struct IOProc {
+        AudioDeviceIOProcID id;
+        AudioDeviceID deviceID;
+        AudioDeviceIOProc proc;
+        void* clientData;
+        bool running;
+    };
+
+    //The IO thread of a device, running while any of its IOProcs is started
+    struct IOThread {
+        std::thread thread;
+        bool stopping;
+        bool inCycle;                   //calling the IOProcs right now
+        UInt64 cycles;
+    };
+
+    struct Listener {
+        AudioObjectID objectID;
+        AudioObjectPropertyAddress address;
+        AudioObjectPropertyListenerProc proc;
+        void* clientData;
+    };
+
+    struct Notification {
+        AudioObjectID objectID;
+        AudioObjectPropertyAddress address;
+    };
+
+    void simulateLatency();
+    Device* findDevice(AudioObjectID objectID);
+    bool hasElementControl(const Device &device, const AudioObjectPropertyAddress* address);
+    OSStatus propertySize(AudioObjectID objectID, const AudioObjectPropertyAddress* address, UInt32* outSize);
+    void releaseDevice(Device &device);
+    UInt32 streamChannels(const Device &device, AudioObjectPropertyScope scope, UInt32 stream);
+
+    //Must be called with [mutex] held
+    void notify(AudioObjectID objectID, AudioObjectPropertySelector selector,
+                AudioObjectPropertyScope scope = kAudioObjectPropertyScopeGlobal,
+                AudioObjectPropertyElement element = kAudioObjectPropertyElementMain);
+    void notificationLoop();
+    void ioLoop(AudioDeviceID deviceID, IOThread* io);
+    IOProc* findIOProc(AudioDeviceID deviceID, AudioDeviceIOProcID procID);   //[ioMutex] must be held
+    void stopIOThread(std::unique_lock<std::mutex> &lock, AudioDeviceID deviceID);
+
+    std::mutex mutex;                           //guards the device model
+    std::vector<Device> deviceList;
+    AudioDeviceID defaultOutput;
+    AudioObjectID nextObjectID;
+
+    std::atomic<UInt64> latencyNs;
+    std::atomic<UInt64> jitterNs;
+    std::atomic<UInt64> calls;
+
+    std::mutex ioMutex;                         //guards the IOProcs and IO threads
+    std::condition_variable ioCondition;        //IO cycle finished, IO thread stopping
+    std::vector<IOProc> ioProcs;
+    std::map<AudioDeviceID, IOThread*> ioThreads;
+    UInt64 nextIOProcID;
+    std::atomic<UInt32> bufferFrames;
+
+    std::mutex listenerMutex;                   //guards everything below
+    std::condition_variable listenerCondition;
+    std::vector<Listener> listeners;
+    std::deque<Notification> pending;
+    bool delivering;
+    bool stopping;
+    std::thread notifier;
+};
+
+}; //namespace hal
+
+#endif //PYCOREAUDIO_HAL_SIM_H
@@ -0,0 +1,117 @@
+#include "io.h"
+#include "hal.h"
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+IOHost ioHost;
+
+IOHost::IOHost(){}
+
+OSStatus IOHost::ioProc(AudioObjectID deviceID, const AudioTimeStamp* now,
+                        const AudioBufferList* inputData, const AudioTimeStamp* inputTime,
+                        AudioBufferList* outputData, const AudioTimeStamp* outputTime, void* clientData){
+    DeviceIO* io = static_cast<DeviceIO*>(clientData);
+    //seq_cst pairs with publish(): either it sees us in the cycle, or we see its chain
+    io->inCycle.store(true, std::memory_order_seq_cst);
+    const Chain* chain = io->chain.load(std::memory_order_seq_cst);
+
+    //Every buffer of a cycle has the same number of frames, of Float32 samples
+    UInt32 frames = 0;
+    const AudioBufferList* lists[2] = { outputData, inputData };
+    for(const AudioBufferList* list : lists){
+        for(UInt32 i = 0; list != NULL && frames == 0 && i < list->mNumberBuffers; i++){
+            const AudioBuffer &buffer = list->mBuffers[i];
+            if(buffer.mNumberChannels > 0) frames = buffer.mDataByteSize / (buffer.mNumberChannels * sizeof(Float32));
+        }
+    }
+    Float64 sampleTime = (now != NULL && (now->mFlags & kAudioTimeStampSampleTimeValid)) ? now->mSampleTime : 0;
+    for(UInt32 i = 0; outputData != NULL && i < outputData->mNumberBuffers; i++){
+        if(outputData->mBuffers[i].mData != NULL) memset(outputData->mBuffers[i].mData, 0, outputData->mBuffers[i].mDataByteSize);
+    }
+
+    if(chain != NULL && frames > 0){
+        for(IOStage* stage : *chain) stage->process(inputData, outputData, frames, sampleTime);
+    }
+    io->inCycle.store(false, std::memory_order_release);
+    return kAudioHardwareNoError;
+}
+
+void IOHost::publish(DeviceIO &io){
+    Chain* chain = new Chain();
+    for(int position = IO_POSITION_INPUT; position <= IO_POSITION_OUTPUT; position++){
+        for(const std::pair<IOPosition, std::shared_ptr<IOStage> > &entry : io.stages){
+            if(entry.first == position) chain->push_back(entry.second.get());
+        }
+    }
+    const Chain* old = io.chain.exchange(chain, std::memory_order_seq_cst);
+    //Once the IOProc was seen outside of a cycle, it can only pick up the new chain
+    while(io.inCycle.load(std::memory_order_seq_cst)){
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    delete old;
+}
+
+void IOHost::shutdown(DeviceIO &io){
+    hal::deviceStop(io.deviceID, io.procID);
+    hal::destroyIOProcID(io.deviceID, io.procID);
+    delete io.chain.exchange(NULL);
+}
+
+bool IOHost::add(AudioDeviceID deviceID, IOPosition position, const std::shared_ptr<IOStage> &stage){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<AudioDeviceID, std::unique_ptr<DeviceIO> >::iterator found = running.find(deviceID);
+    if(found != running.end()){
+        found->second->stages.push_back(std::make_pair(position, stage));
+        publish(*found->second);
+        return true;
+    }
+
+    std::unique_ptr<DeviceIO> io(new DeviceIO());
+    io->deviceID = deviceID;
+    io->procID = NULL;
+    io->chain.store(NULL);
+    io->inCycle.store(false);
+    io->stages.push_back(std::make_pair(position, stage));
+    publish(*io);
+    if(hal::createIOProcID(deviceID, ioProc, io.get(), &io->procID) != kAudioHardwareNoError){
+        delete io->chain.exchange(NULL);
+        return false;
+    }
+    if(hal::deviceStart(deviceID, io->procID) != kAudioHardwareNoError){
+        shutdown(*io);
+        return false;
+    }
+    running[deviceID] = std::move(io);
+    return true;
+}
+
+bool IOHost::remove(AudioDeviceID deviceID, const std::shared_ptr<IOStage> &stage){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<AudioDeviceID, std::unique_ptr<DeviceIO> >::iterator found = running.find(deviceID);
+    if(found == running.end()) return false;
+    DeviceIO &io = *found->second;
+    for(size_t i = 0; i < io.stages.size(); i++){
+        if(io.stages[i].second != stage) continue;
+        io.stages.erase(io.stages.begin() + i);
+        if(io.stages.empty()){
+            shutdown(io);
+            running.erase(found);
+        } else {
+            publish(io);
+        }
+        return true;
+    }
+    return false;
+}
+
+void IOHost::stop(){
+    std::lock_guard<std::mutex> lock(mutex);
+    for(std::pair<const AudioDeviceID, std::unique_ptr<DeviceIO> > &entry : running) shutdown(*entry.second);
+    running.clear();
+}
+
+size_t IOHost::devices(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return running.size();
+}
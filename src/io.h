@@ -0,0 +1,104 @@
+#ifndef PYCOREAUDIO_IO_H
+#define PYCOREAUDIO_IO_H
+
+#include "cacompat.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Work done on the IO thread of a device, once per IO cycle.
+ */
+class IOStage {
+public:
+    virtual ~IOStage(){}
+
+    /**
+     * Process one IO cycle. Runs on the device's realtime IO thread, so
+     * it must not block, allocate or take locks.
+     *
+     * @param input - input streams of the device, NULL if it has none
+     * @param output - output streams of the device, NULL if it has none.
+     *                 Zeroed at the start of the cycle; the stages of a
+     *                 device run in order on the same buffers.
+     * @param frames - number of frames in every buffer
+     * @param sampleTime - sample time of the first frame
+     */
+    virtual void process(const AudioBufferList* input, AudioBufferList* output, UInt32 frames, Float64 sampleTime) = 0;
+};
+
+//Where a stage runs within an IO cycle; stages at the same position run in the order they were added
+enum IOPosition {
+    IO_POSITION_INPUT  = 0,     //reads the input
+    IO_POSITION_SOURCE = 1,     //writes the output
+    IO_POSITION_EFFECT = 2,     //modifies the output
+    IO_POSITION_OUTPUT = 3      //reads the final output
+};
+
+/**
+ * The module's IOProcs.
+ *
+ * There is at most one IOProc per device; it runs the chain of stages
+ * added for the device. The chain is published as an immutable array the
+ * IOProc reads without a lock. A removed stage is only released once the
+ * IOProc is done with it, so stages need no synchronization of their own
+ * against removal. The IOProc is created with the first stage of a
+ * device and destroyed with the last one.
+ *
+ * Note that the HAL hands every IOProc an output buffer of its own and
+ * mixes them; an IOProc never sees what other applications play.
+ */
+class IOHost {
+public:
+    IOHost();
+
+    /**
+     * Add a stage to the IO cycle of a device, starting its IOProc if needed.
+     *
+     * @result - whether the IOProc could be created and started
+     */
+    bool add(AudioDeviceID deviceID, IOPosition position, const std::shared_ptr<IOStage> &stage);
+
+    /**
+     * Remove a stage. Returns once the stage is not running anymore.
+     *
+     * @result - whether the stage was added to the device
+     */
+    bool remove(AudioDeviceID deviceID, const std::shared_ptr<IOStage> &stage);
+
+    /**
+     * Remove every stage and destroy the IOProcs.
+     */
+    void stop();
+
+    /**
+     * Get the number of devices with a running IOProc.
+     */
+    size_t devices();
+
+private:
+    typedef std::vector<IOStage*> Chain;
+
+    struct DeviceIO {
+        AudioDeviceID deviceID;
+        AudioDeviceIOProcID procID;
+        std::vector<std::pair<IOPosition, std::shared_ptr<IOStage> > > stages;
+        std::atomic<const Chain*> chain;            //what the IOProc runs
+        std::atomic<bool> inCycle;                  //the IOProc is running right now
+    };
+
+    static OSStatus ioProc(AudioObjectID deviceID, const AudioTimeStamp* now,
+                           const AudioBufferList* inputData, const AudioTimeStamp* inputTime,
+                           AudioBufferList* outputData, const AudioTimeStamp* outputTime, void* clientData);
+    static void publish(DeviceIO &io);
+    static void shutdown(DeviceIO &io);
+
+    std::mutex mutex;                               //guards [running] and the stage lists
+    std::map<AudioDeviceID, std::unique_ptr<DeviceIO> > running;
+};
+
+extern IOHost ioHost;
+
+#endif //PYCOREAUDIO_IO_H
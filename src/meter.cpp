@@ -0,0 +1,319 @@
+#include "meter.h"
+#include "audio.h"
+#include <math.h>
+#include <algorithm>
+#if defined(PYCOREAUDIO_SIMD_X86)
+    #include <immintrin.h>
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+    #include <arm_neon.h>
+#endif
+
+MeterEngine meterEngine;
+
+/* ------------------------------Kernels----------------------------------- */
+/*
+ * Interleaved samples repeat their channel order every [channels]
+ * samples, vector registers hold [width] samples. After lcm(channels,
+ * width) samples (a period) both line up again, so a vector at the same
+ * offset of every period always holds the same channels in the same
+ * lanes. The vector kernels accumulate one register per such offset,
+ * straight down the periods, and the lanes are folded into channels
+ * once at the end. What is left after the last whole period is done by
+ * the scalar kernel.
+ */
+
+//Largest period the vector kernels keep lanes for, that of 64 channels with AVX2
+static const UInt32 MAX_PERIOD = 512;
+//Periods per pass, so the float clip counts stay exact and the sums accurate
+static const size_t MAX_BLOCKS = 1 << 16;
+
+static UInt32 gcd(UInt32 a, UInt32 b){
+    while(b != 0){
+        UInt32 rest = a % b;
+        a = b;
+        b = rest;
+    }
+    return a;
+}
+
+static void levelsScalar(const Float32* samples, UInt32 frames, UInt32 channels,
+                         Float32* peak, Float32* energy, UInt32* clips){
+    for(UInt32 frame = 0; frame < frames; frame++, samples += channels){
+        for(UInt32 channel = 0; channel < channels; channel++){
+            Float32 sample = samples[channel];
+            Float32 level = fabsf(sample);
+            if(level > peak[channel]) peak[channel] = level;
+            energy[channel] += sample * sample;
+            if(level >= 1.0f) clips[channel]++;
+        }
+    }
+}
+
+/**
+ * Accumulate [Group] vectors per period, starting at [offset] of every period.
+ */
+typedef void (*LevelPass)(const Float32* samples, size_t blocks, UInt32 period, UInt32 offset,
+                          Float32* peak, Float32* energy, Float32* clips);
+
+#if defined(PYCOREAUDIO_SIMD_X86)
+template <int Group>
+static void passSSE2(const Float32* samples, size_t blocks, UInt32 period, UInt32 offset,
+                     Float32* peak, Float32* energy, Float32* clips){
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 p[Group], e[Group], c[Group];
+    for(int g = 0; g < Group; g++) p[g] = e[g] = c[g] = _mm_setzero_ps();
+    const Float32* row = samples + offset;
+    for(size_t block = 0; block < blocks; block++, row += period){
+        for(int g = 0; g < Group; g++){
+            __m128 x = _mm_loadu_ps(row + 4 * g);
+            __m128 level = _mm_andnot_ps(sign, x);
+            p[g] = _mm_max_ps(p[g], level);
+            e[g] = _mm_add_ps(e[g], _mm_mul_ps(x, x));
+            c[g] = _mm_add_ps(c[g], _mm_and_ps(_mm_cmpge_ps(level, one), one));
+        }
+    }
+    for(int g = 0; g < Group; g++){
+        _mm_storeu_ps(peak + offset + 4 * g, p[g]);
+        _mm_storeu_ps(energy + offset + 4 * g, e[g]);
+        _mm_storeu_ps(clips + offset + 4 * g, c[g]);
+    }
+}
+
+template <int Group>
+PYCOREAUDIO_TARGET_AVX2 static void passAVX2(const Float32* samples, size_t blocks, UInt32 period, UInt32 offset,
+                                             Float32* peak, Float32* energy, Float32* clips){
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 p[Group], e[Group], c[Group];
+    for(int g = 0; g < Group; g++) p[g] = e[g] = c[g] = _mm256_setzero_ps();
+    const Float32* row = samples + offset;
+    for(size_t block = 0; block < blocks; block++, row += period){
+        for(int g = 0; g < Group; g++){
+            __m256 x = _mm256_loadu_ps(row + 8 * g);
+            __m256 level = _mm256_andnot_ps(sign, x);
+            p[g] = _mm256_max_ps(p[g], level);
+            e[g] = _mm256_fmadd_ps(x, x, e[g]);
+            c[g] = _mm256_add_ps(c[g], _mm256_and_ps(_mm256_cmp_ps(level, one, _CMP_GE_OQ), one));
+        }
+    }
+    for(int g = 0; g < Group; g++){
+        _mm256_storeu_ps(peak + offset + 8 * g, p[g]);
+        _mm256_storeu_ps(energy + offset + 8 * g, e[g]);
+        _mm256_storeu_ps(clips + offset + 8 * g, c[g]);
+    }
+}
+
+static const LevelPass PASSES_SSE2[4] = { passSSE2<1>, passSSE2<2>, passSSE2<3>, passSSE2<4> };
+static const LevelPass PASSES_AVX2[4] = { passAVX2<1>, passAVX2<2>, passAVX2<3>, passAVX2<4> };
+#endif
+
+#if defined(PYCOREAUDIO_SIMD_NEON)
+template <int Group>
+static void passNEON(const Float32* samples, size_t blocks, UInt32 period, UInt32 offset,
+                     Float32* peak, Float32* energy, Float32* clips){
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const uint32x4_t oneBits = vreinterpretq_u32_f32(one);
+    float32x4_t p[Group], e[Group], c[Group];
+    for(int g = 0; g < Group; g++) p[g] = e[g] = c[g] = vdupq_n_f32(0.0f);
+    const Float32* row = samples + offset;
+    for(size_t block = 0; block < blocks; block++, row += period){
+        for(int g = 0; g < Group; g++){
+            float32x4_t x = vld1q_f32(row + 4 * g);
+            float32x4_t level = vabsq_f32(x);
+            p[g] = vmaxq_f32(p[g], level);
+            e[g] = vmlaq_f32(e[g], x, x);
+            c[g] = vaddq_f32(c[g], vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(level, one), oneBits)));
+        }
+    }
+    for(int g = 0; g < Group; g++){
+        vst1q_f32(peak + offset + 4 * g, p[g]);
+        vst1q_f32(energy + offset + 4 * g, e[g]);
+        vst1q_f32(clips + offset + 4 * g, c[g]);
+    }
+}
+
+static const LevelPass PASSES_NEON[4] = { passNEON<1>, passNEON<2>, passNEON<3>, passNEON<4> };
+#endif
+
+/**
+ * Run the passes of a vector kernel over all whole periods, see above.
+ */
+static void levelsVector(const LevelPass passes[4], UInt32 width, const Float32* samples, UInt32 frames, UInt32 channels,
+                         Float32* peak, Float32* energy, UInt32* clips){
+    UInt32 period = channels / gcd(channels, width) * width;
+    size_t total = (size_t)frames * channels;
+    size_t blocks = period <= MAX_PERIOD ? total / period : 0;
+    size_t done = 0;
+    while(blocks > 0){
+        size_t count = blocks < MAX_BLOCKS ? blocks : MAX_BLOCKS;
+        Float32 lanePeak[MAX_PERIOD], laneEnergy[MAX_PERIOD], laneClips[MAX_PERIOD];
+        UInt32 vectors = period / width;
+        for(UInt32 vector = 0; vector < vectors;){
+            UInt32 group = vectors - vector < 4 ? vectors - vector : 4;
+            passes[group - 1](samples + done, count, period, vector * width, lanePeak, laneEnergy, laneClips);
+            vector += group;
+        }
+        for(UInt32 lane = 0; lane < period; lane++){
+            UInt32 channel = lane % channels;
+            if(lanePeak[lane] > peak[channel]) peak[channel] = lanePeak[lane];
+            energy[channel] += laneEnergy[lane];
+            clips[channel] += (UInt32)laneClips[lane];
+        }
+        done += count * period;
+        blocks -= count;
+    }
+    //Whole periods are whole frames, the rest starts at the first channel
+    levelsScalar(samples + done, (UInt32)((total - done) / channels), channels, peak, energy, clips);
+}
+
+void accumulateLevels(simd::Level level, const Float32* samples, UInt32 frames, UInt32 channels,
+                      Float32* peak, Float32* energy, UInt32* clips){
+    if(channels == 0) return;
+    switch(level){
+#if defined(PYCOREAUDIO_SIMD_X86)
+        case simd::LEVEL_SSE2: levelsVector(PASSES_SSE2, 4, samples, frames, channels, peak, energy, clips); return;
+        case simd::LEVEL_AVX2: levelsVector(PASSES_AVX2, 8, samples, frames, channels, peak, energy, clips); return;
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+        case simd::LEVEL_NEON: levelsVector(PASSES_NEON, 4, samples, frames, channels, peak, energy, clips); return;
+#endif
+        default: levelsScalar(samples, frames, channels, peak, energy, clips); return;
+    }
+}
+
+void accumulateLevels(const Float32* samples, UInt32 frames, UInt32 channels,
+                      Float32* peak, Float32* energy, UInt32* clips){
+    accumulateLevels(simd::level(), samples, frames, channels, peak, energy, clips);
+}
+/* ----------------------------------------------------------------------- */
+
+/* -------------------------------Meter----------------------------------- */
+Meter::Meter(MeterScope scope, UInt32 channels, Float64 sampleRate, UInt32 integrationMs, UInt32 releaseMs) :
+    scope(scope),
+    channelCount(channels),
+    sampleRate(sampleRate > 0 ? sampleRate : 48000.0),
+    integrationSeconds((integrationMs > 0 ? integrationMs : 1) / 1000.0),
+    releaseSeconds((releaseMs > 0 ? releaseMs : 1) / 1000.0),
+    levels(new Level[channels]),
+    frameCount(0),
+    peakHold(channels, 0.0f),
+    meanSquare(channels, 0.0),
+    cyclePeak(channels),
+    cycleEnergy(channels),
+    cycleClips(channels),
+    coefficientFrames(0),
+    releaseCoefficient(0),
+    integrationCoefficient(0) {
+    for(UInt32 i = 0; i < channels; i++){
+        levels[i].peak.store(0.0f, std::memory_order_relaxed);
+        levels[i].rms.store(0.0f, std::memory_order_relaxed);
+        levels[i].clips.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Meter::process(const AudioBufferList* input, AudioBufferList* output, UInt32 frames, Float64 sampleTime){
+    const AudioBufferList* streams = scope == METER_INPUT ? input : output;
+    if(streams == NULL) return;
+
+    //Streams are metered in order; a layout that changed under us is measured as far as it fits
+    UInt32 measured = 0;
+    std::fill(cyclePeak.begin(), cyclePeak.end(), 0.0f);
+    std::fill(cycleEnergy.begin(), cycleEnergy.end(), 0.0f);
+    std::fill(cycleClips.begin(), cycleClips.end(), 0);
+    for(UInt32 i = 0; i < streams->mNumberBuffers; i++){
+        const AudioBuffer &buffer = streams->mBuffers[i];
+        UInt32 channels = buffer.mNumberChannels;
+        if(measured + channels > channelCount || buffer.mData == NULL) break;
+        if(buffer.mDataByteSize < (UInt64)frames * channels * sizeof(Float32)) break;
+        accumulateLevels((const Float32*)buffer.mData, frames, channels,
+                         &cyclePeak[measured], &cycleEnergy[measured], &cycleClips[measured]);
+        measured += channels;
+    }
+
+    if(frames != coefficientFrames){
+        Float64 seconds = frames / sampleRate;
+        releaseCoefficient = (Float32)exp(-seconds / releaseSeconds);
+        integrationCoefficient = 1.0 - exp(-seconds / integrationSeconds);
+        coefficientFrames = frames;
+    }
+    for(UInt32 channel = 0; channel < measured; channel++){
+        Float32 released = peakHold[channel] * releaseCoefficient;
+        peakHold[channel] = cyclePeak[channel] > released ? cyclePeak[channel] : released;
+        meanSquare[channel] += (cycleEnergy[channel] / frames - meanSquare[channel]) * integrationCoefficient;
+
+        Level &level = levels[channel];
+        level.peak.store(peakHold[channel], std::memory_order_relaxed);
+        level.rms.store((Float32)sqrt(meanSquare[channel]), std::memory_order_relaxed);
+        if(cycleClips[channel] > 0){
+            level.clips.store(level.clips.load(std::memory_order_relaxed) + cycleClips[channel], std::memory_order_relaxed);
+        }
+    }
+    frameCount.fetch_add(frames, std::memory_order_release);
+}
+
+size_t Meter::read(MeterReading* out, size_t max) const {
+    size_t count = channelCount < max ? channelCount : max;
+    for(size_t i = 0; i < count; i++){
+        out[i].peak = levels[i].peak.load(std::memory_order_relaxed);
+        out[i].rms = levels[i].rms.load(std::memory_order_relaxed);
+        out[i].clips = levels[i].clips.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+/* ----------------------------------------------------------------------- */
+
+/* ----------------------------MeterEngine-------------------------------- */
+UInt32 MeterEngine::start(AudioDeviceID deviceID, MeterScope scope, UInt32 integrationMs, UInt32 releaseMs){
+    int channels = getDeviceChannelCount(deviceID, scope == METER_INPUT);
+    if(channels <= 0) return 0;
+    Float64 sampleRate = getDeviceSampleRate(deviceID);
+    std::shared_ptr<Meter> meter(new Meter(scope, (UInt32)channels, sampleRate, integrationMs, releaseMs));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::pair<AudioDeviceID, UInt32> key(deviceID, (UInt32)scope);
+    MeterTable::iterator running = meters.find(key);
+    if(running != meters.end()){
+        ioHost.remove(deviceID, running->second);
+        meters.erase(running);
+    }
+    IOPosition position = scope == METER_INPUT ? IO_POSITION_INPUT : IO_POSITION_OUTPUT;
+    if(!ioHost.add(deviceID, position, meter)){
+        publish();
+        return 0;
+    }
+    meters[key] = meter;
+    publish();
+    return (UInt32)channels;
+}
+
+bool MeterEngine::stop(AudioDeviceID deviceID, MeterScope scope){
+    std::lock_guard<std::mutex> lock(mutex);
+    MeterTable::iterator running = meters.find(std::make_pair(deviceID, (UInt32)scope));
+    if(running == meters.end()) return false;
+    ioHost.remove(deviceID, running->second);
+    meters.erase(running);
+    publish();
+    return true;
+}
+
+void MeterEngine::stop(){
+    std::lock_guard<std::mutex> lock(mutex);
+    for(MeterTable::iterator it = meters.begin(); it != meters.end(); ++it){
+        ioHost.remove(it->first.first, it->second);
+    }
+    meters.clear();
+    publish();
+}
+
+std::shared_ptr<const Meter> MeterEngine::find(AudioDeviceID deviceID, MeterScope scope){
+    std::shared_ptr<const MeterTable> table = std::atomic_load(&published);
+    if(!table) return std::shared_ptr<const Meter>();
+    MeterTable::const_iterator found = table->find(std::make_pair(deviceID, (UInt32)scope));
+    if(found == table->end()) return std::shared_ptr<const Meter>();
+    return found->second;
+}
+
+void MeterEngine::publish(){
+    std::atomic_store(&published, std::shared_ptr<const MeterTable>(new MeterTable(meters)));
+}
+/* ----------------------------------------------------------------------- */
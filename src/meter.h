@@ -0,0 +1,156 @@
+#ifndef PYCOREAUDIO_METER_H
+#define PYCOREAUDIO_METER_H
+
+#include "cacompat.h"
+#include "io.h"
+#include "simd.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//Streams a meter measures
+enum MeterScope {
+    METER_INPUT  = 0,   //the input streams of the device
+    METER_OUTPUT = 1    //what the module plays to the output streams, see IOHost
+};
+
+/**
+ * Levels of one channel.
+ */
+struct MeterReading {
+    Float32 peak;           //peak level with release, linear (1.0 is full scale)
+    Float32 rms;            //RMS level over the integration time, linear
+    UInt64 clips;           //samples at or beyond full scale so far
+};
+
+/**
+ * Add the levels of interleaved Float32 samples to per-channel
+ * accumulators: [peak] is raised to the largest absolute sample, the sum
+ * of squares is added to [energy] and the samples at or beyond full
+ * scale to [clips]. Uses the vector kernels of simd::level(), or of
+ * [level] if given.
+ *
+ * @param samples - [frames] frames of [channels] interleaved samples
+ * @param frames - number of frames
+ * @param channels - number of channels
+ * @param peak - one accumulator per channel
+ * @param energy - one accumulator per channel
+ * @param clips - one accumulator per channel
+ */
+void accumulateLevels(const Float32* samples, UInt32 frames, UInt32 channels,
+                      Float32* peak, Float32* energy, UInt32* clips);
+void accumulateLevels(simd::Level level, const Float32* samples, UInt32 frames, UInt32 channels,
+                      Float32* peak, Float32* energy, UInt32* clips);
+
+/**
+ * Per-channel peak/RMS meter, run as a stage of a device's IOProc.
+ *
+ * Every IO cycle the levels of the cycle are measured with the vector
+ * kernels, run through the meter ballistics (exponential peak release,
+ * exponential RMS integration) and published as atomics; read() takes
+ * no lock and can be called from any thread.
+ */
+class Meter : public IOStage {
+public:
+    /**
+     * @param scope - streams to measure
+     * @param channels - number of channels of those streams
+     * @param sampleRate - sample rate of the device, in Hz
+     * @param integrationMs - time constant of the RMS level
+     * @param releaseMs - time constant of the peak release
+     */
+    Meter(MeterScope scope, UInt32 channels, Float64 sampleRate, UInt32 integrationMs, UInt32 releaseMs);
+
+    void process(const AudioBufferList* input, AudioBufferList* output, UInt32 frames, Float64 sampleTime) override;
+
+    /**
+     * Get the current levels.
+     *
+     * @param out - buffer to write to, one reading per channel
+     * @param max - capacity of [out]
+     * @result - number of readings written
+     */
+    size_t read(MeterReading* out, size_t max) const;
+
+    UInt32 channels() const { return channelCount; }
+
+    /**
+     * Get the number of frames measured so far.
+     */
+    UInt64 frames() const { return frameCount.load(std::memory_order_acquire); }
+
+private:
+    struct Level {
+        std::atomic<Float32> peak;
+        std::atomic<Float32> rms;
+        std::atomic<UInt64> clips;
+    };
+
+    MeterScope scope;
+    UInt32 channelCount;
+    Float64 sampleRate;
+    Float64 integrationSeconds;
+    Float64 releaseSeconds;
+    std::unique_ptr<Level[]> levels;            //published, one per channel
+    std::atomic<UInt64> frameCount;
+
+    //IO thread only
+    std::vector<Float32> peakHold;
+    std::vector<Float64> meanSquare;
+    std::vector<Float32> cyclePeak;
+    std::vector<Float32> cycleEnergy;
+    std::vector<UInt32> cycleClips;
+    UInt32 coefficientFrames;                   //cycle length the coefficients below are for
+    Float32 releaseCoefficient;
+    Float64 integrationCoefficient;
+};
+
+/**
+ * The meters of all devices, at most one per device and scope.
+ * find() takes no lock; the table of meters is published RCU-style.
+ */
+class MeterEngine {
+public:
+    /**
+     * Start metering a device. A meter running there already is replaced.
+     *
+     * @param deviceID - ID of the device
+     * @param scope - streams to measure
+     * @param integrationMs - time constant of the RMS level
+     * @param releaseMs - time constant of the peak release
+     * @result - number of channels metered, 0 if the device has none or the IOProc could not be started
+     */
+    UInt32 start(AudioDeviceID deviceID, MeterScope scope, UInt32 integrationMs, UInt32 releaseMs);
+
+    /**
+     * Stop metering a device.
+     *
+     * @result - whether a meter was running
+     */
+    bool stop(AudioDeviceID deviceID, MeterScope scope);
+
+    /**
+     * Stop every meter.
+     */
+    void stop();
+
+    /**
+     * Get the meter of a device, NULL if it is not metered.
+     */
+    std::shared_ptr<const Meter> find(AudioDeviceID deviceID, MeterScope scope);
+
+private:
+    typedef std::map<std::pair<AudioDeviceID, UInt32>, std::shared_ptr<Meter> > MeterTable;
+
+    void publish();     //[mutex] must be held
+
+    std::mutex mutex;                               //guards [meters]
+    MeterTable meters;
+    std::shared_ptr<const MeterTable> published;    //copy of [meters] for find(), atomic access only
+};
+
+extern MeterEngine meterEngine;
+
+#endif //PYCOREAUDIO_METER_H
@@ -0,0 +1,190 @@
+#include "playback.h"
+#include "audio.h"
+#include "gain.h"
+#include <string.h>
+
+PlaybackEngine playbackEngine;
+
+//Shortest wait retryDelay() asks for, so writers do not spin
+static const UInt64 MIN_RETRY_DELAY = 250000;
+
+/* ------------------------------Playback--------------------------------- */
+Playback::Playback(UInt32 channels, size_t capacityFrames, Float64 sampleRate) :
+    channelCount(channels),
+    sampleRate(sampleRate > 0 ? sampleRate : 48000.0),
+    ring(capacityFrames, channels),
+    armed(false),
+    closing(false),
+    written(0),
+    played(0),
+    underruns(0),
+    silence(0),
+    maxQueued(0),
+    cycleFrames(0) {}
+
+void Playback::process(const AudioBufferList* input, AudioBufferList* output, UInt32 frames, Float64 sampleTime){
+    size_t queued = ring.readable();
+    if(queued > maxQueued.load(std::memory_order_relaxed)) maxQueued.store(queued, std::memory_order_relaxed);
+    cycleFrames.store(frames, std::memory_order_relaxed);
+    if(output == NULL) return;
+
+    size_t done = 0;
+    while(done < frames){
+        size_t readable;
+        const Float32* region = ring.readRegion(&readable);
+        if(readable == 0) break;
+        size_t count = frames - done < readable ? frames - done : readable;
+
+        //Spread the frames over the streams in order, mixed into what earlier stages wrote
+        UInt32 offset = 0;
+        for(UInt32 i = 0; i < output->mNumberBuffers; i++){
+            AudioBuffer &buffer = output->mBuffers[i];
+            UInt32 channels = buffer.mNumberChannels;
+            if(offset + channels > channelCount || buffer.mData == NULL) break;
+            if(buffer.mDataByteSize < (UInt64)frames * channels * sizeof(Float32)) break;
+            Float32* target = (Float32*)buffer.mData + done * channels;
+            if(channels == channelCount){
+                for(size_t sample = 0; sample < count * channels; sample++) target[sample] += region[sample];
+            } else {
+                for(size_t frame = 0; frame < count; frame++){
+                    const Float32* source = region + frame * channelCount + offset;
+                    for(UInt32 channel = 0; channel < channels; channel++) target[frame * channels + channel] += source[channel];
+                }
+            }
+            offset += channels;
+        }
+        ring.consume(count);
+        done += count;
+    }
+
+    played.store(played.load(std::memory_order_relaxed) + done, std::memory_order_relaxed);
+    if(done < frames && armed.load(std::memory_order_relaxed)){
+        underruns.store(underruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        silence.store(silence.load(std::memory_order_relaxed) + (frames - done), std::memory_order_relaxed);
+    }
+}
+
+size_t Playback::write(const Float32* samples, size_t frames){
+    size_t done = 0;
+    while(done < frames){
+        size_t writable;
+        Float32* region = ring.writeRegion(&writable);
+        if(writable == 0) break;
+        size_t count = frames - done < writable ? frames - done : writable;
+        memcpy(region, samples + done * channelCount, count * channelCount * sizeof(Float32));
+        ring.produce(count);
+        done += count;
+    }
+    if(done > 0){
+        written.store(written.load(std::memory_order_relaxed) + done, std::memory_order_relaxed);
+        armed.store(true, std::memory_order_relaxed);
+    }
+    return done;
+}
+
+UInt64 Playback::retryDelay(size_t pending) const {
+    size_t capacity = ring.capacity();
+    size_t room = capacity - ring.readable();
+    size_t needed = pending < capacity / 2 ? pending : capacity / 2;
+    if(needed == 0 || room >= needed) return 0;
+    UInt64 delay = (UInt64)((needed - room) * 1e9 / sampleRate);
+    return delay > MIN_RETRY_DELAY ? delay : MIN_RETRY_DELAY;
+}
+
+size_t Playback::drain(){
+    armed.store(false, std::memory_order_relaxed);
+    return ring.readable();
+}
+
+PlaybackStats Playback::stats() const {
+    PlaybackStats stats;
+    stats.written = written.load(std::memory_order_relaxed);
+    stats.played = played.load(std::memory_order_relaxed);
+    stats.underruns = underruns.load(std::memory_order_relaxed);
+    stats.silence = silence.load(std::memory_order_relaxed);
+    stats.queued = ring.readable();
+    stats.maxQueued = maxQueued.load(std::memory_order_relaxed);
+    stats.capacity = ring.capacity();
+    stats.cycleFrames = cycleFrames.load(std::memory_order_relaxed);
+    return stats;
+}
+/* ----------------------------------------------------------------------- */
+
+/* ---------------------------PlaybackEngine------------------------------ */
+UInt32 PlaybackEngine::start(AudioDeviceID deviceID, size_t capacityFrames){
+    int channels = getDeviceChannelCount(deviceID, false);
+    if(channels <= 0) return 0;
+    Float64 sampleRate = getDeviceSampleRate(deviceID);
+    if(capacityFrames == 0) capacityFrames = (size_t)((sampleRate > 0 ? sampleRate : 48000) / 10);
+    std::shared_ptr<Playback> playback(new Playback((UInt32)channels, capacityFrames, sampleRate));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    PlaybackTable::iterator running = playbacks.find(deviceID);
+    if(running != playbacks.end()){
+        running->second->close();
+        ioHost.remove(deviceID, running->second);
+        playbacks.erase(running);
+    }
+    if(!ioHost.add(deviceID, IO_POSITION_SOURCE, playback)){
+        publish();
+        return 0;
+    }
+    playbacks[deviceID] = playback;
+    publish();
+    return (UInt32)channels;
+}
+
+bool PlaybackEngine::stop(AudioDeviceID deviceID){
+    std::lock_guard<std::mutex> lock(mutex);
+    PlaybackTable::iterator running = playbacks.find(deviceID);
+    if(running == playbacks.end()) return false;
+    running->second->close();
+    ioHost.remove(deviceID, running->second);
+    playbacks.erase(running);
+    publish();
+    gainEngine.stop(deviceID);
+    return true;
+}
+
+void PlaybackEngine::stop(){
+    std::lock_guard<std::mutex> lock(mutex);
+    for(PlaybackTable::iterator it = playbacks.begin(); it != playbacks.end(); ++it){
+        it->second->close();
+        ioHost.remove(it->first, it->second);
+    }
+    playbacks.clear();
+    publish();
+    gainEngine.stop();
+}
+
+std::shared_ptr<Playback> PlaybackEngine::find(AudioDeviceID deviceID){
+    std::shared_ptr<const PlaybackTable> table = std::atomic_load(&published);
+    if(!table) return std::shared_ptr<Playback>();
+    PlaybackTable::const_iterator found = table->find(deviceID);
+    if(found == table->end()) return std::shared_ptr<Playback>();
+    return found->second;
+}
+
+bool PlaybackEngine::setGain(AudioDeviceID deviceID, Float32 gain){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(playbacks.find(deviceID) == playbacks.end()) return false;
+    std::shared_ptr<SoftwareGain> stage = gainEngine.find(deviceID);
+    //Full level needs no stage
+    if(!stage && gain >= 1.0f) return true;
+    if(!stage) stage = gainEngine.start(deviceID);
+    if(!stage) return false;
+    stage->setGain(gain);
+    return true;
+}
+
+Float32 PlaybackEngine::gain(AudioDeviceID deviceID){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(playbacks.find(deviceID) == playbacks.end()) return -1.0f;
+    std::shared_ptr<SoftwareGain> stage = gainEngine.find(deviceID);
+    return stage ? stage->gain() : 1.0f;
+}
+
+void PlaybackEngine::publish(){
+    std::atomic_store(&published, std::shared_ptr<const PlaybackTable>(new PlaybackTable(playbacks)));
+}
+/* ----------------------------------------------------------------------- */
@@ -0,0 +1,179 @@
+#ifndef PYCOREAUDIO_PLAYBACK_H
+#define PYCOREAUDIO_PLAYBACK_H
+
+#include "cacompat.h"
+#include "io.h"
+#include "ring.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/**
+ * Counters of a playback.
+ */
+struct PlaybackStats {
+    UInt64 written;         //frames queued by the writer
+    UInt64 played;          //frames handed to the device
+    UInt64 underruns;       //IO cycles the ring ran short of while the writer was still going
+    UInt64 silence;         //frames of silence those cycles played
+    UInt64 queued;          //frames waiting to be played
+    UInt64 maxQueued;       //most frames queued at the start of an IO cycle
+    UInt64 capacity;        //size of the ring in frames
+    UInt32 cycleFrames;     //frames of the last IO cycle
+};
+
+/**
+ * Playback to the output streams of a device, run as a source stage of
+ * its IOProc.
+ *
+ * The writer copies interleaved frames into a preallocated FrameRing,
+ * every IO cycle takes the oldest frames out of it and adds them to the
+ * output streams, in order. A cycle the ring cannot fill plays silence
+ * for the rest and counts as an underrun, unless the writer has drained
+ * the playback, i.e. declared the end of what it had to play. There is
+ * one writer at a time.
+ */
+class Playback : public IOStage {
+public:
+    /**
+     * @param channels - number of output channels of the device
+     * @param capacityFrames - minimum size of the ring, in frames
+     * @param sampleRate - sample rate of the device, in Hz
+     */
+    Playback(UInt32 channels, size_t capacityFrames, Float64 sampleRate);
+
+    void process(const AudioBufferList* input, AudioBufferList* output, UInt32 frames, Float64 sampleTime) override;
+
+    /**
+     * Queue as many frames as there is room for. Never blocks on the IO
+     * thread; the caller waits retryDelay() before writing the rest.
+     *
+     * @param samples - [frames] frames of interleaved samples
+     * @param frames - number of frames
+     * @result - number of frames queued
+     */
+    size_t write(const Float32* samples, size_t frames);
+
+    /**
+     * Get how long a writer with [pending] frames left should wait before
+     * trying again: until the device will have played enough to make room
+     * for them, or for half of the ring if they need more.
+     *
+     * @param pending - number of frames waiting to be written
+     * @result - time to wait in nanoseconds, 0 if there is room already
+     */
+    UInt64 retryDelay(size_t pending) const;
+
+    /**
+     * Declare the end of what is to be played, so the ring running empty
+     * is not counted as an underrun until the next write().
+     *
+     * @result - number of frames still queued
+     */
+    size_t drain();
+
+    /**
+     * Wake up writers and make them give up, see closed().
+     */
+    void close(){ closing.store(true, std::memory_order_release); }
+
+    /**
+     * Whether the playback was stopped.
+     */
+    bool closed() const { return closing.load(std::memory_order_acquire); }
+
+    /**
+     * Get the counters of the playback.
+     */
+    PlaybackStats stats() const;
+
+    UInt32 channels() const { return channelCount; }
+    Float64 rate() const { return sampleRate; }
+
+    /**
+     * Lock held by the writer, so there is one at a time.
+     */
+    std::mutex &writer(){ return writerMutex; }
+
+private:
+    UInt32 channelCount;
+    Float64 sampleRate;
+    FrameRing<Float32> ring;
+    std::atomic<bool> armed;            //the writer is not done, running short is an underrun
+    std::atomic<bool> closing;
+    std::atomic<UInt64> written;
+    std::atomic<UInt64> played;
+    std::atomic<UInt64> underruns;
+    std::atomic<UInt64> silence;
+    std::atomic<UInt64> maxQueued;
+    std::atomic<UInt32> cycleFrames;
+
+    std::mutex writerMutex;             //makes every writer thread the ring's single producer
+};
+
+/**
+ * The playbacks of all devices, at most one per device. find() takes no
+ * lock; the table of playbacks is published RCU-style.
+ */
+class PlaybackEngine {
+public:
+    /**
+     * Start playing to a device. A playback running there already is
+     * stopped and replaced.
+     *
+     * @param deviceID - ID of the device
+     * @param capacityFrames - minimum size of the ring in frames, 0 for 100 ms
+     * @result - number of channels played to, 0 if the device has no output or the IOProc could not be started
+     */
+    UInt32 start(AudioDeviceID deviceID, size_t capacityFrames);
+
+    /**
+     * Stop playing to a device, dropping what is queued, and stop its
+     * gain stage. Blocked writers return.
+     *
+     * @result - whether a playback was running
+     */
+    bool stop(AudioDeviceID deviceID);
+
+    /**
+     * Stop every playback.
+     */
+    void stop();
+
+    /**
+     * Get the playback of a device, NULL if there is none.
+     */
+    std::shared_ptr<Playback> find(AudioDeviceID deviceID);
+
+    /**
+     * Scale what is played to a device, ramped over 20 ms, see
+     * SoftwareGain. The gain stage runs until the playback is stopped; a
+     * playback that replaces another keeps its gain.
+     *
+     * @param deviceID - ID of the device
+     * @param gain - linear gain, 0.0-1.0
+     * @result - false if the device has no playback or the stage could not be started
+     */
+    bool setGain(AudioDeviceID deviceID, Float32 gain);
+
+    /**
+     * Get the gain of the playback of a device.
+     *
+     * @result - linear gain, 1.0 until set, -1 if the device has no playback
+     */
+    Float32 gain(AudioDeviceID deviceID);
+
+private:
+    typedef std::map<AudioDeviceID, std::shared_ptr<Playback> > PlaybackTable;
+
+    void publish();     //[mutex] must be held
+
+    std::mutex mutex;                                   //guards [playbacks]
+    PlaybackTable playbacks;
+    std::shared_ptr<const PlaybackTable> published;     //copy of [playbacks] for find(), atomic access only
+};
+
+extern PlaybackEngine playbackEngine;
+
+#endif //PYCOREAUDIO_PLAYBACK_H
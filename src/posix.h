@@ -0,0 +1,83 @@
+#ifndef PYCOREAUDIO_POSIX_H
+#define PYCOREAUDIO_POSIX_H
+
+#include "cacompat.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Small POSIX helpers shared by the threads that hand results to Python
+ * (EventWatcher, FadeEngine, WorkerPool) and by the simulated HAL.
+ */
+
+/**
+ * Read the monotonic clock, the time base of all event, fade and
+ * completion timestamps.
+ *
+ * @result - nanoseconds since an arbitrary point, never going backwards
+ */
+inline UInt64 monotonicNanoseconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (UInt64)now.tv_sec * 1000000000ull + (UInt64)now.tv_nsec;
+}
+
+/**
+ * A non-blocking, close-on-exec pipe whose read end is readable while
+ * something is waiting, for select()/poll()/asyncio integration.
+ *
+ * If the pipe cannot be created fd() is -1 and signal()/drain() do
+ * nothing, which leaves the blocking APIs working.
+ */
+class WakeupPipe {
+public:
+    WakeupPipe(){
+        fds[0] = fds[1] = -1;
+        if(pipe(fds) == 0){
+            for(int fd : fds){
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+        }
+    }
+
+    ~WakeupPipe(){
+        for(int fd : fds){
+            if(fd >= 0) close(fd);
+        }
+    }
+
+    WakeupPipe(const WakeupPipe&) = delete;
+    WakeupPipe& operator=(const WakeupPipe&) = delete;
+
+    /**
+     * Make the read end readable.
+     */
+    void signal(){
+        char byte = 1;
+        //A full pipe already means "readable", so EAGAIN is fine
+        ssize_t written = write(fds[1], &byte, 1);
+        (void)written;
+    }
+
+    /**
+     * Empty the pipe, so the read end is no longer readable.
+     */
+    void drain(){
+        char buffer[64];
+        while(read(fds[0], buffer, sizeof(buffer)) > 0){}
+    }
+
+    /**
+     * @result - the read end, or -1 if the pipe could not be created
+     */
+    int fd() const {
+        return fds[0];
+    }
+
+private:
+    int fds[2];
+};
+
+#endif //PYCOREAUDIO_POSIX_H
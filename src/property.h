@@ -0,0 +1,230 @@
+#ifndef PYCOREAUDIO_PROPERTY_H
+#define PYCOREAUDIO_PROPERTY_H
+
+#include "cacompat.h"
+#include "hal.h"
+#include <stddef.h>
+
+/*
+ * Typed property layer.
+ *
+ * Every HAL property the module uses is described by a constexpr
+ * Property<T, Policy>: its address plus the type of its value and how it
+ * is laid out over the elements of a device. The get/set paths below are
+ * generated from the descriptor at compile time; they work on channel
+ * spans and values on the caller's stack and never allocate.
+ */
+
+//How a property is spread over the elements of an object
+enum ElementPolicy {
+    ELEMENT_SINGLE,         //one value, on the element given by the descriptor
+    ELEMENT_PER_CHANNEL     //one value per channel, addressed through a ChannelSpan
+};
+
+/**
+ * Descriptor of a HAL property. It is an AudioObjectPropertyAddress, so
+ * it can be handed to the HAL (and to older code) as is.
+ */
+template <typename T, ElementPolicy Policy>
+struct Property : AudioObjectPropertyAddress {
+    typedef T ValueType;
+    static const ElementPolicy policy = Policy;
+
+    constexpr Property(AudioObjectPropertySelector selector, AudioObjectPropertyScope scope,
+                       AudioObjectPropertyElement element)
+        : AudioObjectPropertyAddress{ selector, scope, element } {}
+
+    /**
+     * Address of the property on [element].
+     */
+    AudioObjectPropertyAddress on(AudioObjectPropertyElement element) const {
+        AudioObjectPropertyAddress address = *this;
+        address.mElement = element;
+        return address;
+    }
+};
+
+/**
+ * Non-owning view of a list of channels (property elements).
+ */
+struct ChannelSpan {
+    const int* channels;
+    size_t count;
+
+    ChannelSpan() : channels(NULL), count(0) {}
+    ChannelSpan(const int* channels, size_t count) : channels(channels), count(count) {}
+    template <size_t N>
+    ChannelSpan(const int (&channels)[N]) : channels(channels), count(N) {}
+
+    const int* begin() const { return channels; }
+    const int* end() const { return channels + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+};
+
+//The main element on its own; some devices only have their controls there
+const int MAIN_CHANNEL[1] = { 0 };
+
+/**
+ * Values read from several channels. The storage lives inside the
+ * object, i.e. on the caller's stack; reads beyond [Capacity] channels
+ * fail instead of growing it.
+ */
+template <typename T, size_t Capacity>
+struct ChannelValues {
+    T values[Capacity];
+    size_t count;
+
+    ChannelValues() : count(0) {}
+
+    const T* begin() const { return values; }
+    const T* end() const { return values + count; }
+    size_t size() const { return count; }
+    static size_t capacity() { return Capacity; }
+};
+
+//Enough for any real device; getValidChannels() stops after a few gaps anyway
+const size_t MAX_CHANNELS = 128;
+
+namespace property {
+
+/**
+ * Read a single valued property.
+ *
+ * @param objectID - object to read from
+ * @param property - descriptor of the property
+ * @param value - receives the value
+ * @result - whether the read succeeded
+ */
+template <typename T>
+bool get(AudioObjectID objectID, const Property<T, ELEMENT_SINGLE> &property, T &value){
+    UInt32 dataSize = sizeof(T);
+    return hal::getPropertyData(objectID, &property, 0, NULL, &dataSize, &value) == kAudioHardwareNoError;
+}
+
+/**
+ * Write a single valued property.
+ *
+ * @param objectID - object to write to
+ * @param property - descriptor of the property
+ * @param value - value to set
+ * @result - whether the write succeeded
+ */
+template <typename T>
+bool set(AudioObjectID objectID, const Property<T, ELEMENT_SINGLE> &property, T value){
+    return hal::setPropertyData(objectID, &property, 0, NULL, sizeof(T), &value) == kAudioHardwareNoError;
+}
+
+/**
+ * Read a per-channel property from a single channel.
+ *
+ * @param objectID - object to read from
+ * @param property - descriptor of the property
+ * @param channel - element to read
+ * @param value - receives the value
+ * @result - whether the read succeeded
+ */
+template <typename T>
+bool get(AudioObjectID objectID, const Property<T, ELEMENT_PER_CHANNEL> &property, int channel, T &value){
+    AudioObjectPropertyAddress address = property.on(channel);
+    UInt32 dataSize = sizeof(T);
+    return hal::getPropertyData(objectID, &address, 0, NULL, &dataSize, &value) == kAudioHardwareNoError;
+}
+
+/**
+ * Write a per-channel property on a single channel.
+ *
+ * @param objectID - object to write to
+ * @param property - descriptor of the property
+ * @param channel - element to write
+ * @param value - value to set
+ * @result - whether the write succeeded
+ */
+template <typename T>
+bool set(AudioObjectID objectID, const Property<T, ELEMENT_PER_CHANNEL> &property, int channel, T value){
+    AudioObjectPropertyAddress address = property.on(channel);
+    return hal::setPropertyData(objectID, &address, 0, NULL, sizeof(T), &value) == kAudioHardwareNoError;
+}
+
+/**
+ * Write the same value on every channel of [channels]. All channels are
+ * tried even if one fails.
+ *
+ * @param objectID - object to write to
+ * @param property - descriptor of the property
+ * @param channels - elements to write
+ * @param value - value to set
+ * @result - whether every write succeeded
+ */
+template <typename T>
+bool set(AudioObjectID objectID, const Property<T, ELEMENT_PER_CHANNEL> &property, ChannelSpan channels, T value){
+    bool ok = true;
+    for(int channel : channels){
+        ok = set(objectID, property, channel, value) && ok;
+    }
+    return ok;
+}
+
+/**
+ * Read every channel of [channels].
+ *
+ * @param objectID - object to read from
+ * @param property - descriptor of the property
+ * @param channels - elements to read
+ * @param values - receives one value per channel
+ * @result - whether every read succeeded and fit into [values]
+ */
+template <typename T, size_t Capacity>
+bool get(AudioObjectID objectID, const Property<T, ELEMENT_PER_CHANNEL> &property, ChannelSpan channels,
+         ChannelValues<T, Capacity> &values){
+    values.count = 0;
+    if(channels.size() > Capacity) return false;
+    for(int channel : channels){
+        if(!get(objectID, property, channel, values.values[values.count])) return false;
+        values.count++;
+    }
+    return true;
+}
+
+/**
+ * Write one value per channel of [channels]. All channels are tried
+ * even if one fails.
+ *
+ * @param objectID - object to write to
+ * @param property - descriptor of the property
+ * @param channels - elements to write
+ * @param values - one value per channel, in the order of [channels]
+ * @result - whether every write succeeded
+ */
+template <typename T>
+bool set(AudioObjectID objectID, const Property<T, ELEMENT_PER_CHANNEL> &property, ChannelSpan channels,
+         const T* values){
+    bool ok = true;
+    for(size_t i = 0; i < channels.size(); i++){
+        ok = set(objectID, property, channels.channels[i], values[i]) && ok;
+    }
+    return ok;
+}
+
+/**
+ * Read every channel of [channels] into caller-owned storage. All
+ * channels are tried even if one fails; a failed one is left as it was.
+ *
+ * @param objectID - object to read from
+ * @param property - descriptor of the property
+ * @param channels - elements to read
+ * @param values - receives one value per channel, room for channels.size()
+ * @result - whether every read succeeded
+ */
+template <typename T>
+bool get(AudioObjectID objectID, const Property<T, ELEMENT_PER_CHANNEL> &property, ChannelSpan channels, T* values){
+    bool ok = true;
+    for(size_t i = 0; i < channels.size(); i++){
+        ok = get(objectID, property, channels.channels[i], values[i]) && ok;
+    }
+    return ok;
+}
+
+} //namespace property
+
+#endif //PYCOREAUDIO_PROPERTY_H
@@ -0,0 +1,231 @@
+#include "registry.h"
+#include "hal.h"
+#include "trace.h"
+
+DeviceRegistry deviceRegistry;
+
+//Per-device properties whose change invalidates a cached entry
+static const AudioObjectPropertyAddress* const watchedDeviceProperties[] = {
+    &properties::name,
+    &properties::instreams,
+    &properties::outstreams
+};
+
+DeviceRegistry::DeviceRegistry() : listening(false), dirty(true), listDirty(true) {}
+
+bool DeviceRegistry::start(){
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    if(listening) return true;
+    OSStatus result = hal::addPropertyListener(kAudioObjectSystemObject, &properties::count,
+                                               onDeviceListChanged, this);
+    listening = (result == kAudioHardwareNoError);
+
+    std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+    listDirty = true;
+    dirty = true;
+    return listening;
+}
+
+void DeviceRegistry::stop(){
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    if(listening){
+        hal::removePropertyListener(kAudioObjectSystemObject, &properties::count, onDeviceListChanged, this);
+    }
+    while(!watched.empty()) unwatchDevice(*watched.begin());
+    listening = false;
+    std::atomic_store(&current, DeviceSnapshot());
+    byUID.clear();
+    byName.clear();
+
+    std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+    listDirty = true;
+    dirty = true;
+    dirtyDevices.clear();
+}
+
+void DeviceRegistry::watchDevice(AudioDeviceID deviceID){
+    for(const AudioObjectPropertyAddress* address : watchedDeviceProperties){
+        hal::addPropertyListener(deviceID, address, onDeviceChanged, this);
+    }
+    watched.insert(deviceID);
+}
+
+void DeviceRegistry::unwatchDevice(AudioDeviceID deviceID){
+    //Fails harmlessly if the device is already gone
+    for(const AudioObjectPropertyAddress* address : watchedDeviceProperties){
+        hal::removePropertyListener(deviceID, address, onDeviceChanged, this);
+    }
+    watched.erase(deviceID);
+}
+
+//getDeviceUID() and getDeviceName() return this when the HAL call fails
+static const char UNKNOWN[] = "Unknown";
+
+void DeviceRegistry::indexDevice(const DeviceInfo &info){
+    if(info.uid != UNKNOWN) byUID[info.uid] = info.id;
+    if(info.name != UNKNOWN) byName.insert(std::make_pair(info.name, info.id));
+}
+
+void DeviceRegistry::unindexDevice(const DeviceInfo &info){
+    //Another device may have taken over the UID meanwhile, e.g. on a re-plug
+    std::unordered_map<std::string, AudioDeviceID>::iterator uid = byUID.find(info.uid);
+    if(uid != byUID.end() && uid->second == info.id) byUID.erase(uid);
+
+    typedef std::unordered_multimap<std::string, AudioDeviceID>::iterator NameIterator;
+    std::pair<NameIterator, NameIterator> names = byName.equal_range(info.name);
+    for(NameIterator name = names.first; name != names.second; ++name){
+        if(name->second == info.id){
+            byName.erase(name);
+            break;
+        }
+    }
+}
+
+DeviceSnapshot DeviceRegistry::snapshot(){
+    if(!dirty.load(std::memory_order_acquire)){
+        DeviceSnapshot published = std::atomic_load(&current);
+        if(published) return published;
+    }
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    if(!refresh()) return DeviceSnapshot();
+    return current;
+}
+
+bool DeviceRegistry::findByUID(const std::string &uid, AudioDeviceID &deviceID){
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    if(!refresh()) return false;
+    std::unordered_map<std::string, AudioDeviceID>::const_iterator found = byUID.find(uid);
+    if(found == byUID.end()) return false;
+    deviceID = found->second;
+    return true;
+}
+
+bool DeviceRegistry::findByName(const std::string &name, AudioDeviceID &deviceID){
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    if(!refresh()) return false;
+    typedef std::unordered_multimap<std::string, AudioDeviceID>::const_iterator NameIterator;
+    std::pair<NameIterator, NameIterator> names = byName.equal_range(name);
+    if(names.first == names.second) return false;
+    deviceID = names.first->second;
+    for(NameIterator found = names.first; found != names.second; ++found){
+        if(found->second < deviceID) deviceID = found->second;
+    }
+    return true;
+}
+
+void DeviceRegistry::seed(const std::vector<DeviceInfo> &devices){
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    //Without listeners, every snapshot() queries the HAL anyway
+    if(!listening || current) return;
+    for(const DeviceInfo &info : devices) indexDevice(info);
+    std::atomic_store(&current, DeviceSnapshot(new std::vector<DeviceInfo>(devices)));
+
+    //A change since start() is picked up by revalidate()
+    std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+    listDirty = false;
+    dirtyDevices.clear();
+    dirty = false;
+}
+
+bool DeviceRegistry::revalidate(){
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    {
+        //Unlike the listeners, leave [dirty] alone so snapshot() stays lock-free
+        std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+        listDirty = true;
+        if(current){
+            for(const DeviceInfo &info : *current) dirtyDevices.insert(info.id);
+        }
+    }
+    return refresh();
+}
+
+bool DeviceRegistry::refresh(){
+    //Take the change flags first, anything firing from now on triggers another refresh
+    bool listChanged;
+    std::set<AudioDeviceID> changed;
+    {
+        std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+        listChanged = listDirty || !listening;
+        listDirty = false;
+        changed.swap(dirtyDevices);
+    }
+    if(current && !listChanged && changed.empty()){
+        settle();
+        return true;
+    }
+
+    std::vector<AudioDeviceID> deviceIDs;
+    if(listChanged || !current){
+        if(!getDeviceIDs(deviceIDs)){
+            std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+            listDirty = true;
+            return false;
+        }
+    } else {
+        for(const DeviceInfo &info : *current) deviceIDs.push_back(info.id);
+    }
+
+    std::map<AudioDeviceID, const DeviceInfo*> known;
+    if(current){
+        for(const DeviceInfo &info : *current) known[info.id] = &info;
+    }
+
+    //Only the entries that are queried again, added or gone touch the index
+    std::vector<DeviceInfo>* devices = new std::vector<DeviceInfo>();
+    devices->reserve(deviceIDs.size());
+    for(AudioDeviceID deviceID : deviceIDs){
+        std::map<AudioDeviceID, const DeviceInfo*>::const_iterator cached = known.find(deviceID);
+        if(listening && cached != known.end() && changed.count(deviceID) == 0){
+            devices->push_back(*cached->second);
+            continue;
+        }
+        //Listen before querying, so a change in between is not lost
+        if(listening && watched.count(deviceID) == 0) watchDevice(deviceID);
+        devices->push_back(getDeviceInfo(deviceID));
+        if(cached != known.end()) unindexDevice(*cached->second);
+        indexDevice(devices->back());
+    }
+
+    std::set<AudioDeviceID> present(deviceIDs.begin(), deviceIDs.end());
+    for(const std::pair<const AudioDeviceID, const DeviceInfo*> &entry : known){
+        if(present.count(entry.first) == 0) unindexDevice(*entry.second);
+    }
+    if(listening){
+        std::vector<AudioDeviceID> gone;
+        for(AudioDeviceID deviceID : watched){
+            if(present.count(deviceID) == 0) gone.push_back(deviceID);
+        }
+        for(AudioDeviceID deviceID : gone) unwatchDevice(deviceID);
+    }
+
+    std::atomic_store(&current, DeviceSnapshot(devices));
+    settle();
+    return true;
+}
+
+void DeviceRegistry::settle(){
+    //Let snapshot() skip the lock again once the published snapshot is current
+    std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+    if(listening && !listDirty && dirtyDevices.empty()) dirty = false;
+}
+
+OSStatus DeviceRegistry::onDeviceListChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                             const AudioObjectPropertyAddress* addresses, void* clientData){
+    trace::Scope scope(trace::CATEGORY_LISTENER, "DeviceRegistry::onDeviceListChanged", objectID, numberAddresses ? addresses[0].mSelector : 0);
+    DeviceRegistry* registry = static_cast<DeviceRegistry*>(clientData);
+    std::lock_guard<std::mutex> lock(registry->dirtyMutex);
+    registry->listDirty = true;
+    registry->dirty = true;
+    return kAudioHardwareNoError;
+}
+
+OSStatus DeviceRegistry::onDeviceChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                         const AudioObjectPropertyAddress* addresses, void* clientData){
+    trace::Scope scope(trace::CATEGORY_LISTENER, "DeviceRegistry::onDeviceChanged", objectID, numberAddresses ? addresses[0].mSelector : 0);
+    DeviceRegistry* registry = static_cast<DeviceRegistry*>(clientData);
+    std::lock_guard<std::mutex> lock(registry->dirtyMutex);
+    registry->dirtyDevices.insert(objectID);
+    registry->dirty = true;
+    return kAudioHardwareNoError;
+}
@@ -0,0 +1,117 @@
+#ifndef PYCOREAUDIO_REGISTRY_H
+#define PYCOREAUDIO_REGISTRY_H
+
+#include "audio.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::shared_ptr<const std::vector<DeviceInfo> > DeviceSnapshot;
+
+/**
+ * Cache of the metadata of all devices.
+ *
+ * While started, the registry listens for changes of the device list
+ * (kAudioHardwarePropertyDevices) and of the name and stream layout of
+ * every known device. A snapshot is only rebuilt when one of those
+ * listeners fired, and only the devices that changed are queried again,
+ * so a warm snapshot() makes no HAL calls at all.
+ *
+ * Snapshots are immutable and shared, they stay valid after the
+ * registry has moved on to a newer one. The current one is published
+ * RCU-style: while no listener fired, snapshot() takes no lock.
+ */
+class DeviceRegistry {
+public:
+    DeviceRegistry();
+
+    /**
+     * Install the HAL listeners and start caching.
+     *
+     * @result - whether the listeners could be installed. If not, the
+     *           registry keeps working, but without caching.
+     */
+    bool start();
+
+    /**
+     * Remove all listeners and drop the cached snapshot.
+     */
+    void stop();
+
+    /**
+     * Get the current device list, refreshing the entries that changed
+     * since the last call.
+     *
+     * @result - device list, or NULL if it could not be retrieved
+     */
+    DeviceSnapshot snapshot();
+
+    /**
+     * Find a device by UID, refreshing the registry first like snapshot().
+     * The index is kept up to date along with the snapshot, so a warm
+     * lookup is a single hash probe.
+     *
+     * @param uid - UID of the device
+     * @param deviceID - receives the ID of the device
+     * @result - whether a device with that UID is present
+     */
+    bool findByUID(const std::string &uid, AudioDeviceID &deviceID);
+
+    /**
+     * Find a device by name, see findByUID(). Names need not be unique;
+     * among devices of the same name, the lowest ID wins.
+     */
+    bool findByName(const std::string &name, AudioDeviceID &deviceID);
+
+    /**
+     * Publish a device list known from elsewhere (devcache.h) as the
+     * first snapshot, right after start(). It is served as is until
+     * revalidate() queried every device.
+     *
+     * @param devices - device list, by ID
+     */
+    void seed(const std::vector<DeviceInfo> &devices);
+
+    /**
+     * Query the device list and every device again, as if all listeners
+     * had fired. snapshot() keeps serving the previous snapshot without
+     * a lock meanwhile.
+     *
+     * @result - whether the device list could be retrieved
+     */
+    bool revalidate();
+
+private:
+    static OSStatus onDeviceListChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                        const AudioObjectPropertyAddress* addresses, void* clientData);
+    static OSStatus onDeviceChanged(AudioObjectID objectID, UInt32 numberAddresses,
+                                    const AudioObjectPropertyAddress* addresses, void* clientData);
+
+    void watchDevice(AudioDeviceID deviceID);
+    void unwatchDevice(AudioDeviceID deviceID);
+    bool refresh();     //[refreshMutex] must be held
+    void settle();      //[refreshMutex] must be held
+    void indexDevice(const DeviceInfo &info);
+    void unindexDevice(const DeviceInfo &info);
+
+    std::mutex refreshMutex;                    //guards the snapshot, its index and the listener bookkeeping
+    DeviceSnapshot current;                     //also read without the lock, atomic access only
+    std::unordered_map<std::string, AudioDeviceID> byUID;
+    std::unordered_multimap<std::string, AudioDeviceID> byName;
+    std::set<AudioDeviceID> watched;
+    bool listening;
+
+    std::mutex dirtyMutex;                      //guards the change flags set by the listeners
+    std::atomic<bool> dirty;                    //whether a flag below is set or the registry is not listening
+    bool listDirty;
+    std::set<AudioDeviceID> dirtyDevices;
+};
+
+extern DeviceRegistry deviceRegistry;
+
+#endif //PYCOREAUDIO_REGISTRY_H
@@ -0,0 +1,171 @@
+#ifndef PYCOREAUDIO_RING_H
+#define PYCOREAUDIO_RING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+/**
+ * Bounded lock-free single-producer/single-consumer queue.
+ *
+ * All memory is allocated by the constructor; push() and pop() never
+ * allocate, block or take locks, so the producer side may run on a HAL
+ * notification or realtime thread. The capacity is rounded up to a
+ * power of two.
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t minCapacity) : head(0), tail(0) {
+        size_t capacity = 1;
+        while(capacity < minCapacity) capacity <<= 1;
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    /**
+     * Append an item. Producer side only.
+     *
+     * @param item - item to append
+     * @param wasEmpty - if not NULL, set to whether the consumer had
+     *                   already taken everything before this item, i.e.
+     *                   whether it may be waiting and needs a wakeup
+     * @result - false if the ring is full and the item was dropped
+     */
+    bool push(const T &item, bool* wasEmpty = NULL){
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) > mask) return false;
+        slots[t & mask] = item;
+        //seq_cst pairs with pop(), so either we see the consumer caught up or it sees this item
+        tail.store(t + 1, std::memory_order_seq_cst);
+        if(wasEmpty) *wasEmpty = head.load(std::memory_order_seq_cst) == t;
+        return true;
+    }
+
+    /**
+     * Take up to [max] items. Consumer side only.
+     *
+     * @param out - buffer to write to
+     * @param max - capacity of [out]
+     * @result - number of items taken
+     */
+    size_t pop(T* out, size_t max){
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t available = tail.load(std::memory_order_acquire) - h;
+        size_t count = available < max ? available : max;
+        for(size_t i = 0; i < count; i++) out[i] = slots[(h + i) & mask];
+        head.store(h + count, std::memory_order_seq_cst);
+        return count;
+    }
+
+    /**
+     * Whether there is nothing to take. Consumer side only.
+     */
+    bool empty() const {
+        return tail.load(std::memory_order_seq_cst) == head.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head;   //next slot to read, written by the consumer
+    alignas(64) std::atomic<size_t> tail;   //next slot to write, written by the producer
+};
+
+/**
+ * Bounded lock-free single-producer/single-consumer ring of audio
+ * frames, [channels] interleaved samples each.
+ *
+ * Both sides work on the ring's own memory: the producer fills the
+ * region writeRegion() hands out and commits it with produce(), the
+ * consumer reads the region readRegion() hands out and frees it with
+ * consume(). A region stays untouched by the other side until it is
+ * committed, so the consumer can lend it out without a copy. Regions end
+ * at the end of the ring; a wrapped span takes two of them. All memory
+ * is allocated by the constructor and the capacity is rounded up to a
+ * power of two frames.
+ */
+template <typename T>
+class FrameRing {
+public:
+    FrameRing(size_t minFrames, size_t channels) : channelCount(channels), head(0), tail(0) {
+        size_t capacity = 1;
+        while(capacity < minFrames) capacity <<= 1;
+        samples.resize(capacity * channels);
+        mask = capacity - 1;
+    }
+
+    /**
+     * Get the free frames up to the end of the ring. Producer side only.
+     *
+     * @param frames - set to the number of frames that can be written there
+     * @result - first sample of the region
+     */
+    T* writeRegion(size_t* frames){
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t free = mask + 1 - (t - head.load(std::memory_order_acquire));
+        size_t start = t & mask;
+        *frames = free < mask + 1 - start ? free : mask + 1 - start;
+        return &samples[start * channelCount];
+    }
+
+    /**
+     * Commit [frames] frames written to writeRegion(). Producer side only.
+     */
+    void produce(size_t frames){
+        tail.store(tail.load(std::memory_order_relaxed) + frames, std::memory_order_release);
+    }
+
+    /**
+     * Get the queued frames up to the end of the ring. Consumer side only.
+     *
+     * @param frames - set to the number of frames that can be read there
+     * @result - first sample of the region
+     */
+    T* readRegion(size_t* frames){
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t queued = tail.load(std::memory_order_acquire) - h;
+        size_t start = h & mask;
+        *frames = queued < mask + 1 - start ? queued : mask + 1 - start;
+        return &samples[start * channelCount];
+    }
+
+    /**
+     * Free [frames] frames read from readRegion(). Consumer side only.
+     */
+    void consume(size_t frames){
+        head.store(head.load(std::memory_order_relaxed) + frames, std::memory_order_release);
+    }
+
+    /**
+     * Get the number of queued frames. Exact on the consumer side, a lower
+     * bound on the producer side; a snapshot anywhere else.
+     */
+    size_t readable() const {
+        size_t h = head.load(std::memory_order_acquire);   //before [tail], so it cannot be ahead of it
+        return tail.load(std::memory_order_acquire) - h;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    size_t channels() const {
+        return channelCount;
+    }
+
+private:
+    std::vector<T> samples;
+    size_t channelCount;
+    size_t mask;
+    //Padded rather than aligned apart: rings are allocated with new, which ignores over-alignment before C++17
+    std::atomic<size_t> head;               //next frame to read, written by the consumer
+    char padding[64];
+    std::atomic<size_t> tail;               //next frame to write, written by the producer
+};
+
+#endif //PYCOREAUDIO_RING_H
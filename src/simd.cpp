@@ -0,0 +1,56 @@
+#include "simd.h"
+#include <atomic>
+
+namespace simd {
+
+static std::atomic<int> selected(-1);     //-1 until first needed
+
+Level detect(){
+#if defined(PYCOREAUDIO_SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return LEVEL_AVX2;
+    if(__builtin_cpu_supports("sse2")) return LEVEL_SSE2;
+    return LEVEL_SCALAR;
+#elif defined(PYCOREAUDIO_SIMD_NEON)
+    return LEVEL_NEON;      //part of every ARM64 CPU
+#else
+    return LEVEL_SCALAR;
+#endif
+}
+
+bool supported(Level level){
+    if(level == LEVEL_SCALAR) return true;
+    Level best = detect();
+#if defined(PYCOREAUDIO_SIMD_X86)
+    return level != LEVEL_NEON && level <= best;
+#else
+    return level == best;
+#endif
+}
+
+Level level(){
+    int current = selected.load(std::memory_order_relaxed);
+    if(current < 0){
+        current = detect();
+        selected.store(current, std::memory_order_relaxed);
+    }
+    return (Level)current;
+}
+
+bool setLevel(Level level){
+    if(!supported(level)) return false;
+    selected.store(level, std::memory_order_relaxed);
+    return true;
+}
+
+const char* name(Level level){
+    switch(level){
+        case LEVEL_SSE2: return "sse2";
+        case LEVEL_AVX2: return "avx2";
+        case LEVEL_NEON: return "neon";
+        case LEVEL_SCALAR:
+        default:         return "scalar";
+    }
+}
+
+}; //namespace simd
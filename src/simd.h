@@ -0,0 +1,57 @@
+#ifndef PYCOREAUDIO_SIMD_H
+#define PYCOREAUDIO_SIMD_H
+
+#include "cacompat.h"
+
+/*
+ * Runtime selection of the vectorized sample kernels.
+ *
+ * Kernels are built for every instruction set the compiler can target
+ * next to a scalar version: SSE2 and AVX2 on x86-64, NEON on ARM64. The
+ * best one the CPU supports is picked when first needed, so one binary
+ * runs everywhere.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+    #define PYCOREAUDIO_SIMD_X86 1
+    //Functions using AVX2 intrinsics must be marked, the rest of the build targets the baseline
+    #define PYCOREAUDIO_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+    #define PYCOREAUDIO_SIMD_NEON 1
+#endif
+
+namespace simd {
+
+enum Level {
+    LEVEL_SCALAR = 0,
+    LEVEL_SSE2   = 1,
+    LEVEL_AVX2   = 2,
+    LEVEL_NEON   = 3
+};
+
+/**
+ * Get the best level supported by both the build and the CPU.
+ */
+Level detect();
+
+/**
+ * Whether kernels of [level] can run here.
+ */
+bool supported(Level level);
+
+/**
+ * Get the level the kernels use, detect() unless changed.
+ */
+Level level();
+
+/**
+ * Make the kernels use another level, e.g. to compare them.
+ *
+ * @result - false if [level] is not supported, nothing is changed then
+ */
+bool setLevel(Level level);
+
+const char* name(Level level);
+
+}; //namespace simd
+
+#endif //PYCOREAUDIO_SIMD_H
@@ -0,0 +1,333 @@
+#include "stats.h"
+#include "trace.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace stats {
+
+namespace {
+
+const UInt32 HAL_SLOTS = 64;        //(op, selector) pairs a shard can tell apart, a power of two
+const UInt32 ERROR_SLOTS = 16;      //distinct OSStatus values a shard can tell apart, a power of two
+
+//Written by the owning thread only, read by anyone
+struct Counter {
+    std::atomic<UInt64> calls;
+    std::atomic<UInt64> errors;
+    std::atomic<UInt64> timed;
+    std::atomic<UInt64> ticks;
+    std::atomic<UInt64> buckets[BUCKETS];
+};
+
+struct HalSlot {
+    std::atomic<UInt64> key;        //(op + 1) << 32 | selector, 0 while free
+    Counter counter;
+};
+
+struct ErrorSlot {
+    std::atomic<UInt64> key;        //1 << 32 | status, 0 while free
+    std::atomic<UInt64> count;
+};
+
+//Everything one thread counts. Shards are never freed, the shard of a
+//thread that ended is handed to the next new thread.
+struct Shard {
+    Counter api[API_COUNT];
+    HalSlot hal[HAL_SLOTS];
+    ErrorSlot errors[ERROR_SLOTS];
+    std::atomic<UInt64> dropped;
+};
+
+//Counts merged over the shards, still in ticks
+struct Sum {
+    UInt64 calls, errors, timed, ticks, buckets[BUCKETS];
+
+    Sum() : calls(0), errors(0), timed(0), ticks(0) {
+        for(UInt32 b = 0; b < BUCKETS; b++) buckets[b] = 0;
+    }
+
+    void add(const Counter &counter){
+        calls += counter.calls.load(std::memory_order_relaxed);
+        errors += counter.errors.load(std::memory_order_relaxed);
+        timed += counter.timed.load(std::memory_order_relaxed);
+        ticks += counter.ticks.load(std::memory_order_relaxed);
+        for(UInt32 b = 0; b < BUCKETS; b++) buckets[b] += counter.buckets[b].load(std::memory_order_relaxed);
+    }
+
+    void subtract(const Sum &other){
+        calls -= other.calls;
+        errors -= other.errors;
+        timed -= other.timed;
+        ticks -= other.ticks;
+        for(UInt32 b = 0; b < BUCKETS; b++) buckets[b] -= other.buckets[b];
+    }
+};
+
+struct Totals {
+    Sum api[API_COUNT];
+    std::map<UInt64, Sum> hal;
+    std::map<OSStatus, UInt64> errors;
+    UInt64 dropped;
+
+    Totals() : dropped(0) {}
+};
+
+typedef std::chrono::steady_clock steady;
+
+struct Registry {
+    std::mutex mutex;               //guards everything below
+    std::vector<Shard*> shards;     //every shard ever made
+    std::vector<Shard*> unused;     //shards of threads that ended
+    Totals baseline;                //counts at the last reset()
+    UInt64 originTicks;             //when the first shard was made, to calibrate ticks()
+    steady::time_point origin;
+
+    Registry() : originTicks(ticks()), origin(steady::now()) {}
+};
+
+//Never destroyed, threads may still record while the process exits
+Registry& registry(){
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+//What the calling thread needs on every call, in one place
+struct Local {
+    Shard* shard;
+    UInt32 depth;                   //entry points being counted
+    UInt32 random;                  //xorshift state picking the calls to time, 0 until seeded
+};
+
+thread_local Local local = { NULL, 0, 0 };
+
+//Hands the shard back when its thread ends
+struct Owner {
+    Shard* shard;
+
+    ~Owner(){
+        if(!shard) return;
+        local.shard = NULL;
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.unused.push_back(shard);
+    }
+};
+
+thread_local Owner owner = { NULL };
+
+Shard* attach(){
+    Registry &r = registry();
+    Shard* shard;
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if(r.unused.empty()){
+            shard = new Shard();    //value-initialized, all zero
+            r.shards.push_back(shard);
+        }
+        else {
+            shard = r.unused.back();
+            r.unused.pop_back();
+        }
+    }
+    //After the thread's destructors ran, the shard stays with it for good
+    if(!owner.shard) owner.shard = shard;
+    local.shard = shard;
+    return shard;
+}
+
+inline Shard* shard(){
+    Shard* shard = local.shard;
+    return shard ? shard : attach();
+}
+
+inline void add(std::atomic<UInt64> &counter, UInt64 value){
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+inline void count(Counter &counter, UInt64 start, bool error){
+    add(counter.calls, 1);
+    if(error) add(counter.errors, 1);
+    if(!start) return;
+    UInt64 elapsed = ticks() - start;
+    add(counter.timed, 1);
+    add(counter.ticks, elapsed);
+    UInt32 bucket = elapsed ? 64 - __builtin_clzll(elapsed) : 0;
+    add(counter.buckets[bucket < BUCKETS ? bucket : BUCKETS - 1], 1);
+}
+
+inline UInt32 hash(UInt64 key, UInt32 slots){
+    return (UInt32)((key * 0x9E3779B97F4A7C15ull) >> 32) & (slots - 1);
+}
+
+//Find or claim the slot of [key], NULL if the table is full
+template <typename Slot>
+Slot* slot(Slot* slots, UInt32 size, UInt64 key){
+    UInt32 index = hash(key, size);
+    for(UInt32 probe = 0; probe < size; probe++){
+        Slot &slot = slots[(index + probe) & (size - 1)];
+        UInt64 found = slot.key.load(std::memory_order_relaxed);
+        if(found == key) return &slot;
+        if(found == 0){
+            slot.key.store(key, std::memory_order_release);
+            return &slot;
+        }
+    }
+    return NULL;
+}
+
+Totals merge(Registry &r){
+    Totals totals;
+    for(Shard* shard : r.shards){
+        for(UInt32 api = 0; api < API_COUNT; api++) totals.api[api].add(shard->api[api]);
+        for(HalSlot &slot : shard->hal){
+            UInt64 key = slot.key.load(std::memory_order_acquire);
+            if(key) totals.hal[key].add(slot.counter);
+        }
+        for(ErrorSlot &slot : shard->errors){
+            UInt64 key = slot.key.load(std::memory_order_acquire);
+            if(key) totals.errors[(OSStatus)(UInt32)key] += slot.count.load(std::memory_order_relaxed);
+        }
+        totals.dropped += shard->dropped.load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+double calibrate(Registry &r){
+#if defined(__APPLE__)
+    mach_timebase_info_data_t base;
+    mach_timebase_info(&base);
+    return (double)base.numer / base.denom;
+#elif defined(__x86_64__) || defined(__i386__)
+    //Against the steady clock since the registry was made, at least 10 ms for a usable rate
+    steady::time_point earliest = r.origin + std::chrono::milliseconds(10);
+    if(steady::now() < earliest) std::this_thread::sleep_until(earliest);
+    UInt64 now = ticks();
+    double elapsed = std::chrono::duration<double, std::nano>(steady::now() - r.origin).count();
+    return now > r.originTicks ? elapsed / (now - r.originTicks) : 1.0;
+#else
+    return 1.0;
+#endif
+}
+
+Timing timing(const Sum &sum, double nsPerTick){
+    Timing timing;
+    timing.calls = sum.calls;
+    timing.errors = sum.errors;
+    timing.timed = sum.timed;
+    timing.totalNs = sum.ticks * nsPerTick;
+    for(UInt32 b = 0; b < BUCKETS; b++) timing.buckets[b] = sum.buckets[b];
+    return timing;
+}
+
+const char* HAL_OP_NAMES[HAL_OP_COUNT] = {
+    "hasProperty", "getPropertyDataSize", "getPropertyData", "setPropertyData",
+    "addPropertyListener", "removePropertyListener", "createIOProcID", "destroyIOProcID",
+    "deviceStart", "deviceStop"
+};
+
+const char* API_NAMES[API_COUNT] = {
+    "init", "deinit", "getVolume", "setVolume", "getMute", "setMute",
+    "getVolumeForDevice", "setVolumeForDevice", "getVolumeScalarForDevice", "setVolumeScalarForDevice",
+    "getMuteForDevice", "setMuteForDevice", "getVolumeForDevices", "setVolumeForDevices",
+    "getMuteForDevices", "setMuteForDevices", "applyScene", "getChannelVolumesForDevice", "setChannelVolumesForDevice",
+    "getChannelVolumesForDevices", "setChannelVolumesForDevices", "getDeviceCount", "getDevices"
+};
+
+}; //namespace
+
+UInt64 begin(){
+    //A random sample, a fixed stride could time the same step of a repeated sequence every time
+    UInt32 random = local.random;
+    if(random == 0) random = (UInt32)(uintptr_t)&local | 1;
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    local.random = random;
+    return random % TIMED_EVERY == 0 ? ticks() : 0;
+}
+
+void recordHal(HalOp op, AudioObjectPropertySelector selector, UInt64 start, OSStatus result){
+    Shard* s = shard();
+    HalSlot* hal = slot(s->hal, HAL_SLOTS, (UInt64)(op + 1) << 32 | selector);
+    if(hal) count(hal->counter, start, result != noErr);
+    else add(s->dropped, 1);
+    if(result != noErr){
+        ErrorSlot* error = slot(s->errors, ERROR_SLOTS, 1ull << 32 | (UInt32)result);
+        if(error) add(error->count, 1);
+        else add(s->dropped, 1);
+    }
+}
+
+namespace detail {
+
+bool enter(Api api, bool &traced){
+    traced = trace::active();
+    if(traced) trace::detail::begin(trace::CATEGORY_API, API_NAMES[api], 0, 0);
+    return local.depth++ == 0;
+}
+
+void leave(Api api, UInt64 start, bool outermost, bool traced){
+    local.depth--;
+    if(outermost) count(shard()->api[api], start, false);
+    if(traced) trace::detail::end();
+}
+
+}; //namespace detail
+
+Timing::Timing() : calls(0), errors(0), timed(0), totalNs(0) {
+    for(UInt32 b = 0; b < BUCKETS; b++) buckets[b] = 0;
+}
+
+double Snapshot::bucketNs(UInt32 b) const {
+    return (double)(1ull << b) * nsPerTick;
+}
+
+Snapshot read(){
+    Registry &r = registry();
+    Totals totals;
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        totals = merge(r);
+        for(UInt32 api = 0; api < API_COUNT; api++) totals.api[api].subtract(r.baseline.api[api]);
+        for(auto &entry : r.baseline.hal) totals.hal[entry.first].subtract(entry.second);
+        for(auto &entry : r.baseline.errors) totals.errors[entry.first] -= entry.second;
+        totals.dropped -= r.baseline.dropped;
+    }
+
+    Snapshot snapshot;
+    snapshot.nsPerTick = calibrate(r);
+    for(UInt32 api = 0; api < API_COUNT; api++) snapshot.api[api] = timing(totals.api[api], snapshot.nsPerTick);
+    for(auto &entry : totals.hal){
+        if(entry.second.calls == 0) continue;
+        std::pair<UInt32, AudioObjectPropertySelector> key((UInt32)(entry.first >> 32) - 1, (UInt32)entry.first);
+        snapshot.hal[key] = timing(entry.second, snapshot.nsPerTick);
+    }
+    for(auto &entry : totals.errors){
+        if(entry.second) snapshot.errors[entry.first] = entry.second;
+    }
+    snapshot.dropped = totals.dropped;
+    return snapshot;
+}
+
+double nsPerTick(){
+    return calibrate(registry());
+}
+
+void reset(){
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.baseline = merge(r);
+}
+
+const char* name(HalOp op){
+    return op < HAL_OP_COUNT ? HAL_OP_NAMES[op] : "unknown";
+}
+
+const char* name(Api api){
+    return api < API_COUNT ? API_NAMES[api] : "unknown";
+}
+
+}; //namespace stats
@@ -0,0 +1,190 @@
+#ifndef PYCOREAUDIO_STATS_H
+#define PYCOREAUDIO_STATS_H
+
+#include "cacompat.h"
+#include <map>
+#include <utility>
+#if defined(__APPLE__)
+    #include <mach/mach_time.h>
+#elif defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#else
+    #include <time.h>
+#endif
+
+/*
+ * Call statistics, always on.
+ *
+ * Every HAL call made through the shorthands in hal.h is counted by
+ * operation and property selector, with its OSStatus when it fails, and
+ * every public entry point of audio.h is counted the same way. Each
+ * thread records into a shard of its own with plain stores, so recording
+ * takes no lock and shares no cache line; read() merges the shards.
+ *
+ * Reading a clock can cost more than the rest of the bookkeeping (over
+ * 20 ns for the time stamp counter on some virtual machines), so only a
+ * random sample of about one call in TIMED_EVERY is timed. Latencies go
+ * into histograms with power-of-two buckets, kept in clock ticks and
+ * converted to nanoseconds on read.
+ */
+namespace stats {
+
+//The calls of hal::Backend
+enum HalOp {
+    HAL_HAS_PROPERTY,
+    HAL_GET_PROPERTY_DATA_SIZE,
+    HAL_GET_PROPERTY_DATA,
+    HAL_SET_PROPERTY_DATA,
+    HAL_ADD_PROPERTY_LISTENER,
+    HAL_REMOVE_PROPERTY_LISTENER,
+    HAL_CREATE_IO_PROC_ID,
+    HAL_DESTROY_IO_PROC_ID,
+    HAL_DEVICE_START,
+    HAL_DEVICE_STOP,
+    HAL_OP_COUNT
+};
+
+//The public entry points of audio.h
+enum Api {
+    API_INIT,
+    API_DEINIT,
+    API_GET_VOLUME,
+    API_SET_VOLUME,
+    API_GET_MUTE,
+    API_SET_MUTE,
+    API_GET_VOLUME_FOR_DEVICE,
+    API_SET_VOLUME_FOR_DEVICE,
+    API_GET_VOLUME_SCALAR_FOR_DEVICE,
+    API_SET_VOLUME_SCALAR_FOR_DEVICE,
+    API_GET_MUTE_FOR_DEVICE,
+    API_SET_MUTE_FOR_DEVICE,
+    API_GET_VOLUME_FOR_DEVICES,
+    API_SET_VOLUME_FOR_DEVICES,
+    API_GET_MUTE_FOR_DEVICES,
+    API_SET_MUTE_FOR_DEVICES,
+    API_APPLY_SCENE,
+    API_GET_CHANNEL_VOLUMES_FOR_DEVICE,
+    API_SET_CHANNEL_VOLUMES_FOR_DEVICE,
+    API_GET_CHANNEL_VOLUMES_FOR_DEVICES,
+    API_SET_CHANNEL_VOLUMES_FOR_DEVICES,
+    API_GET_DEVICE_COUNT,
+    API_GET_DEVICES,
+    API_COUNT
+};
+
+//About one call in this many is timed
+const UInt32 TIMED_EVERY = 4;
+
+//Bucket b holds latencies of [2^(b-1), 2^b) ticks, the last one everything longer
+const UInt32 BUCKETS = 32;
+
+/**
+ * Read the clock the statistics are kept in, as cheap as the platform
+ * allows: mach_absolute_time() on macOS, the time stamp counter on other
+ * x86 systems, CLOCK_MONOTONIC elsewhere.
+ */
+inline UInt64 ticks(){
+#if defined(__APPLE__)
+    return mach_absolute_time();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (UInt64)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/**
+ * Start a call, to be counted with recordHal() or by an ApiCall.
+ *
+ * @result - ticks() if the call is to be timed, 0 otherwise
+ */
+UInt64 begin();
+
+/**
+ * Count a HAL call that started with begin() and has just returned.
+ *
+ * @param op - the call
+ * @param selector - selector of the property address, 0 for calls without one
+ * @param start - what begin() returned
+ * @param result - what it returned, noErr counts as success
+ */
+void recordHal(HalOp op, AudioObjectPropertySelector selector, UInt64 start, OSStatus result);
+
+namespace detail {
+    bool enter(Api api, bool &traced);
+    void leave(Api api, UInt64 start, bool outermost, bool traced);
+};
+
+/**
+ * Times the public entry point it is declared in, until the end of the
+ * scope. Only the outermost entry point of a thread is counted, so a
+ * batch call is not also counted as the single calls it makes. While
+ * tracing (see trace.h), every entry point is traced.
+ */
+class ApiCall {
+public:
+    explicit ApiCall(Api api) : api(api), outermost(detail::enter(api, traced)), start(outermost ? begin() : 0) {}
+    ~ApiCall(){ detail::leave(api, start, outermost, traced); }
+
+private:
+    ApiCall(const ApiCall&);
+    ApiCall& operator=(const ApiCall&);
+
+    Api api;
+    bool traced;
+    bool outermost;
+    UInt64 start;
+};
+
+/**
+ * Merged counts of one entry point or of one HAL call and selector.
+ */
+struct Timing {
+    UInt64 calls;
+    UInt64 errors;              //HAL calls only, calls that did not return noErr
+    UInt64 timed;               //calls in the histogram and the total
+    double totalNs;
+    UInt64 buckets[BUCKETS];
+
+    Timing();
+};
+
+/**
+ * Everything counted since the last reset().
+ */
+struct Snapshot {
+    Timing api[API_COUNT];
+    std::map<std::pair<UInt32, AudioObjectPropertySelector>, Timing> hal;      //by (HalOp, selector)
+    std::map<OSStatus, UInt64> errors;                                          //failed HAL calls by result
+    UInt64 dropped;             //HAL calls not told apart, a shard holds only so many selectors
+    double nsPerTick;
+
+    /**
+     * Get the upper bound of histogram bucket [b] in nanoseconds.
+     */
+    double bucketNs(UInt32 b) const;
+};
+
+/**
+ * Merge the shards of all threads.
+ */
+Snapshot read();
+
+/**
+ * Start counting from zero.
+ */
+void reset();
+
+/**
+ * Get the length of a tick of ticks() in nanoseconds.
+ */
+double nsPerTick();
+
+const char* name(HalOp op);
+const char* name(Api api);
+
+}; //namespace stats
+
+#endif //PYCOREAUDIO_STATS_H
@@ -0,0 +1,262 @@
+#include "trace.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+
+namespace trace {
+
+namespace detail {
+    std::atomic<bool> enabled(false);
+};
+
+namespace {
+
+struct Event {
+    UInt64 ticks;                           //stats::ticks()
+    const char* name;                       //NULL for end events
+    AudioObjectID objectID;
+    AudioObjectPropertySelector selector;
+    UInt32 thread;                          //trace thread number, see claim()
+    UInt8 category;
+};
+
+//Written by the owning thread only. dump() reads it while it may be written
+//and drops whatever the writer may have overwritten meanwhile.
+struct Ring {
+    std::vector<Event> events;              //a power of two, never resized
+    std::atomic<UInt64> head;               //events ever written, the next one goes to head % size
+    char threadName[64];                    //of the owning thread, empty if it has none
+
+    Ring() : head(0) { threadName[0] = 0; }
+};
+
+//The rings of one start(), made up front and handed out to threads in order
+struct Pool {
+    std::unique_ptr<Ring[]> rings;
+    size_t count;
+    size_t capacity;                        //events per ring
+    std::atomic<size_t> claimed;            //rings handed out, may run past [count]
+
+    Pool(size_t rings, size_t events) : rings(new Ring[rings]), count(rings), capacity(events), claimed(0) {
+        for(size_t i = 0; i < rings; i++) this->rings[i].events.resize(events);
+    }
+};
+
+struct Registry {
+    std::mutex mutex;                       //serializes start() and dump()
+    std::vector<Pool*> pools;               //every pool ever made, see start()
+    UInt64 origin;                          //ticks at the last start()
+
+    Registry() : origin(0) {}
+};
+
+//Never destroyed, threads may still record while the process exits
+Registry& registry(){
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+std::atomic<Pool*> current(NULL);           //pool of the last start()
+std::atomic<UInt32> generation(0);          //bumped by every start()
+
+struct Local {
+    Ring* ring;                             //NULL if the pool was used up
+    UInt32 generation;                      //of the pool [ring] was claimed from
+    UInt32 thread;
+};
+
+thread_local Local local = { NULL, 0, 0 };
+
+/**
+ * Take the next ring of the current pool for this thread. Takes no lock
+ * and does not allocate; a thread that finds the pool used up records
+ * nothing until the next start().
+ */
+void claim(UInt32 now){
+    Pool* pool = current.load(std::memory_order_acquire);
+    local.generation = now;
+    size_t index = pool->claimed.fetch_add(1, std::memory_order_relaxed);
+    if(index >= pool->count){
+        local.ring = NULL;
+        return;
+    }
+    Ring* ring = &pool->rings[index];
+    pthread_getname_np(pthread_self(), ring->threadName, sizeof(ring->threadName));
+    local.ring = ring;
+    local.thread = (UInt32)index + 1;
+}
+
+inline void record(UInt8 category, const char* name, AudioObjectID objectID, AudioObjectPropertySelector selector){
+    UInt32 now = generation.load(std::memory_order_acquire);
+    if(local.generation != now) claim(now);
+    Ring* ring = local.ring;
+    if(!ring) return;
+    UInt64 head = ring->head.load(std::memory_order_relaxed);
+    Event &event = ring->events[head & (ring->events.size() - 1)];
+    event.ticks = stats::ticks();
+    event.name = name;
+    event.objectID = objectID;
+    event.selector = selector;
+    event.thread = local.thread;
+    event.category = category;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * Copy the events of [ring] that are still intact.
+ */
+void collect(Ring* ring, std::vector<Event> &out){
+    UInt64 size = ring->events.size();
+    UInt64 head = ring->head.load(std::memory_order_acquire);
+    UInt64 first = head > size ? head - size : 0;
+    std::vector<Event> copied;
+    copied.reserve(head - first);
+    for(UInt64 i = first; i < head; i++) copied.push_back(ring->events[i & (size - 1)]);
+    //Whatever the writer got to meanwhile may be torn
+    std::atomic_thread_fence(std::memory_order_acquire);
+    UInt64 now = ring->head.load(std::memory_order_relaxed);
+    UInt64 intact = now > size ? now - size : 0;
+    size_t skip = intact > first ? (size_t)(intact - first) : 0;
+    if(skip < copied.size()) out.insert(out.end(), copied.begin() + skip, copied.end());
+}
+
+const char* CATEGORY_NAMES[CATEGORY_COUNT] = { "hal", "listener", "api", "python" };
+
+void writeString(FILE* file, const std::string &text){
+    fputc('"', file);
+    for(char c : text){
+        if(c == '"' || c == '\\') fprintf(file, "\\%c", c);
+        else if((unsigned char)c < 0x20) fprintf(file, "\\u%04x", c);
+        else fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+void writeSelector(FILE* file, AudioObjectPropertySelector selector){
+    char text[5];
+    for(int i = 0; i < 4; i++){
+        text[i] = (char)(selector >> (24 - 8 * i));
+        if(text[i] < 0x20 || text[i] > 0x7e){
+            fprintf(file, "%u", (unsigned int)selector);
+            return;
+        }
+    }
+    text[4] = 0;
+    writeString(file, text);
+}
+
+}; //namespace
+
+void detail::begin(Category category, const char* name, AudioObjectID objectID, AudioObjectPropertySelector selector){
+    record((UInt8)category, name, objectID, selector);
+}
+
+void detail::end(){
+    record(0, NULL, 0, 0);
+}
+
+void start(size_t capacity, size_t threads){
+    Registry &r = registry();
+    size_t size = 1;
+    while(size < capacity) size *= 2;
+    if(threads == 0) threads = 1;
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.origin = stats::ticks();
+    //A pool of the same shape is reused. Others are kept rather than freed, a thread
+    //that was recording during the last start() may still be writing to one.
+    Pool* pool = NULL;
+    for(Pool* made : r.pools){
+        if(made->count == threads && made->capacity == size) pool = made;
+    }
+    if(!pool){
+        pool = new Pool(threads, size);
+        r.pools.push_back(pool);
+    }
+    //Events a straggler writes into a reset ring are older than [origin] and not dumped
+    for(size_t i = 0; i < pool->count; i++){
+        pool->rings[i].head.store(0, std::memory_order_relaxed);
+        pool->rings[i].threadName[0] = 0;
+    }
+    pool->claimed.store(0, std::memory_order_relaxed);
+    current.store(pool, std::memory_order_release);
+    generation.fetch_add(1, std::memory_order_release);
+    detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+void stop(){
+    detail::enabled.store(false, std::memory_order_relaxed);
+}
+
+long dump(const std::string &path){
+    Registry &r = registry();
+    std::vector<Event> events;
+    std::map<UInt32, std::string> threadNames;
+    UInt64 origin;
+    size_t untraced = 0;
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        Pool* pool = current.load(std::memory_order_acquire);
+        size_t claimed = pool ? pool->claimed.load(std::memory_order_relaxed) : 0;
+        size_t used = pool ? std::min(claimed, pool->count) : 0;
+        for(size_t i = 0; i < used; i++){
+            Ring &ring = pool->rings[i];
+            collect(&ring, events);
+            UInt32 thread = (UInt32)i + 1;
+            threadNames[thread] = ring.threadName[0] ? std::string(ring.threadName) : "thread " + std::to_string(thread);
+        }
+        untraced = claimed - used;
+        origin = r.origin;
+    }
+    double usPerTick = stats::nsPerTick() / 1000;
+
+    FILE* file = fopen(path.c_str(), "w");
+    if(!file) return -1;
+    int pid = (int)getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"untracedThreads\":%zu},\"traceEvents\":[\n", untraced);
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"CoreAudio\"}}", pid);
+    std::map<UInt32, int> depths;           //by thread, to drop ends whose begin was overwritten
+    long written = 0;
+    for(const Event &event : events){
+        if(event.ticks < origin) continue;
+        int &depth = depths[event.thread];
+        double ts = (event.ticks - origin) * usPerTick;
+        if(!event.name){
+            if(depth == 0) continue;
+            depth--;
+            fprintf(file, ",\n{\"ph\":\"E\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f}", pid, event.thread, ts);
+        }
+        else {
+            depth++;
+            fprintf(file, ",\n{\"name\":");
+            writeString(file, event.name);
+            fprintf(file, ",\"cat\":\"%s\",\"ph\":\"B\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f",
+                    event.category < CATEGORY_COUNT ? CATEGORY_NAMES[event.category] : "unknown", pid, event.thread, ts);
+            if(event.objectID || event.selector){
+                fprintf(file, ",\"args\":{\"object\":%u", (unsigned int)event.objectID);
+                if(event.selector){
+                    fprintf(file, ",\"selector\":");
+                    writeSelector(file, event.selector);
+                }
+                fputc('}', file);
+            }
+            fputc('}', file);
+        }
+        written++;
+    }
+    for(auto &entry : depths){
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":", pid, entry.first);
+        writeString(file, threadNames[entry.first]);
+        fprintf(file, "}}");
+    }
+    fprintf(file, "\n]}\n");
+    bool ok = ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    return ok ? written : -1;
+}
+
+}; //namespace trace
@@ -0,0 +1,98 @@
+#ifndef PYCOREAUDIO_TRACE_H
+#define PYCOREAUDIO_TRACE_H
+
+#include "cacompat.h"
+#include "stats.h"
+#include <atomic>
+#include <string>
+
+/*
+ * Opt-in event tracing, for stalls the statistics of stats.h average away.
+ *
+ * While tracing, every HAL call, listener callback, public entry point
+ * and Python entry point records a begin and an end event into a ring of
+ * its thread. start() allocates a ring per thread up front, and a thread
+ * takes the next one with its first event, so recording never allocates
+ * or takes a lock, also in listener callbacks. Threads beyond that count
+ * record nothing until the next start(). When a ring is full its oldest
+ * events are overwritten.
+ * dump() writes what the rings hold in the Chrome trace event format,
+ * which chrome://tracing and Perfetto open. While not tracing, an event
+ * site costs one branch.
+ */
+namespace trace {
+
+enum Category {
+    CATEGORY_HAL,               //AudioObject and AudioDevice calls
+    CATEGORY_LISTENER,          //property listener callbacks
+    CATEGORY_API,               //public entry points of audio.h
+    CATEGORY_PYTHON,            //functions of the Python module
+    CATEGORY_COUNT
+};
+
+namespace detail {
+    extern std::atomic<bool> enabled;
+    void begin(Category category, const char* name, AudioObjectID objectID, AudioObjectPropertySelector selector);
+    void end();
+};
+
+/**
+ * Whether events are being recorded.
+ */
+inline bool active(){
+    return detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Records a begin event where it is declared and the matching end event
+ * at the end of the scope, while tracing.
+ */
+class Scope {
+public:
+    /**
+     * @param category - what is traced
+     * @param name - what the event is called, must outlive the trace (a literal)
+     * @param objectID - object the call is about, 0 if none
+     * @param selector - property the call is about, 0 if none
+     */
+    Scope(Category category, const char* name, AudioObjectID objectID = 0, AudioObjectPropertySelector selector = 0)
+        : traced(active()) {
+        if(traced) detail::begin(category, name, objectID, selector);
+    }
+
+    ~Scope(){
+        if(traced) detail::end();
+    }
+
+private:
+    Scope(const Scope&);
+    Scope& operator=(const Scope&);
+
+    bool traced;
+};
+
+/**
+ * Start recording, dropping what was recorded before.
+ *
+ * @param capacity - events each thread's ring holds, rounded up to a power of two
+ * @param threads - number of rings, i.e. threads that can record until the next start()
+ */
+void start(size_t capacity, size_t threads);
+
+/**
+ * Stop recording. What was recorded is kept for dump().
+ */
+void stop();
+
+/**
+ * Write the events recorded since the last start() to [path] as Chrome
+ * trace JSON. Threads may keep recording while this runs. The number of
+ * threads that found no ring left is written as otherData.untracedThreads.
+ *
+ * @result - number of events written, -1 if [path] could not be written
+ */
+long dump(const std::string &path);
+
+}; //namespace trace
+
+#endif //PYCOREAUDIO_TRACE_H
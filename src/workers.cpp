@@ -0,0 +1,137 @@
+#include "workers.h"
+#include "audio.h"
+#include "posix.h"
+#include <chrono>
+
+/**
+ * Run a job the same way the synchronous API would.
+ */
+static void execute(const AsyncJob &job, AsyncResult &result){
+    switch(job.op){
+        case ASYNC_GET_VOLUME:            result.value = getVolume(); break;
+        case ASYNC_SET_VOLUME:            result.value = setVolume(job.value); break;
+        case ASYNC_GET_MUTE:              result.value = getMute(); break;
+        case ASYNC_SET_MUTE:              result.value = setMute(job.value != 0); break;
+        case ASYNC_GET_VOLUME_FOR_DEVICE: result.value = getVolumeForDevice(job.deviceID); break;
+        case ASYNC_SET_VOLUME_FOR_DEVICE: result.value = setVolumeForDevice(job.deviceID, job.value); break;
+        case ASYNC_GET_MUTE_FOR_DEVICE:   result.value = getMuteForDevice(job.deviceID); break;
+        case ASYNC_SET_MUTE_FOR_DEVICE:   result.value = setMuteForDevice(job.deviceID, job.value != 0); break;
+        case ASYNC_GET_DEVICES:
+            result.devices = deviceRegistry.snapshot();
+            result.value = result.devices ? 1 : 0;
+            break;
+        default:                          result.value = -1; break;
+    }
+}
+
+WorkerPool::WorkerPool(size_t threads, size_t depth) :
+    threadCount(threads), maxDepth(depth), pending(0), stopping(false) {
+}
+
+WorkerPool::~WorkerPool(){
+    stop();
+}
+
+bool WorkerPool::submit(const AsyncJob &job){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(pending >= maxDepth) return false;
+    while(workers.size() < threadCount) workers.push_back(std::thread(&WorkerPool::run, this));
+    jobs.push_back(job);
+    pending++;
+    jobAvailable.notify_one();
+    return true;
+}
+
+size_t WorkerPool::take(AsyncResult* out, size_t max){
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+    while(count < max && !results.empty()){
+        out[count++] = results.front();
+        results.pop_front();
+    }
+    pending -= count;
+    if(results.empty()) wakeupPipe.drain();
+    return count;
+}
+
+bool WorkerPool::wait(int timeoutMs){
+    std::unique_lock<std::mutex> lock(mutex);
+    if(timeoutMs < 0){
+        resultAvailable.wait(lock, [this]{ return !results.empty(); });
+        return true;
+    }
+    return resultAvailable.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return !results.empty(); });
+}
+
+int WorkerPool::fd() const {
+    return wakeupPipe.fd();
+}
+
+void WorkerPool::configure(size_t threads, size_t depth){
+    std::unique_lock<std::mutex> lock(mutex);
+    maxDepth = depth;
+    if(threads == threadCount) return;
+    threadCount = threads;
+    //Fewer threads: retire all of them, submit() starts the new number
+    if(workers.size() > threadCount) stopThreads(lock);
+}
+
+size_t WorkerPool::threads(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return threadCount;
+}
+
+size_t WorkerPool::depth(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return maxDepth;
+}
+
+size_t WorkerPool::inFlight(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending;
+}
+
+void WorkerPool::stop(){
+    std::unique_lock<std::mutex> lock(mutex);
+    stopThreads(lock);
+}
+
+void WorkerPool::stopThreads(std::unique_lock<std::mutex> &lock){
+    std::vector<std::thread> stopped;
+    stopped.swap(workers);
+    stopping = true;
+    jobAvailable.notify_all();
+    lock.unlock();
+    for(std::thread &worker : stopped) worker.join();
+    lock.lock();
+    stopping = false;
+    //Jobs submitted while stopping get fresh threads
+    if(!jobs.empty()){
+        while(workers.size() < threadCount) workers.push_back(std::thread(&WorkerPool::run, this));
+    }
+}
+
+void WorkerPool::run(){
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true){
+        jobAvailable.wait(lock, [this]{ return stopping || !jobs.empty(); });
+        //Queued jobs are finished before stopping
+        if(jobs.empty()) return;
+        AsyncJob job = jobs.front();
+        jobs.pop_front();
+        lock.unlock();
+
+        AsyncResult result;
+        result.id = job.id;
+        result.op = job.op;
+        execute(job, result);
+        result.completed = monotonicNanoseconds();
+
+        lock.lock();
+        results.push_back(result);
+        if(results.size() == 1){
+            wakeupPipe.signal();
+            resultAvailable.notify_all();
+        }
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef PYCOREAUDIO_WORKERS_H
+#define PYCOREAUDIO_WORKERS_H
+
+#include "cacompat.h"
+#include "posix.h"
+#include "registry.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Operations a WorkerPool can run, see execute() in workers.cpp
+enum AsyncOp {
+    ASYNC_GET_VOLUME,               //default output device
+    ASYNC_SET_VOLUME,
+    ASYNC_GET_MUTE,
+    ASYNC_SET_MUTE,
+    ASYNC_GET_VOLUME_FOR_DEVICE,
+    ASYNC_SET_VOLUME_FOR_DEVICE,
+    ASYNC_GET_MUTE_FOR_DEVICE,
+    ASYNC_SET_MUTE_FOR_DEVICE,
+    ASYNC_GET_DEVICES
+};
+
+/**
+ * An operation to run on the pool.
+ */
+struct AsyncJob {
+    UInt64 id;                  //chosen by the caller, handed back in the result
+    UInt32 op;                  //one of AsyncOp
+    AudioDeviceID deviceID;     //for the *_FOR_DEVICE operations
+    int value;                  //volume level or mute state to set
+};
+
+/**
+ * The outcome of an AsyncJob.
+ */
+struct AsyncResult {
+    UInt64 id;
+    UInt32 op;
+    int value;                  //what the matching synchronous call returned (bool as 0/1)
+    DeviceSnapshot devices;     //ASYNC_GET_DEVICES only
+    UInt64 completed;           //monotonic clock, nanoseconds
+};
+
+/**
+ * A small pool of native threads running CoreAudio calls off the
+ * caller's thread.
+ *
+ * Jobs are bounded by a queue depth: a job counts against it from
+ * submit() until its result is taken, so neither the queue nor the
+ * unread results can grow without bound. Results are collected in a
+ * queue; fd() polls readable while there are any, so an event loop can
+ * pick them up without a thread of its own. The Python module keeps
+ * one pool per module object.
+ */
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads = 4, size_t depth = 256);
+    ~WorkerPool();
+
+    /**
+     * Queue a job. The threads are started on first use.
+     *
+     * @result - false if the queue depth is reached
+     */
+    bool submit(const AsyncJob &job);
+
+    /**
+     * Take up to [max] results, without waiting.
+     *
+     * @param out - buffer to write to
+     * @param max - capacity of [out]
+     * @result - number of results taken
+     */
+    size_t take(AsyncResult* out, size_t max);
+
+    /**
+     * Wait until results are pending.
+     *
+     * @param timeoutMs - timeout in milliseconds, negative to wait forever
+     * @result - whether results are pending
+     */
+    bool wait(int timeoutMs);
+
+    /**
+     * Get a file descriptor that polls readable while results are pending.
+     */
+    int fd() const;
+
+    /**
+     * Change the number of threads and the queue depth. Lowering the
+     * number of threads waits for the queued jobs.
+     */
+    void configure(size_t threads, size_t depth);
+    size_t threads();
+    size_t depth();
+
+    /**
+     * Get the number of jobs submitted whose result was not taken yet.
+     */
+    size_t inFlight();
+
+    /**
+     * Finish the queued jobs and stop the threads. Results stay
+     * available to take().
+     */
+    void stop();
+
+private:
+    void run();
+    void stopThreads(std::unique_lock<std::mutex> &lock);
+
+    std::mutex mutex;                           //guards everything below
+    std::condition_variable jobAvailable;
+    std::condition_variable resultAvailable;
+    std::deque<AsyncJob> jobs;
+    std::deque<AsyncResult> results;
+    std::vector<std::thread> workers;
+    size_t threadCount;
+    size_t maxDepth;
+    size_t pending;                             //submitted, result not taken yet
+    bool stopping;
+    WakeupPipe wakeupPipe;
+};
+
+#endif //PYCOREAUDIO_WORKERS_H